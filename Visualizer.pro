@@ -22,21 +22,54 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
-CONFIG += c++11
+CONFIG += c++11 thread
 
 SOURCES += \
         main.cpp \
-    visualizer.cpp
+    visualizer.cpp \
+    satellitestore.cpp \
+    sgp4.cpp \
+    propagation.cpp \
+    catalog.cpp \
+    snapshot.cpp \
+    texturestreamer.cpp \
+    texturecache.cpp \
+    virtualtexture.cpp \
+    spheremesh.cpp \
+    shadermanager.cpp \
+    frameprofiler.cpp \
+    culling.cpp \
+    picking.cpp \
+    groundtrack.cpp \
+    passes.cpp \
+    conjunctions.cpp \
+    simclock.cpp \
+    keyframes.cpp \
+    ephemeris.cpp
 
 HEADERS += \
-    visualizer.h
+    visualizer.h \
+    satellitestore.h \
+    sgp4.h \
+    propagation.h \
+    catalog.h \
+    snapshot.h \
+    texturestreamer.h \
+    texturecache.h \
+    virtualtexture.h \
+    spheremesh.h \
+    shadermanager.h \
+    frameprofiler.h \
+    culling.h \
+    picking.h \
+    groundtrack.h \
+    passes.h \
+    conjunctions.h \
+    simclock.h \
+    keyframes.h \
+    ephemeris.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
-
-unix:!macx: LIBS += -L$$PWD/../assimp-4.1.0/lib/ -lassimp
-
-INCLUDEPATH += $$PWD/../assimp-4.1.0/include/
-DEPENDPATH += $$PWD/../assimp-4.1.0/include/
@@ -0,0 +1,59 @@
+#ifndef BENCHCATALOG_H
+#define BENCHCATALOG_H
+
+#include <random>
+#include <vector>
+
+#include "sgp4.h"
+
+// Синтетический каталог с распределением, похожим на публичный:
+// в основном LEO, немного MEO, GEO и высокоэллиптических орбит.
+// Общий для бенчмарков, чтобы их числа были сравнимы
+inline std::vector<OrbitalElements> makeCatalog(size_t count, double epoch)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+    std::vector<OrbitalElements> catalog(count);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        OrbitalElements &el = catalog[i];
+        double kind = uni(rng);
+
+        el.catalog_number = i + 1;
+        el.epoch_jd = epoch - uni(rng) * 7.0;
+        el.raan = uni(rng) * 360.0;
+        el.arg_perigee = uni(rng) * 360.0;
+        el.mean_anomaly = uni(rng) * 360.0;
+
+        if(kind < 0.85)
+        {
+            el.mean_motion = 12.0 + uni(rng) * 4.0;
+            el.eccentricity = uni(rng) * 0.02;
+            el.inclination = 40.0 + uni(rng) * 60.0;
+            el.bstar = uni(rng) * 5.0e-4;
+        }
+        else if(kind < 0.92)
+        {
+            el.mean_motion = 2.0 + uni(rng) * 2.0;
+            el.eccentricity = uni(rng) * 0.01;
+            el.inclination = 50.0 + uni(rng) * 15.0;
+        }
+        else if(kind < 0.97)
+        {
+            el.mean_motion = 1.0027 + (uni(rng) - 0.5) * 0.002;
+            el.eccentricity = uni(rng) * 0.001;
+            el.inclination = uni(rng) * 15.0;
+        }
+        else
+        {
+            el.mean_motion = 2.006;
+            el.eccentricity = 0.6 + uni(rng) * 0.15;
+            el.inclination = 63.4;
+        }
+    }
+
+    return catalog;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#include "catalog.h"
+
+#include <QFile>
+#include <QDir>
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+// Размер каталога и бюджет загрузки
+#define CATALOG_SIZE 100000
+#define LOAD_BUDGET_MS 100.0
+#define RUNS 10
+
+// Запись синтетического каталога 3LE во временный файл
+static QString writeCatalog(size_t count)
+{
+    QString path = QDir::temp().filePath("catalog_bench.3le");
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return QString();
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+    char record[256];
+
+    for(size_t i = 0; i < count; i++)
+    {
+        unsigned id = i % 100000;
+        int length = snprintf(record, sizeof(record),
+                              "OBJECT %zu\n"
+                              "1 %05uU 98067A   20%03u.%08u  .00001234  00000-0  28098-4 0  9990\n"
+                              "2 %05u %8.4f %8.4f %07u %8.4f %8.4f %11.8f 12345\n",
+                              i, id, 1 + (unsigned)(uni(rng) * 365), (unsigned)(uni(rng) * 99999999), id,
+                              uni(rng) * 180.0, uni(rng) * 360.0, (unsigned)(uni(rng) * 200000),
+                              uni(rng) * 360.0, uni(rng) * 360.0, 1.0 + uni(rng) * 15.0);
+        file.write(record, length);
+    }
+
+    return path;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? std::strtoul(argv[1], NULL, 10) : CATALOG_SIZE;
+    unsigned threads = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 0;
+
+    QString path = writeCatalog(count);
+    if(path.isEmpty())
+    {
+        printf("failed to write test catalog\n");
+        return 1;
+    }
+
+    std::vector<double> times;
+    size_t loaded = 0;
+    for(int run = 0; run < RUNS; run++)
+    {
+        std::vector<OrbitalElements> elements;
+        auto begin = std::chrono::steady_clock::now();
+        loaded = loadCatalog(path, elements, threads);
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+    std::sort(times.begin(), times.end());
+    QFile::remove(path);
+
+    double median = times[times.size() / 2];
+    printf("records: %zu of %zu\n", loaded, count);
+    printf("load: min %.2f ms, median %.2f ms, max %.2f ms\n", times.front(), median, times.back());
+    printf("load budget %.0f ms: %s\n", LOAD_BUDGET_MS, median < LOAD_BUDGET_MS ? "OK" : "EXCEEDED");
+
+    return loaded == count && median < LOAD_BUDGET_MS ? 0 : 1;
+}
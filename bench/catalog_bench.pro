@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Бенчмарк загрузки каталогов TLE/OMM
+#
+#-------------------------------------------------
+
+QT       = core
+
+TARGET = catalog_bench
+TEMPLATE = app
+
+CONFIG += console c++11 release thread
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+        catalog_bench.cpp \
+    ../catalog.cpp \
+    ../sgp4.cpp
+
+HEADERS += \
+    ../catalog.h \
+    ../sgp4.h
@@ -0,0 +1,237 @@
+#include "visualizer.h"
+#include "benchcatalog.h"
+
+#include <QGuiApplication>
+#include <QDir>
+#include <QFile>
+
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Размер кадра и число кадров серии: первые BENCH_WARMUP не учитываются
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_FRAMES 200
+#define BENCH_WARMUP 16
+
+// Разброс скорости осколков по каждой оси, км/с
+#define DEBRIS_DV 0.1
+
+// Счетчик выделений памяти во всех потоках
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// Среднее движение круговой орбиты на высоте altitude км, оборотов в сутки
+static double meanMotion(double altitude)
+{
+    double a = SGP4_EARTH_RADIUS_KM + altitude;
+    return std::sqrt(SGP4_MU / (a * a * a)) * 86400.0 / (2.0 * M_PI);
+}
+
+// Созвездие Уокера i: t/p/f - t спутников в p плоскостях с шагом фазы f
+static void addWalker(std::vector<OrbitalElements> &catalog, double epoch, double inclination,
+                      unsigned total, unsigned planes, unsigned phasing, double altitude)
+{
+    unsigned per_plane = total / planes;
+    for(unsigned p = 0; p < planes; p++)
+        for(unsigned s = 0; s < per_plane; s++)
+        {
+            OrbitalElements el;
+            el.catalog_number = catalog.size() + 1;
+            el.epoch_jd = epoch;
+            el.inclination = inclination;
+            el.raan = 360.0 * p / planes;
+            el.mean_anomaly = std::fmod(360.0 * s / per_plane + 360.0 * phasing * p / total, 360.0);
+            el.mean_motion = meanMotion(altitude);
+            catalog.push_back(el);
+        }
+}
+
+// Несколько оболочек группировки широкополосного доступа
+static std::vector<OrbitalElements> makeWalker(double epoch)
+{
+    std::vector<OrbitalElements> catalog;
+    addWalker(catalog, epoch, 53.0, 1584, 72, 1, 550.0);
+    addWalker(catalog, epoch, 53.2, 1584, 72, 1, 540.0);
+    addWalker(catalog, epoch, 70.0, 720, 36, 1, 570.0);
+    addWalker(catalog, epoch, 97.6, 348, 6, 1, 560.0);
+    return catalog;
+}
+
+// Облако осколков разрушения на солнечно-синхронной орбите 790 км.
+// Орбиты осколков получены из малых приращений скорости, а сами осколки
+// уже разошлись вдоль орбиты в кольцо
+static std::vector<OrbitalElements> makeDebris(size_t count, double epoch)
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+    std::normal_distribution<double> dv(0.0, DEBRIS_DV);
+    std::vector<OrbitalElements> catalog(count);
+
+    double a0 = SGP4_EARTH_RADIUS_KM + 790.0;
+    double v0 = std::sqrt(SGP4_MU / a0);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        OrbitalElements &el = catalog[i];
+        double dt = dv(rng), dr = dv(rng), dn = dv(rng);
+        double a = a0 * (1.0 + 2.0 * dt / v0);
+
+        el.catalog_number = i + 1;
+        el.epoch_jd = epoch;
+        el.eccentricity = std::min(0.5, std::sqrt(4.0 * dt * dt + dr * dr) / v0);
+        el.inclination = 98.6 + dn / v0 * 180.0 / M_PI;
+        el.raan = 30.0 + dn / v0 * 180.0 / M_PI;
+        el.arg_perigee = uni(rng) * 360.0;
+        el.mean_anomaly = uni(rng) * 360.0;
+        el.mean_motion = meanMotion(a - SGP4_EARTH_RADIUS_KM);
+        el.bstar = uni(rng) * 1.0e-3;
+    }
+
+    return catalog;
+}
+
+struct Workload
+{
+    const char *name;
+    std::vector<OrbitalElements> catalog;
+};
+
+static double percentile(std::vector<double> values, double p)
+{
+    if(values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+    return values[rank ? std::min(rank, values.size()) - 1 : 0];
+}
+
+// render_bench [кадров] [имя серии]: серии по очереди, результат - CSV в stdout,
+// по строке на проход каждой серии. Время кадра - полный renderFrame с
+// ожиданием GPU, выделения памяти - во всех потоках за кадр. Положения меток
+// на все кадры серии считаются до замеров в окно эфемерид снимка, поэтому
+// в кадр входит только интерполяция окна, а не пропагация каталога
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+
+    int frames = argc > 1 ? std::atoi(argv[1]) : BENCH_FRAMES;
+    const char *only = argc > 2 ? argv[2] : nullptr;
+
+    double epoch = julianDate(2020, 1, 1, 0, 0, 0.0);
+    std::vector<Workload> workloads;
+    workloads.push_back({"marks_1k", makeCatalog(1000, epoch)});
+    workloads.push_back({"marks_10k", makeCatalog(10000, epoch)});
+    workloads.push_back({"marks_100k", makeCatalog(100000, epoch)});
+    workloads.push_back({"walker", makeWalker(epoch)});
+    workloads.push_back({"debris_50k", makeDebris(50000, epoch)});
+
+    Visualizer visualizer(QSize(BENCH_WIDTH, BENCH_HEIGHT));
+
+    printf("workload,satellites,pass,cpu_p50_ms,cpu_p95_ms,cpu_p99_ms,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms,"
+           "draws,state_changes,frame_p50_ms,frame_p95_ms,frame_p99_ms,allocs_per_frame,allocs_max\n");
+
+    bool ok = true;
+    for(const auto &w : workloads)
+    {
+        if(only && strcmp(only, w.name))
+            continue;
+
+        // Отсчет окна на каждый кадр, кадры идут точно по отсчетам
+        QString snapshot = QDir(QDir::tempPath()).filePath(QString("render_bench_%1.snap").arg(w.name));
+        if(!writeSnapshot(snapshot, w.catalog.data(), w.catalog.size(), 1.0f / SCENE_UNIT_KM,
+                          epoch, SNAPSHOT_STEP, BENCH_WARMUP + frames) || !visualizer.openSnapshot(snapshot))
+        {
+            QFile::remove(snapshot);
+            ok = false;
+            continue;
+        }
+
+        std::vector<double> times;
+        size_t allocs_total = 0, allocs_max = 0;
+        for(int i = 0; i < BENCH_WARMUP + frames; i++)
+        {
+            // Камера облетает Землю, метки движутся по минуте за кадр
+            double angle = 2.0 * M_PI * i / (BENCH_WARMUP + frames);
+            QVector3D direction(std::sin(angle), 0.3f, std::cos(angle));
+
+            if(i == BENCH_WARMUP)
+                visualizer.profiler().reset();
+
+            size_t allocs_begin = allocations.load(std::memory_order_relaxed);
+            auto begin = std::chrono::steady_clock::now();
+            visualizer.renderFrame(epoch + i * SNAPSHOT_STEP, QVector3D(0.0f, 0.0f, 0.0f), direction, 3.0f, false);
+            auto end = std::chrono::steady_clock::now();
+            size_t allocs = allocations.load(std::memory_order_relaxed) - allocs_begin;
+
+            if(i < BENCH_WARMUP)
+                continue;
+            times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+            allocs_total += allocs;
+            allocs_max = std::max(allocs_max, allocs);
+        }
+
+        QFile::remove(snapshot);
+
+        if(times.empty())
+        {
+            ok = false;
+            continue;
+        }
+
+        FrameProfiler &profiler = visualizer.profiler();
+        for(int pass = 0; pass < profiler.passCount(); pass++)
+        {
+            PassStats s = profiler.stats(pass);
+            printf("%s,%zu,%s,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%u,%u,%.3f,%.3f,%.3f,%.1f,%zu\n",
+                   w.name, w.catalog.size(), s.name.toUtf8().constData(),
+                   s.cpu_p50, s.cpu_p95, s.cpu_p99, s.gpu_p50, s.gpu_p95, s.gpu_p99, s.draws, s.state_changes,
+                   percentile(times, 50.0), percentile(times, 95.0), percentile(times, 99.0),
+                   (double)allocs_total / times.size(), allocs_max);
+        }
+        fflush(stdout);
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#-------------------------------------------------
+#
+# Бенчмарк отрисовки без окна на синтетических каталогах
+#
+#-------------------------------------------------
+
+QT       += core gui opengl
+
+TARGET = render_bench
+TEMPLATE = app
+
+CONFIG += console c++11 release thread
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+        render_bench.cpp \
+    ../visualizer.cpp \
+    ../satellitestore.cpp \
+    ../sgp4.cpp \
+    ../propagation.cpp \
+    ../catalog.cpp \
+    ../snapshot.cpp \
+    ../texturestreamer.cpp \
+    ../texturecache.cpp \
+    ../virtualtexture.cpp \
+    ../spheremesh.cpp \
+    ../shadermanager.cpp \
+    ../frameprofiler.cpp \
+    ../culling.cpp \
+    ../picking.cpp \
+    ../groundtrack.cpp \
+    ../passes.cpp \
+    ../conjunctions.cpp \
+    ../simclock.cpp \
+    ../keyframes.cpp \
+    ../ephemeris.cpp
+
+HEADERS += \
+    benchcatalog.h \
+    ../visualizer.h \
+    ../satellitestore.h \
+    ../sgp4.h \
+    ../propagation.h \
+    ../catalog.h \
+    ../snapshot.h \
+    ../texturestreamer.h \
+    ../texturecache.h \
+    ../virtualtexture.h \
+    ../spheremesh.h \
+    ../shadermanager.h \
+    ../frameprofiler.h \
+    ../culling.h \
+    ../picking.h \
+    ../groundtrack.h \
+    ../passes.h \
+    ../conjunctions.h \
+    ../simclock.h \
+    ../keyframes.h \
+    ../ephemeris.h
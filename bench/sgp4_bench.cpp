@@ -0,0 +1,157 @@
+#include "sgp4.h"
+#include "propagation.h"
+#include "ephemeris.h"
+#include "benchcatalog.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+// Размер публичного каталога и бюджет одного кадра при 30 FPS
+#define CATALOG_SIZE 30000
+#define FRAME_BUDGET_MS 33.0
+#define RUNS 50
+
+// Допустимое отклонение кэша эфемерид от пропагации, км
+#define EPHEMERIS_MAX_ERROR_KM 0.05
+
+// Каталог мусора для проверки масштабирования по потокам
+#define DEBRIS_SIZE 200000
+#define SCALING_RUNS 10
+
+// Эталон Vallado для спутника 00005 через 360 минут после эпохи, км
+static const char *REF_LINE1 = "1 00005U 58002B   00179.78495062  .00000023  00000-0  28098-4 0  4753";
+static const char *REF_LINE2 = "2 00005  34.2682 348.7242 1859667 331.7664  19.3264 10.82419157413667";
+static const double REF_POSITION[3] = {-7154.03120202, -3783.17682504, -3536.19412294};
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? std::strtoul(argv[1], NULL, 10) : CATALOG_SIZE;
+
+    // Проверка точности на эталонном спутнике
+    OrbitalElements ref;
+    parseTle(REF_LINE1, REF_LINE2, ref);
+    Sgp4Propagator ref_propagator;
+    ref_propagator.setElements(&ref, 1);
+
+    float position[3];
+    ref_propagator.propagate(ref.epoch_jd + 360.0 / 1440.0, 1.0f, position);
+
+    // Обратное отображение осей сцены в TEME
+    double teme[3] = {position[0], -position[2], position[1]};
+    double error = 0.0;
+    for(int i = 0; i < 3; i++)
+        error = std::max(error, std::fabs(teme[i] - REF_POSITION[i]));
+    printf("reference 00005 +360 min: max error %.3f m\n", error * 1000.0);
+
+    // Замер пропагации каталога
+    double epoch = julianDate(2020, 1, 1, 0, 0, 0.0);
+    std::vector<OrbitalElements> catalog = makeCatalog(count, epoch);
+
+    auto init_begin = std::chrono::steady_clock::now();
+    Sgp4Propagator propagator;
+    propagator.setElements(catalog.data(), catalog.size());
+    auto init_end = std::chrono::steady_clock::now();
+
+    std::vector<float> positions(count * 3);
+    std::vector<double> times;
+    for(int run = 0; run < RUNS; run++)
+    {
+        double jd = epoch + run / 1440.0;
+        auto begin = std::chrono::steady_clock::now();
+        propagator.propagate(jd, 1.0f, positions.data());
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+    std::sort(times.begin(), times.end());
+
+    size_t failed = 0;
+    for(size_t i = 0; i < count; i++)
+        if(propagator.error(i) != Sgp4Propagator::Ok)
+            failed++;
+
+    double median = times[times.size() / 2];
+    printf("satellites: %zu (groups: %zu, failed: %zu)\n", count, propagator.groupCount(), failed);
+    printf("init: %.2f ms\n", std::chrono::duration<double, std::milli>(init_end - init_begin).count());
+    printf("propagate: min %.2f ms, median %.2f ms, max %.2f ms, %.1f ns/satellite\n",
+           times.front(), median, times.back(), median * 1.0e6 / count);
+    printf("frame budget %.0f ms: %s\n", FRAME_BUDGET_MS, median < FRAME_BUDGET_MS ? "OK" : "EXCEEDED");
+
+    // Кэш эфемерид: подгонка отрезка, вычисление каталога на случайные
+    // моменты отрезка вместе со скоростями и отклонение положений от пропагации, км
+    EphemerisCache ephemeris;
+    ephemeris.setElements(catalog.data(), catalog.size(), 1.0f);
+    double segment_jd = std::floor(epoch * 86400.0 / EPHEMERIS_SEGMENT) * EPHEMERIS_SEGMENT / 86400.0;
+    auto fit_begin = std::chrono::steady_clock::now();
+    ephemeris.request(segment_jd);
+    while(ephemeris.isFitting())
+    {
+        std::this_thread::yield();
+        ephemeris.update();
+    }
+    auto fit_end = std::chrono::steady_clock::now();
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> offset(0.0, EPHEMERIS_SEGMENT / 86400.0);
+    std::vector<float> cached(count * 3), cached_velocities(count * 3);
+    std::vector<double> eval_times;
+    double max_position = 0.0;
+    for(int run = 0; run < RUNS; run++)
+    {
+        double jd = segment_jd + offset(rng);
+        auto begin = std::chrono::steady_clock::now();
+        ephemeris.evaluate(jd, cached.data(), cached_velocities.data());
+        auto end = std::chrono::steady_clock::now();
+        eval_times.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+
+        propagator.propagate(jd, 1.0f, positions.data());
+        for(size_t i = 0; i < count; i++)
+            if(propagator.error(i) == Sgp4Propagator::Ok)
+                for(int a = 0; a < 3; a++)
+                    max_position = std::max(max_position, (double)std::fabs(cached[i * 3 + a] - positions[i * 3 + a]));
+    }
+    std::sort(eval_times.begin(), eval_times.end());
+
+    printf("ephemeris: fit %.2f ms per %.0f s segment, evaluate median %.2f ms, %.1f ns/satellite\n",
+           std::chrono::duration<double, std::milli>(fit_end - fit_begin).count(), EPHEMERIS_SEGMENT,
+           eval_times[eval_times.size() / 2], eval_times[eval_times.size() / 2] * 1.0e6 / count);
+    printf("ephemeris: max error %.3f m\n", max_position * 1000.0);
+
+    // Масштабирование PropagationScheduler на каталоге мусора
+    size_t debris = argc > 2 ? std::strtoul(argv[2], NULL, 10) : DEBRIS_SIZE;
+    std::vector<OrbitalElements> debris_catalog = makeCatalog(debris, epoch);
+    std::vector<float> debris_positions(debris * 3);
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    double single = 0.0;
+
+    printf("scaling, %zu satellites:\n", debris);
+    for(unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        PropagationScheduler scheduler(threads);
+        scheduler.setElements(debris_catalog.data(), debris, 1.0f);
+
+        std::vector<double> runs;
+        for(int run = 0; run < SCALING_RUNS; run++)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            scheduler.propagate(epoch + run / 1440.0, debris_positions.data());
+            auto end = std::chrono::steady_clock::now();
+            runs.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+        }
+        std::sort(runs.begin(), runs.end());
+
+        double ms = runs[runs.size() / 2];
+        if(threads == 1)
+            single = ms;
+        printf("  threads %2u: median %.2f ms, speedup %.2f\n", threads, ms, single / ms);
+
+        if(threads < max_threads && threads * 2 > max_threads)
+            threads = max_threads / 2;
+    }
+
+    return error < 1.0e-3 && median < FRAME_BUDGET_MS && max_position < EPHEMERIS_MAX_ERROR_KM ? 0 : 1;
+}
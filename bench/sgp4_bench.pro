@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Микробенчмарк пакетного пропагатора SGP4/SDP4
+#
+#-------------------------------------------------
+
+TARGET = sgp4_bench
+TEMPLATE = app
+
+CONFIG += console c++11 release thread
+CONFIG -= qt app_bundle
+
+# Циклы по полосам рассчитаны на автовекторизацию
+QMAKE_CXXFLAGS_RELEASE += -O3 -march=native
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+        sgp4_bench.cpp \
+    ../sgp4.cpp \
+    ../propagation.cpp \
+    ../ephemeris.cpp
+
+HEADERS += \
+    benchcatalog.h \
+    ../sgp4.h \
+    ../propagation.h \
+    ../ephemeris.h
@@ -0,0 +1,369 @@
+#include "catalog.h"
+
+#include <QFile>
+#include <QDebug>
+
+#include <thread>
+#include <algorithm>
+#include <cstring>
+
+// Минимальный размер куска, ради которого стоит заводить поток
+#define CATALOG_MIN_CHUNK (256 * 1024)
+
+// Максимальное число колонок OMM CSV
+#define CATALOG_MAX_COLUMNS 64
+
+// Поля OMM, которые нужны пропагатору
+enum OmmField
+{
+    FieldNone = -1,
+    FieldEpoch = 0,
+    FieldMeanMotion,
+    FieldEccentricity,
+    FieldInclination,
+    FieldRaan,
+    FieldArgPerigee,
+    FieldMeanAnomaly,
+    FieldCatalogNumber,
+    FieldBstar
+};
+
+static const struct
+{
+    const char *name;
+    OmmField field;
+} OMM_FIELDS[] =
+{
+    {"EPOCH", FieldEpoch},
+    {"MEAN_MOTION", FieldMeanMotion},
+    {"ECCENTRICITY", FieldEccentricity},
+    {"INCLINATION", FieldInclination},
+    {"RA_OF_ASC_NODE", FieldRaan},
+    {"ARG_OF_PERICENTER", FieldArgPerigee},
+    {"MEAN_ANOMALY", FieldMeanAnomaly},
+    {"NORAD_CAT_ID", FieldCatalogNumber},
+    {"BSTAR", FieldBstar}
+};
+
+// Начало строки, следующей за p
+static inline const char *nextLine(const char *p, const char *end)
+{
+    const char *n = (const char *)std::memchr(p, '\n', end - p);
+    return n ? n + 1 : end;
+}
+
+// Длина строки без перевода строки
+static inline size_t lineLength(const char *p, const char *end)
+{
+    const char *n = (const char *)std::memchr(p, '\n', end - p);
+    if(!n)
+        n = end;
+    if(n > p && n[-1] == '\r')
+        n--;
+    return n - p;
+}
+
+// Первое начало строки не раньше p
+static inline const char *alignToLine(const char *data, const char *p, const char *end)
+{
+    return p == data || p[-1] == '\n' ? p : nextLine(p, end);
+}
+
+// Поиск подстроки без выделения памяти
+static const char *find(const char *p, const char *end, const char *str, size_t length)
+{
+    while(p + length <= end)
+    {
+        p = (const char *)std::memchr(p, str[0], end - p - length + 1);
+        if(!p)
+            return end;
+        if(!std::memcmp(p, str, length))
+            return p;
+        p++;
+    }
+    return end;
+}
+
+static OmmField lookupField(const char *begin, const char *end)
+{
+    size_t length = end - begin;
+    for(const auto &f : OMM_FIELDS)
+        if(std::strlen(f.name) == length && !std::memcmp(f.name, begin, length))
+            return f.field;
+    return FieldNone;
+}
+
+// Эпоха OMM: YYYY-MM-DDThh:mm:ss.ssssss или YYYY-DDDThh:mm:ss.ssssss
+static double parseEpoch(const char *b, const char *e)
+{
+    while(b < e && (*b == ' ' || *b == '"'))
+        b++;
+    if(e - b < 8)
+        return 0.0;
+
+    int year = (int)parseNumber(b, b + 4);
+    double jd;
+    if(b[7] == '-')
+        jd = julianDate(year, (int)parseNumber(b + 5, b + 7), (int)parseNumber(b + 8, b + 10), 0, 0, 0.0);
+    else
+        jd = julianDate(year, 1, 1, 0, 0, 0.0) - 1.0 + parseNumber(b + 5, b + 8);
+
+    const char *t = (const char *)std::memchr(b, 'T', e - b);
+    if(t && e - t >= 9)
+        jd += (parseNumber(t + 1, t + 3) * 3600.0 + parseNumber(t + 4, t + 6) * 60.0 + parseNumber(t + 7, e)) / 86400.0;
+
+    return jd;
+}
+
+static void setField(OrbitalElements &el, OmmField field, const char *b, const char *e)
+{
+    switch(field)
+    {
+        case FieldEpoch: el.epoch_jd = parseEpoch(b, e); break;
+        case FieldMeanMotion: el.mean_motion = parseNumber(b, e); break;
+        case FieldEccentricity: el.eccentricity = parseNumber(b, e); break;
+        case FieldInclination: el.inclination = parseNumber(b, e); break;
+        case FieldRaan: el.raan = parseNumber(b, e); break;
+        case FieldArgPerigee: el.arg_perigee = parseNumber(b, e); break;
+        case FieldMeanAnomaly: el.mean_anomaly = parseNumber(b, e); break;
+        case FieldCatalogNumber: el.catalog_number = (uint32_t)parseNumber(b, e); break;
+        case FieldBstar: el.bstar = parseNumber(b, e); break;
+        default: break;
+    }
+}
+
+// TLE/3LE: запись принадлежит куску, в котором начинается ее строка 1
+static void parseTleChunk(const char *data, const char *begin, const char *chunk_end, const char *end,
+                          std::vector<OrbitalElements> &out)
+{
+    const char *p = alignToLine(data, begin, end);
+    while(p < chunk_end)
+    {
+        const char *next = nextLine(p, end);
+        if(p[0] != '1' || next >= end || next[0] != '2')
+        {
+            p = next;
+            continue;
+        }
+
+        // Короткие строки не читаются, чтобы не выйти за отображенный файл
+        OrbitalElements el;
+        if(lineLength(p, end) >= 63 && lineLength(next, end) >= 63 && parseTle(p, next, el))
+            out.push_back(el);
+
+        p = nextLine(next, end);
+    }
+}
+
+// OMM XML: запись - сегмент, начинающийся в куске. Открывающий тег
+// сегмента ищется как "<segment", после него может идти атрибут
+static void parseXmlChunk(const char *begin, const char *chunk_end, const char *end,
+                          std::vector<OrbitalElements> &out)
+{
+    const char *p = find(begin, end, "<segment", 8);
+    while(p < chunk_end)
+    {
+        const char *segment_end = find(p, end, "</segment>", 10);
+
+        OrbitalElements el;
+        const char *q = p + 8;
+        while((q = (const char *)std::memchr(q, '<', segment_end - q)))
+        {
+            q++;
+            if(q >= segment_end || *q == '/' || *q == '?' || *q == '!')
+                continue;
+
+            const char *name_end = q;
+            while(name_end < segment_end && *name_end != '>' && *name_end != ' ' && *name_end != '/')
+                name_end++;
+            const char *value = (const char *)std::memchr(name_end, '>', segment_end - name_end);
+            if(!value)
+                break;
+            value++;
+            const char *value_end = (const char *)std::memchr(value, '<', segment_end - value);
+            if(!value_end)
+                value_end = segment_end;
+
+            OmmField field = lookupField(q, name_end);
+            if(field != FieldNone)
+                setField(el, field, value, value_end);
+            q = value_end;
+        }
+
+        if(el.mean_motion > 0.0)
+            out.push_back(el);
+
+        p = find(segment_end, end, "<segment", 8);
+    }
+}
+
+// Разбор строки CSV на поля с учетом кавычек
+static size_t splitCsv(const char *p, const char *line_end, const char **fields, const char **fields_end)
+{
+    size_t n = 0;
+    while(n < CATALOG_MAX_COLUMNS)
+    {
+        const char *b = p;
+        const char *e;
+        if(p < line_end && *p == '"')
+        {
+            b = ++p;
+            while(p < line_end && *p != '"')
+                p++;
+            e = p;
+            p = (const char *)std::memchr(p, ',', line_end - p);
+        }
+        else
+        {
+            p = (const char *)std::memchr(p, ',', line_end - p);
+            e = p ? p : line_end;
+        }
+
+        fields[n] = b;
+        fields_end[n] = e;
+        n++;
+
+        if(!p)
+            break;
+        p++;
+    }
+    return n;
+}
+
+// OMM CSV: запись - строка, начинающаяся в куске
+static void parseCsvChunk(const char *data, const char *begin, const char *chunk_end, const char *end,
+                          const OmmField *columns, size_t column_count, std::vector<OrbitalElements> &out)
+{
+    const char *fields[CATALOG_MAX_COLUMNS];
+    const char *fields_end[CATALOG_MAX_COLUMNS];
+
+    const char *p = alignToLine(data, begin, end);
+    while(p < chunk_end)
+    {
+        const char *line_end = p + lineLength(p, end);
+        size_t n = std::min(splitCsv(p, line_end, fields, fields_end), column_count);
+
+        OrbitalElements el;
+        for(size_t i = 0; i < n; i++)
+            if(columns[i] != FieldNone)
+                setField(el, columns[i], fields[i], fields_end[i]);
+
+        if(el.mean_motion > 0.0)
+            out.push_back(el);
+
+        p = nextLine(line_end, end);
+    }
+}
+
+CatalogFormat detectCatalogFormat(const char *data, size_t size)
+{
+    const char *end = data + size;
+    const char *p = data;
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+    if(p == end)
+        return CatalogUnknown;
+
+    if(*p == '<')
+        return CatalogOmmXml;
+
+    // CSV узнается по заголовку
+    const char *line_end = p + lineLength(p, end);
+    if(find(p, line_end, "MEAN_MOTION", 11) != line_end && std::memchr(p, ',', line_end - p))
+        return CatalogOmmCsv;
+
+    return CatalogTle;
+}
+
+size_t parseCatalog(const char *data, size_t size, CatalogFormat format,
+                    std::vector<OrbitalElements> &elements, unsigned threads)
+{
+    if(format == CatalogUnknown)
+        format = detectCatalogFormat(data, size);
+    if(format == CatalogUnknown)
+        return 0;
+
+    const char *begin = data;
+    const char *end = data + size;
+
+    // Колонки CSV берутся из заголовка
+    OmmField columns[CATALOG_MAX_COLUMNS];
+    size_t column_count = 0;
+    if(format == CatalogOmmCsv)
+    {
+        const char *fields[CATALOG_MAX_COLUMNS];
+        const char *fields_end[CATALOG_MAX_COLUMNS];
+        const char *line_end = begin + lineLength(begin, end);
+        column_count = splitCsv(begin, line_end, fields, fields_end);
+        for(size_t i = 0; i < column_count; i++)
+            columns[i] = lookupField(fields[i], fields_end[i]);
+        begin = nextLine(line_end, end);
+    }
+
+    if(!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunks = std::max<size_t>(1, std::min<size_t>(threads, (end - begin) / CATALOG_MIN_CHUNK));
+
+    // Оценка числа записей для резервирования: средний размер записи в байтах
+    size_t record_size = format == CatalogTle ? 140 : format == CatalogOmmCsv ? 160 : 1200;
+
+    std::vector<std::vector<OrbitalElements>> parts(chunks);
+    auto parse = [&](size_t i)
+    {
+        const char *chunk_begin = begin + (end - begin) * i / chunks;
+        const char *chunk_end = begin + (end - begin) * (i + 1) / chunks;
+        parts[i].reserve((chunk_end - chunk_begin) / record_size + 1);
+
+        if(format == CatalogTle)
+            parseTleChunk(data, chunk_begin, chunk_end, end, parts[i]);
+        else if(format == CatalogOmmXml)
+            parseXmlChunk(chunk_begin, chunk_end, end, parts[i]);
+        else
+            parseCsvChunk(data, chunk_begin, chunk_end, end, columns, column_count, parts[i]);
+    };
+
+    std::vector<std::thread> pool;
+    for(size_t i = 1; i < chunks; i++)
+        pool.emplace_back(parse, i);
+    parse(0);
+    for(auto &t : pool)
+        t.join();
+
+    // Сборка кусков в порядке файла
+    size_t total = 0;
+    for(const auto &part : parts)
+        total += part.size();
+
+    size_t offset = elements.size();
+    elements.resize(offset + total);
+    for(const auto &part : parts)
+    {
+        std::copy(part.begin(), part.end(), elements.begin() + offset);
+        offset += part.size();
+    }
+
+    return total;
+}
+
+size_t loadCatalog(const QString &path, std::vector<OrbitalElements> &elements, unsigned threads)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly) || !file.size())
+    {
+        qDebug() << "Error during catalog loading:" << path;
+        return 0;
+    }
+
+    // Файл разбирается прямо в отображении, без чтения в буфер
+    const char *data = (const char *)file.map(0, file.size());
+    if(!data)
+    {
+        qDebug() << "Error during catalog mapping:" << path;
+        return 0;
+    }
+
+    size_t count = parseCatalog(data, file.size(), CatalogUnknown, elements, threads);
+    file.unmap((uchar *)data);
+
+    return count;
+}
@@ -0,0 +1,33 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <QString>
+
+#include <vector>
+#include <cstddef>
+
+#include "sgp4.h"
+
+// Форматы каталогов
+enum CatalogFormat
+{
+    CatalogUnknown = 0,
+    CatalogTle,     // TLE и 3LE: строки 1 и 2, необязательная строка имени
+    CatalogOmmXml,  // CCSDS OMM XML, сегменты <segment>
+    CatalogOmmCsv   // CCSDS OMM CSV с заголовком
+};
+
+// Определение формата по началу данных
+CatalogFormat detectCatalogFormat(const char *data, size_t size);
+
+// Разбор каталога из памяти. Данные делятся на куски по границам записей,
+// куски разбираются параллельно без копирования строк, результат
+// дописывается в elements в порядке следования записей.
+// threads = 0 - по числу ядер. Возвращает число разобранных записей
+size_t parseCatalog(const char *data, size_t size, CatalogFormat format,
+                    std::vector<OrbitalElements> &elements, unsigned threads = 0);
+
+// Загрузка каталога из файла, отображенного в память
+size_t loadCatalog(const QString &path, std::vector<OrbitalElements> &elements, unsigned threads = 0);
+
+#endif
@@ -0,0 +1,379 @@
+#include "conjunctions.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Координаты ячеек ограничены, чтобы линейный ключ уместился в 64 бита
+#define CELL_LIMIT (1 << 19)
+
+// Разряд поразрядной сортировки ключей ячеек
+#define RADIX_BITS 11
+
+// Кубический эрмитов сплайн по положениям и скоростям концов отрезка длины h
+static inline void hermite(const float *a, const float *da, const float *b, const float *db, float x, float h, float *out)
+{
+    float x2 = x * x, x3 = x2 * x;
+    float h00 = 2.0f * x3 - 3.0f * x2 + 1.0f, h01 = 3.0f * x2 - 2.0f * x3;
+    float h10 = (x3 - 2.0f * x2 + x) * h, h11 = (x3 - x2) * h;
+    for(int c = 0; c < 3; c++)
+        out[c] = h00 * a[c] + h10 * da[c] + h01 * b[c] + h11 * db[c];
+}
+
+// Производная того же сплайна по времени
+static inline void hermiteRate(const float *a, const float *da, const float *b, const float *db, float x, float h, float *out)
+{
+    float x2 = x * x;
+    float d00 = (6.0f * x2 - 6.0f * x) / h;
+    float d10 = 3.0f * x2 - 4.0f * x + 1.0f, d11 = 3.0f * x2 - 2.0f * x;
+    for(int c = 0; c < 3; c++)
+        out[c] = d00 * (a[c] - b[c]) + d10 * da[c] + d11 * db[c];
+}
+
+ConjunctionScreener::ConjunctionScreener()
+{
+    m_job_done = false;
+}
+
+ConjunctionScreener::~ConjunctionScreener()
+{
+    join();
+}
+
+void ConjunctionScreener::screen(const OrbitalElements *elements, size_t count, double begin_jd, double end_jd,
+                                 std::vector<Conjunction> &conjunctions, unsigned threads)
+{
+    conjunctions.clear();
+    if(count < 2 || !(end_jd > begin_jd))
+        return;
+
+    // Шаг подгоняется, чтобы последний узел пришелся на конец окна
+    size_t intervals = size_t(std::ceil((end_jd - begin_jd) * 86400.0 / CONJUNCTION_NODE_STEP));
+    double node_step = (end_jd - begin_jd) * 86400.0 / intervals;
+
+    Sgp4Propagator propagator;
+    propagator.setElements(elements, count);
+    size_t groups = propagator.groupCount();
+    if(!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned propagation_threads = std::min<size_t>(threads, groups);
+
+    // Узлы блока в км и км/с. Нулевой узел блока - последний узел предыдущего
+    std::vector<float> positions((CONJUNCTION_BLOCK + 1) * count * 3);
+    std::vector<float> velocities((CONJUNCTION_BLOCK + 1) * count * 3);
+    std::vector<Grid> grids(threads);
+
+    for(size_t block = 0; block < intervals; block += CONJUNCTION_BLOCK)
+    {
+        size_t nodes = std::min<size_t>(CONJUNCTION_BLOCK, intervals - block);
+        size_t first_node = block ? 1 : 0;
+        if(block)
+        {
+            std::copy_n(positions.begin() + CONJUNCTION_BLOCK * count * 3, count * 3, positions.begin());
+            std::copy_n(velocities.begin() + CONJUNCTION_BLOCK * count * 3, count * 3, velocities.begin());
+        }
+
+        // Каждая группа пропагатора целиком в одном потоке, поэтому состояние
+        // резонансного интегратора SDP4 не делится между потоками
+        std::vector<std::thread> workers;
+        for(unsigned t = 0; t < propagation_threads; t++)
+            workers.emplace_back([&, t] {
+                size_t first = groups * t / propagation_threads;
+                size_t last = groups * (t + 1) / propagation_threads;
+                for(size_t k = first_node; k <= nodes; k++)
+                    propagator.propagate(begin_jd + (block + k) * node_step / 86400.0, 1.0f,
+                                         positions.data() + k * count * 3, velocities.data() + k * count * 3,
+                                         first, last - first);
+            });
+        for(auto &w : workers)
+            w.join();
+        workers.clear();
+
+        // Шаги просмотра блока делятся между потоками подряд идущими диапазонами,
+        // чтобы конец шага служил началом следующего
+        size_t steps = nodes * CONJUNCTION_SUBSTEPS;
+        double block_jd = begin_jd + block * node_step / 86400.0;
+        for(unsigned t = 0; t < threads; t++)
+            workers.emplace_back([&, t] {
+                screenSteps(grids[t], count, positions.data(), velocities.data(),
+                            steps * t / threads, steps * (t + 1) / threads, block_jd, node_step);
+            });
+        for(auto &w : workers)
+            w.join();
+    }
+
+    for(const auto &g : grids)
+        conjunctions.insert(conjunctions.end(), g.found.begin(), g.found.end());
+
+    // Сближение находят соседние шаги, а пара, идущая рядом, - каждый шаг.
+    // Цепочки событий пары с промежутками меньше CONJUNCTION_MERGE_GAP
+    // сводятся к самому тесному сближению
+    std::sort(conjunctions.begin(), conjunctions.end(), [](const Conjunction &a, const Conjunction &b) {
+        if(a.first != b.first)
+            return a.first < b.first;
+        return a.second != b.second ? a.second < b.second : a.tca_jd < b.tca_jd;
+    });
+
+    size_t n = 0;
+    double run_end = 0.0;
+    for(size_t i = 0; i < conjunctions.size(); i++)
+    {
+        const Conjunction &c = conjunctions[i];
+        if(n && conjunctions[n - 1].first == c.first && conjunctions[n - 1].second == c.second &&
+           (c.tca_jd - run_end) * 86400.0 < CONJUNCTION_MERGE_GAP)
+        {
+            if(c.miss_distance < conjunctions[n - 1].miss_distance)
+                conjunctions[n - 1] = c;
+        }
+        else
+            conjunctions[n++] = c;
+        run_end = c.tca_jd;
+    }
+    conjunctions.resize(n);
+
+    std::sort(conjunctions.begin(), conjunctions.end(), [](const Conjunction &a, const Conjunction &b) {
+        if(a.tca_jd != b.tca_jd)
+            return a.tca_jd < b.tca_jd;
+        return a.first != b.first ? a.first < b.first : a.second < b.second;
+    });
+}
+
+void ConjunctionScreener::screenSteps(Grid &grid, size_t count, const float *positions, const float *velocities,
+                                      size_t first_step, size_t last_step, double block_jd, double node_step) const
+{
+    grid.start.resize(count * 3);
+    grid.end.resize(count * 3);
+    grid.cells.resize(count * 3);
+    grid.keys.resize(count);
+    grid.sorted.resize(count);
+    grid.scratch_keys.resize(count);
+    grid.scratch.resize(count);
+
+    float h = node_step;
+    float limit = m_threshold + CONJUNCTION_LINEAR_MARGIN;
+    for(size_t s = first_step; s < last_step; s++)
+    {
+        size_t node = s / CONJUNCTION_SUBSTEPS;
+        float x0 = float(s % CONJUNCTION_SUBSTEPS) / CONJUNCTION_SUBSTEPS;
+        float x1 = float(s % CONJUNCTION_SUBSTEPS + 1) / CONJUNCTION_SUBSTEPS;
+        const float *pa = positions + node * count * 3, *pb = pa + count * 3;
+        const float *va = velocities + node * count * 3, *vb = va + count * 3;
+
+        if(s == first_step)
+            for(size_t i = 0; i < count; i++)
+                hermite(pa + i * 3, va + i * 3, pb + i * 3, vb + i * 3, x0, h, grid.start.data() + i * 3);
+        else
+            grid.start.swap(grid.end);
+        for(size_t i = 0; i < count; i++)
+            hermite(pa + i * 3, va + i * 3, pb + i * 3, vb + i * 3, x1, h, grid.end.data() + i * 3);
+
+        const float *p0 = grid.start.data();
+        const float *p1 = grid.end.data();
+
+        // Ячейка не меньше порога плюс наибольшего смещения за шаг: тогда середины
+        // отрезков пары, сблизившейся на шаге, не дальше одной ячейки друг от друга
+        float displacement = 0.0f;
+        for(size_t i = 0; i < count; i++)
+        {
+            float dx = p1[i * 3] - p0[i * 3], dy = p1[i * 3 + 1] - p0[i * 3 + 1], dz = p1[i * 3 + 2] - p0[i * 3 + 2];
+            displacement = std::max(displacement, dx * dx + dy * dy + dz * dz);
+        }
+        float inv_cell = 1.0f / (limit + std::sqrt(displacement));
+
+        // Ячейки середин отрезков и границы занятой области по осям. Спутники
+        // с ошибкой пропагации (в центре Земли) не участвуют
+        int32_t lo[3] = {CELL_LIMIT, CELL_LIMIT, CELL_LIMIT};
+        int32_t hi[3] = {-CELL_LIMIT, -CELL_LIMIT, -CELL_LIMIT};
+        size_t placed = 0;
+        for(size_t i = 0; i < count; i++)
+        {
+            const float *p = p0 + i * 3, *q = p1 + i * 3;
+            if(p[0] == 0.0f && p[1] == 0.0f && p[2] == 0.0f)
+                continue;
+
+            int32_t *c = grid.cells.data() + placed * 3;
+            for(int a = 0; a < 3; a++)
+            {
+                float cell = std::floor((p[a] + q[a]) * 0.5f * inv_cell);
+                c[a] = (int32_t)std::min(std::max(cell, -float(CELL_LIMIT)), float(CELL_LIMIT));
+                lo[a] = std::min(lo[a], c[a]);
+                hi[a] = std::max(hi[a], c[a]);
+            }
+            grid.sorted[placed++] = i;
+        }
+        if(placed < 2)
+            continue;
+
+        // Линейный ключ ячейки с пустым слоем по краям области: соседняя
+        // ячейка - прибавление смещения, которое не переходит на другую строку
+        uint64_t ny = hi[1] - lo[1] + 3, nz = hi[2] - lo[2] + 3;
+        uint64_t max_key = 0;
+        for(size_t k = 0; k < placed; k++)
+        {
+            const int32_t *c = grid.cells.data() + k * 3;
+            grid.keys[k] = (uint64_t(c[0] - lo[0] + 1) * ny + uint64_t(c[1] - lo[1] + 1)) * nz + uint64_t(c[2] - lo[2] + 1);
+            max_key = std::max(max_key, grid.keys[k]);
+        }
+
+        // Поразрядная сортировка: ячейки по возрастанию ключа, объекты ячейки подряд
+        for(int shift = 0; shift < 64 && (max_key >> shift); shift += RADIX_BITS)
+        {
+            uint32_t histogram[1 << RADIX_BITS] = {};
+            for(size_t k = 0; k < placed; k++)
+                histogram[(grid.keys[k] >> shift) & ((1 << RADIX_BITS) - 1)]++;
+            uint32_t sum = 0;
+            for(int d = 0; d < (1 << RADIX_BITS); d++)
+            {
+                uint32_t n = histogram[d];
+                histogram[d] = sum;
+                sum += n;
+            }
+            for(size_t k = 0; k < placed; k++)
+            {
+                uint32_t at = histogram[(grid.keys[k] >> shift) & ((1 << RADIX_BITS) - 1)]++;
+                grid.scratch_keys[at] = grid.keys[k];
+                grid.scratch[at] = grid.sorted[k];
+            }
+            grid.keys.swap(grid.scratch_keys);
+            grid.sorted.swap(grid.scratch);
+        }
+        const uint64_t *keys = grid.keys.data();
+        const uint32_t *objects = grid.sorted.data();
+
+        // Кандидаты - пары, относительное прямолинейное движение которых
+        // на шаге подходит ближе порога с запасом
+        auto test = [&](uint32_t i, uint32_t j) {
+            float r0[3], dr[3];
+            for(int c = 0; c < 3; c++)
+            {
+                r0[c] = p0[j * 3 + c] - p0[i * 3 + c];
+                dr[c] = p1[j * 3 + c] - p1[i * 3 + c] - r0[c];
+            }
+            float rd = r0[0] * dr[0] + r0[1] * dr[1] + r0[2] * dr[2];
+            float dd = dr[0] * dr[0] + dr[1] * dr[1] + dr[2] * dr[2];
+            float t = dd > 0.0f ? std::min(std::max(-rd / dd, 0.0f), 1.0f) : 0.0f;
+            float d2 = 0.0f;
+            for(int c = 0; c < 3; c++)
+                d2 += (r0[c] + t * dr[c]) * (r0[c] + t * dr[c]);
+            if(d2 < limit * limit)
+                refine(grid, count, positions, velocities, std::min(i, j), std::max(i, j), node, x0, x1, block_jd, node_step);
+        };
+
+        // Соседи "вперед", чтобы пара из разных ячеек нашлась ровно один раз:
+        // следующая ячейка строки и строки (0, 1), (1, -1), (1, 0), (1, 1) по
+        // три ячейки с ключами [k + row - 1, k + row + 1]. Ключи растут вместе
+        // с ключом ячейки, поэтому у каждой строки свой указатель, идущий
+        // по отсортированному массиву только вперед
+        uint64_t rows[4] = {nz, ny * nz - nz, ny * nz, ny * nz + nz};
+        size_t cursors[4] = {0, 0, 0, 0};
+        for(size_t p = 0; p < placed;)
+        {
+            uint64_t key = keys[p];
+            size_t run = p + 1;
+            while(run < placed && keys[run] == key)
+                run++;
+
+            for(size_t r = p; r < run; r++)
+                for(size_t q = r + 1; q < run; q++)
+                    test(objects[r], objects[q]);
+            for(size_t q = run; q < placed && keys[q] == key + 1; q++)
+                for(size_t r = p; r < run; r++)
+                    test(objects[r], objects[q]);
+
+            for(int k = 0; k < 4; k++)
+            {
+                size_t &q = cursors[k];
+                while(q < placed && keys[q] < key + rows[k] - 1)
+                    q++;
+                for(size_t e = q; e < placed && keys[e] <= key + rows[k] + 1; e++)
+                    for(size_t r = p; r < run; r++)
+                        test(objects[r], objects[e]);
+            }
+            p = run;
+        }
+    }
+}
+
+void ConjunctionScreener::refine(Grid &grid, size_t count, const float *positions, const float *velocities,
+                                 uint32_t i, uint32_t j, size_t node, float x0, float x1, double block_jd, double node_step) const
+{
+    const float *pa = positions + node * count * 3, *pb = pa + count * 3;
+    const float *va = velocities + node * count * 3, *vb = va + count * 3;
+    float h = node_step;
+
+    auto distance = [&](float x) {
+        float a[3], c[3];
+        hermite(pa + i * 3, va + i * 3, pb + i * 3, vb + i * 3, x, h, a);
+        hermite(pa + j * 3, va + j * 3, pb + j * 3, vb + j * 3, x, h, c);
+        return (c[0] - a[0]) * (c[0] - a[0]) + (c[1] - a[1]) * (c[1] - a[1]) + (c[2] - a[2]) * (c[2] - a[2]);
+    };
+
+    // Золотое сечение на шаге и соседних с ним в пределах отрезка узлов.
+    // Минимум на краю отрезка найдут и соседние шаги, повтор уйдет при слиянии
+    const float g = 0.618034f;
+    float w = x1 - x0;
+    float lo = std::max(x0 - w, 0.0f), hi = std::min(x1 + w, 1.0f);
+    float c = hi - g * (hi - lo), d = lo + g * (hi - lo);
+    float fc = distance(c), fd = distance(d);
+    for(int k = 0; k < CONJUNCTION_TCA_ITERATIONS; k++)
+    {
+        if(fc < fd)
+        {
+            hi = d;
+            d = c;
+            fd = fc;
+            c = hi - g * (hi - lo);
+            fc = distance(c);
+        }
+        else
+        {
+            lo = c;
+            c = d;
+            fc = fd;
+            d = lo + g * (hi - lo);
+            fd = distance(d);
+        }
+    }
+
+    float x = 0.5f * (lo + hi);
+    float d2 = distance(x);
+    if(d2 >= m_threshold * m_threshold)
+        return;
+
+    float ra[3], rc[3];
+    hermiteRate(pa + i * 3, va + i * 3, pb + i * 3, vb + i * 3, x, h, ra);
+    hermiteRate(pa + j * 3, va + j * 3, pb + j * 3, vb + j * 3, x, h, rc);
+    float speed = std::sqrt((rc[0] - ra[0]) * (rc[0] - ra[0]) + (rc[1] - ra[1]) * (rc[1] - ra[1]) +
+                            (rc[2] - ra[2]) * (rc[2] - ra[2]));
+
+    grid.found.push_back({i, j, block_jd + (node + x) * node_step / 86400.0, std::sqrt(d2), speed});
+}
+
+void ConjunctionScreener::start(const OrbitalElements *elements, size_t count, double begin_jd, double end_jd)
+{
+    join();
+    m_job_elements.assign(elements, elements + count);
+    m_job_done = false;
+
+    m_job = std::thread([this, begin_jd, end_jd] {
+        screen(m_job_elements.data(), m_job_elements.size(), begin_jd, end_jd, m_job_conjunctions);
+        m_job_done = true;
+        if(m_ready_callback)
+            m_ready_callback();
+    });
+}
+
+bool ConjunctionScreener::acquire(std::vector<Conjunction> &conjunctions)
+{
+    if(!m_job.joinable() || !m_job_done)
+        return false;
+
+    m_job.join();
+    conjunctions.swap(m_job_conjunctions);
+    return true;
+}
+
+void ConjunctionScreener::join()
+{
+    if(m_job.joinable())
+        m_job.join();
+}
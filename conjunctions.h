@@ -0,0 +1,108 @@
+#ifndef CONJUNCTIONS_H
+#define CONJUNCTIONS_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "sgp4.h"
+
+// Порог сближения по умолчанию, км
+#define CONJUNCTION_THRESHOLD 5.0
+
+// Шаг узлов пропагации, секунды, и шагов просмотра на отрезок узлов.
+// Между узлами положения интерполируются по скоростям
+#define CONJUNCTION_NODE_STEP 120.0
+#define CONJUNCTION_SUBSTEPS 12
+
+// Отрезков узлов в одном блоке: узлы блока пропагируются все сразу,
+// затем шаги просмотра блока делятся между потоками
+#define CONJUNCTION_BLOCK 32
+
+// Запас на отклонение движения от прямой на шаге просмотра, км
+#define CONJUNCTION_LINEAR_MARGIN 1.0
+
+// Итерации золотого сечения при поиске момента наибольшего сближения
+#define CONJUNCTION_TCA_ITERATIONS 24
+
+// Сближения одной пары, разделенные меньшим интервалом, секунды,
+// считаются одним: пара, идущая рядом, дает одно событие
+#define CONJUNCTION_MERGE_GAP 120.0
+
+// Сближение пары объектов каталога
+struct Conjunction
+{
+    uint32_t first;          // индекс в каталоге, first < second
+    uint32_t second;
+    double tca_jd;           // момент наибольшего сближения
+    float miss_distance;     // км
+    float relative_speed;    // км/с
+};
+
+// Поиск сближений каталога за время, почти линейное по числу объектов.
+// На каждом шаге просмотра середины отрезков движения объектов
+// раскладываются по равномерной сетке с ячейкой не меньше порога плюс
+// наибольшего смещения за шаг, поэтому пара, сблизившаяся на шаге, лежит
+// в одной или соседних ячейках. Ячейки упорядочиваются поразрядной
+// сортировкой ключей, проверяются сама ячейка и 13 соседей "вперед".
+// Кандидаты отбираются по относительному прямолинейному движению, а
+// момент наибольшего сближения уточняется на эрмитовом сплайне по
+// положениям и скоростям соседних узлов
+class ConjunctionScreener
+{
+    public:
+        ConjunctionScreener();
+        ~ConjunctionScreener();
+
+        // Порог сближения, км
+        void setThreshold(double km) { m_threshold = km; }
+        double threshold() const { return m_threshold; }
+
+        // Синхронный расчет на интервал [begin_jd, end_jd] всеми потоками
+        // (threads = 0 - по числу ядер). Сближения идут по возрастанию TCA
+        void screen(const OrbitalElements *elements, size_t count, double begin_jd, double end_jd,
+                    std::vector<Conjunction> &conjunctions, unsigned threads = 0);
+
+        // Тот же расчет в фоновом потоке. Элементы копируются.
+        // acquire() возвращает false, пока результат не готов
+        void start(const OrbitalElements *elements, size_t count, double begin_jd, double end_jd);
+        bool acquire(std::vector<Conjunction> &conjunctions);
+        bool isRunning() const { return m_job.joinable(); }
+
+        // Вызывается из фонового потока по окончании расчета
+        void setReadyCallback(std::function<void()> callback) { m_ready_callback = callback; }
+
+    private:
+        // Рабочие массивы потока просмотра
+        struct Grid
+        {
+            std::vector<float> start;       // положения в начале шага
+            std::vector<float> end;         // и в конце
+            std::vector<int32_t> cells;     // ячейки середин отрезков
+            std::vector<uint64_t> keys;     // ключи ячеек по возрастанию
+            std::vector<uint32_t> sorted;   // объекты в порядке ключей
+            std::vector<uint64_t> scratch_keys;
+            std::vector<uint32_t> scratch;
+            std::vector<Conjunction> found;
+        };
+
+        void screenSteps(Grid &grid, size_t count, const float *positions, const float *velocities,
+                         size_t first_step, size_t last_step, double block_jd, double node_step) const;
+        void refine(Grid &grid, size_t count, const float *positions, const float *velocities,
+                    uint32_t i, uint32_t j, size_t node, float x0, float x1, double block_jd, double node_step) const;
+        void join();
+
+        double m_threshold = CONJUNCTION_THRESHOLD;
+
+        // Фоновый расчет
+        std::thread m_job;
+        std::atomic<bool> m_job_done;
+        std::vector<OrbitalElements> m_job_elements;
+        std::vector<Conjunction> m_job_conjunctions;
+        std::function<void()> m_ready_callback;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "culling.h"
+
+#include <QVector4D>
+
+#include <algorithm>
+#include <cmath>
+
+void ViewCuller::update(const QMatrix4x4 &view_proj, const QVector3D &camera, float pixels_per_unit,
+                        const float *positions, const float *orbit_transforms, size_t count)
+{
+    // Плоскости пирамиды видимости из строк матрицы, нормали внутрь
+    QVector4D r3 = view_proj.row(3);
+    QVector4D planes[6];
+    for(int i = 0; i < 3; i++)
+    {
+        planes[i * 2] = r3 + view_proj.row(i);
+        planes[i * 2 + 1] = r3 - view_proj.row(i);
+    }
+    for(int i = 0; i < 6; i++)
+    {
+        float length = planes[i].toVector3D().length();
+        for(int j = 0; j < 4; j++)
+            m_planes[i][j] = planes[i][j] / length;
+    }
+
+    m_mask.resize(count);
+    uint8_t *mask = m_mask.data();
+
+    // Метки: пирамида видимости и затенение Землей. Ближайшая к центру
+    // Земли точка отрезка камера-метка ищется по параметру t на [0, 1].
+    // Камера внутри Земли ничего не затеняет
+    float cx = camera.x(), cy = camera.y(), cz = camera.z();
+    float cc = cx * cx + cy * cy + cz * cz - CULL_EARTH_RADIUS * CULL_EARTH_RADIUS;
+    uint8_t camera_outside = cc > 0.0f;
+    for(size_t i = 0; i < count; i++)
+    {
+        float x = positions[i * 3], y = positions[i * 3 + 1], z = positions[i * 3 + 2];
+
+        uint8_t visible = 1;
+        for(int k = 0; k < 6; k++)
+            visible &= m_planes[k][0] * x + m_planes[k][1] * y + m_planes[k][2] * z + m_planes[k][3] >= 0.0f;
+
+        float dx = x - cx, dy = y - cy, dz = z - cz;
+        float a = std::max(dx * dx + dy * dy + dz * dz, 1e-12f);
+        float b = cx * dx + cy * dy + cz * dz;
+        float t = std::min(std::max(-b / a, 0.0f), 1.0f);
+        float d = cc + 2.0f * t * b + t * t * a;
+        visible &= (d >= 0.0f) | (camera_outside ^ 1);
+
+        mask[i] = visible;
+    }
+    compact(m_marks, count);
+
+    // Орбиты: ограничивающая сфера эллипса. Центр - перенос матрицы,
+    // радиус - большая полуось, то есть длиннейший из столбцов x и z
+    m_orbit_lods.resize(count);
+    uint8_t *lods = m_orbit_lods.data();
+    for(size_t i = 0; i < count; i++)
+    {
+        const float *m = orbit_transforms + i * 16;
+        float x = m[12], y = m[13], z = m[14];
+        float r = std::sqrt(std::max(m[0] * m[0] + m[1] * m[1] + m[2] * m[2],
+                                     m[8] * m[8] + m[9] * m[9] + m[10] * m[10]));
+
+        uint8_t visible = m[15] != 0.0f;
+        for(int k = 0; k < 6; k++)
+            visible &= m_planes[k][0] * x + m_planes[k][1] * y + m_planes[k][2] * z + m_planes[k][3] >= -r;
+        mask[i] = visible;
+
+        // Наибольшее отклонение хорды при равномерном шаге параметра - у концов
+        // большой оси, a * pi^2 / (2 n^2), как у окружности радиуса a. Радиус
+        // в пикселях берется по ближней точке сферы, внутри сферы уровень наибольший
+        float dx = x - cx, dy = y - cy, dz = z - cz;
+        float nearest = std::sqrt(dx * dx + dy * dy + dz * dz) - r;
+        float radius_px = nearest > 0.0f ? std::min(r * pixels_per_unit / nearest, 1e12f) : 1e12f;
+        float segments = float(M_PI) * std::sqrt(radius_px / (2.0f * ORBIT_LOD_ERROR));
+
+        int lod = 0;
+        while(lod < ORBIT_LODS - 1 && orbitLodSegments(lod) < segments)
+            lod++;
+        lods[i] = lod;
+    }
+    sortOrbits(count);
+}
+
+void ViewCuller::sortOrbits(size_t count)
+{
+    // Сортировка подсчетом по уровням, внутри уровня - по возрастанию индекса
+    size_t histogram[ORBIT_LODS] = {};
+    for(size_t i = 0; i < count; i++)
+        histogram[m_orbit_lods[i]] += m_mask[i];
+
+    // Огрубление всех орбит сдвигом гистограммы, пока вершины не уложатся в бюджет
+    int bias = 0;
+    size_t shifted[ORBIT_LODS];
+    for(;;)
+    {
+        std::fill_n(shifted, ORBIT_LODS, 0);
+        for(int lod = 0; lod < ORBIT_LODS; lod++)
+            shifted[std::max(lod - bias, 0)] += histogram[lod];
+
+        m_orbit_vertices = 0;
+        for(int lod = 0; lod < ORBIT_LODS; lod++)
+            m_orbit_vertices += shifted[lod] * orbitLodSegments(lod);
+        if(m_orbit_vertices <= ORBIT_VERTEX_BUDGET || bias == ORBIT_LODS - 1)
+            break;
+        bias++;
+    }
+
+    size_t next[ORBIT_LODS];
+    m_lod_begin[0] = 0;
+    for(int lod = 0; lod < ORBIT_LODS; lod++)
+    {
+        next[lod] = m_lod_begin[lod];
+        m_lod_begin[lod + 1] = m_lod_begin[lod] + shifted[lod];
+    }
+
+    m_orbits.resize(m_lod_begin[ORBIT_LODS]);
+    for(size_t i = 0; i < count; i++)
+        if(m_mask[i])
+            m_orbits[next[std::max(m_orbit_lods[i] - bias, 0)]++] = i;
+}
+
+void ViewCuller::compact(std::vector<uint32_t> &indices, size_t count)
+{
+    // Емкость не уменьшается, поэтому в установившемся режиме память не выделяется
+    indices.resize(count);
+    size_t n = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        indices[n] = i;
+        n += m_mask[i];
+    }
+    indices.resize(n);
+}
@@ -0,0 +1,69 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Радиус Земли в единицах сцены (диаметр Земли - единица)
+#define CULL_EARTH_RADIUS 0.5f
+
+// Уровни детализации орбит: кольца из ORBIT_MIN_SEGMENTS << lod отрезков
+// в одном буфере, кольцо уровня lod начинается с вершины orbitLodFirst(lod)
+#define ORBIT_MIN_SEGMENTS 16
+#define ORBIT_LODS 7
+
+// Допустимое отклонение отрезка от эллипса на экране, пиксели
+#define ORBIT_LOD_ERROR 0.5f
+
+// Предел вершин всех орбит за кадр: при превышении все орбиты
+// огрубляются на уровень, пока сумма не уложится
+#define ORBIT_VERTEX_BUDGET 2000000
+
+inline int orbitLodFirst(int lod) { return ORBIT_MIN_SEGMENTS * ((1 << lod) - 1); }
+inline int orbitLodSegments(int lod) { return ORBIT_MIN_SEGMENTS << lod; }
+
+// Отсечение меток и орбит до отправки на GPU.
+// Метка отбрасывается, если она вне пирамиды видимости или отрезок от
+// камеры до нее пересекает Землю. Орбита отбрасывается, если ее
+// ограничивающая сфера вне пирамиды видимости или орбита скрыта.
+// Видимой орбите назначается уровень детализации по экранному размеру.
+// Проверки идут без ветвлений в отдельную маску, чтобы цикл
+// векторизовался, а индексы видимых собираются вторым проходом
+class ViewCuller
+{
+    public:
+        // positions - 3 float на спутник, orbit_transforms - матрицы орбит
+        // по 16 float (нулевая матрица - скрытая орбита), pixels_per_unit -
+        // размер в пикселях единичного отрезка на единичном расстоянии от камеры
+        void update(const QMatrix4x4 &view_proj, const QVector3D &camera, float pixels_per_unit,
+                    const float *positions, const float *orbit_transforms, size_t count);
+
+        // Индексы видимых меток по возрастанию
+        const std::vector<uint32_t> &visibleMarks() const { return m_marks; }
+
+        // Индексы видимых орбит, сгруппированные по уровням детализации:
+        // орбиты уровня lod занимают [orbitLodBegin(lod), orbitLodBegin(lod + 1))
+        const std::vector<uint32_t> &visibleOrbits() const { return m_orbits; }
+        size_t orbitLodBegin(int lod) const { return m_lod_begin[lod]; }
+
+        // Вершин орбит в последнем кадре
+        size_t orbitVertices() const { return m_orbit_vertices; }
+
+    private:
+        void compact(std::vector<uint32_t> &indices, size_t count);
+        void sortOrbits(size_t count);
+
+        float m_planes[6][4];
+        std::vector<uint8_t> m_mask;
+        std::vector<uint32_t> m_marks;
+        std::vector<uint32_t> m_orbits;
+        std::vector<uint8_t> m_orbit_lods;
+        size_t m_lod_begin[ORBIT_LODS + 1] = {};
+        size_t m_orbit_vertices = 0;
+};
+
+#endif
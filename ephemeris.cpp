@@ -0,0 +1,315 @@
+#include "ephemeris.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Номер отрезка, содержащего момент jd
+static inline int64_t segmentIndex(double jd)
+{
+    return (int64_t)std::floor(jd * 86400.0 / EPHEMERIS_SEGMENT);
+}
+
+// Момент jd на отрезке index в координате ряда [-1, 1]
+static inline double segmentX(double jd, int64_t index)
+{
+    return 2.0 * (jd * 86400.0 / EPHEMERIS_SEGMENT - index) - 1.0;
+}
+
+EphemerisCache::EphemerisCache()
+{
+    m_job_done = false;
+}
+
+EphemerisCache::~EphemerisCache()
+{
+    join();
+}
+
+void EphemerisCache::setElements(const OrbitalElements *elements, size_t count, float scale)
+{
+    join();
+    m_job_segment.reset();
+    m_queue.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_segments.clear();
+    }
+
+    m_propagator.setElements(elements, count);
+    m_count = count;
+    m_scale = scale;
+}
+
+void EphemerisCache::request(double jd)
+{
+    if(!m_count)
+        return;
+
+    int64_t index = segmentIndex(jd);
+    if(cached(index) || (m_job.joinable() && m_job_segment->index == index))
+        return;
+
+    m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), index), m_queue.end());
+    m_queue.push_front(index);
+    if(m_queue.size() > EPHEMERIS_CACHE_SEGMENTS)
+        m_queue.pop_back();
+
+    update();
+}
+
+void EphemerisCache::update()
+{
+    if(m_job.joinable())
+    {
+        if(!m_job_done)
+            return;
+        finish();
+    }
+
+    while(!m_queue.empty() && !m_job.joinable())
+    {
+        int64_t index = m_queue.front();
+        m_queue.pop_front();
+        if(!cached(index))
+            start(index);
+    }
+}
+
+bool EphemerisCache::wait(double jd)
+{
+    int64_t index = segmentIndex(jd);
+    while(!cached(index))
+    {
+        bool pending = (m_job.joinable() && m_job_segment->index == index) ||
+                       std::find(m_queue.begin(), m_queue.end(), index) != m_queue.end();
+        if(!pending)
+            return false;
+
+        // Текущая подгонка дожидается, затем запускается следующая из очереди
+        if(m_job.joinable())
+            finish();
+        update();
+    }
+    return true;
+}
+
+bool EphemerisCache::evaluate(double jd, float *positions, float *velocities)
+{
+    int64_t index = segmentIndex(jd);
+    std::shared_ptr<Segment> segment = find(index);
+    if(!segment)
+        return false;
+
+    const size_t n = EPHEMERIS_COEFFICIENTS;
+    size_t count = segment->count;
+    float x = float(segmentX(jd, index));
+    float x2 = 2.0f * x;
+    float dx = float(2.0 / EPHEMERIS_SEGMENT);
+
+    // Положение - ряд по T_k, скорость - производная ряда, ряд по U_{k-1}
+    // с коэффициентами k * c_k. Обе суммы считаются рекурсией Кленшоу по
+    // блоку спутников, внутренний цикл идет по смежным коэффициентам
+    for(size_t begin = 0; begin < count; begin += EPHEMERIS_BLOCK)
+    {
+        size_t block = std::min<size_t>(EPHEMERIS_BLOCK, count - begin);
+        for(int a = 0; a < 3; a++)
+        {
+            const float *c = segment->coefficients.data() + a * n * count + begin;
+            float b1[EPHEMERIS_BLOCK] = {}, b2[EPHEMERIS_BLOCK] = {};
+            float u1[EPHEMERIS_BLOCK] = {}, u2[EPHEMERIS_BLOCK] = {};
+
+            for(size_t k = n - 1; k >= 1; k--)
+            {
+                const float *ck = c + k * count;
+                float kf = float(k);
+                for(size_t j = 0; j < block; j++)
+                {
+                    float b0 = ck[j] + x2 * b1[j] - b2[j];
+                    b2[j] = b1[j];
+                    b1[j] = b0;
+
+                    float u0 = kf * ck[j] + x2 * u1[j] - u2[j];
+                    u2[j] = u1[j];
+                    u1[j] = u0;
+                }
+            }
+
+            float *p = positions + begin * 3 + a;
+            for(size_t j = 0; j < block; j++)
+                p[j * 3] = c[j] + x * b1[j] - b2[j];
+
+            if(velocities)
+            {
+                float *v = velocities + begin * 3 + a;
+                for(size_t j = 0; j < block; j++)
+                    v[j * 3] = u1[j] * dx;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool EphemerisCache::evaluate(double jd, const uint32_t *indices, size_t count, float *positions)
+{
+    int64_t index = segmentIndex(jd);
+    std::shared_ptr<Segment> segment = find(index);
+    if(!segment)
+        return false;
+
+    const size_t n = EPHEMERIS_COEFFICIENTS;
+    size_t stride = segment->count;
+    float x = float(segmentX(jd, index));
+    float x2 = 2.0f * x;
+
+    for(size_t s = 0; s < count; s++)
+    {
+        size_t i = indices[s];
+        for(int a = 0; a < 3; a++)
+        {
+            if(i >= stride)
+            {
+                positions[s * 3 + a] = 0.0f;
+                continue;
+            }
+
+            const float *c = segment->coefficients.data() + a * n * stride + i;
+            float b1 = 0.0f, b2 = 0.0f;
+            for(size_t k = n - 1; k >= 1; k--)
+            {
+                float b0 = c[k * stride] + x2 * b1 - b2;
+                b2 = b1;
+                b1 = b0;
+            }
+            positions[s * 3 + a] = c[0] + x * b1 - b2;
+        }
+    }
+
+    return true;
+}
+
+bool EphemerisCache::cached(int64_t index) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto &segment : m_segments)
+        if(segment->index == index)
+            return true;
+    return false;
+}
+
+std::shared_ptr<EphemerisCache::Segment> EphemerisCache::find(int64_t index)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto &segment : m_segments)
+    {
+        if(segment->index == index)
+        {
+            segment->used = ++m_clock;
+            return segment;
+        }
+    }
+    return nullptr;
+}
+
+void EphemerisCache::finish()
+{
+    m_job.join();
+
+    // Вытесняется отрезок, который дольше всех не читали
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_segments.size() >= EPHEMERIS_CACHE_SEGMENTS)
+    {
+        auto oldest = std::min_element(m_segments.begin(), m_segments.end(),
+            [](const std::shared_ptr<Segment> &a, const std::shared_ptr<Segment> &b) { return a->used < b->used; });
+        m_segments.erase(oldest);
+    }
+    m_job_segment->used = ++m_clock;
+    m_segments.push_back(m_job_segment);
+    m_job_segment.reset();
+}
+
+void EphemerisCache::start(int64_t index)
+{
+    m_job_segment = std::make_shared<Segment>();
+    m_job_segment->index = index;
+    m_job_segment->count = m_count;
+    m_job_segment->used = 0;
+    m_job_done = false;
+
+    m_job = std::thread([this] {
+        fit(*m_job_segment);
+        m_job_done = true;
+        if(m_ready_callback)
+            m_ready_callback();
+    });
+}
+
+void EphemerisCache::fit(Segment &segment)
+{
+    const size_t n = EPHEMERIS_COEFFICIENTS;
+    size_t count = segment.count;
+    m_job_nodes.resize(n * count * 3);
+    segment.coefficients.resize(3 * n * count);
+
+    // Узлы Чебышева x_j = cos(theta_j), theta_j = pi * (j + 1/2) / n
+    double theta[EPHEMERIS_COEFFICIENTS];
+    for(size_t j = 0; j < n; j++)
+        theta[j] = M_PI * (j + 0.5) / n;
+
+    double begin_jd = segment.index * EPHEMERIS_SEGMENT / 86400.0;
+    double half = EPHEMERIS_SEGMENT / 86400.0 / 2.0;
+
+    // Узлы пропагируются по возрастанию времени (x_j убывает с j): резонансный
+    // интегратор SDP4 тогда продолжает шаг, а не начинает с эпохи. Группа
+    // пропагатора целиком в одном потоке, как и в GroundTracks
+    size_t groups = m_propagator.groupCount();
+    unsigned threads = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), std::max<size_t>(groups, 1)));
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; t++)
+        workers.emplace_back([&, t] {
+            size_t first = groups * t / threads;
+            size_t last = groups * (t + 1) / threads;
+            for(size_t j = n; j-- > 0;)
+                m_propagator.propagate(begin_jd + half * (1.0 + std::cos(theta[j])), m_scale,
+                                       m_job_nodes.data() + j * count * 3, nullptr, first, last - first);
+        });
+    for(auto &w : workers)
+        w.join();
+    workers.clear();
+
+    // Коэффициенты - дискретное косинусное преобразование значений в узлах:
+    // c_k = 2/n * sum_j f(x_j) cos(k * theta_j), c_0 вдвое меньше
+    double basis[EPHEMERIS_COEFFICIENTS][EPHEMERIS_COEFFICIENTS];
+    for(size_t k = 0; k < n; k++)
+        for(size_t j = 0; j < n; j++)
+            basis[k][j] = (k ? 2.0 : 1.0) / n * std::cos(k * theta[j]);
+
+    for(unsigned t = 0; t < threads; t++)
+        workers.emplace_back([&, t] {
+            for(size_t i = count * t / threads; i < count * (t + 1) / threads; i++)
+            {
+                for(int a = 0; a < 3; a++)
+                {
+                    double f[EPHEMERIS_COEFFICIENTS];
+                    for(size_t j = 0; j < n; j++)
+                        f[j] = m_job_nodes[j * count * 3 + i * 3 + a];
+
+                    for(size_t k = 0; k < n; k++)
+                    {
+                        double c = 0.0;
+                        for(size_t j = 0; j < n; j++)
+                            c += basis[k][j] * f[j];
+                        segment.coefficients[(a * n + k) * count + i] = float(c);
+                    }
+                }
+            }
+        });
+    for(auto &w : workers)
+        w.join();
+}
+
+void EphemerisCache::join()
+{
+    if(m_job.joinable())
+        m_job.join();
+}
@@ -0,0 +1,109 @@
+#ifndef EPHEMERIS_H
+#define EPHEMERIS_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "sgp4.h"
+
+// Длина отрезка аппроксимации, секунды, и число коэффициентов Чебышева на
+// координату. Для LEO отрезок - пятая часть оборота, ошибка ряда много
+// меньше точности float
+#define EPHEMERIS_SEGMENT 1200.0
+#define EPHEMERIS_COEFFICIENTS 10
+
+// Отрезков в кэше (для каталога 30000 объектов - 3.6 МБ на отрезок)
+#define EPHEMERIS_CACHE_SEGMENTS 16
+
+// Спутников в блоке вычисления: рекурсия Кленшоу идет по блоку сразу,
+// промежуточные суммы блока лежат в регистрах и кэше
+#define EPHEMERIS_BLOCK 64
+
+// Кэш эфемерид каталога в виде рядов Чебышева.
+// Время делится на отрезки по EPHEMERIS_SEGMENT от JD 0; для отрезка
+// положения всех спутников пропагируются в узлах Чебышева и
+// раскладываются в ряд. Коэффициенты отрезка лежат массивами
+// [координата][степень][спутник], поэтому положения каталога на любой
+// момент отрезка считаются рекурсией Кленшоу, векторизованной по
+// спутникам, без повторной пропагации. Отрезки подгоняются по запросу в
+// фоновом потоке, при переполнении вытесняется давно не читанный
+class EphemerisCache
+{
+    public:
+        EphemerisCache();
+        ~EphemerisCache();
+
+        // Замена каталога, scale - единиц сцены на км. Кэш очищается.
+        // Вызывается из того же потока, что и update()
+        void setElements(const OrbitalElements *elements, size_t count, float scale);
+        size_t size() const { return m_count; }
+
+        // Подгонка отрезка, содержащего момент jd, в фоне. Последний запрос
+        // подгоняется первым, самые старые из лишних отбрасываются
+        void request(double jd);
+
+        // Забор готового отрезка и запуск следующего. Вызывается регулярно
+        void update();
+        bool isFitting() const { return m_job.joinable(); }
+
+        // Ожидание отрезка момента jd, если он подгоняется или стоит в
+        // очереди. false - отрезок не подогнан и не запрошен
+        bool wait(double jd);
+
+        // Вызывается из фонового потока по окончании подгонки отрезка
+        void setReadyCallback(std::function<void()> callback) { m_ready_callback = callback; }
+
+        // Положения (и скорости в секунду, если velocities не нулевой) всех
+        // спутников на момент jd, 3 float на спутник. false - отрезок еще не
+        // подогнан, массивы не меняются. Можно вызывать из любого потока
+        bool evaluate(double jd, float *positions, float *velocities = nullptr);
+
+        // То же для спутников с номерами indices (например, для трасс)
+        bool evaluate(double jd, const uint32_t *indices, size_t count, float *positions);
+
+    private:
+        struct Segment
+        {
+            int64_t index;
+            size_t count;
+            uint64_t used;
+            std::vector<float> coefficients;
+        };
+
+        std::shared_ptr<Segment> find(int64_t index);
+        bool cached(int64_t index) const;
+        void finish();
+        void start(int64_t index);
+        void fit(Segment &segment);
+        void join();
+
+        Sgp4Propagator m_propagator;
+        size_t m_count = 0;
+        float m_scale = 1.0f;
+
+        // Готовые отрезки и счетчик чтений для вытеснения. Поток отрисовки
+        // и фоновые расчеты читают кэш под блокировкой, а отрезок - по
+        // своей копии указателя, поэтому вытеснение его не освобождает
+        mutable std::mutex m_mutex;
+        std::vector<std::shared_ptr<Segment>> m_segments;
+        uint64_t m_clock = 0;
+
+        // Запросы, ждущие подгонки, последний - в начале
+        std::deque<int64_t> m_queue;
+
+        // Фоновая подгонка
+        std::thread m_job;
+        std::atomic<bool> m_job_done;
+        std::shared_ptr<Segment> m_job_segment;
+        std::vector<float> m_job_nodes;
+        std::function<void()> m_ready_callback;
+};
+
+#endif
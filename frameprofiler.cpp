@@ -0,0 +1,242 @@
+#include "frameprofiler.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+TimingHistory::TimingHistory()
+{
+    for(auto &v : m_values)
+        v.store(0.0f, std::memory_order_relaxed);
+    m_next = 0;
+}
+
+void TimingHistory::push(float value)
+{
+    size_t next = m_next.load(std::memory_order_relaxed);
+    m_values[next % PROFILER_HISTORY].store(value, std::memory_order_relaxed);
+    m_next.store(next + 1, std::memory_order_release);
+}
+
+size_t TimingHistory::count() const
+{
+    return std::min<size_t>(m_next.load(std::memory_order_acquire), PROFILER_HISTORY);
+}
+
+float TimingHistory::percentile(float p) const
+{
+    size_t n = count();
+    if(!n)
+        return 0.0f;
+
+    float values[PROFILER_HISTORY];
+    for(size_t i = 0; i < n; i++)
+        values[i] = m_values[i].load(std::memory_order_relaxed);
+
+    // Метод ближайшего ранга
+    size_t rank = (size_t)std::ceil(p / 100.0f * n);
+    size_t k = rank ? std::min(rank, n) - 1 : 0;
+    std::nth_element(values, values + k, values + n);
+    return values[k];
+}
+
+FrameProfiler::FrameProfiler(QOpenGLFunctions_3_3_Core *gl) : m_gl(gl)
+{
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    for(auto &samples : m_samples)
+        for(auto &s : samples)
+            if(s.query)
+                m_gl->glDeleteQueries(1, &s.query);
+}
+
+void FrameProfiler::init(const std::vector<QString> &passes)
+{
+    m_passes.clear();
+    for(size_t i = 0; i <= passes.size(); i++)
+    {
+        std::unique_ptr<Pass> pass(new Pass);
+        pass->name = i < passes.size() ? passes[i] : QString("Frame");
+        pass->draws = 0;
+        pass->state_changes = 0;
+        m_passes.push_back(std::move(pass));
+    }
+
+    for(auto &samples : m_samples)
+    {
+        samples.resize(m_passes.size());
+        for(size_t i = 0; i + 1 < samples.size(); i++)
+            m_gl->glGenQueries(1, &samples[i].query);
+    }
+}
+
+void FrameProfiler::beginFrame()
+{
+    // Слот кадра PROFILER_QUERY_FRAMES назад освобождается
+    m_frame++;
+    int slot = m_frame % PROFILER_QUERY_FRAMES;
+    collect(slot);
+    m_slot_frame[slot] = m_frame;
+
+    m_frame_start = Clock::now();
+    m_draws = 0;
+    m_state_changes = 0;
+}
+
+void FrameProfiler::beginPass(int pass)
+{
+    if(m_passes.empty())
+        return;
+    if(m_pass >= 0)
+        endPass();
+
+    Sample &s = m_samples[m_frame % PROFILER_QUERY_FRAMES][pass];
+    m_gl->glBeginQuery(GL_TIME_ELAPSED, s.query);
+    m_pass = pass;
+    m_pass_start = Clock::now();
+    m_draws = 0;
+    m_state_changes = 0;
+}
+
+void FrameProfiler::endPass()
+{
+    if(m_pass < 0)
+        return;
+
+    m_gl->glEndQuery(GL_TIME_ELAPSED);
+    Sample &s = m_samples[m_frame % PROFILER_QUERY_FRAMES][m_pass];
+    s.cpu = std::chrono::duration<float, std::milli>(Clock::now() - m_pass_start).count();
+    s.draws = m_draws;
+    s.state_changes = m_state_changes;
+    s.pending = true;
+
+    Sample &frame = m_samples[m_frame % PROFILER_QUERY_FRAMES].back();
+    frame.draws += m_draws;
+    frame.state_changes += m_state_changes;
+    m_pass = -1;
+}
+
+void FrameProfiler::endFrame()
+{
+    if(m_passes.empty())
+        return;
+    endPass();
+
+    Sample &frame = m_samples[m_frame % PROFILER_QUERY_FRAMES].back();
+    frame.cpu = std::chrono::duration<float, std::milli>(Clock::now() - m_frame_start).count();
+    frame.pending = true;
+}
+
+void FrameProfiler::collect(int slot)
+{
+    std::vector<Sample> &samples = m_samples[slot];
+    if(samples.empty() || !samples.back().pending)
+        return;
+
+    float gpu_total = 0.0f;
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        Sample &s = samples[i];
+        if(!s.pending)
+            continue;
+        s.pending = false;
+
+        Pass &pass = *m_passes[i];
+        pass.cpu.push(s.cpu);
+        pass.draws = s.draws;
+        pass.state_changes = s.state_changes;
+
+        // Неготовый результат пропускается, а не ожидается
+        float gpu = -1.0f;
+        if(s.query)
+        {
+            GLint available = GL_FALSE;
+            m_gl->glGetQueryObjectiv(s.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if(available)
+            {
+                GLuint64 ns = 0;
+                m_gl->glGetQueryObjectui64v(s.query, GL_QUERY_RESULT, &ns);
+                gpu = ns / 1e6f;
+                gpu_total += gpu;
+                pass.gpu.push(gpu);
+            }
+        }
+        else
+        {
+            gpu = gpu_total;
+            pass.gpu.push(gpu);
+        }
+
+        if(m_csv_file.isOpen())
+            m_csv << m_slot_frame[slot] << ',' << pass.name << ',' << s.cpu << ',' << gpu << ','
+                  << s.draws << ',' << s.state_changes << '\n';
+
+        s.draws = 0;
+        s.state_changes = 0;
+    }
+
+    // Запись на диск пачками, чтобы не платить за нее каждый кадр
+    if(m_csv_file.isOpen() && m_slot_frame[slot] % PROFILER_HISTORY == 0)
+        m_csv.flush();
+}
+
+PassStats FrameProfiler::stats(int pass) const
+{
+    const Pass &p = *m_passes[pass];
+    PassStats s;
+    s.name = p.name;
+    s.cpu_p50 = p.cpu.percentile(50.0f);
+    s.cpu_p95 = p.cpu.percentile(95.0f);
+    s.cpu_p99 = p.cpu.percentile(99.0f);
+    s.gpu_p50 = p.gpu.percentile(50.0f);
+    s.gpu_p95 = p.gpu.percentile(95.0f);
+    s.gpu_p99 = p.gpu.percentile(99.0f);
+    s.draws = p.draws;
+    s.state_changes = p.state_changes;
+    s.samples = p.cpu.count();
+    return s;
+}
+
+void FrameProfiler::reset()
+{
+    // Замеры, еще ждущие GPU, относятся к прошлой серии
+    for(auto &samples : m_samples)
+        for(auto &s : samples)
+        {
+            s.pending = false;
+            s.draws = 0;
+            s.state_changes = 0;
+        }
+
+    for(auto &pass : m_passes)
+    {
+        pass->cpu.clear();
+        pass->gpu.clear();
+        pass->draws = 0;
+        pass->state_changes = 0;
+    }
+}
+
+bool FrameProfiler::openCsv(const QString &path)
+{
+    if(m_csv_file.isOpen())
+    {
+        m_csv.flush();
+        m_csv_file.close();
+    }
+    if(path.isEmpty())
+        return true;
+
+    m_csv_file.setFileName(path);
+    if(!m_csv_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        qDebug() << "Error during profile writing:" << path;
+        return false;
+    }
+    m_csv.setDevice(&m_csv_file);
+    m_csv << "frame,pass,cpu_ms,gpu_ms,draws,state_changes\n";
+    return true;
+}
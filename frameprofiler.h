@@ -0,0 +1,127 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <QString>
+#include <QFile>
+#include <QTextStream>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+// Число кадров в истории каждого прохода
+#define PROFILER_HISTORY 256
+
+// Кадров между запросом и чтением таймеров GPU. Результат прошлого
+// кадра с тем же индексом к этому моменту уже готов, и чтение не ждет GPU
+#define PROFILER_QUERY_FRAMES 2
+
+// Последние PROFILER_HISTORY значений одного прохода.
+// Пишет только поток отрисовки, читать можно из любого потока без
+// блокировок: читатель в худшем случае увидит уже замененное значение
+class TimingHistory
+{
+    public:
+        TimingHistory();
+
+        void push(float value);
+        void clear() { m_next.store(0, std::memory_order_release); }
+
+        // Процентиль p (0-100) по сохраненным значениям, 0 - если их нет
+        float percentile(float p) const;
+        size_t count() const;
+
+    private:
+        std::atomic<float> m_values[PROFILER_HISTORY];
+        std::atomic<size_t> m_next;
+};
+
+// Сводка прохода, времена в миллисекундах
+struct PassStats
+{
+    QString name;
+    float cpu_p50, cpu_p95, cpu_p99;
+    float gpu_p50, gpu_p95, gpu_p99;
+    unsigned draws;
+    unsigned state_changes;
+    size_t samples;
+};
+
+// Замер проходов кадра: время CPU по steady_clock, время GPU по
+// запросам GL_TIME_ELAPSED, число вызовов отрисовки и смен состояния.
+// Проходы не вложены друг в друга, последним идет общий проход кадра,
+// его время GPU - сумма проходов
+class FrameProfiler
+{
+    public:
+        explicit FrameProfiler(QOpenGLFunctions_3_3_Core *gl);
+        ~FrameProfiler();
+
+        // Имена проходов, вызывается в контексте GL до первого кадра
+        void init(const std::vector<QString> &passes);
+
+        // Разметка кадра в потоке отрисовки
+        void beginFrame();
+        void beginPass(int pass);
+        void endPass();
+        void endFrame();
+
+        // Счетчики текущего прохода
+        void countDraw() { m_draws++; }
+        void countStateChange() { m_state_changes++; }
+
+        // Сводка по истории прохода; passCount() - 1 - весь кадр
+        int passCount() const { return m_passes.size(); }
+        PassStats stats(int pass) const;
+
+        // Сброс истории, например между сериями замеров
+        void reset();
+
+        // Построчная запись каждого кадра в CSV: frame,pass,cpu_ms,gpu_ms,draws,state_changes.
+        // Пустой путь закрывает файл
+        bool openCsv(const QString &path);
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Pass
+        {
+            QString name;
+            TimingHistory cpu;
+            TimingHistory gpu;
+            std::atomic<unsigned> draws;
+            std::atomic<unsigned> state_changes;
+        };
+
+        // Замер прохода, ожидающий результата GPU
+        struct Sample
+        {
+            GLuint query = 0;
+            bool pending = false;
+            float cpu = 0.0f;
+            unsigned draws = 0;
+            unsigned state_changes = 0;
+        };
+
+        void collect(int slot);
+
+        QOpenGLFunctions_3_3_Core *m_gl;
+        std::vector<std::unique_ptr<Pass>> m_passes;
+        std::vector<Sample> m_samples[PROFILER_QUERY_FRAMES];
+        uint64_t m_frame = 0;
+        uint64_t m_slot_frame[PROFILER_QUERY_FRAMES] = {};
+
+        // Текущий проход
+        int m_pass = -1;
+        Clock::time_point m_pass_start;
+        Clock::time_point m_frame_start;
+        unsigned m_draws = 0;
+        unsigned m_state_changes = 0;
+
+        QFile m_csv_file;
+        QTextStream m_csv;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#include "groundtrack.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+GroundTracks::GroundTracks(QOpenGLFunctions_3_3_Core *gl) : m_gl(gl)
+{
+    m_job_done = false;
+    m_slots = int(std::ceil((GROUND_TRACK_PAST + GROUND_TRACK_FUTURE) / GROUND_TRACK_STEP)) + 1;
+}
+
+GroundTracks::~GroundTracks()
+{
+    join();
+}
+
+void GroundTracks::init()
+{
+    m_gl->glGenBuffers(1, &m_vbo);
+    m_gl->glGenTextures(1, &m_texture);
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    m_gl->glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, m_vbo);
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    // Кольцо под уже заданные спутники
+    setWindow(m_past * 1440.0, m_future * 1440.0, m_step * 1440.0);
+}
+
+void GroundTracks::setElements(const OrbitalElements *elements, size_t count,
+                               EphemerisCache *ephemeris, const uint32_t *catalog_indices)
+{
+    join();
+    m_propagator.setElements(elements, count);
+    m_count = count;
+    m_ephemeris = catalog_indices ? ephemeris : nullptr;
+    m_ephemeris_indices.clear();
+    if(m_ephemeris)
+        m_ephemeris_indices.assign(catalog_indices, catalog_indices + count);
+    setWindow(m_past * 1440.0, m_future * 1440.0, m_step * 1440.0);
+}
+
+void GroundTracks::setWindow(double past, double future, double step)
+{
+    join();
+    m_past = past / 1440.0;
+    m_future = future / 1440.0;
+    m_step = step / 1440.0;
+    m_slots = int(std::ceil((past + future) / step)) + 1;
+
+    // Кольцо пусто, отсчет моментов начнется с первого update()
+    m_base_jd = 0.0;
+    m_begin = 0;
+    m_end = 0;
+
+    if(m_vbo)
+    {
+        m_gl->glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        m_gl->glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 2 * m_slots * m_count, NULL, GL_DYNAMIC_DRAW);
+        m_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void GroundTracks::update(double jd)
+{
+    if(!m_count || !m_vbo)
+        return;
+
+    if(m_job.joinable())
+    {
+        if(!m_job_done)
+            return;
+        m_job.join();
+        upload();
+    }
+
+    if(m_base_jd == 0.0)
+        m_base_jd = jd;
+    int64_t begin = (int64_t)std::floor((jd - m_past - m_base_jd) / m_step);
+    int64_t end = begin + m_slots;
+    if(begin >= m_begin && end <= m_end)
+        return;
+
+    // Сдвиг окна досчитывает только новые моменты с нужного края,
+    // разрыв с прежним окном - все окно заново
+    if(m_begin == m_end || begin > m_end || end < m_begin)
+        compute(begin, end);
+    else if(end > m_end)
+        compute(m_end, end);
+    else
+        compute(begin, m_begin);
+}
+
+void GroundTracks::compute(int64_t begin, int64_t end)
+{
+    m_job_begin = begin;
+    m_job_end = end;
+    m_job_done = false;
+
+    m_job = std::thread([this] {
+        size_t samples = m_job_end - m_job_begin;
+        size_t count = m_count;
+        m_job_positions.resize(samples * count * 3);
+        m_job_samples.resize(samples * count * 2);
+
+        // Моменты на отрезках кэша эфемерид вычисляются рядами, остальные пропагируются
+        m_job_cached.assign(samples, 0);
+        if(m_ephemeris)
+            for(size_t j = 0; j < samples; j++)
+                m_job_cached[j] = m_ephemeris->evaluate(m_base_jd + (m_job_begin + (int64_t)j) * m_step,
+                                                        m_ephemeris_indices.data(), count,
+                                                        m_job_positions.data() + j * count * 3);
+
+        // Каждая группа пропагатора целиком в одном потоке, поэтому состояние
+        // резонансного интегратора SDP4 не делится между потоками
+        size_t groups = m_propagator.groupCount();
+        unsigned threads = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(), groups));
+        std::vector<std::thread> workers;
+        for(unsigned t = 0; t < threads; t++)
+            workers.emplace_back([this, t, threads, groups, samples, count] {
+                size_t first = groups * t / threads;
+                size_t last = groups * (t + 1) / threads;
+                for(size_t j = 0; j < samples; j++)
+                {
+                    if(m_job_cached[j])
+                        continue;
+                    double jd = m_base_jd + (m_job_begin + (int64_t)j) * m_step;
+                    m_propagator.propagate(jd, 1.0f, m_job_positions.data() + j * count * 3, nullptr, first, last - first);
+                }
+            });
+        for(auto &w : workers)
+            w.join();
+        workers.clear();
+
+        // Перевод в широту и долготу поворотом TEME на звездное время. Масштаб
+        // положений (км пропагатора или единицы сцены кэша) углам не важен.
+        // Спутник с ошибкой пропагации (в центре Земли) - точка NaN
+        for(unsigned t = 0; t < threads; t++)
+            workers.emplace_back([this, t, threads, samples, count] {
+                for(size_t j = samples * t / threads; j < samples * (t + 1) / threads; j++)
+                {
+                    double jd = m_base_jd + (m_job_begin + (int64_t)j) * m_step;
+                    double g = greenwichSiderealTime(jd);
+                    double cg = std::cos(g), sg = std::sin(g);
+
+                    const float *p = m_job_positions.data() + j * count * 3;
+                    float *out = m_job_samples.data() + j * count * 2;
+                    for(size_t i = 0; i < count; i++, p += 3, out += 2)
+                    {
+                        double tx = p[0], ty = -p[2], tz = p[1];
+                        double x = cg * tx + sg * ty;
+                        double y = -sg * tx + cg * ty;
+                        if(x == 0.0 && y == 0.0 && tz == 0.0)
+                        {
+                            out[0] = out[1] = std::numeric_limits<float>::quiet_NaN();
+                            continue;
+                        }
+                        out[0] = std::atan2(tz, std::sqrt(x * x + y * y));
+                        out[1] = std::atan2(y, x);
+                    }
+                }
+            });
+        for(auto &w : workers)
+            w.join();
+
+        m_job_done = true;
+    });
+}
+
+void GroundTracks::upload()
+{
+    // Моменты идут в слоты подряд, поэтому загрузка - не больше двух диапазонов
+    m_gl->glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    int64_t k = m_job_begin;
+    while(k < m_job_end)
+    {
+        int64_t slot = ((k % m_slots) + m_slots) % m_slots;
+        int64_t run = std::min<int64_t>(m_job_end - k, m_slots - slot);
+        m_gl->glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 2 * m_count * slot,
+                              sizeof(GLfloat) * 2 * m_count * run,
+                              m_job_samples.data() + (k - m_job_begin) * m_count * 2);
+        k += run;
+    }
+    m_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if(m_begin != m_end && m_job_begin == m_end)
+    {
+        m_end = m_job_end;
+        m_begin = std::max(m_begin, m_end - m_slots);
+    }
+    else if(m_begin != m_end && m_job_end == m_begin)
+    {
+        m_begin = m_job_begin;
+        m_end = std::min(m_end, m_begin + m_slots);
+    }
+    else
+    {
+        m_begin = m_job_begin;
+        m_end = m_job_end;
+    }
+}
+
+void GroundTracks::join()
+{
+    if(m_job.joinable())
+        m_job.join();
+}
+
+void GroundTracks::bind(int unit)
+{
+    m_gl->glActiveTexture(GL_TEXTURE0 + unit);
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+}
+
+float GroundTracks::samplePosition(double jd) const
+{
+    return float((jd - m_base_jd) / m_step - m_begin);
+}
@@ -0,0 +1,97 @@
+#ifndef GROUNDTRACK_H
+#define GROUNDTRACK_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "sgp4.h"
+#include "ephemeris.h"
+
+// Окно трасс по умолчанию: минуты до и после текущего момента и шаг
+#define GROUND_TRACK_PAST 90.0
+#define GROUND_TRACK_FUTURE 90.0
+#define GROUND_TRACK_STEP 1.0
+
+// Подсчитанные трассы спутников: широта и долгота подспутниковой точки
+// (геоцентрические, радианы) с шагом по времени в окне вокруг текущего
+// момента. Земля под спутником поворачивается по звездному времени.
+// Точки хранятся на GPU в кольцевом буфере с раскладкой [слот][трасса]:
+// при сдвиге окна считаются и загружаются только новые моменты, а
+// вышедшие из окна перезаписываются. Расчет идет в фоновом потоке,
+// спутники делятся между ядрами по группам пропагатора
+class GroundTracks
+{
+    public:
+        explicit GroundTracks(QOpenGLFunctions_3_3_Core *gl);
+        ~GroundTracks();
+
+        // Буфер и текстура, вызывается в контексте GL
+        void init();
+
+        // Спутники трасс. Кольцо считается заново. Если задан кэш эфемерид
+        // каталога и номера спутников трасс в нем, моменты на подогнанных
+        // отрезках кэша берутся из него без пропагации
+        void setElements(const OrbitalElements *elements, size_t count,
+                         EphemerisCache *ephemeris = nullptr, const uint32_t *catalog_indices = nullptr);
+
+        // Окно в минутах до и после текущего момента и шаг, минуты
+        void setWindow(double past, double future, double step);
+
+        // Загрузка готового расчета и запуск следующего под момент jd.
+        // Вызывается каждый кадр в контексте GL
+        void update(double jd);
+
+        // Трасса рисуется из samples() точек подряд, начиная со слота
+        // firstSlot() кольца из slotCount() слотов. Текстура RG32F:
+        // точка трассы track в слоте slot - тексель slot * trackCount() + track
+        void bind(int unit);
+        int trackCount() const { return m_count; }
+        int slotCount() const { return m_slots; }
+        int firstSlot() const { return m_count ? int((m_begin % m_slots + m_slots) % m_slots) : 0; }
+        int samples() const { return m_count ? int(m_end - m_begin) : 0; }
+
+        // Положение момента jd на трассе в точках от первой
+        float samplePosition(double jd) const;
+
+        // Идет фоновый расчет, результат появится в одном из следующих update()
+        bool isComputing() const { return m_job.joinable(); }
+
+    private:
+        void join();
+        void compute(int64_t begin, int64_t end);
+        void upload();
+
+        QOpenGLFunctions_3_3_Core *m_gl;
+        GLuint m_vbo = 0;
+        GLuint m_texture = 0;
+
+        Sgp4Propagator m_propagator;
+        EphemerisCache *m_ephemeris = nullptr;
+        std::vector<uint32_t> m_ephemeris_indices;
+        int m_count = 0;
+        int m_slots = 0;
+        double m_past = GROUND_TRACK_PAST / 1440.0;
+        double m_future = GROUND_TRACK_FUTURE / 1440.0;
+        double m_step = GROUND_TRACK_STEP / 1440.0;
+
+        // Моменты считаются целыми номерами шагов от m_base_jd.
+        // В кольце лежат моменты [m_begin, m_end), момент k - в слоте k % m_slots
+        double m_base_jd = 0.0;
+        int64_t m_begin = 0;
+        int64_t m_end = 0;
+
+        // Фоновый расчет моментов [m_job_begin, m_job_end) в m_job_samples
+        std::thread m_job;
+        std::atomic<bool> m_job_done;
+        int64_t m_job_begin = 0;
+        int64_t m_job_end = 0;
+        std::vector<float> m_job_samples;
+        std::vector<float> m_job_positions;
+        std::vector<uint8_t> m_job_cached;
+};
+
+#endif
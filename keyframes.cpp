@@ -0,0 +1,241 @@
+#include "keyframes.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Диапазонов изменений хранилища, загружаемых по отдельности
+#define KEYFRAME_PATCH_RANGES 16
+
+MarkKeyframes::MarkKeyframes(QOpenGLFunctions_3_3_Core *gl) : m_gl(gl)
+{
+}
+
+void MarkKeyframes::init()
+{
+    m_gl->glGenBuffers(1, &m_vbo);
+    m_gl->glGenTextures(1, &m_texture);
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    m_gl->glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, m_vbo);
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void MarkKeyframes::setSpan(double seconds)
+{
+    if(seconds == m_span)
+        return;
+
+    // Метки стоят на текущем отрезке, пока не придут ключи новой сетки
+    m_span = seconds;
+    clear();
+}
+
+void MarkKeyframes::clear()
+{
+    m_keys.clear();
+    m_requested = false;
+}
+
+bool MarkKeyframes::nextRequest(double jd, double &key_jd)
+{
+    if(m_requested)
+        return false;
+
+    int64_t k = (int64_t)std::floor(jd * 86400.0 / m_span);
+    for(int64_t i = k; i <= k + 2; i++)
+    {
+        if(find(i))
+            continue;
+
+        m_requested = true;
+        key_jd = i * m_span / 86400.0;
+        return true;
+    }
+
+    return false;
+}
+
+void MarkKeyframes::insert(double key_jd, const float *positions, const float *velocities, size_t count)
+{
+    m_requested = false;
+
+    double t = key_jd * 86400.0 / m_span;
+    int64_t index = (int64_t)std::llround(t);
+    if(std::fabs(t - index) > 1e-3 || find(index))
+        return;
+
+    // Вытесняется ключ, дальше всех отстоящий от нового
+    if(m_keys.size() >= KEYFRAME_CACHE)
+    {
+        auto far = std::max_element(m_keys.begin(), m_keys.end(), [index](const Key &a, const Key &b) {
+            return std::llabs(a.index - index) < std::llabs(b.index - index);
+        });
+        m_keys.erase(far);
+    }
+
+    Key key;
+    key.index = index;
+    key.positions.assign(positions, positions + count * 3);
+    key.velocities.assign(velocities, velocities + count * 3);
+    m_keys.push_back(std::move(key));
+}
+
+bool MarkKeyframes::update(double jd, SatelliteStore &store, const std::vector<SatelliteHandle> &catalog)
+{
+    size_t count = store.size();
+    bool external = !store.dirtyRanges(SatelliteStore::Positions, KEYFRAME_PATCH_RANGES).empty();
+
+    // Отрезок под момент jd. Без одного из ключей метки стоят на другом
+    double t = jd * 86400.0 / m_span;
+    int64_t k = (int64_t)std::floor(t);
+    const Key *a = find(k);
+    const Key *b = find(k + 1);
+    float fraction = float(t - k);
+    if(!a || !b)
+    {
+        a = a ? a : b;
+        b = a;
+        fraction = 0.0f;
+    }
+
+    bool segment = a != nullptr;
+    bool changed = false;
+    if(segment != m_segment || count != m_count || (segment && (a->index != m_first || b->index != m_second)))
+    {
+        // Каталог в хранилище догоняет показанные положения, чтобы метки
+        // без ключей остались на месте. Новые положения извне важнее
+        if(m_segment && !external && count == m_count)
+        {
+            m_scratch.resize(catalog.size() * 3);
+            for(size_t c = 0; c < catalog.size(); c++)
+            {
+                size_t i = store.indexOf(catalog[c]);
+                if(i != SIZE_MAX)
+                    std::copy_n(&m_positions[i * 3], 3, &m_scratch[c * 3]);
+            }
+            store.setPositions(catalog.size(), catalog.data(), m_scratch.data());
+        }
+
+        rebuild(a, b, store, catalog);
+        m_segment = segment;
+        m_first = segment ? a->index : 0;
+        m_second = segment ? b->index : 0;
+        changed = true;
+    }
+    else if(external)
+    {
+        patch(store);
+        changed = true;
+    }
+
+    if(!changed && fraction == m_fraction)
+        return false;
+
+    m_fraction = fraction;
+    interpolate();
+    return true;
+}
+
+const MarkKeyframes::Key *MarkKeyframes::find(int64_t index) const
+{
+    for(const Key &key : m_keys)
+        if(key.index == index)
+            return &key;
+    return nullptr;
+}
+
+void MarkKeyframes::rebuild(const Key *a, const Key *b, const SatelliteStore &store, const std::vector<SatelliteHandle> &catalog)
+{
+    size_t count = store.size();
+    m_count = count;
+    m_dense.resize(count * 12);
+    m_keyed.assign(count, 0);
+
+    const float *p = store.positionData();
+    for(size_t i = 0; i < count; i++)
+    {
+        float *d = &m_dense[i * 12];
+        std::copy_n(p + i * 3, 3, d);
+        std::fill_n(d + 3, 3, 0.0f);
+        std::copy_n(p + i * 3, 3, d + 6);
+        std::fill_n(d + 9, 3, 0.0f);
+    }
+
+    // Ключи посчитаны для каталога на момент запроса; ключи другого
+    // каталога по размеру не подходят и не используются
+    if(a && a->positions.size() == catalog.size() * 3 && b->positions.size() == catalog.size() * 3)
+    {
+        for(size_t c = 0; c < catalog.size(); c++)
+        {
+            size_t i = store.indexOf(catalog[c]);
+            if(i == SIZE_MAX)
+                continue;
+
+            float *d = &m_dense[i * 12];
+            std::copy_n(&a->positions[c * 3], 3, d);
+            std::copy_n(&a->velocities[c * 3], 3, d + 3);
+            std::copy_n(&b->positions[c * 3], 3, d + 6);
+            std::copy_n(&b->velocities[c * 3], 3, d + 9);
+            m_keyed[i] = 1;
+        }
+    }
+
+    m_gl->glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    if(count > m_capacity)
+    {
+        m_capacity = std::max(count, m_capacity * 2);
+        m_gl->glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 12 * m_capacity, NULL, GL_DYNAMIC_DRAW);
+    }
+    if(count)
+        m_gl->glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * 12 * count, m_dense.data());
+    m_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MarkKeyframes::patch(SatelliteStore &store)
+{
+    // Изменения хранилища касаются только меток без ключей
+    const auto &ranges = store.dirtyRanges(SatelliteStore::Positions, KEYFRAME_PATCH_RANGES);
+    const float *p = store.positionData();
+
+    m_gl->glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    for(const auto &r : ranges)
+    {
+        size_t end = std::min(r.end, m_count);
+        if(r.begin >= end)
+            continue;
+
+        for(size_t i = r.begin; i < end; i++)
+        {
+            if(m_keyed[i])
+                continue;
+            std::copy_n(p + i * 3, 3, &m_dense[i * 12]);
+            std::copy_n(p + i * 3, 3, &m_dense[i * 12 + 6]);
+        }
+        m_gl->glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 12 * r.begin,
+                              sizeof(GLfloat) * 12 * (end - r.begin), &m_dense[r.begin * 12]);
+    }
+    m_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MarkKeyframes::interpolate()
+{
+    // Тот же сплайн, что в KEYFRAME_GLSL
+    float x = m_fraction, x2 = x * x, x3 = x2 * x;
+    float h00 = 2.0f * x3 - 3.0f * x2 + 1.0f;
+    float h01 = 3.0f * x2 - 2.0f * x3;
+    float h10 = float(m_span) * (x3 - 2.0f * x2 + x);
+    float h11 = float(m_span) * (x3 - x2);
+
+    m_positions.resize(m_count * 3);
+    for(size_t i = 0; i < m_count; i++)
+    {
+        const float *d = &m_dense[i * 12];
+        for(int c = 0; c < 3; c++)
+            m_positions[i * 3 + c] = h00 * d[c] + h01 * d[6 + c] + h10 * d[3 + c] + h11 * d[9 + c];
+    }
+}
+
+void MarkKeyframes::bind(int unit)
+{
+    m_gl->glActiveTexture(GL_TEXTURE0 + unit);
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+}
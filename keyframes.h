@@ -0,0 +1,123 @@
+#ifndef KEYFRAMES_H
+#define KEYFRAMES_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "satellitestore.h"
+
+// Настенное время между ключами, секунды, и наибольший шаг ключей в
+// секундах модели: при сильном ускорении ключи идут чаще, иначе сплайн
+// между ними уходит от орбиты
+#define KEYFRAME_INTERVAL 1.0
+#define KEYFRAME_MAX_SPAN 300.0
+
+// Ключей в кэше: отрезок текущего момента, следующий ключ и запасной
+#define KEYFRAME_CACHE 4
+
+// Точка привязки буферной текстуры ключей
+#define KEYFRAME_BINDING 3
+
+// Положение метки i на текущий момент: эрмитов сплайн по положениям и
+// скоростям двух ключей. Доля отрезка и его длина в секундах берутся из
+// key_params блока кадра, поэтому вставляется после FRAME_GLSL
+#define KEYFRAME_GLSL \
+    "layout(binding = " QT_STRINGIFY(KEYFRAME_BINDING) ") uniform samplerBuffer sat_keyframes;\n" \
+    "vec3 satellitePosition(int i) {\n" \
+    "   vec3 p0 = texelFetch(sat_keyframes, i * 4).xyz;\n" \
+    "   vec3 v0 = texelFetch(sat_keyframes, i * 4 + 1).xyz;\n" \
+    "   vec3 p1 = texelFetch(sat_keyframes, i * 4 + 2).xyz;\n" \
+    "   vec3 v1 = texelFetch(sat_keyframes, i * 4 + 3).xyz;\n" \
+    "   float x = key_params.x, x2 = x * x, x3 = x2 * x;\n" \
+    "   return (2.0 * x3 - 3.0 * x2 + 1.0) * p0 + (3.0 * x2 - 2.0 * x3) * p1 +\n" \
+    "          key_params.y * ((x3 - 2.0 * x2 + x) * v0 + (x3 - x2) * v1);\n" \
+    "}\n"
+
+// Ключевые кадры меток каталога. Положения и скорости считаются в узлах
+// сетки модельного времени с шагом span() и на GPU лежит пара ключей
+// отрезка, в котором находится текущий момент: метки движутся по сплайну
+// в вершинном шейдере каждый кадр, а новые ключи нужны раз в отрезок.
+// Та же интерполяция на CPU дает положения для отсечения и выбора меток.
+// Метки вне каталога и метки, для которых ключей еще нет, стоят на
+// положениях из SatelliteStore
+class MarkKeyframes
+{
+    public:
+        explicit MarkKeyframes(QOpenGLFunctions_3_3_Core *gl);
+
+        // Буфер и текстура, вызывается в контексте GL
+        void init();
+
+        // Шаг сетки ключей в секундах модели. Ключи прежней сетки сбрасываются
+        void setSpan(double seconds);
+        double span() const { return m_span; }
+
+        // Ключи прежнего каталога
+        void clear();
+
+        // Следующий недостающий ключ для момента jd: начало и конец отрезка
+        // и ключ за ним. Возвращает false, если все есть или ключ уже запрошен
+        bool nextRequest(double jd, double &key_jd);
+
+        // Посчитанный ключ: 3 float положения и скорости (в секунду) на спутник
+        // каталога. Ключ вне сетки (запрошенный до смены шага) отбрасывается
+        void insert(double key_jd, const float *positions, const float *velocities, size_t count);
+
+        // Выбор отрезка под момент jd, загрузка ключей при смене отрезка и
+        // изменившихся положений хранилища, интерполяция положений на CPU.
+        // Вызывается каждый кадр в контексте GL до загрузки буферов хранилища.
+        // Возвращает true, если положения меток изменились
+        bool update(double jd, SatelliteStore &store, const std::vector<SatelliteHandle> &catalog);
+
+        // Доля отрезка и его длина в секундах для key_params
+        float fraction() const { return m_fraction; }
+        float segmentSeconds() const { return float(m_span); }
+
+        // Положения меток на момент последнего update(), 3 float в плотном порядке хранилища
+        const float *positions() const { return m_positions.data(); }
+        size_t count() const { return m_count; }
+
+        void bind(int unit);
+
+    private:
+        struct Key
+        {
+            int64_t index;
+            std::vector<float> positions;
+            std::vector<float> velocities;
+        };
+
+        const Key *find(int64_t index) const;
+        void rebuild(const Key *a, const Key *b, const SatelliteStore &store, const std::vector<SatelliteHandle> &catalog);
+        void patch(SatelliteStore &store);
+        void interpolate();
+
+        QOpenGLFunctions_3_3_Core *m_gl;
+        GLuint m_vbo = 0;
+        GLuint m_texture = 0;
+        size_t m_capacity = 0;
+
+        double m_span = KEYFRAME_INTERVAL;
+        std::vector<Key> m_keys;
+        bool m_requested = false;
+
+        // Отрезок в буфере: ключи начала и конца (равны, если метки стоят на
+        // одном ключе), m_segment = false - ключей нет
+        bool m_segment = false;
+        int64_t m_first = 0;
+        int64_t m_second = 0;
+        size_t m_count = 0;
+        float m_fraction = 0.0f;
+
+        // Ключи в плотном порядке, 12 float на метку: p0, v0, p1, v1.
+        // m_keyed - метка движется по ключам, а не стоит на месте из хранилища
+        std::vector<float> m_dense;
+        std::vector<uint8_t> m_keyed;
+        std::vector<float> m_positions;
+        std::vector<float> m_scratch;
+};
+
+#endif
@@ -3,12 +3,177 @@
 
 #include <QTimer>
 #include <QObject>
+#include <QImageReader>
+#include <QDir>
+
+#include <ctime>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
-    Visualizer w;
-    w.show();
+
+    // --tiles день ночь облака: нарезка текстур высокого разрешения в пирамиду тайлов.
+    // Слои приводятся к размеру дневной карты
+    if(argc > 4 && QString(argv[1]) == "--tiles")
+    {
+        QSize size = QImageReader(argv[2]).size();
+        bool ok = buildTilePyramid(argv[2], EARTH_TILES_DIR, "day", TextureBC1) &&
+                  buildTilePyramid(argv[3], EARTH_TILES_DIR, "night", TextureBC1, size.width(), size.height()) &&
+                  buildTilePyramid(argv[4], EARTH_TILES_DIR, "clouds", TextureBC3, size.width(), size.height());
+        return ok ? 0 : 1;
+    }
+
+    // --passes станции.csv дни каталог: таблица пролетов каталога над станциями
+    // от текущего времени в CSV на stdout, время расчета - в stderr
+    if(argc > 4 && QString(argv[1]) == "--passes")
+    {
+        std::vector<GroundStation> stations;
+        std::vector<OrbitalElements> elements;
+        if(!loadStations(argv[2], stations) || !loadCatalog(argv[4], elements))
+            return 1;
+
+        PassPredictor predictor;
+        predictor.setStations(stations);
+        std::vector<SatellitePass> passes;
+        double jd = 2440587.5 + MILLS / 86400000.0;
+        long int start = MILLS;
+        predictor.predict(elements.data(), elements.size(), jd, jd + QString(argv[3]).toDouble(), passes);
+        fprintf(stderr, "Passes: %zu satellites, %zu stations, %zu passes, %ld ms\n",
+                elements.size(), predictor.stations().size(), passes.size(), (long int)(MILLS - start));
+
+        printf("catalog_number,station,aos_jd,los_jd,max_jd,max_elevation\n");
+        for(const SatellitePass &pass : passes)
+            printf("%u,%s,%.6f,%.6f,%.6f,%.2f\n", elements[pass.satellite].catalog_number,
+                   qPrintable(predictor.stations()[pass.station].name), pass.aos_jd, pass.los_jd, pass.max_jd, pass.max_elevation);
+        return 0;
+    }
+
+    // --conjunctions порог_км дни каталог: сближения объектов каталога ближе
+    // порога от текущего времени в CSV на stdout, время расчета - в stderr
+    if(argc > 4 && QString(argv[1]) == "--conjunctions")
+    {
+        std::vector<OrbitalElements> elements;
+        if(!loadCatalog(argv[4], elements))
+            return 1;
+
+        ConjunctionScreener screener;
+        screener.setThreshold(QString(argv[2]).toDouble());
+        std::vector<Conjunction> conjunctions;
+        double jd = 2440587.5 + MILLS / 86400000.0;
+        long int start = MILLS;
+        screener.screen(elements.data(), elements.size(), jd, jd + QString(argv[3]).toDouble(), conjunctions);
+        fprintf(stderr, "Conjunctions: %zu objects, %zu conjunctions, %ld ms\n",
+                elements.size(), conjunctions.size(), (long int)(MILLS - start));
+
+        printf("first,second,tca_jd,miss_km,relative_speed_km_s\n");
+        for(const Conjunction &c : conjunctions)
+            printf("%u,%u,%.6f,%.3f,%.3f\n", elements[c.first].catalog_number, elements[c.second].catalog_number,
+                   c.tca_jd, c.miss_distance, c.relative_speed);
+        return 0;
+    }
+
+    QStringList args = a.arguments();
+
+    // --headless каталог N: N кадров без окна с шагом SNAPSHOT_STEP от текущего времени
+    // в каталог/frame_00000.png и далее, в конце - скорость отрисовки
+    QString headless_dir;
+    int headless_frames = 0;
+    int headless = args.indexOf("--headless");
+    if(headless > 0 && headless + 2 < args.size())
+    {
+        headless_dir = args[headless + 1];
+        headless_frames = args[headless + 2].toInt();
+        args.removeAt(headless + 2);
+        args.removeAt(headless + 1);
+        args.removeAt(headless);
+    }
+
+    Visualizer w(headless_dir.isEmpty() ? QSize() : QSize(1080, 720));
+    if(headless_dir.isEmpty())
+        w.show();
+
+    // --profile файл.csv: замеры проходов каждого кадра, --overlay: их графики поверх сцены
+    int profile = args.indexOf("--profile");
+    if(profile > 0 && profile + 1 < args.size())
+    {
+        w.profiler().openCsv(args[profile + 1]);
+        args.removeAt(profile + 1);
+        args.removeAt(profile);
+    }
+    if(args.removeAll("--overlay"))
+        w.setProfilerOverlay(true);
+
+    // --screen порог_км: сближения каталога на сутки вперед окрашивают метки
+    double screen_km = 0.0;
+    int screen = args.indexOf("--screen");
+    if(screen > 0 && screen + 1 < args.size())
+    {
+        screen_km = args[screen + 1].toDouble();
+        args.removeAt(screen + 1);
+        args.removeAt(screen);
+    }
+
+    // --warp N: ускорение часов модели с запуска
+    int warp = args.indexOf("--warp");
+    if(warp > 0 && warp + 1 < args.size())
+    {
+        w.setTimeWarp(args[warp + 1].toDouble());
+        args.removeAt(warp + 1);
+        args.removeAt(warp);
+    }
+
+    // Необязательные аргументы: файл каталога или снимка (*.snap).
+    // Если после каталога указан снимок, он записывается и открывается
+    if(args.size() > 2)
+    {
+        if(w.saveSnapshot(args[2], args[1]))
+            w.openSnapshot(args[2]);
+    }
+    else if(args.size() > 1)
+    {
+        if(args[1].endsWith(".snap"))
+            w.openSnapshot(args[1]);
+        else
+            w.openCatalog(args[1]);
+    }
+
+    if(screen_km > 0.0)
+    {
+        double jd = 2440587.5 + MILLS / 86400000.0;
+        w.screenConjunctions(jd, jd + 1.0, screen_km);
+    }
+
+    if(!headless_dir.isEmpty())
+    {
+        QDir().mkpath(headless_dir);
+        double jd = 2440587.5 + MILLS / 86400000.0;
+
+        // Замеряется только отрисовка с чтением кадра: сжатие PNG идет в
+        // одном потоке и учитывается отдельно
+        long int render_ms = 0, save_ms = 0;
+        std::clock_t render_cpu = 0;
+        for(int i = 0; i < headless_frames; i++)
+        {
+            long int start = MILLS;
+            std::clock_t cpu_start = std::clock();
+            QImage frame = w.renderFrame(jd + i * SNAPSHOT_STEP, QVector3D(0.0f, 0.0f, 0.0f), QVector3D(0.0f, 0.0f, 1.0f), 3.0f);
+            render_cpu += std::clock() - cpu_start;
+            long int rendered = MILLS;
+            render_ms += rendered - start;
+
+            frame.save(QDir(headless_dir).filePath(QString("frame_%1.png").arg(i, 5, 10, QChar('0'))));
+            save_ms += MILLS - rendered;
+        }
+
+        // Процессорное время всех потоков на кадр позволяет сравнивать машины
+        // и число потоков llvmpipe (LP_NUM_THREADS) независимо от загрузки ядер
+        int frames = std::max(1, headless_frames);
+        float fps = headless_frames * 1000.0f / std::max(1L, render_ms);
+        double cpu_ms = double(render_cpu) * 1000.0 / CLOCKS_PER_SEC;
+        printf("Headless: %d frames, rendering %ld ms, %.2f fps, %.2f ms CPU per frame; PNG encoding %ld ms, %.2f ms per frame\n",
+               headless_frames, render_ms, fps, cpu_ms / frames, save_ms, double(save_ms) / frames);
+        return 0;
+    }
 
     return a.exec();
 }
@@ -0,0 +1,539 @@
+#include "passes.h"
+
+#include <QFile>
+#include <QStringList>
+#include <QDebug>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+bool loadStations(const QString &path, std::vector<GroundStation> &stations)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qDebug() << "Error during stations loading:" << path;
+        return false;
+    }
+
+    stations.clear();
+    while(!file.atEnd())
+    {
+        QString line = QString::fromUtf8(file.readLine()).trimmed();
+        if(line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.split(',');
+        if(fields.size() < 4)
+        {
+            qDebug() << "Damaged station entry:" << line;
+            continue;
+        }
+
+        GroundStation station;
+        station.name = fields[0].trimmed();
+        station.latitude = fields[1].toDouble();
+        station.longitude = fields[2].toDouble();
+        station.altitude = fields[3].toDouble();
+        if(fields.size() > 4)
+            station.min_elevation = fields[4].toDouble();
+        stations.push_back(station);
+    }
+    return true;
+}
+
+PassPredictor::PassPredictor()
+{
+    m_job_done = false;
+}
+
+PassPredictor::~PassPredictor()
+{
+    join();
+}
+
+void PassPredictor::setStations(const std::vector<GroundStation> &stations)
+{
+    join();
+    m_stations = stations;
+    if(m_stations.size() > PASS_MAX_STATIONS)
+    {
+        qDebug() << "Too many ground stations, ignored:" << m_stations.size() - PASS_MAX_STATIONS;
+        m_stations.resize(PASS_MAX_STATIONS);
+    }
+
+    // Геодезические координаты в земные на эллипсоиде WGS-72
+    double e2 = PASS_EARTH_FLATTENING * (2.0 - PASS_EARTH_FLATTENING);
+    m_sites.resize(m_stations.size());
+    for(size_t k = 0; k < m_stations.size(); k++)
+    {
+        const GroundStation &station = m_stations[k];
+        double lat = station.latitude * M_PI / 180.0;
+        double lon = station.longitude * M_PI / 180.0;
+        double sl = std::sin(lat), cl = std::cos(lat);
+        double radius = SGP4_EARTH_RADIUS_KM / std::sqrt(1.0 - e2 * sl * sl);
+
+        Site &site = m_sites[k];
+        site.position[0] = (radius + station.altitude) * cl * std::cos(lon);
+        site.position[1] = (radius + station.altitude) * cl * std::sin(lon);
+        site.position[2] = (radius * (1.0 - e2) + station.altitude) * sl;
+        site.up[0] = cl * std::cos(lon);
+        site.up[1] = cl * std::sin(lon);
+        site.up[2] = sl;
+        site.sin_min = std::sin(station.min_elevation * M_PI / 180.0);
+    }
+}
+
+void PassPredictor::setStep(double seconds)
+{
+    join();
+    m_step = seconds;
+}
+
+PassPredictor::Frame PassPredictor::frame(const Site &site, double jd, double scale) const
+{
+    double g = greenwichSiderealTime(jd);
+    double cg = std::cos(g), sg = std::sin(g);
+
+    // Поворот на звездное время в TEME и перестановка в оси сцены:
+    // x -> x, z -> y, y -> -z. Скорость - вращение вокруг оси z TEME
+    Frame f;
+    const double *from[2] = {site.position, site.up};
+    float *to[2] = {f.s, f.u};
+    float *rate[2] = {f.sv, f.uv};
+    for(int m = 0; m < 2; m++)
+    {
+        double k = m ? 1.0 : scale;
+        double x = (cg * from[m][0] - sg * from[m][1]) * k;
+        double y = (sg * from[m][0] + cg * from[m][1]) * k;
+        double z = from[m][2] * k;
+
+        to[m][0] = x;
+        to[m][1] = z;
+        to[m][2] = -y;
+        rate[m][0] = -PASS_EARTH_ROTATION * y;
+        rate[m][1] = 0.0f;
+        rate[m][2] = -PASS_EARTH_ROTATION * x;
+    }
+    return f;
+}
+
+// Шаг пропагации спутника, секунды: PASS_SAMPLES_PER_REV узлов на оборот,
+// у вытянутых орбит - с учетом угловой скорости в перигее
+static double propagationStep(const OrbitalElements &el)
+{
+    double e = std::min(el.eccentricity, 0.99);
+    double period = 86400.0 / std::max(el.mean_motion, 1e-3);
+    return period / PASS_SAMPLES_PER_REV * std::pow(1.0 - e * e, 1.5) / ((1.0 + e) * (1.0 + e));
+}
+
+// Кубический сплайн Эрмита по значениям и производным на концах отрезка длины h
+static inline void hermite(const float *a, const float *da, const float *b, const float *db, float x, float h, float *out)
+{
+    float x2 = x * x, x3 = x2 * x;
+    float h00 = 2.0f * x3 - 3.0f * x2 + 1.0f, h01 = 3.0f * x2 - 2.0f * x3;
+    float h10 = (x3 - 2.0f * x2 + x) * h, h11 = (x3 - x2) * h;
+    for(int c = 0; c < 3; c++)
+        out[c] = h00 * a[c] + h10 * da[c] + h01 * b[c] + h11 * db[c];
+}
+
+void PassPredictor::predict(const OrbitalElements *elements, size_t count, double begin_jd, double end_jd,
+                            std::vector<SatellitePass> &passes, unsigned threads)
+{
+    passes.clear();
+    size_t stations = m_sites.size();
+    if(!count || !stations || !(end_jd > begin_jd))
+        return;
+
+    // Шаг подгоняется, чтобы последний узел пришелся на конец окна
+    size_t steps = size_t(std::ceil((end_jd - begin_jd) * 86400.0 / m_step)) + 1;
+    double step = (end_jd - begin_jd) * 86400.0 / (steps - 1);
+
+    // Станции на узлах общие для всех задач. Последний узел пропагации
+    // может лежать за концом окна
+    std::vector<Frame> frames((steps + PASS_MAX_SUBSTEPS) * stations);
+    for(size_t j = 0; j < steps + PASS_MAX_SUBSTEPS; j++)
+        for(size_t k = 0; k < stations; k++)
+            frames[j * stations + k] = frame(m_sites[k], begin_jd + j * step / 86400.0, 1.0);
+
+    // Спутники с близким шагом пропагации попадают в одну задачу,
+    // чтобы медленные орбиты не пропагировались с шагом быстрых
+    std::vector<uint32_t> order(count);
+    std::vector<double> steps_of(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        order[i] = i;
+        steps_of[i] = propagationStep(elements[i]);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return steps_of[a] < steps_of[b]; });
+
+    // Задачи разбираются по счетчику: задачи с коротким шагом
+    // и глубококосмические считаются дольше, поэтому равного деления нет
+    size_t chunks = (count + PASS_CHUNK - 1) / PASS_CHUNK;
+    if(!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<size_t>(threads, chunks);
+
+    std::atomic<size_t> next(0);
+    std::vector<std::vector<SatellitePass>> results(threads);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; t++)
+        workers.emplace_back([&, t] {
+            Sgp4Propagator propagator;
+            for(size_t c = next++; c < chunks; c = next++)
+            {
+                size_t first = c * PASS_CHUNK;
+                predictChunk(propagator, elements, order.data() + first, std::min<size_t>(PASS_CHUNK, count - first),
+                             frames.data(), steps, begin_jd, step, results[t]);
+            }
+        });
+    for(auto &w : workers)
+        w.join();
+
+    for(const auto &r : results)
+        passes.insert(passes.end(), r.begin(), r.end());
+    std::sort(passes.begin(), passes.end(), [](const SatellitePass &a, const SatellitePass &b) {
+        if(a.aos_jd != b.aos_jd)
+            return a.aos_jd < b.aos_jd;
+        return a.satellite != b.satellite ? a.satellite < b.satellite : a.station < b.station;
+    });
+}
+
+void PassPredictor::predictChunk(Sgp4Propagator &propagator, const OrbitalElements *elements, const uint32_t *indices,
+                                 size_t n, const Frame *frames, size_t steps, double begin_jd, double step,
+                                 std::vector<SatellitePass> &passes) const
+{
+    size_t stations = m_sites.size();
+    size_t cells = n * stations;
+
+    std::vector<OrbitalElements> chunk(n);
+    double chunk_step = std::numeric_limits<double>::max();
+    for(size_t i = 0; i < n; i++)
+    {
+        chunk[i] = elements[indices[i]];
+        chunk_step = std::min(chunk_step, propagationStep(chunk[i]));
+    }
+    propagator.setElements(chunk.data(), n);
+
+    // Узлы пропагации - каждый sub-й узел просмотра
+    size_t sub = std::min<size_t>(std::max(1.0, std::floor(chunk_step / step)), PASS_MAX_SUBSTEPS);
+    float h = step, hs = sub * step;
+
+    // Отсечение по центральному углу между спутником и станцией: на отрезке
+    // узлов он меняется не больше, чем на угол, пройденный спутником и станцией.
+    // Если в обоих узлах угол больше предельного для апогея с этим запасом,
+    // спутник весь отрезок ниже порога станции (с запасом PASS_GRAZE_MARGIN)
+    std::vector<float> cos_limit(cells);
+    for(size_t i = 0; i < n; i++)
+    {
+        const OrbitalElements &el = chunk[i];
+        double motion = el.mean_motion * 2.0 * M_PI / 86400.0;
+        double apogee = std::cbrt(SGP4_MU / (motion * motion)) * (1.0 + el.eccentricity) * PASS_APOGEE_MARGIN;
+        double sweep = (2.0 * M_PI / (PASS_SAMPLES_PER_REV * propagationStep(el)) + PASS_EARTH_ROTATION) * hs;
+
+        for(size_t k = 0; k < stations; k++)
+        {
+            const Site &site = m_sites[k];
+            double radius = std::sqrt(site.position[0] * site.position[0] + site.position[1] * site.position[1] +
+                                      site.position[2] * site.position[2]);
+            double horizon = std::asin(std::max(site.sin_min - PASS_GRAZE_MARGIN, -1.0f));
+            double angle = std::acos(std::min(radius * std::cos(horizon) / apogee, 1.0)) - horizon;
+            cos_limit[k * n + i] = std::cos(std::min(angle + sweep + PASS_FILTER_MARGIN, M_PI));
+        }
+    }
+
+    // Кольцо из трех узлов пропагации: максимум уточняется на двух
+    // отрезках просмотра, которые могут захватить предыдущий узел.
+    // Состояние пролетов - по станциям, внутри станции по спутникам
+    std::vector<float> positions(3 * n * 3), velocities(3 * n * 3), current(n * 3);
+    std::vector<float> cosines(2 * cells), e1(cells), e2(cells), max_e(cells);
+    std::vector<uint32_t> list;
+    std::vector<uint8_t> any(n);
+    std::vector<double> aos(cells, std::numeric_limits<double>::quiet_NaN()), max_jd(cells);
+    size_t node = 0;
+
+    // Синус высоты в момент base + y узлов просмотра, y в [0, 2].
+    // Спутник интерполируется между узлами пропагации, станция - между
+    // узлами просмотра
+    auto elevation = [&](size_t base, size_t i, size_t k, float y)
+    {
+        size_t a = base + (y > 1.0f);
+        const Frame &fa = frames[a * stations + k];
+        const Frame &fb = frames[(a + 1) * stations + k];
+        float s[3], u[3];
+        hermite(fa.s, fa.sv, fb.s, fb.sv, y - float(a - base), h, s);
+        hermite(fa.u, fa.uv, fb.u, fb.uv, y - float(a - base), h, u);
+
+        size_t whole = base + size_t(y);
+        size_t q = std::min(whole / sub, node - 1);
+        float x = (float(whole - q * sub) + (y - float(size_t(y)))) / sub;
+        const float *pa = positions.data() + (q % 3 * n + i) * 3;
+        const float *va = velocities.data() + (q % 3 * n + i) * 3;
+        const float *pb = positions.data() + ((q + 1) % 3 * n + i) * 3;
+        const float *vb = velocities.data() + ((q + 1) % 3 * n + i) * 3;
+        float p[3];
+        hermite(pa, va, pb, vb, x, hs, p);
+
+        float dd = 0.0f, du = 0.0f, uu = 0.0f;
+        for(int c = 0; c < 3; c++)
+        {
+            float d = p[c] - s[c];
+            dd += d * d;
+            du += d * u[c];
+            uu += u[c] * u[c];
+        }
+        return du / std::sqrt(dd * uu);
+    };
+
+    // Пересечение порога на [lo, hi] делением пополам
+    auto root = [&](size_t base, size_t i, size_t k, float lo, float hi, bool rising)
+    {
+        for(int it = 0; it < PASS_ROOT_ITERATIONS; it++)
+        {
+            float mid = 0.5f * (lo + hi);
+            if((elevation(base, i, k, mid) >= m_sites[k].sin_min) == rising)
+                hi = mid;
+            else
+                lo = mid;
+        }
+        return begin_jd + (base + 0.5 * (lo + hi)) * step / 86400.0;
+    };
+
+    // Максимум на двух отрезках от base золотым сечением
+    auto maximum = [&](size_t base, size_t i, size_t k, float &y)
+    {
+        const float r = 0.618034f;
+        float lo = 0.0f, hi = 2.0f;
+        float a = hi - r * (hi - lo), b = lo + r * (hi - lo);
+        float fa = elevation(base, i, k, a), fb = elevation(base, i, k, b);
+        for(int it = 0; it < PASS_MAX_ITERATIONS; it++)
+        {
+            if(fa < fb)
+            {
+                lo = a;
+                a = b;
+                fa = fb;
+                b = lo + r * (hi - lo);
+                fb = elevation(base, i, k, b);
+            }
+            else
+            {
+                hi = b;
+                b = a;
+                fb = fa;
+                a = hi - r * (hi - lo);
+                fa = elevation(base, i, k, a);
+            }
+        }
+        y = 0.5f * (lo + hi);
+        return elevation(base, i, k, y);
+    };
+
+    auto record = [&](size_t i, size_t k, double aos_jd, double los_jd, double top_jd, float top)
+    {
+        float degrees = std::asin(std::min(std::max(top, -1.0f), 1.0f)) * 180.0 / M_PI;
+        passes.push_back({indices[i], uint32_t(k), aos_jd, los_jd, top_jd, degrees});
+    };
+
+    // Узел просмотра j: высоты активных пар и переходы через порог
+    auto screen = [&](size_t j)
+    {
+        double jd = begin_jd + j * step / 86400.0;
+        float x = float(j + sub - node * sub) / sub;
+        const float *pa = positions.data() + (node + 2) % 3 * n * 3, *pb = positions.data() + node % 3 * n * 3;
+        const float *va = velocities.data() + (node + 2) % 3 * n * 3, *vb = velocities.data() + node % 3 * n * 3;
+        for(size_t i = 0; i < n; i++)
+            if(any[i])
+                hermite(pa + i * 3, va + i * 3, pb + i * 3, vb + i * 3, x, hs, current.data() + i * 3);
+
+        // Неактивные пары пропускаются: пролета на таком отрезке нет,
+        // а грубый максимум не может на нем оказаться
+        for(uint32_t c : list)
+        {
+            size_t k = c / n, i = c % n;
+            const Frame &f = frames[j * stations + k];
+            float threshold = m_sites[k].sin_min;
+            const float *p = current.data() + i * 3;
+            float dx = p[0] - f.s[0], dy = p[1] - f.s[1], dz = p[2] - f.s[2];
+            float ec = (dx * f.u[0] + dy * f.u[1] + dz * f.u[2]) / std::sqrt(dx * dx + dy * dy + dz * dz);
+            float ep = e1[c];
+            bool open = !std::isnan(aos[c]);
+
+            if(j == 0)
+            {
+                if(ec >= threshold)
+                {
+                    aos[c] = jd;
+                    max_e[c] = ec;
+                    max_jd[c] = jd;
+                }
+            }
+            else
+            {
+                // Грубый максимум в узле j - 1: уточнение на отрезках [j - 2, j].
+                // Пролет, идущий с начала окна на спаде, уточняется на первых отрезках
+                bool peak = j >= 2 && ep >= e2[c] && ep > ec && ep >= threshold - PASS_GRAZE_MARGIN;
+                if(peak || (j == 2 && open && e2[c] > ep))
+                {
+                    float y = 0.0f;
+                    float top = maximum(j - 2, i, k, y);
+                    double top_jd = begin_jd + (j - 2 + y) * step / 86400.0;
+                    if(open && top > max_e[c])
+                    {
+                        max_e[c] = top;
+                        max_jd[c] = top_jd;
+                    }
+                    else if(!open && top >= threshold && e2[c] < threshold && ep < threshold && ec < threshold)
+                    {
+                        // Пролет целиком между узлами
+                        record(i, k, root(j - 2, i, k, 0.0f, y, true), root(j - 2, i, k, y, 2.0f, false), top_jd, top);
+                    }
+                }
+
+                if(!open && ec >= threshold)
+                {
+                    aos[c] = root(j - 1, i, k, 0.0f, 1.0f, true);
+                    max_e[c] = ec;
+                    max_jd[c] = jd;
+                }
+                else if(open && ec >= threshold && ec > max_e[c])
+                {
+                    max_e[c] = ec;
+                    max_jd[c] = jd;
+                }
+                else if(open && ec < threshold)
+                {
+                    record(i, k, aos[c], root(j - 1, i, k, 0.0f, 1.0f, false), max_jd[c], max_e[c]);
+                    aos[c] = std::numeric_limits<double>::quiet_NaN();
+                }
+            }
+
+            e2[c] = ep;
+            e1[c] = ec;
+        }
+    };
+
+    size_t nodes = (steps - 1 + sub - 1) / sub + 1;
+    for(node = 0; node < nodes; node++)
+    {
+        size_t jn = node * sub;
+        float *p = positions.data() + node % 3 * n * 3;
+        propagator.propagate(begin_jd + jn * step / 86400.0, 1.0f, p, velocities.data() + node % 3 * n * 3);
+
+        // Косинусы центрального угла до станций в узле
+        float *cos_now = cosines.data() + node % 2 * cells;
+        const float *cos_prev = cosines.data() + (node + 1) % 2 * cells;
+        for(size_t k = 0; k < stations; k++)
+        {
+            const Frame &f = frames[jn * stations + k];
+            float sr = std::sqrt(f.s[0] * f.s[0] + f.s[1] * f.s[1] + f.s[2] * f.s[2]);
+            for(size_t i = 0; i < n; i++)
+            {
+                const float *q = p + i * 3;
+                float r = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2]);
+                cos_now[k * n + i] = (q[0] * f.s[0] + q[1] * f.s[1] + q[2] * f.s[2]) / (r * sr);
+            }
+        }
+
+        if(node == 0)
+        {
+            for(size_t c = 0; c < cells; c++)
+                list.push_back(c);
+            std::fill(any.begin(), any.end(), 1);
+            screen(0);
+            continue;
+        }
+
+        // Пары, видимые хотя бы в одном конце отрезка с запасом.
+        // У остальных прежние высоты забываются
+        list.clear();
+        std::fill(any.begin(), any.end(), 0);
+        for(size_t c = 0; c < cells; c++)
+        {
+            if((cos_prev[c] >= cos_limit[c]) | (cos_now[c] >= cos_limit[c]))
+            {
+                list.push_back(c);
+                any[c % n] = 1;
+            }
+            else
+            {
+                e1[c] = -2.0f;
+                e2[c] = -2.0f;
+            }
+        }
+
+        for(size_t j = jn - sub + 1; j <= std::min(jn, steps - 1); j++)
+            screen(j);
+    }
+    node = nodes - 1;
+
+    // Незакончившиеся пролеты обрезаются концом окна, максимум
+    // уточняется на последних отрезках
+    double end_jd = begin_jd + (steps - 1) * step / 86400.0;
+    for(size_t k = 0; k < stations; k++)
+        for(size_t i = 0; i < n; i++)
+        {
+            size_t c = k * n + i;
+            if(std::isnan(aos[c]))
+                continue;
+
+            if(steps >= 3)
+            {
+                float y = 0.0f;
+                float top = maximum(steps - 3, i, k, y);
+                if(top > max_e[c])
+                {
+                    max_e[c] = top;
+                    max_jd[c] = begin_jd + (steps - 3 + y) * step / 86400.0;
+                }
+            }
+            record(i, k, aos[c], end_jd, max_jd[c], max_e[c]);
+        }
+}
+
+void PassPredictor::start(const OrbitalElements *elements, size_t count, double begin_jd, double end_jd)
+{
+    join();
+    m_job_elements.assign(elements, elements + count);
+    m_job_done = false;
+
+    m_job = std::thread([this, begin_jd, end_jd] {
+        predict(m_job_elements.data(), m_job_elements.size(), begin_jd, end_jd, m_job_passes);
+        m_job_done = true;
+        if(m_ready_callback)
+            m_ready_callback();
+    });
+}
+
+bool PassPredictor::acquire(std::vector<SatellitePass> &passes)
+{
+    if(!m_job.joinable() || !m_job_done)
+        return false;
+
+    m_job.join();
+    passes.swap(m_job_passes);
+    return true;
+}
+
+void PassPredictor::join()
+{
+    if(m_job.joinable())
+        m_job.join();
+}
+
+void PassPredictor::visibility(const float *positions, size_t count, float km_per_unit, double jd, uint32_t *masks) const
+{
+    std::fill(masks, masks + count, 0);
+    for(size_t k = 0; k < m_sites.size(); k++)
+    {
+        Frame f = frame(m_sites[k], jd, 1.0 / km_per_unit);
+        float threshold = m_sites[k].sin_min;
+        for(size_t i = 0; i < count; i++)
+        {
+            float dx = positions[i * 3] - f.s[0], dy = positions[i * 3 + 1] - f.s[1], dz = positions[i * 3 + 2] - f.s[2];
+            float du = dx * f.u[0] + dy * f.u[1] + dz * f.u[2];
+            masks[i] |= uint32_t(du >= threshold * std::sqrt(dx * dx + dy * dy + dz * dz)) << k;
+        }
+    }
+}
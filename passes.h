@@ -0,0 +1,148 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include <QString>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "sgp4.h"
+
+// Шаг просмотра высот, секунды
+#define PASS_COARSE_STEP 60.0
+
+// Узлов пропагации на оборот. Между узлами положения спутников
+// интерполируются по скоростям, поэтому шаг пропагации медленных
+// орбит много больше шага просмотра, но не больше PASS_MAX_SUBSTEPS шагов
+#define PASS_SAMPLES_PER_REV 32
+#define PASS_MAX_SUBSTEPS 64
+
+// Спутников в одной задаче потока. У задачи свой пропагатор,
+// который проходит окно от начала до конца
+#define PASS_CHUNK 256
+
+// Запас отсечения по центральному углу, радианы, и запас радиуса апогея
+#define PASS_FILTER_MARGIN 0.02
+#define PASS_APOGEE_MARGIN 1.02
+
+// Итерации уточнения: деление пополам для AOS/LOS и золотое сечение для максимума
+#define PASS_ROOT_ITERATIONS 10
+#define PASS_MAX_ITERATIONS 16
+
+// Грубый максимум ниже порога станции не больше чем на столько (синус высоты)
+// тоже уточняется: короткий пролет может целиком уместиться между узлами
+#define PASS_GRAZE_MARGIN 0.05f
+
+// Станций не больше, чем бит в маске видимости
+#define PASS_MAX_STATIONS 32
+
+// Сжатие эллипсоида WGS-72 и угловая скорость вращения Земли, рад/с
+#define PASS_EARTH_FLATTENING (1.0 / 298.26)
+#define PASS_EARTH_ROTATION 7.29211585e-5
+
+// Наземная станция
+struct GroundStation
+{
+    QString name;
+    double latitude = 0.0;        // градусы, геодезическая
+    double longitude = 0.0;       // градусы, к востоку
+    double altitude = 0.0;        // км над эллипсоидом
+    double min_elevation = 0.0;   // градусы
+};
+
+// Пролет спутника над станцией. Пролет, уже идущий в начале окна
+// или не закончившийся к его концу, обрезается границей окна
+struct SatellitePass
+{
+    uint32_t satellite;      // индекс в каталоге
+    uint32_t station;        // индекс станции
+    double aos_jd;
+    double los_jd;
+    double max_jd;
+    float max_elevation;     // градусы
+};
+
+// Станции из CSV: имя, широта, долгота, высота в км и необязательный
+// минимальный угол места. Строки с # и пустые пропускаются
+bool loadStations(const QString &path, std::vector<GroundStation> &stations);
+
+// Прогноз пролетов каталога над наземными станциями.
+// Спутники, отсортированные по шагу пропагации, делятся на задачи по
+// PASS_CHUNK, потоки разбирают их по очереди. Задача пропагирует свои
+// спутники и просматривает синус высоты над всеми станциями с шагом
+// PASS_COARSE_STEP, пропуская отрезки, на которых спутник заведомо
+// далеко от станции. Смена знака превышения над порогом и грубые
+// максимумы уточняются на эрмитовом сплайне по положениям и скоростям
+// соседних узлов, поэтому уточнение не требует новой пропагации
+class PassPredictor
+{
+    public:
+        PassPredictor();
+        ~PassPredictor();
+
+        void setStations(const std::vector<GroundStation> &stations);
+        const std::vector<GroundStation> &stations() const { return m_stations; }
+
+        // Шаг грубого просмотра, секунды
+        void setStep(double seconds);
+
+        // Синхронный расчет на интервал [begin_jd, end_jd] всеми потоками
+        // (threads = 0 - по числу ядер). Пролеты идут по возрастанию AOS
+        void predict(const OrbitalElements *elements, size_t count, double begin_jd, double end_jd,
+                     std::vector<SatellitePass> &passes, unsigned threads = 0);
+
+        // Тот же расчет в фоновом потоке. Элементы копируются.
+        // acquire() возвращает false, пока результат не готов
+        void start(const OrbitalElements *elements, size_t count, double begin_jd, double end_jd);
+        bool acquire(std::vector<SatellitePass> &passes);
+        bool isRunning() const { return m_job.joinable(); }
+
+        // Вызывается из фонового потока по окончании расчета
+        void setReadyCallback(std::function<void()> callback) { m_ready_callback = callback; }
+
+        // Маски станций, над которыми видны спутники в момент jd: бит k - станция k.
+        // positions - 3 float на спутник в осях сцены, km_per_unit - км в единице
+        void visibility(const float *positions, size_t count, float km_per_unit, double jd, uint32_t *masks) const;
+
+    private:
+        // Станция в земной системе, км
+        struct Site
+        {
+            double position[3];
+            double up[3];
+            float sin_min;
+        };
+
+        // Станция в осях сцены на момент узла: положение, вертикаль
+        // и их скорости от вращения Земли (в секунду)
+        struct Frame
+        {
+            float s[3];
+            float u[3];
+            float sv[3];
+            float uv[3];
+        };
+
+        Frame frame(const Site &site, double jd, double scale) const;
+        void predictChunk(Sgp4Propagator &propagator, const OrbitalElements *elements, const uint32_t *indices,
+                          size_t n, const Frame *frames, size_t steps, double begin_jd, double step,
+                          std::vector<SatellitePass> &passes) const;
+        void join();
+
+        std::vector<GroundStation> m_stations;
+        std::vector<Site> m_sites;
+        double m_step = PASS_COARSE_STEP;
+
+        // Фоновый расчет
+        std::thread m_job;
+        std::atomic<bool> m_job_done;
+        std::vector<OrbitalElements> m_job_elements;
+        std::vector<SatellitePass> m_job_passes;
+        std::function<void()> m_ready_callback;
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "picking.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+void SatellitePicker::update(const float *positions, size_t count)
+{
+    if(count != m_count || m_nodes.empty())
+    {
+        m_count = count;
+        build(positions);
+        return;
+    }
+
+    // Потомки всегда лежат после родителя, поэтому обратный порядок - снизу вверх
+    for(size_t i = m_nodes.size(); i-- > 0;)
+    {
+        Node &node = m_nodes[i];
+        if(node.count)
+        {
+            fitLeaf(positions, node);
+            continue;
+        }
+
+        const Node &l = m_nodes[node.first];
+        const Node &r = m_nodes[node.first + 1];
+        for(int k = 0; k < 3; k++)
+        {
+            node.min[k] = std::min(l.min[k], r.min[k]);
+            node.max[k] = std::max(l.max[k], r.max[k]);
+        }
+    }
+
+    if(area() > PICK_REBUILD_RATIO * m_built_area)
+        build(positions);
+}
+
+void SatellitePicker::build(const float *positions)
+{
+    m_nodes.clear();
+    m_indices.resize(m_count);
+    for(size_t i = 0; i < m_count; i++)
+        m_indices[i] = i;
+
+    if(m_count)
+    {
+        m_nodes.reserve(2 * (m_count / (PICK_LEAF_SIZE / 2) + 1));
+        m_nodes.resize(1);
+        split(positions, 0, 0, m_count);
+    }
+    m_built_area = area();
+}
+
+void SatellitePicker::split(const float *positions, uint32_t node, uint32_t begin, uint32_t end)
+{
+    Node &n = m_nodes[node];
+    n.first = begin;
+    n.count = end - begin;
+    fitLeaf(positions, n);
+    if(n.count <= PICK_LEAF_SIZE)
+        return;
+
+    // Деление по медиане вдоль самой длинной оси дает сбалансированное дерево
+    int axis = 0;
+    for(int k = 1; k < 3; k++)
+        if(n.max[k] - n.min[k] > n.max[axis] - n.min[axis])
+            axis = k;
+
+    uint32_t mid = (begin + end) / 2;
+    std::nth_element(m_indices.begin() + begin, m_indices.begin() + mid, m_indices.begin() + end,
+                     [positions, axis](uint32_t a, uint32_t b) { return positions[a * 3 + axis] < positions[b * 3 + axis]; });
+
+    // Ссылка на узел недействительна после добавления потомков
+    uint32_t children = m_nodes.size();
+    m_nodes.resize(children + 2);
+    m_nodes[node].first = children;
+    m_nodes[node].count = 0;
+
+    split(positions, children, begin, mid);
+    split(positions, children + 1, mid, end);
+}
+
+void SatellitePicker::fitLeaf(const float *positions, Node &node) const
+{
+    for(int k = 0; k < 3; k++)
+    {
+        node.min[k] = std::numeric_limits<float>::max();
+        node.max[k] = -std::numeric_limits<float>::max();
+    }
+
+    for(uint32_t i = node.first; i < node.first + node.count; i++)
+    {
+        const float *p = positions + m_indices[i] * 3;
+        for(int k = 0; k < 3; k++)
+        {
+            node.min[k] = std::min(node.min[k], p[k]);
+            node.max[k] = std::max(node.max[k], p[k]);
+        }
+    }
+}
+
+float SatellitePicker::area() const
+{
+    float sum = 0.0f;
+    for(const Node &n : m_nodes)
+    {
+        float x = n.max[0] - n.min[0], y = n.max[1] - n.min[1], z = n.max[2] - n.min[2];
+        sum += x * y + y * z + z * x;
+    }
+    return sum;
+}
+
+size_t SatellitePicker::pick(const float *positions, const QVector3D &origin, const QVector3D &direction,
+                             float tolerance, float occluder_radius) const
+{
+    if(m_nodes.empty())
+        return SIZE_MAX;
+
+    float o[3] = {origin.x(), origin.y(), origin.z()};
+    float d[3] = {direction.x(), direction.y(), direction.z()};
+    float inv[3] = {1.0f / d[0], 1.0f / d[1], 1.0f / d[2]};
+
+    // Метки дальше первого пересечения луча со сферой закрыты ею
+    float best_t = std::numeric_limits<float>::max();
+    float b = QVector3D::dotProduct(origin, direction);
+    float c = origin.lengthSquared() - occluder_radius * occluder_radius;
+    float disc = b * b - c;
+    if(c > 0.0f && disc >= 0.0f && -b - std::sqrt(disc) > 0.0f)
+        best_t = -b - std::sqrt(disc);
+
+    size_t best = SIZE_MAX;
+    uint32_t stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while(top)
+    {
+        const Node &node = m_nodes[stack[--top]];
+
+        // Узел расширяется на допуск на самом дальнем своем расстоянии,
+        // после чего проверяется пересечение с лучом по плоскостям
+        float half = 0.0f, center_dist = 0.0f;
+        for(int k = 0; k < 3; k++)
+        {
+            float e = 0.5f * (node.max[k] - node.min[k]);
+            float v = 0.5f * (node.max[k] + node.min[k]) - o[k];
+            half += e * e;
+            center_dist += v * v;
+        }
+        float pad = tolerance * (std::sqrt(center_dist) + std::sqrt(half));
+
+        float t_near = 0.0f, t_far = best_t;
+        for(int k = 0; k < 3; k++)
+        {
+            float t0 = (node.min[k] - pad - o[k]) * inv[k];
+            float t1 = (node.max[k] + pad - o[k]) * inv[k];
+            t_near = std::max(t_near, std::min(t0, t1));
+            t_far = std::min(t_far, std::max(t0, t1));
+        }
+        if(t_near > t_far)
+            continue;
+
+        if(!node.count)
+        {
+            stack[top++] = node.first;
+            stack[top++] = node.first + 1;
+            continue;
+        }
+
+        for(uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            const float *p = positions + m_indices[i] * 3;
+            float v[3] = {p[0] - o[0], p[1] - o[1], p[2] - o[2]};
+            float t = v[0] * d[0] + v[1] * d[1] + v[2] * d[2];
+            if(t <= 0.0f || t >= best_t)
+                continue;
+
+            float perp = v[0] * v[0] + v[1] * v[1] + v[2] * v[2] - t * t;
+            if(perp <= tolerance * tolerance * t * t)
+            {
+                best_t = t;
+                best = m_indices[i];
+            }
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,57 @@
+#ifndef PICKING_H
+#define PICKING_H
+
+#include <QVector3D>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Не больше меток в листе иерархии
+#define PICK_LEAF_SIZE 8
+
+// Во сколько раз может вырасти суммарная площадь узлов после подгонки
+// под новые положения, прежде чем иерархия строится заново
+#define PICK_REBUILD_RATIO 2.0f
+
+// Иерархия ограничивающих параллелепипедов (BVH) над положениями меток
+// для выбора метки лучом из-под курсора.
+// При неизменном числе меток иерархия не перестраивается, а подгоняется
+// под новые положения за один проход снизу вверх. Метки за орбиту уходят
+// далеко, поэтому, когда узлы слишком разрастаются, иерархия строится заново
+class SatellitePicker
+{
+    public:
+        // positions - 3 float на метку. Подгонка или построение заново
+        void update(const float *positions, size_t count);
+
+        // Ближайшая к началу луча метка, видимая не дальше tolerance радиан
+        // от луча и не закрытая сферой радиуса occluder_radius в начале
+        // координат. positions - те же, что в последнем update(),
+        // direction нормирован. SIZE_MAX - попадания нет
+        size_t pick(const float *positions, const QVector3D &origin, const QVector3D &direction,
+                    float tolerance, float occluder_radius) const;
+
+    private:
+        // Лист при count > 0: метки m_indices[first, first + count).
+        // Иначе потомки - узлы first и first + 1
+        struct Node
+        {
+            float min[3];
+            float max[3];
+            uint32_t first;
+            uint32_t count;
+        };
+
+        void build(const float *positions);
+        void split(const float *positions, uint32_t node, uint32_t begin, uint32_t end);
+        void fitLeaf(const float *positions, Node &node) const;
+        float area() const;
+
+        size_t m_count = 0;
+        std::vector<Node> m_nodes;
+        std::vector<uint32_t> m_indices;
+        float m_built_area = 0.0f;
+};
+
+#endif
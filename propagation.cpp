@@ -0,0 +1,250 @@
+#include "propagation.h"
+
+#include <algorithm>
+
+static inline uint64_t packRange(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)end << 32 | begin;
+}
+
+PropagationScheduler::PropagationScheduler(unsigned threads) :
+    m_queues(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+    m_stop = false;
+    m_pending = 0;
+    m_has_request = false;
+    m_requested_jd = 0.0;
+    m_ready = 1;
+
+    for(auto &q : m_queues)
+        q.range = 0;
+
+    for(unsigned i = 1; i < m_queues.size(); i++)
+        m_workers.emplace_back(&PropagationScheduler::workerLoop, this, i);
+    m_coordinator = std::thread(&PropagationScheduler::coordinatorLoop, this);
+}
+
+PropagationScheduler::~PropagationScheduler()
+{
+    m_stop = true;
+
+    // Захват мьютексов гарантирует, что потоки не пропустят пробуждение
+    {
+        std::lock_guard<std::mutex> lock(m_job_mutex);
+    }
+    m_job_cv.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+    }
+    m_request_cv.notify_all();
+
+    m_coordinator.join();
+    for(auto &w : m_workers)
+        w.join();
+}
+
+void PropagationScheduler::setElements(const OrbitalElements *elements, size_t count, float scale)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_propagator.setElements(elements, count);
+    m_count = count;
+    m_scale = scale;
+
+    for(auto &b : m_buffers)
+        b.assign(count * 3, 0.0f);
+    for(auto &b : m_velocity_buffers)
+        b.assign(count * 3, 0.0f);
+
+    // Кадров старого каталога больше нет
+    m_back = 0;
+    m_front = 2;
+    m_ready = 1;
+}
+
+void PropagationScheduler::request(double jd)
+{
+    // Флаг ставится под мьютексом ожидания, иначе координатор может
+    // проверить условие до записи и уснуть, пропустив пробуждение
+    m_requested_jd.store(jd);
+    {
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+        m_has_request.store(true);
+    }
+    m_request_cv.notify_one();
+}
+
+bool PropagationScheduler::acquire(const float *&positions, double &jd)
+{
+    const float *velocities;
+    return acquire(positions, velocities, jd);
+}
+
+bool PropagationScheduler::acquire(const float *&positions, const float *&velocities, double &jd)
+{
+    if(!(m_ready.load() & 4))
+        return false;
+
+    m_front = m_ready.exchange(m_front) & 3;
+    positions = m_buffers[m_front].data();
+    velocities = m_velocity_buffers[m_front].data();
+    jd = m_buffer_jd[m_front];
+    return true;
+}
+
+void PropagationScheduler::propagate(double jd, float *positions, float *velocities)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    runJob(jd, positions, velocities);
+}
+
+void PropagationScheduler::coordinatorLoop()
+{
+    while(!m_stop)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_request_mutex);
+            m_request_cv.wait(lock, [this] { return m_stop || m_has_request; });
+        }
+
+        if(m_stop)
+            break;
+        if(!m_has_request.exchange(false))
+            continue;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        double jd = m_requested_jd.load();
+        runJob(jd, m_buffers[m_back].data(), m_velocity_buffers[m_back].data());
+        m_buffer_jd[m_back] = jd;
+
+        // Публикация: задний буфер становится готовым, прежний готовый - задним
+        m_back = m_ready.exchange(m_back | 4) & 3;
+        if(m_ready_callback)
+            m_ready_callback();
+    }
+}
+
+void PropagationScheduler::workerLoop(unsigned id)
+{
+    uint32_t seen = 0;
+    for(;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_job_mutex);
+            m_job_cv.wait(lock, [&] { return m_stop || m_job_generation != seen; });
+            if(m_stop)
+                return;
+            seen = m_job_generation;
+        }
+
+        work(id);
+    }
+}
+
+void PropagationScheduler::runJob(double jd, float *positions, float *velocities)
+{
+    size_t groups = m_propagator.groupCount();
+    size_t threads = m_queues.size();
+    if(!groups)
+        return;
+
+    m_pending = groups;
+    {
+        std::lock_guard<std::mutex> lock(m_job_mutex);
+        m_job_jd = jd;
+        m_job_output = positions;
+        m_job_velocities = velocities;
+
+        // Начальное разбиение поровну, дальше балансирует кража
+        for(size_t t = 0; t < threads; t++)
+            m_queues[t].range.store(packRange(groups * t / threads, groups * (t + 1) / threads));
+
+        m_job_generation++;
+    }
+    m_job_cv.notify_all();
+
+    work(0);
+
+    // Дожидаемся групп, которые еще считают другие потоки
+    while(m_pending.load(std::memory_order_acquire) != 0)
+        std::this_thread::yield();
+}
+
+void PropagationScheduler::work(unsigned id)
+{
+    for(;;)
+    {
+        uint32_t begin, end;
+        if(pop(id, begin, end))
+        {
+            // Параметры задания видны после успешного захвата диапазона
+            m_propagator.propagate(m_job_jd, m_scale, m_job_output, m_job_velocities, begin, end - begin);
+            m_pending.fetch_sub(end - begin, std::memory_order_release);
+            continue;
+        }
+
+        if(!steal(id))
+            return;
+    }
+}
+
+bool PropagationScheduler::pop(unsigned id, uint32_t &begin, uint32_t &end)
+{
+    std::atomic<uint64_t> &range = m_queues[id].range;
+    uint64_t r = range.load(std::memory_order_acquire);
+
+    for(;;)
+    {
+        uint32_t b = (uint32_t)r;
+        uint32_t e = (uint32_t)(r >> 32);
+        if(b >= e)
+            return false;
+
+        uint32_t nb = std::min<uint32_t>(b + PROPAGATION_CHUNK, e);
+        if(range.compare_exchange_weak(r, packRange(nb, e), std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            begin = b;
+            end = nb;
+            return true;
+        }
+    }
+}
+
+bool PropagationScheduler::steal(unsigned id)
+{
+    for(;;)
+    {
+        // Жертва - поток с наибольшим остатком
+        unsigned victim = id;
+        uint32_t best = 0;
+        uint64_t r = 0;
+        for(unsigned t = 0; t < m_queues.size(); t++)
+        {
+            if(t == id)
+                continue;
+
+            uint64_t v = m_queues[t].range.load(std::memory_order_acquire);
+            uint32_t b = (uint32_t)v;
+            uint32_t e = (uint32_t)(v >> 32);
+            if(e > b && e - b > best)
+            {
+                best = e - b;
+                victim = t;
+                r = v;
+            }
+        }
+
+        if(!best)
+            return false;
+
+        // Забираем верхнюю половину, маленький остаток - целиком
+        uint32_t b = (uint32_t)r;
+        uint32_t e = (uint32_t)(r >> 32);
+        uint32_t mid = e - b > PROPAGATION_CHUNK ? b + (e - b) / 2 : b;
+        if(m_queues[victim].range.compare_exchange_strong(r, packRange(b, mid), std::memory_order_acq_rel))
+        {
+            m_queues[id].range.store(packRange(mid, e), std::memory_order_release);
+            return true;
+        }
+    }
+}
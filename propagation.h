@@ -0,0 +1,106 @@
+#ifndef PROPAGATION_H
+#define PROPAGATION_H
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include "sgp4.h"
+
+// Число групп SGP4, которое поток забирает из своей очереди за раз
+#define PROPAGATION_CHUNK 16
+
+// Параллельная пропагация каталога в фоновых потоках.
+// Группы SGP4 делятся между потоками поровну, освободившийся поток крадет
+// половину оставшегося диапазона у самого загруженного соседа.
+// Готовые положения публикуются через тройной буфер: поток отрисовки
+// забирает последний кадр без блокировок и ожидания
+class PropagationScheduler
+{
+    public:
+        // threads = 0 - по числу ядер
+        explicit PropagationScheduler(unsigned threads = 0);
+        ~PropagationScheduler();
+
+        // Замена каталога. Дожидается окончания текущего расчета,
+        // вызывается из того же потока, что и acquire()
+        void setElements(const OrbitalElements *elements, size_t count, float scale);
+
+        // Запрос расчета на момент jd. Не блокирует; если расчет уже идет,
+        // следующим будет посчитан последний запрошенный момент
+        void request(double jd);
+
+        // Последний готовый кадр. Возвращает false, если нового кадра нет.
+        // positions и velocities (3 float на спутник, скорости в единицах
+        // масштаба в секунду) действительны до следующего вызова
+        bool acquire(const float *&positions, double &jd);
+        bool acquire(const float *&positions, const float *&velocities, double &jd);
+
+        // Вызывается из фонового потока после публикации каждого кадра.
+        // Задается до первого запроса
+        void setReadyCallback(std::function<void()> callback) { m_ready_callback = callback; }
+
+        // Синхронный расчет всеми потоками в positions и, если задан, velocities
+        void propagate(double jd, float *positions, float *velocities = nullptr);
+
+        size_t size() const { return m_count; }
+        unsigned threadCount() const { return m_queues.size(); }
+
+    private:
+        // Полуинтервал групп [begin, end), упакованный в одно слово для CAS
+        struct alignas(64) Queue
+        {
+            std::atomic<uint64_t> range;
+        };
+
+        void coordinatorLoop();
+        void workerLoop(unsigned id);
+        void runJob(double jd, float *positions, float *velocities);
+        void work(unsigned id);
+        bool pop(unsigned id, uint32_t &begin, uint32_t &end);
+        bool steal(unsigned id);
+
+        Sgp4Propagator m_propagator;
+        size_t m_count = 0;
+        float m_scale = 1.0f;
+
+        // Потоки: координатор работает как поток 0, остальные - рабочие
+        std::vector<Queue> m_queues;
+        std::thread m_coordinator;
+        std::vector<std::thread> m_workers;
+        std::atomic<bool> m_stop;
+
+        // Текущее задание
+        std::mutex m_job_mutex;
+        std::condition_variable m_job_cv;
+        uint32_t m_job_generation = 0;
+        double m_job_jd = 0.0;
+        float *m_job_output = nullptr;
+        float *m_job_velocities = nullptr;
+        std::atomic<size_t> m_pending;
+
+        // Запросы потока отрисовки
+        std::mutex m_request_mutex;
+        std::condition_variable m_request_cv;
+        std::atomic<bool> m_has_request;
+        std::atomic<double> m_requested_jd;
+
+        // Каталог и буферы меняются только под этой блокировкой
+        std::mutex m_mutex;
+
+        // Тройной буфер: индекс готового буфера и бит свежести
+        std::vector<float> m_buffers[3];
+        std::vector<float> m_velocity_buffers[3];
+        double m_buffer_jd[3] = {0.0, 0.0, 0.0};
+        std::atomic<uint8_t> m_ready;
+        uint8_t m_back = 0;
+        uint8_t m_front = 2;
+        std::function<void()> m_ready_callback;
+};
+
+#endif
@@ -0,0 +1,353 @@
+#include "satellitestore.h"
+
+#include <algorithm>
+#include <functional>
+
+SatelliteHandle SatelliteStore::insert(const QVector3D &position, const QVector3D &color)
+{
+    SatelliteHandle handle;
+    append(position, color, handle);
+    return handle;
+}
+
+void SatelliteStore::insert(size_t count, const QVector3D *positions, const QVector3D &color, SatelliteHandle *handles)
+{
+    size_t reserve = m_handles.size() + count;
+    m_positions.reserve(reserve * 3);
+    m_colors.reserve(reserve * 3);
+    m_orbit_transforms.reserve(reserve * 16);
+    m_handles.reserve(reserve);
+
+    for(size_t i = 0; i < count; i++)
+    {
+        SatelliteHandle handle;
+        append(positions[i], color, handle);
+        if(handles)
+            handles[i] = handle;
+    }
+}
+
+void SatelliteStore::remove(SatelliteHandle handle)
+{
+    size_t index = denseIndex(handle);
+    if(index != SIZE_MAX)
+        swapRemove(index);
+}
+
+void SatelliteStore::remove(size_t count, const SatelliteHandle *handles)
+{
+    std::vector<size_t> indices;
+    indices.reserve(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        size_t index = denseIndex(handles[i]);
+        if(index != SIZE_MAX)
+            indices.push_back(index);
+    }
+
+    // Удаление с конца, чтобы перестановка последнего элемента не задевала
+    // еще не удаленные индексы
+    std::sort(indices.begin(), indices.end(), std::greater<size_t>());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    for(size_t index : indices)
+        swapRemove(index);
+}
+
+void SatelliteStore::clear()
+{
+    for(SatelliteHandle handle : m_handles)
+    {
+        uint32_t slot = handle & 0xffffffffu;
+        m_slot_generation[slot]++;
+        m_free_slots.push_back(slot);
+    }
+
+    m_positions.clear();
+    m_colors.clear();
+    m_orbit_transforms.clear();
+    m_orbit_offset.clear();
+    m_orbit_tilt.clear();
+    m_orbit_scale.clear();
+    m_orbit_visible.clear();
+    m_handles.clear();
+    clearDirty();
+}
+
+void SatelliteStore::setPosition(SatelliteHandle handle, const QVector3D &position)
+{
+    size_t index = denseIndex(handle);
+    if(index == SIZE_MAX)
+        return;
+
+    m_positions[index * 3 + 0] = position.x();
+    m_positions[index * 3 + 1] = position.y();
+    m_positions[index * 3 + 2] = position.z();
+    markDirty(Positions, index);
+}
+
+void SatelliteStore::setPositions(size_t count, const SatelliteHandle *handles, const QVector3D *positions)
+{
+    for(size_t i = 0; i < count; i++)
+        setPosition(handles[i], positions[i]);
+}
+
+void SatelliteStore::setPositions(size_t count, const SatelliteHandle *handles, const float *positions)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        size_t index = denseIndex(handles[i]);
+        if(index == SIZE_MAX)
+            continue;
+
+        std::copy_n(positions + i * 3, 3, &m_positions[index * 3]);
+        markDirty(Positions, index);
+    }
+}
+
+void SatelliteStore::setColor(SatelliteHandle handle, const QVector3D &color)
+{
+    size_t index = denseIndex(handle);
+    if(index == SIZE_MAX)
+        return;
+
+    m_colors[index * 3 + 0] = color.x();
+    m_colors[index * 3 + 1] = color.y();
+    m_colors[index * 3 + 2] = color.z();
+    markDirty(Colors, index);
+}
+
+void SatelliteStore::setColors(size_t count, const SatelliteHandle *handles, const QVector3D *colors)
+{
+    for(size_t i = 0; i < count; i++)
+        setColor(handles[i], colors[i]);
+}
+
+void SatelliteStore::setOrbit(SatelliteHandle handle, const QVector3D &offset, const QVector3D &tilt, const QVector3D &scale)
+{
+    size_t index = denseIndex(handle);
+    if(index == SIZE_MAX)
+        return;
+
+    // Матрица пересчитывается только при реальном изменении параметров
+    if(m_orbit_visible[index] && m_orbit_offset[index] == offset &&
+       m_orbit_tilt[index] == tilt && m_orbit_scale[index] == scale)
+        return;
+
+    m_orbit_offset[index] = offset;
+    m_orbit_tilt[index] = tilt;
+    m_orbit_scale[index] = scale;
+    m_orbit_visible[index] = 1;
+    writeOrbit(index);
+}
+
+void SatelliteStore::clearOrbit(SatelliteHandle handle)
+{
+    size_t index = denseIndex(handle);
+    if(index == SIZE_MAX || !m_orbit_visible[index])
+        return;
+
+    m_orbit_visible[index] = 0;
+    writeOrbit(index);
+}
+
+bool SatelliteStore::contains(SatelliteHandle handle) const
+{
+    return denseIndex(handle) != SIZE_MAX;
+}
+
+size_t SatelliteStore::indexOf(SatelliteHandle handle) const
+{
+    return denseIndex(handle);
+}
+
+QVector3D SatelliteStore::position(SatelliteHandle handle) const
+{
+    size_t index = denseIndex(handle);
+    if(index == SIZE_MAX)
+        return QVector3D();
+
+    return QVector3D(m_positions[index * 3], m_positions[index * 3 + 1], m_positions[index * 3 + 2]);
+}
+
+QVector3D SatelliteStore::color(SatelliteHandle handle) const
+{
+    size_t index = denseIndex(handle);
+    if(index == SIZE_MAX)
+        return QVector3D();
+
+    return QVector3D(m_colors[index * 3], m_colors[index * 3 + 1], m_colors[index * 3 + 2]);
+}
+
+const std::vector<SatelliteStore::Range> &SatelliteStore::dirtyRanges(Channel channel, size_t max_ranges)
+{
+    std::vector<Range> &ranges = m_dirty[channel];
+
+    // Слияние не сводит список меньше чем к одному диапазону
+    max_ranges = std::max<size_t>(max_ranges, 1);
+
+    if(!m_dirty_sorted[channel])
+    {
+        std::sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b) { return a.begin < b.begin; });
+        m_dirty_sorted[channel] = true;
+    }
+
+    // Слияние пересекающихся и близких диапазонов. Допустимый разрыв
+    // удваивается, пока число диапазонов не уложится в max_ranges:
+    // лишние байты дешевле лишних вызовов glBufferSubData
+    size_t gap = 0;
+    for(;;)
+    {
+        size_t out = 0;
+        for(size_t i = 0; i < ranges.size(); i++)
+        {
+            if(out > 0 && ranges[i].begin <= ranges[out - 1].end + gap)
+                ranges[out - 1].end = std::max(ranges[out - 1].end, ranges[i].end);
+            else
+                ranges[out++] = ranges[i];
+        }
+        ranges.resize(out);
+
+        if(ranges.size() <= max_ranges)
+            break;
+        gap = gap ? gap * 2 : 16;
+    }
+
+    return ranges;
+}
+
+void SatelliteStore::clearDirty()
+{
+    for(int c = 0; c < ChannelCount; c++)
+    {
+        m_dirty[c].clear();
+        m_dirty_sorted[c] = true;
+    }
+}
+
+size_t SatelliteStore::denseIndex(SatelliteHandle handle) const
+{
+    uint32_t slot = handle & 0xffffffffu;
+    uint32_t generation = handle >> 32;
+
+    if(slot >= m_slot_generation.size() || m_slot_generation[slot] != generation)
+        return SIZE_MAX;
+
+    return m_slot_index[slot];
+}
+
+size_t SatelliteStore::append(const QVector3D &position, const QVector3D &color, SatelliteHandle &handle)
+{
+    uint32_t slot;
+    if(!m_free_slots.empty())
+    {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+    }
+    else
+    {
+        slot = m_slot_generation.size();
+        m_slot_generation.push_back(1);
+        m_slot_index.push_back(0);
+    }
+
+    size_t index = m_handles.size();
+    handle = ((SatelliteHandle)m_slot_generation[slot] << 32) | slot;
+    m_slot_index[slot] = index;
+    m_handles.push_back(handle);
+
+    m_positions.push_back(position.x());
+    m_positions.push_back(position.y());
+    m_positions.push_back(position.z());
+    m_colors.push_back(color.x());
+    m_colors.push_back(color.y());
+    m_colors.push_back(color.z());
+    m_orbit_transforms.resize(m_orbit_transforms.size() + 16, 0.0f);
+    m_orbit_offset.push_back(QVector3D());
+    m_orbit_tilt.push_back(QVector3D());
+    m_orbit_scale.push_back(QVector3D());
+    m_orbit_visible.push_back(0);
+
+    markDirtyAll(index);
+    return index;
+}
+
+void SatelliteStore::swapRemove(size_t index)
+{
+    size_t last = m_handles.size() - 1;
+
+    // Слот удаляемого спутника освобождается, поколение меняется, чтобы
+    // старые дескрипторы перестали находиться
+    uint32_t slot = m_handles[index] & 0xffffffffu;
+    m_slot_generation[slot]++;
+    m_free_slots.push_back(slot);
+
+    if(index != last)
+    {
+        std::copy_n(&m_positions[last * 3], 3, &m_positions[index * 3]);
+        std::copy_n(&m_colors[last * 3], 3, &m_colors[index * 3]);
+        std::copy_n(&m_orbit_transforms[last * 16], 16, &m_orbit_transforms[index * 16]);
+        m_orbit_offset[index] = m_orbit_offset[last];
+        m_orbit_tilt[index] = m_orbit_tilt[last];
+        m_orbit_scale[index] = m_orbit_scale[last];
+        m_orbit_visible[index] = m_orbit_visible[last];
+        m_handles[index] = m_handles[last];
+        m_slot_index[m_handles[index] & 0xffffffffu] = index;
+        markDirtyAll(index);
+    }
+
+    m_positions.resize(last * 3);
+    m_colors.resize(last * 3);
+    m_orbit_transforms.resize(last * 16);
+    m_orbit_offset.pop_back();
+    m_orbit_tilt.pop_back();
+    m_orbit_scale.pop_back();
+    m_orbit_visible.pop_back();
+    m_handles.pop_back();
+}
+
+void SatelliteStore::writeOrbit(size_t index)
+{
+    float *dst = &m_orbit_transforms[index * 16];
+
+    // Нулевая матрица - признак скрытой орбиты для шейдера
+    if(!m_orbit_visible[index])
+    {
+        std::fill_n(dst, 16, 0.0f);
+    }
+    else
+    {
+        QMatrix4x4 model;
+        model.translate(m_orbit_offset[index]);
+        model.rotate(QQuaternion::fromEulerAngles(m_orbit_tilt[index]));
+        model.scale(m_orbit_scale[index]);
+        std::copy_n(model.constData(), 16, dst);
+    }
+
+    markDirty(Orbits, index);
+}
+
+void SatelliteStore::markDirty(Channel channel, size_t index)
+{
+    std::vector<Range> &ranges = m_dirty[channel];
+
+    // Последовательные обновления продлевают последний диапазон
+    if(!ranges.empty())
+    {
+        Range &back = ranges.back();
+        if(index >= back.begin && index <= back.end)
+        {
+            back.end = std::max(back.end, index + 1);
+            return;
+        }
+        if(index < back.begin)
+            m_dirty_sorted[channel] = false;
+    }
+
+    ranges.push_back({index, index + 1});
+}
+
+void SatelliteStore::markDirtyAll(size_t index)
+{
+    for(int c = 0; c < ChannelCount; c++)
+        markDirty((Channel)c, index);
+}
@@ -0,0 +1,111 @@
+#ifndef SATELLITESTORE_H
+#define SATELLITESTORE_H
+
+#include <QVector3D>
+#include <QMatrix4x4>
+#include <QQuaternion>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Цвета меток
+#define MARK_COLOR_GREEN QVector3D(0.1f, 1.0f, 0.1f)
+#define MARK_COLOR_RED QVector3D(1.0f, 0.1f, 0.1f)
+
+// Дескриптор, который хранилище никогда не выдает
+#define INVALID_SATELLITE 0
+
+// Младшие 32 бита - номер слота, старшие - поколение слота
+typedef uint64_t SatelliteHandle;
+
+// Хранилище спутников в виде структуры массивов.
+// Плотные массивы совпадают по раскладке с буферами GPU, поэтому
+// рендерер загружает их напрямую, но только в изменившихся диапазонах.
+// Дескрипторы стабильны: удаление переставляет плотные индексы, но не
+// инвалидирует дескрипторы других спутников.
+class SatelliteStore
+{
+    public:
+        // Полуинтервал [begin, end) плотных индексов
+        struct Range
+        {
+            size_t begin;
+            size_t end;
+        };
+
+        // Каналы, изменения которых отслеживаются раздельно
+        enum Channel
+        {
+            Positions = 0,
+            Colors,
+            Orbits,
+            ChannelCount
+        };
+
+        // Вставка
+        SatelliteHandle insert(const QVector3D &position, const QVector3D &color);
+        void insert(size_t count, const QVector3D *positions, const QVector3D &color, SatelliteHandle *handles);
+
+        // Удаление
+        void remove(SatelliteHandle handle);
+        void remove(size_t count, const SatelliteHandle *handles);
+        void clear();
+
+        // Обновление
+        void setPosition(SatelliteHandle handle, const QVector3D &position);
+        void setPositions(size_t count, const SatelliteHandle *handles, const QVector3D *positions);
+        void setPositions(size_t count, const SatelliteHandle *handles, const float *positions);
+        void setColor(SatelliteHandle handle, const QVector3D &color);
+        void setColors(size_t count, const SatelliteHandle *handles, const QVector3D *colors);
+        void setOrbit(SatelliteHandle handle, const QVector3D &offset, const QVector3D &tilt, const QVector3D &scale);
+        void clearOrbit(SatelliteHandle handle);
+
+        // Доступ
+        bool contains(SatelliteHandle handle) const;
+        size_t indexOf(SatelliteHandle handle) const;
+        SatelliteHandle handleAt(size_t index) const { return m_handles[index]; }
+        size_t size() const { return m_handles.size(); }
+        QVector3D position(SatelliteHandle handle) const;
+        QVector3D color(SatelliteHandle handle) const;
+        bool hasOrbit(size_t index) const { return m_orbit_visible[index] != 0; }
+
+        // Плотные массивы: 3 float на позицию и цвет, 16 float на матрицу орбиты
+        const float *positionData() const { return m_positions.data(); }
+        const float *colorData() const { return m_colors.data(); }
+        const float *orbitTransformData() const { return m_orbit_transforms.data(); }
+
+        // Изменившиеся с последнего clearDirty() диапазоны, отсортированные и
+        // слитые так, чтобы их было не больше max_ranges (0 считается за 1)
+        const std::vector<Range> &dirtyRanges(Channel channel, size_t max_ranges);
+        void clearDirty();
+
+    private:
+        size_t denseIndex(SatelliteHandle handle) const;
+        size_t append(const QVector3D &position, const QVector3D &color, SatelliteHandle &handle);
+        void swapRemove(size_t index);
+        void writeOrbit(size_t index);
+        void markDirty(Channel channel, size_t index);
+        void markDirtyAll(size_t index);
+
+        // Плотные данные
+        std::vector<float> m_positions;
+        std::vector<float> m_colors;
+        std::vector<float> m_orbit_transforms;
+        std::vector<QVector3D> m_orbit_offset;
+        std::vector<QVector3D> m_orbit_tilt;
+        std::vector<QVector3D> m_orbit_scale;
+        std::vector<uint8_t> m_orbit_visible;
+        std::vector<SatelliteHandle> m_handles;
+
+        // Таблица слотов
+        std::vector<uint32_t> m_slot_index;
+        std::vector<uint32_t> m_slot_generation;
+        std::vector<uint32_t> m_free_slots;
+
+        // Отслеживание изменений
+        std::vector<Range> m_dirty[ChannelCount];
+        bool m_dirty_sorted[ChannelCount] = {true, true, true};
+};
+
+#endif
@@ -0,0 +1,1198 @@
+#include "sgp4.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Производные константы модели
+static const double TWO_PI = 2.0 * M_PI;
+static const double X2O3 = 2.0 / 3.0;
+static const double XKE = 60.0 / std::sqrt(SGP4_EARTH_RADIUS_KM * SGP4_EARTH_RADIUS_KM * SGP4_EARTH_RADIUS_KM / SGP4_MU);
+static const double J3OJ2 = SGP4_J3 / SGP4_J2;
+static const double VKMPERSEC = SGP4_EARTH_RADIUS_KM * XKE / 60.0;
+
+// Остаток от деления без вызова fmod, чтобы цикл по полосам векторизовался.
+// Знак результата совпадает со знаком x, как у fmod
+static inline double wrap(double x)
+{
+    return x - TWO_PI * std::trunc(x / TWO_PI);
+}
+
+// Степени десяти для разбора чисел
+static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline double scale10(double value, int exponent)
+{
+    while(exponent > 22)
+    {
+        value *= 1e22;
+        exponent -= 22;
+    }
+    while(exponent < -22)
+    {
+        value /= 1e22;
+        exponent += 22;
+    }
+    return exponent >= 0 ? value * POW10[exponent] : value / POW10[-exponent];
+}
+
+double parseNumber(const char *begin, const char *end)
+{
+    const char *p = begin;
+    while(p < end && (*p == ' ' || *p == '\t'))
+        p++;
+
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    // Мантисса копится в целом, лишние цифры учитываются порядком
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for(; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+        if(digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+    if(p < end && *p == '.')
+    {
+        for(p++; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            if(digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if(p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool exp_negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+            exp_negative = *p++ == '-';
+
+        int e = 0;
+        for(; p < end && *p >= '0' && *p <= '9'; p++)
+            e = std::min(e * 10 + (*p - '0'), 1000);
+        exponent += exp_negative ? -e : e;
+    }
+
+    double value = scale10((double)mantissa, exponent);
+    return negative ? -value : value;
+}
+
+// Чтение поля фиксированной ширины из строки TLE
+static inline double tleField(const char *line, int begin, int length)
+{
+    return parseNumber(line + begin, line + begin + length);
+}
+
+// Чтение поля в формате TLE с подразумеваемой десятичной точкой: " 12345-4" = 0.12345e-4
+static double tleExpField(const char *line, int begin)
+{
+    double mantissa = parseNumber(line + begin + 1, line + begin + 6) * 1e-5;
+    int exponent = (int)parseNumber(line + begin + 6, line + begin + 8);
+    double value = scale10(mantissa, exponent);
+    return line[begin] == '-' ? -value : value;
+}
+
+bool parseTle(const char *line1, const char *line2, OrbitalElements &elements)
+{
+    if(line1[0] != '1' || line2[0] != '2')
+        return false;
+
+    elements.catalog_number = (uint32_t)tleField(line1, 2, 5);
+
+    // Эпоха: двузначный год и дробный день года
+    int year = (int)tleField(line1, 18, 2);
+    year += year < 57 ? 2000 : 1900;
+    double day = tleField(line1, 20, 12);
+    elements.epoch_jd = julianDate(year, 1, 1, 0, 0, 0.0) - 1.0 + day;
+
+    elements.bstar = tleExpField(line1, 53);
+    elements.inclination = tleField(line2, 8, 8);
+    elements.raan = tleField(line2, 17, 8);
+
+    elements.eccentricity = tleField(line2, 26, 7) * 1e-7;
+
+    elements.arg_perigee = tleField(line2, 34, 8);
+    elements.mean_anomaly = tleField(line2, 43, 8);
+    elements.mean_motion = tleField(line2, 52, 11);
+
+    return elements.mean_motion > 0.0;
+}
+
+double julianDate(int year, int month, int day, int hour, int minute, double second)
+{
+    return 367.0 * year - std::floor(7 * (year + std::floor((month + 9) / 12.0)) * 0.25) +
+           std::floor(275 * month / 9.0) + day + 1721013.5 +
+           ((second / 60.0 + minute) / 60.0 + hour) / 24.0;
+}
+
+double greenwichSiderealTime(double jd)
+{
+    double tut1 = (jd - 2451545.0) / 36525.0;
+    double temp = -6.2e-6 * tut1 * tut1 * tut1 + 0.093104 * tut1 * tut1 +
+                  (876600.0 * 3600 + 8640184.812866) * tut1 + 67310.54841;
+    temp = std::fmod(temp * (M_PI / 180.0) / 240.0, TWO_PI);
+    if(temp < 0.0)
+        temp += TWO_PI;
+    return temp;
+}
+
+void orbitEllipse(const OrbitalElements &elements, double scale, float offset[3], float tilt[3], float ellipse_scale[3])
+{
+    double no = elements.mean_motion * TWO_PI / 1440.0;
+    double a = std::pow(XKE / no, X2O3) * SGP4_EARTH_RADIUS_KM * scale;
+    double e = elements.eccentricity;
+    double b = a * std::sqrt(1.0 - e * e);
+
+    // Поворот перифокальной системы в сцене: Ry(raan) * Rx(i) * Ry(argp),
+    // так как поворот вокруг оси z TEME - это поворот вокруг оси y сцены
+    double o = elements.raan * M_PI / 180.0;
+    double i = elements.inclination * M_PI / 180.0;
+    double w = elements.arg_perigee * M_PI / 180.0;
+    double co = std::cos(o), so = std::sin(o);
+    double ci = std::cos(i), si = std::sin(i);
+    double cw = std::cos(w), sw = std::sin(w);
+
+    double m00 = co * cw - so * ci * sw;
+    double m02 = co * sw + so * ci * cw;
+    double m10 = si * sw;
+    double m11 = ci;
+    double m12 = -si * cw;
+    double m20 = -so * cw - co * ci * sw;
+    double m22 = -so * sw + co * ci * cw;
+
+    // Разложение на углы Ry(yaw) * Rx(pitch) * Rz(roll)
+    double pitch = std::asin(std::max(-1.0, std::min(1.0, -m12)));
+    double yaw, roll;
+    if(std::fabs(m12) < 0.9999999)
+    {
+        yaw = std::atan2(m02, m22);
+        roll = std::atan2(m10, m11);
+    }
+    else
+    {
+        yaw = std::atan2(-m20, m00);
+        roll = 0.0;
+    }
+
+    tilt[0] = pitch * 180.0 / M_PI;
+    tilt[1] = yaw * 180.0 / M_PI;
+    tilt[2] = roll * 180.0 / M_PI;
+
+    // Центр эллипса смещен от фокуса на a*e против направления на перигей
+    offset[0] = -a * e * m00;
+    offset[1] = -a * e * m10;
+    offset[2] = -a * e * m20;
+
+    ellipse_scale[0] = a;
+    ellipse_scale[1] = 1.0f;
+    ellipse_scale[2] = b;
+}
+
+// Восстановление исходного среднего движения (initl), рад/мин
+static double recoverMeanMotion(const OrbitalElements &el, double &ao, double &cosio, double &omeosq)
+{
+    double no = el.mean_motion * TWO_PI / 1440.0;
+    double eccsq = el.eccentricity * el.eccentricity;
+    omeosq = 1.0 - eccsq;
+    double rteosq = std::sqrt(omeosq);
+    cosio = std::cos(el.inclination * M_PI / 180.0);
+    double cosio2 = cosio * cosio;
+
+    double ak = std::pow(XKE / no, X2O3);
+    double d1 = 0.75 * SGP4_J2 * (3.0 * cosio2 - 1.0) / (rteosq * omeosq);
+    double del = d1 / (ak * ak);
+    double adel = ak * (1.0 - del * del - del * (1.0 / 3.0 + 134.0 * del * del / 81.0));
+    del = d1 / (adel * adel);
+    no = no / (1.0 + del);
+    ao = std::pow(XKE / no, X2O3);
+    return no;
+}
+
+static bool isDeepSpace(const OrbitalElements &el)
+{
+    double ao, cosio, omeosq;
+    double no = recoverMeanMotion(el, ao, cosio, omeosq);
+    return TWO_PI / no >= SGP4_DEEP_SPACE_PERIOD;
+}
+
+// Лунно-солнечные члены SDP4 (dscom)
+struct DeepCommon
+{
+    double snodm, cnodm, sinim, cosim, sinomm, cosomm, day, em, emsq, gam, rtemsq, nm;
+    double s1, s2, s3, s4, s5, s6, s7, ss1, ss2, ss3, ss4, ss5, ss6, ss7;
+    double sz1, sz2, sz3, sz11, sz12, sz13, sz21, sz22, sz23, sz31, sz32, sz33;
+    double z1, z2, z3, z11, z12, z13, z21, z22, z23, z31, z32, z33;
+};
+
+static void dscom(double epoch, double ep, double argpp, double tc, double inclp, double nodep, double np,
+                  DeepCommon &c, double &e3, double &ee2, double &peo, double &pgho, double &pho,
+                  double &pinco, double &plo, double &se2, double &se3, double &sgh2, double &sgh3,
+                  double &sgh4, double &sh2, double &sh3, double &si2, double &si3, double &sl2,
+                  double &sl3, double &sl4, double &xgh2, double &xgh3, double &xgh4, double &xh2,
+                  double &xh3, double &xi2, double &xi3, double &xl2, double &xl3, double &xl4,
+                  double &zmol, double &zmos)
+{
+    const double zes = 0.01675;
+    const double zel = 0.05490;
+    const double c1ss = 2.9864797e-6;
+    const double c1l = 4.7968065e-7;
+    const double zsinis = 0.39785416;
+    const double zcosis = 0.91744867;
+    const double zcosgs = 0.1945905;
+    const double zsings = -0.98088458;
+
+    c.nm = np;
+    c.em = ep;
+    c.snodm = std::sin(nodep);
+    c.cnodm = std::cos(nodep);
+    c.sinomm = std::sin(argpp);
+    c.cosomm = std::cos(argpp);
+    c.sinim = std::sin(inclp);
+    c.cosim = std::cos(inclp);
+    c.emsq = c.em * c.em;
+    double betasq = 1.0 - c.emsq;
+    c.rtemsq = std::sqrt(betasq);
+
+    peo = 0.0;
+    pinco = 0.0;
+    plo = 0.0;
+    pgho = 0.0;
+    pho = 0.0;
+    c.day = epoch + 18261.5 + tc / 1440.0;
+    double xnodce = std::fmod(4.5236020 - 9.2422029e-4 * c.day, TWO_PI);
+    double stem = std::sin(xnodce);
+    double ctem = std::cos(xnodce);
+    double zcosil = 0.91375164 - 0.03568096 * ctem;
+    double zsinil = std::sqrt(1.0 - zcosil * zcosil);
+    double zsinhl = 0.089683511 * stem / zsinil;
+    double zcoshl = std::sqrt(1.0 - zsinhl * zsinhl);
+    c.gam = 5.8351514 + 0.0019443680 * c.day;
+    double zx = 0.39785416 * stem / zsinil;
+    double zy = zcoshl * ctem + 0.91744867 * zsinhl * stem;
+    zx = std::atan2(zx, zy);
+    zx = c.gam + zx - xnodce;
+    double zcosgl = std::cos(zx);
+    double zsingl = std::sin(zx);
+
+    // Сначала солнечные члены, затем лунные
+    double zcosg = zcosgs;
+    double zsing = zsings;
+    double zcosi = zcosis;
+    double zsini = zsinis;
+    double zcosh = c.cnodm;
+    double zsinh = c.snodm;
+    double cc = c1ss;
+    double xnoi = 1.0 / c.nm;
+
+    for(int lsflg = 1; lsflg <= 2; lsflg++)
+    {
+        double a1 = zcosg * zcosh + zsing * zcosi * zsinh;
+        double a3 = -zsing * zcosh + zcosg * zcosi * zsinh;
+        double a7 = -zcosg * zsinh + zsing * zcosi * zcosh;
+        double a8 = zsing * zsini;
+        double a9 = zsing * zsinh + zcosg * zcosi * zcosh;
+        double a10 = zcosg * zsini;
+        double a2 = c.cosim * a7 + c.sinim * a8;
+        double a4 = c.cosim * a9 + c.sinim * a10;
+        double a5 = -c.sinim * a7 + c.cosim * a8;
+        double a6 = -c.sinim * a9 + c.cosim * a10;
+
+        double x1 = a1 * c.cosomm + a2 * c.sinomm;
+        double x2 = a3 * c.cosomm + a4 * c.sinomm;
+        double x3 = -a1 * c.sinomm + a2 * c.cosomm;
+        double x4 = -a3 * c.sinomm + a4 * c.cosomm;
+        double x5 = a5 * c.sinomm;
+        double x6 = a6 * c.sinomm;
+        double x7 = a5 * c.cosomm;
+        double x8 = a6 * c.cosomm;
+
+        c.z31 = 12.0 * x1 * x1 - 3.0 * x3 * x3;
+        c.z32 = 24.0 * x1 * x2 - 6.0 * x3 * x4;
+        c.z33 = 12.0 * x2 * x2 - 3.0 * x4 * x4;
+        c.z1 = 3.0 * (a1 * a1 + a2 * a2) + c.z31 * c.emsq;
+        c.z2 = 6.0 * (a1 * a3 + a2 * a4) + c.z32 * c.emsq;
+        c.z3 = 3.0 * (a3 * a3 + a4 * a4) + c.z33 * c.emsq;
+        c.z11 = -6.0 * a1 * a5 + c.emsq * (-24.0 * x1 * x7 - 6.0 * x3 * x5);
+        c.z12 = -6.0 * (a1 * a6 + a3 * a5) + c.emsq * (-24.0 * (x2 * x7 + x1 * x8) - 6.0 * (x3 * x6 + x4 * x5));
+        c.z13 = -6.0 * a3 * a6 + c.emsq * (-24.0 * x2 * x8 - 6.0 * x4 * x6);
+        c.z21 = 6.0 * a2 * a5 + c.emsq * (24.0 * x1 * x5 - 6.0 * x3 * x7);
+        c.z22 = 6.0 * (a4 * a5 + a2 * a6) + c.emsq * (24.0 * (x2 * x5 + x1 * x6) - 6.0 * (x4 * x7 + x3 * x8));
+        c.z23 = 6.0 * a4 * a6 + c.emsq * (24.0 * x2 * x6 - 6.0 * x4 * x8);
+        c.z1 = c.z1 + c.z1 + betasq * c.z31;
+        c.z2 = c.z2 + c.z2 + betasq * c.z32;
+        c.z3 = c.z3 + c.z3 + betasq * c.z33;
+        c.s3 = cc * xnoi;
+        c.s2 = -0.5 * c.s3 / c.rtemsq;
+        c.s4 = c.s3 * c.rtemsq;
+        c.s1 = -15.0 * c.em * c.s4;
+        c.s5 = x1 * x3 + x2 * x4;
+        c.s6 = x2 * x3 + x1 * x4;
+        c.s7 = x2 * x4 - x1 * x3;
+
+        if(lsflg == 1)
+        {
+            c.ss1 = c.s1;
+            c.ss2 = c.s2;
+            c.ss3 = c.s3;
+            c.ss4 = c.s4;
+            c.ss5 = c.s5;
+            c.ss6 = c.s6;
+            c.ss7 = c.s7;
+            c.sz1 = c.z1;
+            c.sz2 = c.z2;
+            c.sz3 = c.z3;
+            c.sz11 = c.z11;
+            c.sz12 = c.z12;
+            c.sz13 = c.z13;
+            c.sz21 = c.z21;
+            c.sz22 = c.z22;
+            c.sz23 = c.z23;
+            c.sz31 = c.z31;
+            c.sz32 = c.z32;
+            c.sz33 = c.z33;
+            zcosg = zcosgl;
+            zsing = zsingl;
+            zcosi = zcosil;
+            zsini = zsinil;
+            zcosh = zcoshl * c.cnodm + zsinhl * c.snodm;
+            zsinh = c.snodm * zcoshl - c.cnodm * zsinhl;
+            cc = c1l;
+        }
+    }
+
+    zmol = std::fmod(4.7199672 + 0.22997150 * c.day - c.gam, TWO_PI);
+    zmos = std::fmod(6.2565837 + 0.017201977 * c.day, TWO_PI);
+
+    // Солнечные члены
+    se2 = 2.0 * c.ss1 * c.ss6;
+    se3 = 2.0 * c.ss1 * c.ss7;
+    si2 = 2.0 * c.ss2 * c.sz12;
+    si3 = 2.0 * c.ss2 * (c.sz13 - c.sz11);
+    sl2 = -2.0 * c.ss3 * c.sz2;
+    sl3 = -2.0 * c.ss3 * (c.sz3 - c.sz1);
+    sl4 = -2.0 * c.ss3 * (-21.0 - 9.0 * c.emsq) * zes;
+    sgh2 = 2.0 * c.ss4 * c.sz32;
+    sgh3 = 2.0 * c.ss4 * (c.sz33 - c.sz31);
+    sgh4 = -18.0 * c.ss4 * zes;
+    sh2 = -2.0 * c.ss2 * c.sz22;
+    sh3 = -2.0 * c.ss2 * (c.sz23 - c.sz21);
+
+    // Лунные члены
+    ee2 = 2.0 * c.s1 * c.s6;
+    e3 = 2.0 * c.s1 * c.s7;
+    xi2 = 2.0 * c.s2 * c.z12;
+    xi3 = 2.0 * c.s2 * (c.z13 - c.z11);
+    xl2 = -2.0 * c.s3 * c.z2;
+    xl3 = -2.0 * c.s3 * (c.z3 - c.z1);
+    xl4 = -2.0 * c.s3 * (-21.0 - 9.0 * c.emsq) * zel;
+    xgh2 = 2.0 * c.s4 * c.z32;
+    xgh3 = 2.0 * c.s4 * (c.z33 - c.z31);
+    xgh4 = -18.0 * c.s4 * zel;
+    xh2 = -2.0 * c.s2 * c.z22;
+    xh3 = -2.0 * c.s2 * (c.z23 - c.z21);
+}
+
+void Sgp4Propagator::setElements(const OrbitalElements *elements, size_t count)
+{
+    clear();
+    m_count = count;
+    m_errors.assign(count, Ok);
+
+    // Околоземные спутники идут первыми, глубококосмические - в своих группах
+    std::vector<uint32_t> near_ids, deep_ids;
+    for(size_t i = 0; i < count; i++)
+        (isDeepSpace(elements[i]) ? deep_ids : near_ids).push_back(i);
+
+    size_t near_groups = (near_ids.size() + SGP4_LANES - 1) / SGP4_LANES;
+    size_t deep_groups = (deep_ids.size() + SGP4_LANES - 1) / SGP4_LANES;
+    m_groups.resize(near_groups + deep_groups);
+    m_deep.resize(deep_groups * SGP4_LANES);
+
+    auto fill = [&](const std::vector<uint32_t> &ids, size_t first_group, bool deep)
+    {
+        for(size_t g = 0; g * SGP4_LANES < ids.size(); g++)
+        {
+            Group &group = m_groups[first_group + g];
+            group.count = std::min<size_t>(SGP4_LANES, ids.size() - g * SGP4_LANES);
+            group.deep = deep ? g * SGP4_LANES : -1;
+
+            // Пустые полосы дублируют первый спутник группы, чтобы вычисления
+            // в них оставались конечными; их результат не записывается
+            for(int lane = 0; lane < SGP4_LANES; lane++)
+            {
+                uint32_t id = ids[g * SGP4_LANES + (lane < (int)group.count ? lane : 0)];
+                group.index[lane] = id;
+                initSatellite(elements[id], group, lane, deep ? &m_deep[group.deep + lane] : nullptr);
+            }
+        }
+    };
+
+    fill(near_ids, 0, false);
+    fill(deep_ids, near_groups, true);
+}
+
+void Sgp4Propagator::clear()
+{
+    m_groups.clear();
+    m_deep.clear();
+    m_errors.clear();
+    m_count = 0;
+}
+
+void Sgp4Propagator::initSatellite(const OrbitalElements &el, Group &g, int l, DeepSpace *ds)
+{
+    const double temp4 = 1.5e-12;
+
+    g.epoch[l] = el.epoch_jd;
+    g.bstar[l] = el.bstar;
+    g.ecco[l] = el.eccentricity;
+    g.argpo[l] = el.arg_perigee * M_PI / 180.0;
+    g.inclo[l] = el.inclination * M_PI / 180.0;
+    g.mo[l] = el.mean_anomaly * M_PI / 180.0;
+    g.nodeo[l] = el.raan * M_PI / 180.0;
+    g.invalid[l] = el.mean_motion <= 0.0 || el.eccentricity < 0.0 || el.eccentricity >= 1.0;
+
+    // Негодные элементы заменяются круговой орбитой, чтобы не портить полосу
+    OrbitalElements safe = el;
+    if(g.invalid[l])
+    {
+        safe.mean_motion = 1.0;
+        safe.eccentricity = 0.0;
+        g.ecco[l] = 0.0;
+    }
+
+    // initl
+    double ao, cosio, omeosq;
+    double no = recoverMeanMotion(safe, ao, cosio, omeosq);
+    g.no[l] = no;
+    double ecco = g.ecco[l];
+    double eccsq = ecco * ecco;
+    double rteosq = std::sqrt(omeosq);
+    double cosio2 = cosio * cosio;
+    double sinio = std::sin(g.inclo[l]);
+    double po = ao * omeosq;
+    double con42 = 1.0 - 5.0 * cosio2;
+    g.con41[l] = -con42 - cosio2 - cosio2;
+    double posq = po * po;
+    double rp = ao * (1.0 - ecco);
+
+    // sgp4init
+    double ss = 78.0 / SGP4_EARTH_RADIUS_KM + 1.0;
+    double qzms2ttemp = (120.0 - 78.0) / SGP4_EARTH_RADIUS_KM;
+    double qzms2t = qzms2ttemp * qzms2ttemp * qzms2ttemp * qzms2ttemp;
+
+    bool isimp = rp < (220.0 / SGP4_EARTH_RADIUS_KM + 1.0);
+    double sfour = ss;
+    double qzms24 = qzms2t;
+    double perige = (rp - 1.0) * SGP4_EARTH_RADIUS_KM;
+
+    // Для перигея ниже 156 км s и qoms2t изменяются
+    if(perige < 156.0)
+    {
+        sfour = perige - 78.0;
+        if(perige < 98.0)
+            sfour = 20.0;
+        double qzms24temp = (120.0 - sfour) / SGP4_EARTH_RADIUS_KM;
+        qzms24 = qzms24temp * qzms24temp * qzms24temp * qzms24temp;
+        sfour = sfour / SGP4_EARTH_RADIUS_KM + 1.0;
+    }
+    double pinvsq = 1.0 / posq;
+
+    double tsi = 1.0 / (ao - sfour);
+    double eta = ao * ecco * tsi;
+    double etasq = eta * eta;
+    double eeta = ecco * eta;
+    double psisq = std::fabs(1.0 - etasq);
+    double coef = qzms24 * std::pow(tsi, 4.0);
+    double coef1 = coef / std::pow(psisq, 3.5);
+    double cc2 = coef1 * no * (ao * (1.0 + 1.5 * etasq + eeta * (4.0 + etasq)) + 0.375 * SGP4_J2 * tsi / psisq *
+                 g.con41[l] * (8.0 + 3.0 * etasq * (8.0 + etasq)));
+    double cc1 = el.bstar * cc2;
+    double cc3 = 0.0;
+    if(ecco > 1.0e-4)
+        cc3 = -2.0 * coef * tsi * J3OJ2 * no * sinio / ecco;
+    g.x1mth2[l] = 1.0 - cosio2;
+    g.cc4[l] = 2.0 * no * coef1 * ao * omeosq *
+               (eta * (2.0 + 0.5 * etasq) + ecco * (0.5 + 2.0 * etasq) - SGP4_J2 * tsi / (ao * psisq) *
+               (-3.0 * g.con41[l] * (1.0 - 2.0 * eeta + etasq * (1.5 - 0.5 * eeta)) + 0.75 * g.x1mth2[l] *
+               (2.0 * etasq - eeta * (1.0 + etasq)) * std::cos(2.0 * g.argpo[l])));
+    g.cc5[l] = 2.0 * coef1 * ao * omeosq * (1.0 + 2.75 * (etasq + eeta) + eeta * etasq);
+    double cosio4 = cosio2 * cosio2;
+    double temp1 = 1.5 * SGP4_J2 * pinvsq * no;
+    double temp2 = 0.5 * temp1 * SGP4_J2 * pinvsq;
+    double temp3 = -0.46875 * SGP4_J4 * pinvsq * pinvsq * no;
+    g.mdot[l] = no + 0.5 * temp1 * rteosq * g.con41[l] + 0.0625 * temp2 * rteosq * (13.0 - 78.0 * cosio2 + 137.0 * cosio4);
+    g.argpdot[l] = -0.5 * temp1 * con42 + 0.0625 * temp2 * (7.0 - 114.0 * cosio2 + 395.0 * cosio4) +
+                   temp3 * (3.0 - 36.0 * cosio2 + 49.0 * cosio4);
+    double xhdot1 = -temp1 * cosio;
+    g.nodedot[l] = xhdot1 + (0.5 * temp2 * (4.0 - 19.0 * cosio2) + 2.0 * temp3 * (3.0 - 7.0 * cosio2)) * cosio;
+    double xpidot = g.argpdot[l] + g.nodedot[l];
+    g.omgcof[l] = el.bstar * cc3 * std::cos(g.argpo[l]);
+    g.xmcof[l] = 0.0;
+    if(ecco > 1.0e-4)
+        g.xmcof[l] = -X2O3 * coef * el.bstar / eeta;
+    g.nodecf[l] = 3.5 * omeosq * xhdot1 * cc1;
+    g.t2cof[l] = 1.5 * cc1;
+    if(std::fabs(cosio + 1.0) > 1.5e-12)
+        g.xlcof[l] = -0.25 * J3OJ2 * sinio * (3.0 + 5.0 * cosio) / (1.0 + cosio);
+    else
+        g.xlcof[l] = -0.25 * J3OJ2 * sinio * (3.0 + 5.0 * cosio) / temp4;
+    g.aycof[l] = -0.5 * J3OJ2 * sinio;
+    double delmotemp = 1.0 + eta * std::cos(g.mo[l]);
+    g.delmo[l] = delmotemp * delmotemp * delmotemp;
+    g.sinmao[l] = std::sin(g.mo[l]);
+    g.x7thm1[l] = 7.0 * cosio2 - 1.0;
+    g.cc1[l] = cc1;
+    g.eta[l] = eta;
+
+    // Инициализация SDP4
+    if(ds)
+    {
+        isimp = true;
+        double epoch = el.epoch_jd - 2433281.5;
+        ds->gsto = greenwichSiderealTime(el.epoch_jd);
+
+        DeepCommon c = {};
+        dscom(epoch, ecco, g.argpo[l], 0.0, g.inclo[l], g.nodeo[l], no, c,
+              ds->e3, ds->ee2, ds->peo, ds->pgho, ds->pho, ds->pinco, ds->plo, ds->se2, ds->se3,
+              ds->sgh2, ds->sgh3, ds->sgh4, ds->sh2, ds->sh3, ds->si2, ds->si3, ds->sl2, ds->sl3,
+              ds->sl4, ds->xgh2, ds->xgh3, ds->xgh4, ds->xh2, ds->xh3, ds->xi2, ds->xi3, ds->xl2,
+              ds->xl3, ds->xl4, ds->zmol, ds->zmos);
+
+        // dsinit
+        const double q22 = 1.7891679e-6;
+        const double q31 = 2.1460748e-6;
+        const double q33 = 2.2123015e-7;
+        const double root22 = 1.7891679e-6;
+        const double root44 = 7.3636953e-9;
+        const double root54 = 2.1765803e-9;
+        const double rptim = 4.37526908801129966e-3;
+        const double root32 = 3.7393792e-7;
+        const double root52 = 1.1428639e-7;
+        const double znl = 1.5835218e-4;
+        const double zns = 1.19459e-5;
+
+        double inclm = g.inclo[l];
+        double nm = c.nm;
+        double em = c.em;
+        double emsq = c.emsq;
+        double sinim = c.sinim;
+        double cosim = c.cosim;
+
+        ds->irez = 0;
+        if(nm < 0.0052359877 && nm > 0.0034906585)
+            ds->irez = 1;
+        if(nm >= 8.26e-3 && nm <= 9.24e-3 && em >= 0.5)
+            ds->irez = 2;
+
+        // Солнечные члены
+        double ses = c.ss1 * zns * c.ss5;
+        double sis = c.ss2 * zns * (c.sz11 + c.sz13);
+        double sls = -zns * c.ss3 * (c.sz1 + c.sz3 - 14.0 - 6.0 * emsq);
+        double sghs = c.ss4 * zns * (c.sz31 + c.sz33 - 6.0);
+        double shs = -zns * c.ss2 * (c.sz21 + c.sz23);
+        if(inclm < 5.2359877e-2 || inclm > M_PI - 5.2359877e-2)
+            shs = 0.0;
+        if(sinim != 0.0)
+            shs = shs / sinim;
+        double sgs = sghs - cosim * shs;
+
+        // Лунные члены
+        ds->dedt = ses + c.s1 * znl * c.s5;
+        ds->didt = sis + c.s2 * znl * (c.z11 + c.z13);
+        ds->dmdt = sls - znl * c.s3 * (c.z1 + c.z3 - 14.0 - 6.0 * emsq);
+        double sghl = c.s4 * znl * (c.z31 + c.z33 - 6.0);
+        double shll = -znl * c.s2 * (c.z21 + c.z23);
+        if(inclm < 5.2359877e-2 || inclm > M_PI - 5.2359877e-2)
+            shll = 0.0;
+        ds->domdt = sgs + sghl;
+        ds->dnodt = shs;
+        if(sinim != 0.0)
+        {
+            ds->domdt = ds->domdt - cosim / sinim * shll;
+            ds->dnodt = ds->dnodt + shll / sinim;
+        }
+
+        // Резонансные члены
+        double theta = std::fmod(ds->gsto, TWO_PI);
+        ds->d2201 = ds->d2211 = ds->d3210 = ds->d3222 = ds->d4410 = 0.0;
+        ds->d4422 = ds->d5220 = ds->d5232 = ds->d5421 = ds->d5433 = 0.0;
+        ds->del1 = ds->del2 = ds->del3 = 0.0;
+        ds->xfact = ds->xlamo = 0.0;
+
+        if(ds->irez != 0)
+        {
+            double aonv = std::pow(nm / XKE, X2O3);
+
+            // Резонанс 12-часовых орбит
+            if(ds->irez == 2)
+            {
+                double cosisq = cosim * cosim;
+                double emo = em;
+                em = ecco;
+                double emsqo = emsq;
+                emsq = eccsq;
+                double eoc = em * emsq;
+                double g201 = -0.306 - (em - 0.64) * 0.440;
+                double g211, g310, g322, g410, g422, g520, g521, g532, g533;
+
+                if(em <= 0.65)
+                {
+                    g211 = 3.616 - 13.2470 * em + 16.2900 * emsq;
+                    g310 = -19.302 + 117.3900 * em - 228.4190 * emsq + 156.5910 * eoc;
+                    g322 = -18.9068 + 109.7927 * em - 214.6334 * emsq + 146.5816 * eoc;
+                    g410 = -41.122 + 242.6940 * em - 471.0940 * emsq + 313.9530 * eoc;
+                    g422 = -146.407 + 841.8800 * em - 1629.014 * emsq + 1083.4350 * eoc;
+                    g520 = -532.114 + 3017.977 * em - 5740.032 * emsq + 3708.2760 * eoc;
+                }
+                else
+                {
+                    g211 = -72.099 + 331.819 * em - 508.738 * emsq + 266.724 * eoc;
+                    g310 = -346.844 + 1582.851 * em - 2415.925 * emsq + 1246.113 * eoc;
+                    g322 = -342.585 + 1554.908 * em - 2366.899 * emsq + 1215.972 * eoc;
+                    g410 = -1052.797 + 4758.686 * em - 7193.992 * emsq + 3651.957 * eoc;
+                    g422 = -3581.690 + 16178.110 * em - 24462.770 * emsq + 12422.520 * eoc;
+                    if(em > 0.715)
+                        g520 = -5149.66 + 29936.92 * em - 54087.36 * emsq + 31324.56 * eoc;
+                    else
+                        g520 = 1464.74 - 4664.75 * em + 3763.64 * emsq;
+                }
+                if(em < 0.7)
+                {
+                    g533 = -919.22770 + 4988.6100 * em - 9064.7700 * emsq + 5542.21 * eoc;
+                    g521 = -822.71072 + 4568.6173 * em - 8491.4146 * emsq + 5337.524 * eoc;
+                    g532 = -853.66600 + 4690.2500 * em - 8624.7700 * emsq + 5341.4 * eoc;
+                }
+                else
+                {
+                    g533 = -37995.780 + 161616.52 * em - 229838.20 * emsq + 109377.94 * eoc;
+                    g521 = -51752.104 + 218913.95 * em - 309468.16 * emsq + 146349.42 * eoc;
+                    g532 = -40023.880 + 170470.89 * em - 242699.48 * emsq + 115605.82 * eoc;
+                }
+
+                double sini2 = sinim * sinim;
+                double f220 = 0.75 * (1.0 + 2.0 * cosim + cosisq);
+                double f221 = 1.5 * sini2;
+                double f321 = 1.875 * sinim * (1.0 - 2.0 * cosim - 3.0 * cosisq);
+                double f322 = -1.875 * sinim * (1.0 + 2.0 * cosim - 3.0 * cosisq);
+                double f441 = 35.0 * sini2 * f220;
+                double f442 = 39.3750 * sini2 * sini2;
+                double f522 = 9.84375 * sinim * (sini2 * (1.0 - 2.0 * cosim - 5.0 * cosisq) +
+                              0.33333333 * (-2.0 + 4.0 * cosim + 6.0 * cosisq));
+                double f523 = sinim * (4.92187512 * sini2 * (-2.0 - 4.0 * cosim + 10.0 * cosisq) +
+                              6.56250012 * (1.0 + 2.0 * cosim - 3.0 * cosisq));
+                double f542 = 29.53125 * sinim * (2.0 - 8.0 * cosim + cosisq * (-12.0 + 8.0 * cosim + 10.0 * cosisq));
+                double f543 = 29.53125 * sinim * (-2.0 - 8.0 * cosim + cosisq * (12.0 + 8.0 * cosim - 10.0 * cosisq));
+                double xno2 = nm * nm;
+                double ainv2 = aonv * aonv;
+                double t1 = 3.0 * xno2 * ainv2;
+                double t = t1 * root22;
+                ds->d2201 = t * f220 * g201;
+                ds->d2211 = t * f221 * g211;
+                t1 = t1 * aonv;
+                t = t1 * root32;
+                ds->d3210 = t * f321 * g310;
+                ds->d3222 = t * f322 * g322;
+                t1 = t1 * aonv;
+                t = 2.0 * t1 * root44;
+                ds->d4410 = t * f441 * g410;
+                ds->d4422 = t * f442 * g422;
+                t1 = t1 * aonv;
+                t = t1 * root52;
+                ds->d5220 = t * f522 * g520;
+                ds->d5232 = t * f523 * g532;
+                t = 2.0 * t1 * root54;
+                ds->d5421 = t * f542 * g521;
+                ds->d5433 = t * f543 * g533;
+                ds->xlamo = std::fmod(g.mo[l] + g.nodeo[l] + g.nodeo[l] - theta - theta, TWO_PI);
+                ds->xfact = g.mdot[l] + ds->dmdt + 2.0 * (g.nodedot[l] + ds->dnodt - rptim) - no;
+                em = emo;
+                emsq = emsqo;
+            }
+
+            // Резонанс синхронных орбит
+            if(ds->irez == 1)
+            {
+                double g200 = 1.0 + emsq * (-2.5 + 0.8125 * emsq);
+                double g310 = 1.0 + 2.0 * emsq;
+                double g300 = 1.0 + emsq * (-6.0 + 6.60937 * emsq);
+                double f220 = 0.75 * (1.0 + cosim) * (1.0 + cosim);
+                double f311 = 0.9375 * sinim * sinim * (1.0 + 3.0 * cosim) - 0.75 * (1.0 + cosim);
+                double f330 = 1.0 + cosim;
+                f330 = 1.875 * f330 * f330 * f330;
+                ds->del1 = 3.0 * nm * nm * aonv * aonv;
+                ds->del2 = 2.0 * ds->del1 * f220 * g200 * q22;
+                ds->del3 = 3.0 * ds->del1 * f330 * g300 * q33 * aonv;
+                ds->del1 = ds->del1 * f311 * g310 * q31 * aonv;
+                ds->xlamo = std::fmod(g.mo[l] + g.nodeo[l] + g.argpo[l] - theta, TWO_PI);
+                ds->xfact = g.mdot[l] + xpidot - rptim + ds->dmdt + ds->domdt + ds->dnodt - no;
+            }
+        }
+
+        ds->xli = ds->xlamo;
+        ds->xni = no;
+        ds->atime = 0.0;
+    }
+
+    g.simple[l] = isimp ? 1.0 : 0.0;
+
+    // Коэффициенты, нужные только полной модели
+    g.d2[l] = g.d3[l] = g.d4[l] = 0.0;
+    g.t3cof[l] = g.t4cof[l] = g.t5cof[l] = 0.0;
+    if(!isimp)
+    {
+        double cc1sq = cc1 * cc1;
+        g.d2[l] = 4.0 * ao * tsi * cc1sq;
+        double temp = g.d2[l] * tsi * cc1 / 3.0;
+        g.d3[l] = (17.0 * ao + sfour) * temp;
+        g.d4[l] = 0.5 * temp * ao * tsi * (221.0 * ao + 31.0 * sfour) * cc1;
+        g.t3cof[l] = g.d2[l] + 2.0 * cc1sq;
+        g.t4cof[l] = 0.25 * (3.0 * g.d3[l] + cc1 * (12.0 * g.d2[l] + 10.0 * cc1sq));
+        g.t5cof[l] = 0.2 * (3.0 * g.d4[l] + 12.0 * cc1 * g.d3[l] + 6.0 * g.d2[l] * g.d2[l] +
+                     15.0 * cc1sq * (2.0 * g.d2[l] + cc1sq));
+    }
+}
+
+// Резонансный интегратор SDP4 (dspace)
+static void dspace(Sgp4Propagator::Error &, double t, double argpo, double argpdot, double no,
+                   int irez, double d2201, double d2211, double d3210, double d3222, double d4410,
+                   double d4422, double d5220, double d5232, double d5421, double d5433, double dedt,
+                   double del1, double del2, double del3, double didt, double dmdt, double dnodt,
+                   double domdt, double gsto, double xfact, double xlamo, double &atime, double &xli,
+                   double &xni, double &em, double &argpm, double &inclm, double &mm, double &nodem, double &nm)
+{
+    const double fasx2 = 0.13130908;
+    const double fasx4 = 2.8843198;
+    const double fasx6 = 0.37448087;
+    const double g22 = 5.7686396;
+    const double g32 = 0.95240898;
+    const double g44 = 1.8014998;
+    const double g52 = 1.0508330;
+    const double g54 = 4.4108898;
+    const double rptim = 4.37526908801129966e-3;
+    const double stepp = 720.0;
+    const double stepn = -720.0;
+    const double step2 = 259200.0;
+
+    double theta = std::fmod(gsto + t * rptim, TWO_PI);
+    em = em + dedt * t;
+    inclm = inclm + didt * t;
+    argpm = argpm + domdt * t;
+    nodem = nodem + dnodt * t;
+    mm = mm + dmdt * t;
+
+    if(irez == 0)
+        return;
+
+    // Интегрирование продолжается с прошлой точки, если она по ту же сторону от эпохи
+    if(atime == 0.0 || t * atime <= 0.0 || std::fabs(t) < std::fabs(atime))
+    {
+        atime = 0.0;
+        xni = no;
+        xli = xlamo;
+    }
+    double delt = t > 0.0 ? stepp : stepn;
+
+    double xndt, xldot, xnddt, ft = 0.0;
+    for(;;)
+    {
+        if(irez != 2)
+        {
+            // Околосинхронный резонанс
+            xndt = del1 * std::sin(xli - fasx2) + del2 * std::sin(2.0 * (xli - fasx4)) +
+                   del3 * std::sin(3.0 * (xli - fasx6));
+            xldot = xni + xfact;
+            xnddt = del1 * std::cos(xli - fasx2) + 2.0 * del2 * std::cos(2.0 * (xli - fasx4)) +
+                    3.0 * del3 * std::cos(3.0 * (xli - fasx6));
+            xnddt = xnddt * xldot;
+        }
+        else
+        {
+            // Полусуточный резонанс
+            double xomi = argpo + argpdot * atime;
+            double x2omi = xomi + xomi;
+            double x2li = xli + xli;
+            xndt = d2201 * std::sin(x2omi + xli - g22) + d2211 * std::sin(xli - g22) +
+                   d3210 * std::sin(xomi + xli - g32) + d3222 * std::sin(-xomi + xli - g32) +
+                   d4410 * std::sin(x2omi + x2li - g44) + d4422 * std::sin(x2li - g44) +
+                   d5220 * std::sin(xomi + xli - g52) + d5232 * std::sin(-xomi + xli - g52) +
+                   d5421 * std::sin(xomi + x2li - g54) + d5433 * std::sin(-xomi + x2li - g54);
+            xldot = xni + xfact;
+            xnddt = d2201 * std::cos(x2omi + xli - g22) + d2211 * std::cos(xli - g22) +
+                    d3210 * std::cos(xomi + xli - g32) + d3222 * std::cos(-xomi + xli - g32) +
+                    d5220 * std::cos(xomi + xli - g52) + d5232 * std::cos(-xomi + xli - g52) +
+                    2.0 * (d4410 * std::cos(x2omi + x2li - g44) + d4422 * std::cos(x2li - g44) +
+                    d5421 * std::cos(xomi + x2li - g54) + d5433 * std::cos(-xomi + x2li - g54));
+            xnddt = xnddt * xldot;
+        }
+
+        if(std::fabs(t - atime) < stepp)
+        {
+            ft = t - atime;
+            break;
+        }
+
+        xli = xli + xldot * delt + xndt * step2;
+        xni = xni + xndt * delt + xnddt * step2;
+        atime = atime + delt;
+    }
+
+    nm = xni + xndt * ft + xnddt * ft * ft * 0.5;
+    double xl = xli + xldot * ft + xndt * ft * ft * 0.5;
+    if(irez != 1)
+        mm = xl - 2.0 * nodem + 2.0 * theta;
+    else
+        mm = xl - nodem - argpm + theta;
+}
+
+// Лунно-солнечные периодические члены SDP4 (dpper)
+static void dpper(const double t, const double e3, const double ee2, const double peo, const double pgho,
+                  const double pho, const double pinco, const double plo, const double se2, const double se3,
+                  const double sgh2, const double sgh3, const double sgh4, const double sh2, const double sh3,
+                  const double si2, const double si3, const double sl2, const double sl3, const double sl4,
+                  const double xgh2, const double xgh3, const double xgh4, const double xh2, const double xh3,
+                  const double xi2, const double xi3, const double xl2, const double xl3, const double xl4,
+                  const double zmol, const double zmos,
+                  double &ep, double &inclp, double &nodep, double &argpp, double &mp)
+{
+    const double zns = 1.19459e-5;
+    const double zes = 0.01675;
+    const double znl = 1.5835218e-4;
+    const double zel = 0.05490;
+
+    double zm = zmos + zns * t;
+    double zf = zm + 2.0 * zes * std::sin(zm);
+    double sinzf = std::sin(zf);
+    double f2 = 0.5 * sinzf * sinzf - 0.25;
+    double f3 = -0.5 * sinzf * std::cos(zf);
+    double ses = se2 * f2 + se3 * f3;
+    double sis = si2 * f2 + si3 * f3;
+    double sls = sl2 * f2 + sl3 * f3 + sl4 * sinzf;
+    double sghs = sgh2 * f2 + sgh3 * f3 + sgh4 * sinzf;
+    double shs = sh2 * f2 + sh3 * f3;
+    zm = zmol + znl * t;
+    zf = zm + 2.0 * zel * std::sin(zm);
+    sinzf = std::sin(zf);
+    f2 = 0.5 * sinzf * sinzf - 0.25;
+    f3 = -0.5 * sinzf * std::cos(zf);
+    double sel = ee2 * f2 + e3 * f3;
+    double sil = xi2 * f2 + xi3 * f3;
+    double sll = xl2 * f2 + xl3 * f3 + xl4 * sinzf;
+    double sghl = xgh2 * f2 + xgh3 * f3 + xgh4 * sinzf;
+    double shll = xh2 * f2 + xh3 * f3;
+
+    double pe = ses + sel - peo;
+    double pinc = sis + sil - pinco;
+    double pl = sls + sll - plo;
+    double pgh = sghs + sghl - pgho;
+    double ph = shs + shll - pho;
+    inclp = inclp + pinc;
+    ep = ep + pe;
+    double sinip = std::sin(inclp);
+    double cosip = std::cos(inclp);
+
+    if(inclp >= 0.2)
+    {
+        ph = ph / sinip;
+        pgh = pgh - cosip * ph;
+        argpp = argpp + pgh;
+        nodep = nodep + ph;
+        mp = mp + pl;
+    }
+    else
+    {
+        // Модификация Лиддейна для малых наклонений
+        double sinop = std::sin(nodep);
+        double cosop = std::cos(nodep);
+        double alfdp = sinip * sinop;
+        double betdp = sinip * cosop;
+        double dalf = ph * cosop + pinc * cosip * sinop;
+        double dbet = -ph * sinop + pinc * cosip * cosop;
+        alfdp = alfdp + dalf;
+        betdp = betdp + dbet;
+        nodep = std::fmod(nodep, TWO_PI);
+        double xls = mp + argpp + cosip * nodep;
+        double dls = pl + pgh - pinc * nodep * sinip;
+        xls = xls + dls;
+        double xnoh = nodep;
+        nodep = std::atan2(alfdp, betdp);
+        if(std::fabs(xnoh - nodep) > M_PI)
+        {
+            if(nodep < xnoh)
+                nodep = nodep + TWO_PI;
+            else
+                nodep = nodep - TWO_PI;
+        }
+        mp = mp + pl;
+        argpp = xls - mp - cosip * nodep;
+    }
+}
+
+void Sgp4Propagator::propagate(double jd, float scale, float *positions, float *velocities,
+                               size_t first_group, size_t group_count)
+{
+    size_t end = std::min(first_group + group_count, m_groups.size());
+    for(size_t g = first_group; g < end; g++)
+        propagateGroup(m_groups[g], jd, scale, positions, velocities);
+}
+
+void Sgp4Propagator::propagate(double jd, float scale, float *positions, float *velocities)
+{
+    propagate(jd, scale, positions, velocities, 0, m_groups.size());
+}
+
+void Sgp4Propagator::propagateGroup(Group &g, double jd, float scale, float *positions, float *velocities)
+{
+    const int L = SGP4_LANES;
+    const double temp4 = 1.5e-12;
+
+    double t[L], mm[L], argpm[L], nodem[L], tempa[L], tempe[L], templ[L], nm[L], em[L], inclm[L];
+    double aycof[L], xlcof[L], con41[L], x1mth2[L], x7thm1[L], sinip[L], cosip[L];
+    double ep[L], xincp[L], argpp[L], nodep[L], mp[L], am[L];
+    uint8_t err[L];
+
+    // Вековые возмущения от гравитации и сопротивления атмосферы
+    for(int l = 0; l < L; l++)
+    {
+        t[l] = (jd - g.epoch[l]) * 1440.0;
+
+        double xmdf = g.mo[l] + g.mdot[l] * t[l];
+        double argpdf = g.argpo[l] + g.argpdot[l] * t[l];
+        double nodedf = g.nodeo[l] + g.nodedot[l] * t[l];
+        double t2 = t[l] * t[l];
+        double t3 = t2 * t[l];
+        double t4 = t3 * t[l];
+        nodem[l] = nodedf + g.nodecf[l] * t2;
+
+        double delomg = g.omgcof[l] * t[l];
+        double delmtemp = 1.0 + g.eta[l] * std::cos(xmdf);
+        double delm = g.xmcof[l] * (delmtemp * delmtemp * delmtemp - g.delmo[l]);
+        double temp = delomg + delm;
+
+        bool full = g.simple[l] == 0.0;
+        mm[l] = full ? xmdf + temp : xmdf;
+        argpm[l] = full ? argpdf - temp : argpdf;
+        tempa[l] = 1.0 - g.cc1[l] * t[l] - (full ? g.d2[l] * t2 + g.d3[l] * t3 + g.d4[l] * t4 : 0.0);
+        tempe[l] = g.bstar[l] * g.cc4[l] * t[l] + (full ? g.bstar[l] * g.cc5[l] * (std::sin(mm[l]) - g.sinmao[l]) : 0.0);
+        templ[l] = g.t2cof[l] * t2 + (full ? g.t3cof[l] * t3 + t4 * (g.t4cof[l] + t[l] * g.t5cof[l]) : 0.0);
+
+        nm[l] = g.no[l];
+        em[l] = g.ecco[l];
+        inclm[l] = g.inclo[l];
+        err[l] = g.invalid[l] ? EccentricityOutOfRange : Ok;
+    }
+
+    // Резонансы SDP4 считаются по полосам: интегратор ветвится
+    if(g.deep >= 0)
+    {
+        for(int l = 0; l < (int)g.count; l++)
+        {
+            DeepSpace &d = m_deep[g.deep + l];
+            Error e = Ok;
+            dspace(e, t[l], g.argpo[l], g.argpdot[l], g.no[l], d.irez, d.d2201, d.d2211, d.d3210, d.d3222,
+                   d.d4410, d.d4422, d.d5220, d.d5232, d.d5421, d.d5433, d.dedt, d.del1, d.del2, d.del3,
+                   d.didt, d.dmdt, d.dnodt, d.domdt, d.gsto, d.xfact, d.xlamo, d.atime, d.xli, d.xni,
+                   em[l], argpm[l], inclm[l], mm[l], nodem[l], nm[l]);
+        }
+    }
+
+    for(int l = 0; l < L; l++)
+    {
+        if(nm[l] <= 0.0)
+        {
+            err[l] = NegativeMeanMotion;
+            nm[l] = g.no[l];
+        }
+
+        double cbrt_a = std::cbrt(XKE / nm[l]);
+        am[l] = cbrt_a * cbrt_a * tempa[l] * tempa[l];
+        nm[l] = XKE / (am[l] * std::sqrt(am[l]));
+        em[l] = em[l] - tempe[l];
+
+        if(em[l] >= 1.0 || em[l] < -0.001)
+        {
+            err[l] = EccentricityOutOfRange;
+            em[l] = 0.5;
+        }
+        if(em[l] < 1.0e-6)
+            em[l] = 1.0e-6;
+
+        mm[l] = mm[l] + g.no[l] * templ[l];
+        double xlm = mm[l] + argpm[l] + nodem[l];
+
+        nodem[l] = wrap(nodem[l]);
+        argpm[l] = wrap(argpm[l]);
+        xlm = wrap(xlm);
+        mm[l] = wrap(xlm - argpm[l] - nodem[l]);
+
+        ep[l] = em[l];
+        xincp[l] = inclm[l];
+        argpp[l] = argpm[l];
+        nodep[l] = nodem[l];
+        mp[l] = mm[l];
+        sinip[l] = std::sin(inclm[l]);
+        cosip[l] = std::cos(inclm[l]);
+        aycof[l] = g.aycof[l];
+        xlcof[l] = g.xlcof[l];
+        con41[l] = g.con41[l];
+        x1mth2[l] = g.x1mth2[l];
+        x7thm1[l] = g.x7thm1[l];
+    }
+
+    // Лунно-солнечные периодические члены SDP4
+    if(g.deep >= 0)
+    {
+        for(int l = 0; l < (int)g.count; l++)
+        {
+            DeepSpace &d = m_deep[g.deep + l];
+            dpper(t[l], d.e3, d.ee2, d.peo, d.pgho, d.pho, d.pinco, d.plo, d.se2, d.se3, d.sgh2,
+                  d.sgh3, d.sgh4, d.sh2, d.sh3, d.si2, d.si3, d.sl2, d.sl3, d.sl4, d.xgh2, d.xgh3,
+                  d.xgh4, d.xh2, d.xh3, d.xi2, d.xi3, d.xl2, d.xl3, d.xl4, d.zmol, d.zmos,
+                  ep[l], xincp[l], nodep[l], argpp[l], mp[l]);
+
+            if(xincp[l] < 0.0)
+            {
+                xincp[l] = -xincp[l];
+                nodep[l] = nodep[l] + M_PI;
+                argpp[l] = argpp[l] - M_PI;
+            }
+            if(ep[l] < 0.0 || ep[l] > 1.0)
+            {
+                err[l] = PerturbedEccentricity;
+                ep[l] = 0.5;
+            }
+
+            sinip[l] = std::sin(xincp[l]);
+            cosip[l] = std::cos(xincp[l]);
+            aycof[l] = -0.5 * J3OJ2 * sinip[l];
+            if(std::fabs(cosip[l] + 1.0) > 1.5e-12)
+                xlcof[l] = -0.25 * J3OJ2 * sinip[l] * (3.0 + 5.0 * cosip[l]) / (1.0 + cosip[l]);
+            else
+                xlcof[l] = -0.25 * J3OJ2 * sinip[l] * (3.0 + 5.0 * cosip[l]) / temp4;
+
+            double cosisq = cosip[l] * cosip[l];
+            con41[l] = 3.0 * cosisq - 1.0;
+            x1mth2[l] = 1.0 - cosisq;
+            x7thm1[l] = 7.0 * cosisq - 1.0;
+        }
+    }
+
+    // Долгопериодические члены и уравнение Кеплера
+    double axnl[L], aynl[L], u[L], eo1[L], sineo1[L], coseo1[L];
+    for(int l = 0; l < L; l++)
+    {
+        axnl[l] = ep[l] * std::cos(argpp[l]);
+        double temp = 1.0 / (am[l] * (1.0 - ep[l] * ep[l]));
+        aynl[l] = ep[l] * std::sin(argpp[l]) + temp * aycof[l];
+        double xl = mp[l] + argpp[l] + nodep[l] + temp * xlcof[l] * axnl[l];
+        u[l] = wrap(xl - nodep[l]);
+        eo1[l] = u[l];
+    }
+
+    // Итерации Ньютона выполняются для всех полос, пока не сойдется худшая
+    for(int ktr = 0; ktr < 10; ktr++)
+    {
+        double worst = 0.0;
+        for(int l = 0; l < L; l++)
+        {
+            sineo1[l] = std::sin(eo1[l]);
+            coseo1[l] = std::cos(eo1[l]);
+            double tem5 = 1.0 - coseo1[l] * axnl[l] - sineo1[l] * aynl[l];
+            tem5 = (u[l] - aynl[l] * coseo1[l] + axnl[l] * sineo1[l] - eo1[l]) / tem5;
+            tem5 = std::max(-0.95, std::min(0.95, tem5));
+            eo1[l] = eo1[l] + tem5;
+            worst = std::max(worst, std::fabs(tem5));
+        }
+        if(worst < 1.0e-12)
+            break;
+    }
+
+    // Короткопериодические члены и векторы ориентации
+    for(int l = 0; l < L; l++)
+    {
+        sineo1[l] = std::sin(eo1[l]);
+        coseo1[l] = std::cos(eo1[l]);
+        double ecose = axnl[l] * coseo1[l] + aynl[l] * sineo1[l];
+        double esine = axnl[l] * sineo1[l] - aynl[l] * coseo1[l];
+        double el2 = axnl[l] * axnl[l] + aynl[l] * aynl[l];
+        double pl = am[l] * (1.0 - el2);
+        if(pl < 0.0)
+        {
+            err[l] = NegativeSemiLatusRectum;
+            pl = am[l];
+        }
+
+        double rl = am[l] * (1.0 - ecose);
+        double rdotl = std::sqrt(am[l]) * esine / rl;
+        double rvdotl = std::sqrt(pl) / rl;
+        double betal = std::sqrt(1.0 - el2);
+        double temp = esine / (1.0 + betal);
+        double sinu = am[l] / rl * (sineo1[l] - aynl[l] - axnl[l] * temp);
+        double cosu = am[l] / rl * (coseo1[l] - axnl[l] + aynl[l] * temp);
+        double su = std::atan2(sinu, cosu);
+        double sin2u = (cosu + cosu) * sinu;
+        double cos2u = 1.0 - 2.0 * sinu * sinu;
+        temp = 1.0 / pl;
+        double temp1 = 0.5 * SGP4_J2 * temp;
+        double temp2 = temp1 * temp;
+
+        double mrt = rl * (1.0 - 1.5 * temp2 * betal * con41[l]) + 0.5 * temp1 * x1mth2[l] * cos2u;
+        su = su - 0.25 * temp2 * x7thm1[l] * sin2u;
+        double xnode = nodep[l] + 1.5 * temp2 * cosip[l] * sin2u;
+        double xinc = xincp[l] + 1.5 * temp2 * cosip[l] * sinip[l] * cos2u;
+        double mvt = rdotl - nm[l] * temp1 * x1mth2[l] * sin2u / XKE;
+        double rvdot = rvdotl + nm[l] * temp1 * (x1mth2[l] * cos2u + 1.5 * con41[l]) / XKE;
+
+        double sinsu = std::sin(su);
+        double cossu = std::cos(su);
+        double snod = std::sin(xnode);
+        double cnod = std::cos(xnode);
+        double sini = std::sin(xinc);
+        double cosi = std::cos(xinc);
+        double xmx = -snod * cosi;
+        double xmy = cnod * cosi;
+        double ux = xmx * sinsu + cnod * cossu;
+        double uy = xmy * sinsu + snod * cossu;
+        double uz = sini * sinsu;
+        double vx = xmx * cossu - cnod * sinsu;
+        double vy = xmy * cossu - snod * sinsu;
+        double vz = sini * cossu;
+
+        if(mrt < 1.0 && err[l] == Ok)
+            err[l] = Decayed;
+
+        // Запись в оси сцены; спутники с ошибкой прячутся в центр Земли
+        if(l < (int)g.count)
+        {
+            uint32_t i = g.index[l];
+            m_errors[i] = err[l];
+
+            double k = err[l] == Ok ? SGP4_EARTH_RADIUS_KM * scale : 0.0;
+            positions[i * 3 + 0] = mrt * ux * k;
+            positions[i * 3 + 1] = mrt * uz * k;
+            positions[i * 3 + 2] = -mrt * uy * k;
+
+            if(velocities)
+            {
+                double kv = err[l] == Ok ? VKMPERSEC * scale : 0.0;
+                velocities[i * 3 + 0] = (mvt * ux + rvdot * vx) * kv;
+                velocities[i * 3 + 1] = (mvt * uz + rvdot * vz) * kv;
+                velocities[i * 3 + 2] = -(mvt * uy + rvdot * vy) * kv;
+            }
+        }
+    }
+}
@@ -0,0 +1,159 @@
+#ifndef SGP4_H
+#define SGP4_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Число спутников, обрабатываемых одной группой полос.
+// Все поля группы - массивы этой длины, поэтому циклы по полосам
+// компилятор разворачивает в векторные инструкции (AVX - 4 double, AVX-512 - 8)
+#define SGP4_LANES 8
+
+// Гравитационная модель WGS-72, стандартная для TLE
+#define SGP4_EARTH_RADIUS_KM 6378.135
+#define SGP4_MU 398600.8
+#define SGP4_J2 0.001082616
+#define SGP4_J3 -0.00000253881
+#define SGP4_J4 -0.00000165597
+
+// Порог периода (мин), начиная с которого используется SDP4
+#define SGP4_DEEP_SPACE_PERIOD 225.0
+
+// Средние элементы орбиты в единицах TLE/OMM
+struct OrbitalElements
+{
+    uint32_t catalog_number = 0;
+    double epoch_jd = 0.0;       // юлианская дата эпохи, UTC
+    double bstar = 0.0;          // баллистический коэффициент, 1/радиус Земли
+    double inclination = 0.0;    // градусы
+    double raan = 0.0;           // градусы
+    double eccentricity = 0.0;
+    double arg_perigee = 0.0;    // градусы
+    double mean_anomaly = 0.0;   // градусы
+    double mean_motion = 0.0;    // оборотов в сутки
+};
+
+// Разбор десятичного числа из диапазона символов без выделения памяти.
+// Пробелы в начале пропускаются, разбор останавливается на первом лишнем символе
+double parseNumber(const char *begin, const char *end);
+
+// Разбор двух строк TLE. Строки могут не заканчиваться нулем, читаются первые 69 символов
+bool parseTle(const char *line1, const char *line2, OrbitalElements &elements);
+
+// Юлианская дата по календарной дате UTC
+double julianDate(int year, int month, int day, int hour, int minute, double second);
+
+// Среднее звездное время по Гринвичу (IAU-82), радианы
+double greenwichSiderealTime(double jd);
+
+// Параметры эллипса орбиты в координатах сцены: смещение центра,
+// углы Эйлера (градусы, порядок QQuaternion::fromEulerAngles) и масштаб
+// единичной окружности в плоскости XZ. scale - перевод км в единицы сцены
+void orbitEllipse(const OrbitalElements &elements, double scale, float offset[3], float tilt[3], float ellipse_scale[3]);
+
+// Пакетный пропагатор SGP4/SDP4 (Vallado, 2006) в раскладке AoSoA.
+// Околоземные и глубококосмические спутники собираются в отдельные группы,
+// чтобы ветвление по методу происходило на уровне группы, а не полосы.
+// Результат - положение в TEME, оси которой отображены на оси сцены:
+// x -> x, z (на север) -> y, y -> -z
+class Sgp4Propagator
+{
+    public:
+        // Коды ошибок совпадают с кодами satrec.error
+        enum Error
+        {
+            Ok = 0,
+            EccentricityOutOfRange = 1,
+            NegativeMeanMotion = 2,
+            PerturbedEccentricity = 3,
+            NegativeSemiLatusRectum = 4,
+            Decayed = 6
+        };
+
+        void setElements(const OrbitalElements *elements, size_t count);
+        void clear();
+
+        size_t size() const { return m_count; }
+        size_t groupCount() const { return m_groups.size(); }
+
+        // Пропагация групп [first_group, first_group + group_count) на момент jd.
+        // Положения (и скорости в единицах сцены в секунду, если velocities не
+        // нулевой) пишутся тройками по исходным индексам спутников, умноженные на scale.
+        // Разные диапазоны групп можно обрабатывать параллельно
+        void propagate(double jd, float scale, float *positions, float *velocities,
+                       size_t first_group, size_t group_count);
+        void propagate(double jd, float scale, float *positions, float *velocities = nullptr);
+
+        // Код ошибки последней пропагации спутника с исходным индексом index
+        uint8_t error(size_t index) const { return m_errors[index]; }
+
+    private:
+        struct alignas(64) Group
+        {
+            // Элементы и константы sgp4init
+            double epoch[SGP4_LANES];
+            double bstar[SGP4_LANES];
+            double ecco[SGP4_LANES];
+            double argpo[SGP4_LANES];
+            double inclo[SGP4_LANES];
+            double mo[SGP4_LANES];
+            double no[SGP4_LANES];
+            double nodeo[SGP4_LANES];
+            double mdot[SGP4_LANES];
+            double argpdot[SGP4_LANES];
+            double nodedot[SGP4_LANES];
+            double nodecf[SGP4_LANES];
+            double cc1[SGP4_LANES];
+            double cc4[SGP4_LANES];
+            double cc5[SGP4_LANES];
+            double t2cof[SGP4_LANES];
+            double t3cof[SGP4_LANES];
+            double t4cof[SGP4_LANES];
+            double t5cof[SGP4_LANES];
+            double d2[SGP4_LANES];
+            double d3[SGP4_LANES];
+            double d4[SGP4_LANES];
+            double omgcof[SGP4_LANES];
+            double xmcof[SGP4_LANES];
+            double eta[SGP4_LANES];
+            double delmo[SGP4_LANES];
+            double sinmao[SGP4_LANES];
+            double aycof[SGP4_LANES];
+            double xlcof[SGP4_LANES];
+            double con41[SGP4_LANES];
+            double x1mth2[SGP4_LANES];
+            double x7thm1[SGP4_LANES];
+            double simple[SGP4_LANES];
+
+            uint8_t invalid[SGP4_LANES];
+            uint32_t index[SGP4_LANES];
+            uint32_t count;
+            int32_t deep;
+        };
+
+        // Константы SDP4 (dscom, dsinit) и состояние резонансного интегратора
+        struct DeepSpace
+        {
+            double e3, ee2, peo, pgho, pho, pinco, plo, se2, se3, sgh2, sgh3, sgh4;
+            double sh2, sh3, si2, si3, sl2, sl3, sl4, xgh2, xgh3, xgh4, xh2, xh3;
+            double xi2, xi3, xl2, xl3, xl4, zmol, zmos;
+            double gsto, d2201, d2211, d3210, d3222, d4410, d4422, d5220, d5232;
+            double d5421, d5433, dedt, didt, dmdt, dnodt, domdt, del1, del2, del3;
+            double xfact, xlamo;
+            int irez;
+
+            // Изменяется при пропагации
+            double atime, xli, xni;
+        };
+
+        void initSatellite(const OrbitalElements &el, Group &group, int lane, DeepSpace *deep);
+        void propagateGroup(Group &group, double jd, float scale, float *positions, float *velocities);
+
+        std::vector<Group> m_groups;
+        std::vector<DeepSpace> m_deep;
+        std::vector<uint8_t> m_errors;
+        size_t m_count = 0;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "shadermanager.h"
+
+#include <QFile>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QOpenGLContext>
+#include <QDebug>
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+// Заголовок записи кэша, за ним идет бинарная программа
+struct ShaderCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t length;
+};
+
+static const char shader_cache_magic[4] = {'S', 'V', 'P', 'B'};
+
+ShaderManager::ShaderManager(QOpenGLFunctions_3_3_Core *gl) : m_gl(gl)
+{
+}
+
+void ShaderManager::build(const std::vector<ShaderProgram> &programs)
+{
+    m_cached = 0;
+
+    // Без поддерживаемых форматов бинарных программ кэш не используется
+    GLint formats = 0;
+    m_gl->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    m_binary_gl = formats > 0 ? QOpenGLContext::currentContext()->extraFunctions() : nullptr;
+
+    QByteArray driver = QByteArray::number(SHADER_CACHE_VERSION) + ":" +
+                        (const char*)m_gl->glGetString(GL_VENDOR) + ":" +
+                        (const char*)m_gl->glGetString(GL_RENDERER) + ":" +
+                        (const char*)m_gl->glGetString(GL_VERSION) + ":";
+
+    QDir dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    if(m_binary_gl && !dir.mkpath(SHADER_CACHE_DIR))
+        m_binary_gl = nullptr;
+
+    for(const auto &program : programs)
+    {
+        QString path;
+        if(m_binary_gl)
+        {
+            // Длины разделяют исходники, чтобы перенос текста между ними менял ключ
+            QCryptographicHash hash(QCryptographicHash::Sha1);
+            hash.addData(driver);
+            hash.addData(QByteArray::number((int)strlen(program.vs_source)) + ":");
+            hash.addData(program.vs_source, strlen(program.vs_source));
+            hash.addData(program.fs_source, strlen(program.fs_source));
+            path = dir.filePath(SHADER_CACHE_DIR "/" + QString(hash.result().toHex()) + ".bin");
+
+            *program.id = load(path);
+            if(*program.id)
+            {
+                m_cached++;
+                continue;
+            }
+        }
+
+        *program.id = link(program);
+        if(m_binary_gl && *program.id)
+            save(*program.id, path);
+    }
+
+    // Шейдеры нужны только до линковки
+    for(const auto &shader : m_shaders)
+        m_gl->glDeleteShader(shader.second);
+    m_shaders.clear();
+}
+
+GLuint ShaderManager::load(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return 0;
+    QByteArray data = file.readAll();
+
+    ShaderCacheHeader header;
+    if(data.size() < (int)sizeof(header))
+    {
+        qDebug() << "Damaged shader cache entry:" << path;
+        return 0;
+    }
+    memcpy(&header, data.constData(), sizeof(header));
+    if(memcmp(header.magic, shader_cache_magic, sizeof(header.magic)) || header.version != SHADER_CACHE_VERSION ||
+       header.length != data.size() - (int)sizeof(header))
+    {
+        qDebug() << "Damaged shader cache entry:" << path;
+        return 0;
+    }
+
+    GLuint program = m_gl->glCreateProgram();
+    m_binary_gl->glProgramBinary(program, header.format, data.constData() + sizeof(header), header.length);
+
+    // Драйвер вправе отклонить бинарник, тогда программа собирается из исходников
+    GLint status = GL_FALSE;
+    m_gl->glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if(status == GL_FALSE)
+    {
+        qDebug() << "Stale shader cache entry:" << path;
+        m_gl->glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void ShaderManager::save(GLuint program, const QString &path)
+{
+    // Программа с ошибками линковки не кэшируется
+    GLint status = GL_FALSE;
+    GLint length = 0;
+    m_gl->glGetProgramiv(program, GL_LINK_STATUS, &status);
+    m_gl->glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(status == GL_FALSE || length <= 0)
+        return;
+
+    ShaderCacheHeader header;
+    memcpy(header.magic, shader_cache_magic, sizeof(header.magic));
+    header.version = SHADER_CACHE_VERSION;
+
+    QByteArray data(sizeof(header) + length, 0);
+    GLenum format = 0;
+    m_binary_gl->glGetProgramBinary(program, length, &length, &format, data.data() + sizeof(header));
+    header.format = format;
+    header.length = length;
+    memcpy(data.data(), &header, sizeof(header));
+    data.resize(sizeof(header) + length);
+
+    // Запись через временный файл, чтобы прерванный запуск не оставил обрезанную запись
+    QSaveFile out(path);
+    if(!out.open(QIODevice::WriteOnly) || out.write(data) != data.size() || !out.commit())
+        qDebug() << "Error during shader cache writing:" << path;
+}
+
+GLuint ShaderManager::compile(GLenum type, const char *source, const char *name)
+{
+    for(const auto &shader : m_shaders)
+        if(shader.first == source)
+            return shader.second;
+
+    GLuint id = m_gl->glCreateShader(type);
+    m_gl->glShaderSource(id, 1, &source, NULL);
+    m_gl->glCompileShader(id);
+
+    GLint result;
+    m_gl->glGetShaderiv(id, GL_COMPILE_STATUS, &result);
+    if(result == GL_FALSE)
+    {
+        GLint length = 0;
+        m_gl->glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> info(length + 1, 0);
+        m_gl->glGetShaderInfoLog(id, length, &length, info.data());
+        printf("%s %s: %s", name, type == GL_VERTEX_SHADER ? "VS" : "FS", info.data());
+    }
+
+    m_shaders.push_back(std::make_pair(source, id));
+    return id;
+}
+
+GLuint ShaderManager::link(const ShaderProgram &program)
+{
+    GLuint vs_id = compile(GL_VERTEX_SHADER, program.vs_source, program.name);
+    GLuint fs_id = compile(GL_FRAGMENT_SHADER, program.fs_source, program.name);
+
+    GLuint id = m_gl->glCreateProgram();
+    if(m_binary_gl)
+        m_binary_gl->glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    m_gl->glAttachShader(id, vs_id);
+    m_gl->glAttachShader(id, fs_id);
+    m_gl->glLinkProgram(id);
+    m_gl->glDetachShader(id, vs_id);
+    m_gl->glDetachShader(id, fs_id);
+
+    GLint result;
+    m_gl->glGetProgramiv(id, GL_LINK_STATUS, &result);
+    if(result == GL_FALSE)
+    {
+        GLint length = 0;
+        m_gl->glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> info(length + 1, 0);
+        m_gl->glGetProgramInfoLog(id, length, &length, info.data());
+        printf("%s link: %s", program.name, info.data());
+    }
+    return id;
+}
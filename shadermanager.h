@@ -0,0 +1,58 @@
+#ifndef SHADERMANAGER_H
+#define SHADERMANAGER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QOpenGLExtraFunctions>
+
+#include <vector>
+#include <utility>
+
+// Версия формата кэша: при изменении все записи собираются заново
+#define SHADER_CACHE_VERSION 1
+
+// Подкаталог кэша бинарных программ в QStandardPaths::CacheLocation
+#define SHADER_CACHE_DIR "shaders"
+
+// Строка таблицы программ: имя для сообщений, исходники вершинного и
+// фрагментного шейдеров и переменная для идентификатора программы
+struct ShaderProgram
+{
+    const char *name;
+    const char *vs_source;
+    const char *fs_source;
+    GLuint *id;
+};
+
+// Сборка программ GLSL по таблице.
+// Слинкованная программа сохраняется на диск через glGetProgramBinary.
+// Ключ записи - SHA-1 от исходников и строк производителя, рендерера и
+// версии драйвера, поэтому обновление драйвера или правка шейдера дают
+// новый ключ. При следующем запуске программа загружается через
+// glProgramBinary, а если драйвер ее не принял - компилируется заново
+class ShaderManager
+{
+    public:
+        explicit ShaderManager(QOpenGLFunctions_3_3_Core *gl);
+
+        // Сборка всех программ таблицы, нужен текущий контекст GL.
+        // Один и тот же исходник компилируется не более одного раза
+        void build(const std::vector<ShaderProgram> &programs);
+
+        // Число программ последней сборки, взятых из кэша
+        int cachedCount() const { return m_cached; }
+
+    private:
+        GLuint load(const QString &path);
+        void save(GLuint program, const QString &path);
+        GLuint compile(GLenum type, const char *source, const char *name);
+        GLuint link(const ShaderProgram &program);
+
+        QOpenGLFunctions_3_3_Core *m_gl;
+        QOpenGLExtraFunctions *m_binary_gl = nullptr;
+        std::vector<std::pair<const char*, GLuint>> m_shaders;
+        int m_cached = 0;
+};
+
+#endif
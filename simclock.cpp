@@ -0,0 +1,47 @@
+#include "simclock.h"
+
+#include <algorithm>
+#include <chrono>
+
+SimulationClock::SimulationClock()
+{
+    // Юлианская дата начала эпохи Unix - 2440587.5
+    m_base_wall = wallSeconds();
+    m_base_jd = 2440587.5 + std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count() / 86400000.0;
+}
+
+double SimulationClock::now() const
+{
+    if(m_paused)
+        return m_base_jd;
+    return m_base_jd + (wallSeconds() - m_base_wall) * m_warp / 86400.0;
+}
+
+void SimulationClock::setTime(double jd)
+{
+    m_base_jd = jd;
+    m_base_wall = wallSeconds();
+}
+
+void SimulationClock::setWarp(double warp)
+{
+    // Новое ускорение действует с текущего момента
+    setTime(now());
+    m_warp = std::min(std::max(warp, CLOCK_MIN_WARP), CLOCK_MAX_WARP);
+}
+
+void SimulationClock::setPaused(bool paused)
+{
+    if(paused == m_paused)
+        return;
+
+    setTime(now());
+    m_paused = paused;
+}
+
+double SimulationClock::wallSeconds()
+{
+    // Монотонные часы: перевод системного времени не сдвигает модель
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
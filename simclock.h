@@ -0,0 +1,40 @@
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+// Пределы ускорения времени
+#define CLOCK_MIN_WARP 1.0
+#define CLOCK_MAX_WARP 10000.0
+
+// Часы модели: юлианская дата, идущая от настенного времени с ускорением.
+// Ход задается отсчетом (момент модели и настенный момент, с которого
+// он идет), поэтому пауза, смена ускорения и перемотка не дают скачков
+class SimulationClock
+{
+    public:
+        // Часы идут с текущего момента без ускорения
+        SimulationClock();
+
+        // Момент модели сейчас
+        double now() const;
+
+        // Перемотка на момент jd, ход и ускорение не меняются
+        void setTime(double jd);
+
+        // Ускорение, ограничивается [CLOCK_MIN_WARP, CLOCK_MAX_WARP]
+        void setWarp(double warp);
+        double warp() const { return m_warp; }
+
+        void setPaused(bool paused);
+        bool isPaused() const { return m_paused; }
+
+    private:
+        // Настенное время, секунды
+        static double wallSeconds();
+
+        double m_base_jd;
+        double m_base_wall;
+        double m_warp = CLOCK_MIN_WARP;
+        bool m_paused = false;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "snapshot.h"
+#include "propagation.h"
+
+#include <QDebug>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+static inline uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+Snapshot::~Snapshot()
+{
+    close();
+}
+
+bool Snapshot::open(const QString &path)
+{
+    // Новый файл проверяется отдельно: при ошибке открытый снимок остается
+    std::unique_ptr<QFile> file(new QFile(path));
+    if(!file->open(QIODevice::ReadOnly) || file->size() < (qint64)sizeof(SnapshotHeader))
+    {
+        qDebug() << "Error during snapshot loading:" << path;
+        return false;
+    }
+
+    const uchar *data = file->map(0, file->size());
+    if(!data)
+    {
+        qDebug() << "Error during snapshot mapping:" << path;
+        return false;
+    }
+
+    // Проверка заголовка и того, что все секции лежат внутри файла
+    const SnapshotHeader *h = (const SnapshotHeader *)data;
+    uint64_t size = file->size();
+    uint64_t count = h->count;
+    bool valid = h->magic == SNAPSHOT_MAGIC && h->version == SNAPSHOT_VERSION &&
+                 h->header_size == sizeof(SnapshotHeader) && h->element_size == sizeof(OrbitalElements) &&
+                 count < size &&
+                 h->elements_offset % SNAPSHOT_ALIGN == 0 && h->orbits_offset % SNAPSHOT_ALIGN == 0 &&
+                 h->elements_offset <= size && count * sizeof(OrbitalElements) <= size - h->elements_offset &&
+                 h->orbits_offset <= size && count * SNAPSHOT_ORBIT_FLOATS * sizeof(float) <= size - h->orbits_offset;
+
+    if(valid && h->ephemeris_samples)
+        valid = h->ephemeris_offset % SNAPSHOT_ALIGN == 0 && h->ephemeris_offset <= size &&
+                h->ephemeris_samples < size && h->ephemeris_step > 0.0 &&
+                h->ephemeris_samples * count * 3 * sizeof(float) <= size - h->ephemeris_offset;
+
+    if(!valid)
+    {
+        qDebug() << "Unsupported or damaged snapshot:" << path;
+        file->unmap((uchar *)data);
+        return false;
+    }
+
+    close();
+    m_file = std::move(file);
+    m_data = data;
+    m_header = h;
+    return true;
+}
+
+void Snapshot::close()
+{
+    if(m_file)
+    {
+        if(m_data)
+            m_file->unmap((uchar *)m_data);
+        m_file.reset();
+    }
+
+    m_data = nullptr;
+    m_header = nullptr;
+}
+
+const OrbitalElements *Snapshot::elements() const
+{
+    return m_header ? (const OrbitalElements *)(m_data + m_header->elements_offset) : nullptr;
+}
+
+const float *Snapshot::orbits() const
+{
+    return m_header ? (const float *)(m_data + m_header->orbits_offset) : nullptr;
+}
+
+bool Snapshot::covers(double jd) const
+{
+    if(!m_header || !m_header->ephemeris_samples)
+        return false;
+
+    double last = m_header->ephemeris_start + m_header->ephemeris_step * (m_header->ephemeris_samples - 1);
+    return jd >= m_header->ephemeris_start && jd <= last;
+}
+
+void Snapshot::interpolate(double jd, float *positions) const
+{
+    size_t count = m_header->count;
+    size_t samples = m_header->ephemeris_samples;
+    const float *ephemeris = (const float *)(m_data + m_header->ephemeris_offset);
+
+    double t = (jd - m_header->ephemeris_start) / m_header->ephemeris_step;
+    size_t i = std::min((size_t)std::max(t, 0.0), samples - 1);
+    size_t j = std::min(i + 1, samples - 1);
+    float k = t - i;
+
+    const float *a = ephemeris + i * count * 3;
+    const float *b = ephemeris + j * count * 3;
+    for(size_t n = 0; n < count * 3; n++)
+        positions[n] = a[n] + (b[n] - a[n]) * k;
+}
+
+bool writeSnapshot(const QString &path, const OrbitalElements *elements, size_t count, float scale,
+                   double start, double step, size_t samples)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Error during snapshot writing:" << path;
+        return false;
+    }
+
+    SnapshotHeader h;
+    std::memset(&h, 0, sizeof(h));
+    h.magic = SNAPSHOT_MAGIC;
+    h.version = SNAPSHOT_VERSION;
+    h.header_size = sizeof(SnapshotHeader);
+    h.element_size = sizeof(OrbitalElements);
+    h.count = count;
+    h.scale = scale;
+    h.elements_offset = alignOffset(sizeof(SnapshotHeader));
+    h.orbits_offset = alignOffset(h.elements_offset + count * sizeof(OrbitalElements));
+    h.ephemeris_offset = samples ? alignOffset(h.orbits_offset + count * SNAPSHOT_ORBIT_FLOATS * sizeof(float)) : 0;
+    h.ephemeris_samples = samples;
+    h.ephemeris_start = start;
+    h.ephemeris_step = step;
+
+    // Секции пишутся по порядку, промежутки заполняются нулями
+    auto pad = [&](uint64_t offset)
+    {
+        static const char zeros[SNAPSHOT_ALIGN] = {};
+        if((uint64_t)file.pos() < offset)
+            file.write(zeros, offset - file.pos());
+    };
+
+    bool ok = file.write((const char *)&h, sizeof(h)) == sizeof(h);
+
+    pad(h.elements_offset);
+    ok = ok && file.write((const char *)elements, count * sizeof(OrbitalElements)) == (qint64)(count * sizeof(OrbitalElements));
+
+    std::vector<float> orbits(count * SNAPSHOT_ORBIT_FLOATS);
+    for(size_t i = 0; i < count; i++)
+    {
+        float *o = &orbits[i * SNAPSHOT_ORBIT_FLOATS];
+        orbitEllipse(elements[i], scale, o, o + 3, o + 6);
+    }
+    pad(h.orbits_offset);
+    ok = ok && file.write((const char *)orbits.data(), orbits.size() * sizeof(float)) == (qint64)(orbits.size() * sizeof(float));
+
+    // Эфемериды считаются всеми ядрами и пишутся по отсчету
+    if(samples)
+    {
+        PropagationScheduler scheduler;
+        scheduler.setElements(elements, count, scale);
+
+        std::vector<float> positions(count * 3);
+        pad(h.ephemeris_offset);
+        for(size_t s = 0; s < samples && ok; s++)
+        {
+            scheduler.propagate(start + step * s, positions.data());
+            ok = file.write((const char *)positions.data(), positions.size() * sizeof(float)) == (qint64)(positions.size() * sizeof(float));
+        }
+    }
+
+    if(!ok)
+    {
+        qDebug() << "Error during snapshot writing:" << path;
+        file.close();
+        file.remove();
+        return false;
+    }
+
+    return true;
+}
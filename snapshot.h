@@ -0,0 +1,83 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QFile>
+#include <QString>
+
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "sgp4.h"
+
+// Сигнатура "SVSN" и версия формата снимка
+#define SNAPSHOT_MAGIC 0x4e535653
+#define SNAPSHOT_VERSION 1
+
+// Выравнивание секций в файле
+#define SNAPSHOT_ALIGN 64
+
+// Число float на параметры орбиты: смещение, наклон, масштаб
+#define SNAPSHOT_ORBIT_FLOATS 9
+
+// Заголовок файла снимка. Секции лежат по смещениям от начала файла
+// и читаются прямо из отображения, поэтому формат привязан к
+// little-endian и раскладке OrbitalElements текущей сборки
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t element_size;
+    uint64_t count;
+    double scale;                // единиц сцены на км
+
+    // OrbitalElements[count]
+    uint64_t elements_offset;
+
+    // float[count][SNAPSHOT_ORBIT_FLOATS]
+    uint64_t orbits_offset;
+
+    // Необязательное окно эфемерид: float[samples][count][3] в единицах сцены
+    uint64_t ephemeris_offset;
+    uint64_t ephemeris_samples;
+    double ephemeris_start;      // юлианская дата первого отсчета
+    double ephemeris_step;       // шаг отсчетов, сутки
+};
+
+// Снимок каталога, отображенный в память
+class Snapshot
+{
+    public:
+        ~Snapshot();
+
+        // При ошибке открытый ранее снимок не меняется
+        bool open(const QString &path);
+        void close();
+        bool isOpen() const { return m_header != nullptr; }
+
+        size_t size() const { return m_header ? m_header->count : 0; }
+        float scale() const { return m_header ? m_header->scale : 0.0f; }
+        const OrbitalElements *elements() const;
+        const float *orbits() const;
+
+        // Окно эфемерид
+        size_t ephemerisSamples() const { return m_header ? m_header->ephemeris_samples : 0; }
+        bool covers(double jd) const;
+
+        // Положения на момент jd внутри окна: линейная интерполяция
+        // между соседними отсчетами, 3 float на спутник
+        void interpolate(double jd, float *positions) const;
+
+    private:
+        std::unique_ptr<QFile> m_file;
+        const uchar *m_data = nullptr;
+        const SnapshotHeader *m_header = nullptr;
+};
+
+// Запись снимка: каталог, параметры орбит и, если samples > 0,
+// эфемериды на samples отсчетов с шагом step (сутки) от start
+bool writeSnapshot(const QString &path, const OrbitalElements *elements, size_t count, float scale,
+                   double start = 0.0, double step = 0.0, size_t samples = 0);
+
+#endif
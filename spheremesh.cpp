@@ -0,0 +1,248 @@
+#include "spheremesh.h"
+
+#include <cmath>
+#include <algorithm>
+#include <deque>
+
+SphereMesh::SphereMesh()
+{
+    for(int i = 0; i < SPHERE_LODS; i++)
+        generate(SPHERE_MIN_SLICES << i);
+}
+
+void SphereMesh::generate(int slices)
+{
+    int stacks = slices / 2;
+    std::vector<SphereVertex> vertices;
+    std::vector<GLuint> indices;
+
+    // Сетка широта x долгота, шов на 180 градусах и полюса продублированы,
+    // чтобы текстурные координаты не перескакивали
+    for(int i = 0; i <= stacks; i++)
+    {
+        float v = (float)i / stacks;
+        float lat = M_PI * (0.5 - v);
+        for(int j = 0; j <= slices; j++)
+        {
+            float u = (float)j / slices;
+            float lon = 2.0 * M_PI * (u - 0.5);
+
+            SphereVertex vertex;
+            vertex.normal[0] = std::cos(lat) * std::cos(lon);
+            vertex.normal[1] = std::sin(lat);
+            vertex.normal[2] = -std::cos(lat) * std::sin(lon);
+            for(int c = 0; c < 3; c++)
+                vertex.position[c] = 0.5f * vertex.normal[c];
+            vertex.tangent[0] = -std::sin(lon);
+            vertex.tangent[1] = 0.0f;
+            vertex.tangent[2] = -std::cos(lon);
+
+            // На полюсах u берется по середине сегмента
+            vertex.uv[0] = (i == 0 || i == stacks) ? (j + 0.5f) / slices : u;
+            vertex.uv[1] = v;
+            vertices.push_back(vertex);
+        }
+    }
+
+    // Лицевая сторона снаружи против часовой стрелки, у полюсов по одному треугольнику
+    for(int i = 0; i < stacks; i++)
+    {
+        for(int j = 0; j < slices; j++)
+        {
+            GLuint a = i * (slices + 1) + j;
+            GLuint b = a + slices + 1;
+            if(i != stacks - 1)
+                indices.insert(indices.end(), {a, b, b + 1});
+            if(i != 0)
+                indices.insert(indices.end(), {a, b + 1, a + 1});
+        }
+    }
+
+    optimizeVertexCache(indices, vertices.size());
+
+    // Вершины по порядку первого обращения, полюсные копии последнего
+    // сегмента выпадают, если на них нет ссылок
+    std::vector<GLuint> remap(vertices.size(), GLuint(-1));
+    GLuint base = m_vertices.size();
+    GLuint next = 0;
+    for(auto &index : indices)
+    {
+        if(remap[index] == GLuint(-1))
+        {
+            remap[index] = next++;
+            m_vertices.push_back(vertices[index]);
+        }
+        index = base + remap[index];
+    }
+
+    SphereLod lod;
+    lod.slices = slices;
+    lod.first = m_indices.size();
+    lod.count = indices.size();
+    m_lods.push_back(lod);
+    m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+}
+
+int SphereMesh::selectLod(float radius_px) const
+{
+    for(int i = 0; i < (int)m_lods.size(); i++)
+        if(radius_px * (1.0f - std::cos(M_PI / m_lods[i].slices)) <= SPHERE_LOD_ERROR)
+            return i;
+    return m_lods.size() - 1;
+}
+
+// Вес вершины по позиции в кэше и числу оставшихся треугольников
+static float vertexScore(int cache_position, int remaining)
+{
+    if(!remaining)
+        return -1.0f;
+
+    float score = 0.0f;
+    if(cache_position >= 0)
+    {
+        // Вершины последнего треугольника чуть хуже, чтобы не строить длинные полосы
+        if(cache_position < 3)
+            score = 0.75f;
+        else
+            score = std::pow(1.0f - (float)(cache_position - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+
+    // Вершины с малым числом оставшихся треугольников закрываются первыми
+    return score + 2.0f / std::sqrt((float)remaining);
+}
+
+void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertex_count)
+{
+    size_t triangle_count = indices.size() / 3;
+    if(!triangle_count)
+        return;
+
+    // Треугольники каждой вершины
+    std::vector<int> remaining(vertex_count, 0);
+    for(auto index : indices)
+        remaining[index]++;
+
+    std::vector<size_t> offsets(vertex_count + 1, 0);
+    for(size_t v = 0; v < vertex_count; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<GLuint> adjacency(indices.size());
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t t = 0; t < triangle_count; t++)
+        for(int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> score(vertex_count);
+    for(size_t v = 0; v < vertex_count; v++)
+        score[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangle_score(triangle_count);
+    std::vector<bool> added(triangle_count, false);
+    for(size_t t = 0; t < triangle_count; t++)
+        triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    std::vector<GLuint> result;
+    result.reserve(indices.size());
+    std::vector<GLuint> cache, next_cache;
+
+    size_t best = std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin();
+    size_t cursor = 0;
+
+    while(result.size() < indices.size())
+    {
+        added[best] = true;
+        const GLuint *tri = &indices[best * 3];
+        result.insert(result.end(), tri, tri + 3);
+
+        // Вершины треугольника уходят в начало кэша
+        next_cache.assign(tri, tri + 3);
+        for(auto v : cache)
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+                next_cache.push_back(v);
+
+        for(int k = 0; k < 3; k++)
+        {
+            GLuint v = tri[k];
+            remaining[v]--;
+
+            // Треугольник больше не участвует в соседстве вершины
+            size_t end = offsets[v] + remaining[v];
+            for(size_t a = offsets[v]; a <= end; a++)
+            {
+                if(adjacency[a] == best)
+                {
+                    std::swap(adjacency[a], adjacency[end]);
+                    break;
+                }
+            }
+        }
+
+        // Пересчет весов вершин кэша и вытесненных из него
+        for(size_t i = 0; i < next_cache.size(); i++)
+        {
+            GLuint v = next_cache[i];
+            cache_position[v] = i < VERTEX_CACHE_SIZE ? i : -1;
+            float new_score = vertexScore(cache_position[v], remaining[v]);
+            float diff = new_score - score[v];
+            score[v] = new_score;
+            for(size_t a = offsets[v]; a < offsets[v] + remaining[v]; a++)
+                triangle_score[adjacency[a]] += diff;
+        }
+        if(next_cache.size() > VERTEX_CACHE_SIZE)
+            next_cache.resize(VERTEX_CACHE_SIZE);
+        cache.swap(next_cache);
+
+        // Следующий - лучший из треугольников вершин кэша
+        float best_score = -1.0f;
+        for(auto v : cache)
+        {
+            for(size_t a = offsets[v]; a < offsets[v] + remaining[v]; a++)
+            {
+                if(triangle_score[adjacency[a]] > best_score)
+                {
+                    best_score = triangle_score[adjacency[a]];
+                    best = adjacency[a];
+                }
+            }
+        }
+
+        // Кэш исчерпан: первый оставшийся треугольник
+        if(best_score < 0.0f)
+        {
+            while(cursor < triangle_count && added[cursor])
+                cursor++;
+            if(cursor == triangle_count)
+                break;
+            best = cursor;
+        }
+    }
+
+    indices.swap(result);
+}
+
+float averageCacheMissRatio(const std::vector<GLuint> &indices, size_t vertex_count, int cache_size)
+{
+    if(indices.empty())
+        return 0.0f;
+
+    std::deque<GLuint> fifo;
+    std::vector<bool> cached(vertex_count, false);
+    size_t misses = 0;
+    for(auto v : indices)
+    {
+        if(cached[v])
+            continue;
+
+        misses++;
+        fifo.push_back(v);
+        cached[v] = true;
+        if((int)fifo.size() > cache_size)
+        {
+            cached[fifo.front()] = false;
+            fifo.pop_front();
+        }
+    }
+
+    return (float)misses / (indices.size() / 3);
+}
@@ -0,0 +1,73 @@
+#ifndef SPHEREMESH_H
+#define SPHEREMESH_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <vector>
+#include <cstddef>
+
+// Число сегментов по долготе самого грубого уровня детализации,
+// каждый следующий уровень вдвое подробнее
+#define SPHERE_MIN_SLICES 16
+#define SPHERE_LODS 5
+
+// Допустимое отклонение хорды от сферы на экране, пиксели
+#define SPHERE_LOD_ERROR 0.5f
+
+// Размер моделируемого кэша вершин при упорядочивании индексов
+#define VERTEX_CACHE_SIZE 32
+
+// Вершина сферы: положение, нормаль, касательная на восток, текстурные координаты.
+// Атрибуты идут подряд в одном буфере в порядке location 0-3
+struct SphereVertex
+{
+    GLfloat position[3];
+    GLfloat normal[3];
+    GLfloat tangent[3];
+    GLfloat uv[2];
+};
+
+// Уровень детализации: диапазон в общем буфере индексов
+struct SphereLod
+{
+    int slices;
+    GLsizei first;
+    GLsizei count;
+};
+
+// Сферы диаметром 1 (единица сцены) на нескольких уровнях детализации.
+// Полюса по оси y, нулевой меридиан на +x, восток в сторону -z, что при
+// повороте модели на звездное время совпадает с TEME. Текстура
+// равнопромежуточная: u растет на восток от -180 градусов, v = 0 на
+// северном полюсе. Все уровни лежат в общих буферах вершин и индексов,
+// индексы каждого упорядочены под кэш вершин, вершины - по первому
+// использованию
+class SphereMesh
+{
+    public:
+        SphereMesh();
+
+        const std::vector<SphereVertex> &vertices() const { return m_vertices; }
+        const std::vector<GLuint> &indices() const { return m_indices; }
+        const SphereLod &lod(int level) const { return m_lods[level]; }
+        int lodCount() const { return m_lods.size(); }
+
+        // Самый грубый уровень, отклонение которого на экране не больше
+        // SPHERE_LOD_ERROR при видимом радиусе radius_px пикселей
+        int selectLod(float radius_px) const;
+
+    private:
+        void generate(int slices);
+
+        std::vector<SphereVertex> m_vertices;
+        std::vector<GLuint> m_indices;
+        std::vector<SphereLod> m_lods;
+};
+
+// Переупорядочивание треугольников под кэш вершин (алгоритм Форсайта)
+void optimizeVertexCache(std::vector<GLuint> &indices, size_t vertex_count);
+
+// Среднее число промахов кэша FIFO на треугольник
+float averageCacheMissRatio(const std::vector<GLuint> &indices, size_t vertex_count, int cache_size);
+
+#endif
@@ -0,0 +1,446 @@
+#include "texturecache.h"
+
+#include <QFile>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QDebug>
+
+#include <cmath>
+#include <cstring>
+
+// Заголовок KTX 1.1
+struct KtxHeader
+{
+    uint8_t identifier[12];
+    uint32_t endianness;
+    uint32_t gl_type;
+    uint32_t gl_type_size;
+    uint32_t gl_format;
+    uint32_t gl_internal_format;
+    uint32_t gl_base_internal_format;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t array_elements;
+    uint32_t faces;
+    uint32_t mip_levels;
+    uint32_t key_value_bytes;
+};
+
+static const uint8_t ktx_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+static const char ktx_key[] = "SVSourceHash";
+
+static inline size_t blockBytes(GLenum format)
+{
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+static inline size_t levelBytes(GLenum format, int width, int height)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+size_t CompressedTexture::levelSize(int level) const
+{
+    return levelBytes(m_format, levelWidth(level), levelHeight(level));
+}
+
+size_t CompressedTexture::blockRowBytes(int level) const
+{
+    return size_t((levelWidth(level) + 3) / 4) * blockBytes(m_format);
+}
+
+GLenum compressedFormat(TextureCompression compression)
+{
+    switch(compression)
+    {
+        case TextureBC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TextureBC5: return GL_COMPRESSED_RG_RGTC2;
+        default: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+}
+
+// Уменьшение уровня вдвое усреднением 2x2, нечетный край повторяется
+static void downsample(const std::vector<uint32_t> &src, int width, int height, std::vector<uint32_t> &dst)
+{
+    int w = std::max(1, width / 2);
+    int h = std::max(1, height / 2);
+    dst.resize(size_t(w) * h);
+
+    for(int y = 0; y < h; y++)
+    {
+        const uint32_t *r0 = &src[size_t(std::min(2 * y, height - 1)) * width];
+        const uint32_t *r1 = &src[size_t(std::min(2 * y + 1, height - 1)) * width];
+        for(int x = 0; x < w; x++)
+        {
+            int x0 = std::min(2 * x, width - 1);
+            int x1 = std::min(2 * x + 1, width - 1);
+            uint32_t p[4] = {r0[x0], r0[x1], r1[x0], r1[x1]};
+
+            uint32_t out = 0;
+            for(int c = 0; c < 32; c += 8)
+            {
+                uint32_t sum = 2;
+                for(int i = 0; i < 4; i++)
+                    sum += (p[i] >> c) & 0xFF;
+                out |= (sum / 4) << c;
+            }
+            dst[size_t(y) * w + x] = out;
+        }
+    }
+}
+
+static inline uint16_t pack565(const float c[3])
+{
+    int r = std::min(31, std::max(0, int(c[0] * 31.0f / 255.0f + 0.5f)));
+    int g = std::min(63, std::max(0, int(c[1] * 63.0f / 255.0f + 0.5f)));
+    int b = std::min(31, std::max(0, int(c[2] * 31.0f / 255.0f + 0.5f)));
+    return (r << 11) | (g << 5) | b;
+}
+
+static inline void unpack565(uint16_t v, float c[3])
+{
+    int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+// Цветовой блок BC1: концы отрезка по главной оси цветов блока
+static void encodeColorBlock(const float rgb[16][3], uint8_t *out)
+{
+    float mean[3] = {0, 0, 0};
+    for(int i = 0; i < 16; i++)
+        for(int c = 0; c < 3; c++)
+            mean[c] += rgb[i][c] / 16.0f;
+
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for(int i = 0; i < 16; i++)
+    {
+        float d[3] = {rgb[i][0] - mean[0], rgb[i][1] - mean[1], rgb[i][2] - mean[2]};
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+
+    // Степенной метод для главного собственного вектора
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+    for(int n = 0; n < 8; n++)
+    {
+        float v[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                      cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                      cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if(len < 1e-6f)
+            break;
+        for(int c = 0; c < 3; c++)
+            axis[c] = v[c] / len;
+    }
+
+    float lo = 0.0f, hi = 0.0f;
+    for(int i = 0; i < 16; i++)
+    {
+        float t = (rgb[i][0] - mean[0]) * axis[0] + (rgb[i][1] - mean[1]) * axis[1] + (rgb[i][2] - mean[2]) * axis[2];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+
+    float e0[3], e1[3];
+    for(int c = 0; c < 3; c++)
+    {
+        e0[c] = mean[c] + axis[c] * hi;
+        e1[c] = mean[c] + axis[c] * lo;
+    }
+
+    // color0 > color1 включает режим четырех цветов без прозрачности
+    uint16_t c0 = pack565(e0), c1 = pack565(e1);
+    if(c0 < c1)
+        std::swap(c0, c1);
+
+    uint32_t indices = 0;
+    if(c0 != c1)
+    {
+        float palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for(int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+            palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+        }
+
+        for(int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            float best_dist = 1e30f;
+            for(int p = 0; p < 4; p++)
+            {
+                float dr = rgb[i][0] - palette[p][0], dg = rgb[i][1] - palette[p][1], db = rgb[i][2] - palette[p][2];
+                float dist = dr * dr + dg * dg + db * db;
+                if(dist < best_dist)
+                {
+                    best_dist = dist;
+                    best = p;
+                }
+            }
+            indices |= uint32_t(best) << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    for(int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+// Одноканальный блок BC4 (альфа BC3 и каналы BC5): восемь уровней между min и max
+static void encodeChannelBlock(const uint8_t value[16], uint8_t *out)
+{
+    uint8_t a0 = *std::max_element(value, value + 16);
+    uint8_t a1 = *std::min_element(value, value + 16);
+
+    uint64_t indices = 0;
+    if(a0 != a1)
+    {
+        int palette[8] = {a0, a1};
+        for(int p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * a0 + p * a1 + 3) / 7;
+
+        for(int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            for(int p = 1; p < 8; p++)
+                if(std::abs(value[i] - palette[p]) < std::abs(value[i] - palette[best]))
+                    best = p;
+            indices |= uint64_t(best) << (3 * i);
+        }
+    }
+
+    out[0] = a0;
+    out[1] = a1;
+    for(int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+static void encodeLevel(const std::vector<uint32_t> &pixels, int width, int height,
+                        GLenum format, uint8_t *out)
+{
+    size_t block = blockBytes(format);
+    for(int by = 0; by < height; by += 4)
+    {
+        for(int bx = 0; bx < width; bx += 4)
+        {
+            float rgb[16][3];
+            uint8_t alpha[16], red[16], green[16];
+            for(int i = 0; i < 16; i++)
+            {
+                int x = std::min(bx + i % 4, width - 1);
+                int y = std::min(by + i / 4, height - 1);
+                QRgb p = pixels[size_t(y) * width + x];
+                rgb[i][0] = qRed(p);
+                rgb[i][1] = qGreen(p);
+                rgb[i][2] = qBlue(p);
+                alpha[i] = qAlpha(p);
+                red[i] = qRed(p);
+                green[i] = qGreen(p);
+            }
+
+            if(format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                encodeColorBlock(rgb, out);
+            else if(format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+            {
+                encodeChannelBlock(alpha, out);
+                encodeColorBlock(rgb, out + 8);
+            }
+            else
+            {
+                encodeChannelBlock(red, out);
+                encodeChannelBlock(green, out + 8);
+            }
+            out += block;
+        }
+    }
+}
+
+static GLenum baseFormat(GLenum format)
+{
+    switch(format)
+    {
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return GL_RGBA;
+        case GL_COMPRESSED_RG_RGTC2: return GL_RG;
+        default: return GL_RGB;
+    }
+}
+
+static inline size_t pad4(size_t size)
+{
+    return (size + 3) & ~size_t(3);
+}
+
+bool buildCompressedTexture(const QImage &image, TextureCompression compression, const QByteArray &key,
+                            CompressedTexture &texture, bool mipmaps)
+{
+    if(image.isNull())
+        return false;
+
+    QImage argb = image.convertToFormat(QImage::Format_ARGB32);
+    int width = argb.width(), height = argb.height();
+    GLenum format = compressedFormat(compression);
+
+    int levels = 1;
+    while(mipmaps && ((width >> levels) || (height >> levels)))
+        levels++;
+
+    // Пара ключ-значение с хешем источника
+    size_t kv_size = sizeof(ktx_key) + key.size() + 1;
+    size_t kv_bytes = 4 + pad4(kv_size);
+
+    size_t total = sizeof(KtxHeader) + kv_bytes;
+    for(int l = 0; l < levels; l++)
+        total += 4 + pad4(levelBytes(format, std::max(1, width >> l), std::max(1, height >> l)));
+
+    texture.m_format = format;
+    texture.m_width = width;
+    texture.m_height = height;
+    texture.m_data = QByteArray(total, 0);
+    texture.m_offsets.clear();
+    uint8_t *data = (uint8_t *)texture.m_data.data();
+
+    KtxHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.identifier, ktx_identifier, sizeof(ktx_identifier));
+    h.endianness = 0x04030201;
+    h.gl_type_size = 1;
+    h.gl_internal_format = format;
+    h.gl_base_internal_format = baseFormat(format);
+    h.pixel_width = width;
+    h.pixel_height = height;
+    h.faces = 1;
+    h.mip_levels = levels;
+    h.key_value_bytes = kv_bytes;
+    std::memcpy(data, &h, sizeof(h));
+
+    size_t offset = sizeof(KtxHeader);
+    uint32_t kv_size32 = kv_size;
+    std::memcpy(data + offset, &kv_size32, 4);
+    std::memcpy(data + offset + 4, ktx_key, sizeof(ktx_key));
+    std::memcpy(data + offset + 4 + sizeof(ktx_key), key.constData(), key.size());
+    offset += kv_bytes;
+
+    // Цепочка уровней строится от исходного изображения
+    std::vector<uint32_t> level(size_t(width) * height), next;
+    for(int y = 0; y < height; y++)
+        std::memcpy(&level[size_t(y) * width], argb.constScanLine(y), width * 4);
+
+    int w = width, hgt = height;
+    for(int l = 0; l < levels; l++)
+    {
+        uint32_t size = levelBytes(format, w, hgt);
+        std::memcpy(data + offset, &size, 4);
+        offset += 4;
+
+        texture.m_offsets.push_back(offset);
+        encodeLevel(level, w, hgt, format, data + offset);
+        offset += pad4(size);
+
+        if(l + 1 < levels)
+        {
+            downsample(level, w, hgt, next);
+            level.swap(next);
+            w = std::max(1, w / 2);
+            hgt = std::max(1, hgt / 2);
+        }
+    }
+
+    return true;
+}
+
+bool readCompressedTexture(const QByteArray &data, GLenum format, const QByteArray &key,
+                           CompressedTexture &texture)
+{
+    texture.m_offsets.clear();
+    if(data.size() < (int)sizeof(KtxHeader))
+        return false;
+
+    KtxHeader h;
+    std::memcpy(&h, data.constData(), sizeof(h));
+    if(std::memcmp(h.identifier, ktx_identifier, sizeof(ktx_identifier)) || h.endianness != 0x04030201 ||
+       h.gl_internal_format != format || h.faces != 1 || h.pixel_depth || h.array_elements ||
+       !h.pixel_width || !h.pixel_height || h.mip_levels > 32)
+        return false;
+
+    // Ключ в файле должен совпасть с ожидаемым
+    size_t size = data.size();
+    size_t offset = sizeof(KtxHeader);
+    if(h.key_value_bytes > size - offset)
+        return false;
+    QByteArray expected = QByteArray(ktx_key, sizeof(ktx_key)) + key + QByteArray(1, 0);
+    if(h.key_value_bytes < 4 + (size_t)expected.size() ||
+       std::memcmp(data.constData() + offset + 4, expected.constData(), expected.size()))
+        return false;
+    offset += h.key_value_bytes;
+
+    texture.m_format = format;
+    texture.m_width = h.pixel_width;
+    texture.m_height = h.pixel_height;
+    texture.m_data = data;
+
+    for(uint32_t l = 0; l < h.mip_levels; l++)
+    {
+        uint32_t level_size;
+        if(size - offset < 4)
+            break;
+        std::memcpy(&level_size, data.constData() + offset, 4);
+        offset += 4;
+
+        if(level_size != texture.levelSize(l) || pad4(level_size) > size - offset)
+            break;
+        texture.m_offsets.push_back(offset);
+        offset += pad4(level_size);
+    }
+
+    if(texture.m_offsets.size() != h.mip_levels)
+    {
+        texture.m_offsets.clear();
+        return false;
+    }
+    return true;
+}
+
+bool loadCompressedTexture(const QString &path, TextureCompression compression, CompressedTexture &texture)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray source = file.readAll();
+    file.close();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(TEXTURE_CACHE_VERSION) + ":" + QByteArray::number(compression) + ":");
+    hash.addData(source);
+    QByteArray key = hash.result().toHex();
+
+    QDir dir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    QString cache_path = dir.filePath(TEXTURE_CACHE_DIR "/" + QString(key) + ".ktx");
+    GLenum format = compressedFormat(compression);
+
+    QFile cache(cache_path);
+    if(cache.open(QIODevice::ReadOnly))
+    {
+        if(readCompressedTexture(cache.readAll(), format, key, texture))
+            return true;
+        qDebug() << "Damaged texture cache entry:" << cache_path;
+    }
+
+    if(!buildCompressedTexture(QImage::fromData(source), compression, key, texture))
+        return false;
+
+    // Запись через временный файл, чтобы прерванный запуск не оставил обрезанную запись
+    QSaveFile out(cache_path);
+    if(!dir.mkpath(TEXTURE_CACHE_DIR) || !out.open(QIODevice::WriteOnly) ||
+       out.write(texture.data()) != texture.data().size() || !out.commit())
+        qDebug() << "Error during texture cache writing:" << cache_path;
+
+    return true;
+}
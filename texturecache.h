@@ -0,0 +1,85 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QImage>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// Форматы S3TC не входят в ядро GL, но поддерживаются всеми настольными драйверами
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+
+// Версия кодировщика: входит в ключ кэша, при изменении сжатия
+// старые файлы перестают совпадать и пересобираются
+#define TEXTURE_CACHE_VERSION 1
+
+// Подкаталог кэша в QStandardPaths::CacheLocation
+#define TEXTURE_CACHE_DIR "textures"
+
+// Формат сжатия текстуры:
+// BC1 - цвет без альфа-канала, 4 бита на пиксель
+// BC3 - цвет с альфа-каналом, 8 бит на пиксель
+// BC5 - карта нормалей: X и Y в каналах R и G, Z восстанавливается в шейдере
+enum TextureCompression {TextureBC1, TextureBC3, TextureBC5};
+
+// Сжатая текстура с полной цепочкой mip-уровней. data хранит образ
+// файла KTX 1.1 целиком, уровни указывают внутрь него
+class CompressedTexture
+{
+    public:
+        GLenum format() const { return m_format; }
+        int width() const { return m_width; }
+        int height() const { return m_height; }
+        int levels() const { return m_offsets.size(); }
+        bool isNull() const { return m_offsets.empty(); }
+
+        int levelWidth(int level) const { return std::max(1, m_width >> level); }
+        int levelHeight(int level) const { return std::max(1, m_height >> level); }
+        const char *levelData(int level) const { return m_data.constData() + m_offsets[level]; }
+        size_t levelSize(int level) const;
+
+        // Байт на строку блоков 4x4 уровня
+        size_t blockRowBytes(int level) const;
+
+        const QByteArray &data() const { return m_data; }
+
+    private:
+        friend bool buildCompressedTexture(const QImage &, TextureCompression, const QByteArray &, CompressedTexture &, bool);
+        friend bool readCompressedTexture(const QByteArray &, GLenum, const QByteArray &, CompressedTexture &);
+
+        GLenum m_format = 0;
+        int m_width = 0;
+        int m_height = 0;
+        QByteArray m_data;
+        std::vector<size_t> m_offsets;
+};
+
+GLenum compressedFormat(TextureCompression compression);
+
+// Строит mip-уровни на CPU и сжимает их. key записывается в файл для проверки.
+// Без mipmaps сжимается только исходный уровень (тайлы виртуальных текстур)
+bool buildCompressedTexture(const QImage &image, TextureCompression compression, const QByteArray &key,
+                            CompressedTexture &texture, bool mipmaps = true);
+
+// Разбор образа KTX с проверкой формата и ключа
+bool readCompressedTexture(const QByteArray &data, GLenum format, const QByteArray &key,
+                           CompressedTexture &texture);
+
+// Загрузка через кэш: ключ - хеш содержимого файла, формата и версии.
+// При промахе изображение декодируется, сжимается и сохраняется в кэш
+bool loadCompressedTexture(const QString &path, TextureCompression compression, CompressedTexture &texture);
+
+#endif
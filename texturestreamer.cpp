@@ -0,0 +1,244 @@
+#include "texturestreamer.h"
+
+#include <QImageReader>
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+
+// Задача декодирования одного файла
+class TextureStreamer::DecodeTask : public QRunnable
+{
+    public:
+        DecodeTask(TextureStreamer *streamer, size_t index, const QString &path, bool preview,
+                   TextureCompression compression) :
+            m_streamer(streamer), m_index(index), m_path(path), m_preview(preview), m_compression(compression) {}
+
+        void run()
+        {
+            if(m_streamer->m_cancelled)
+                return;
+
+            if(!m_preview)
+            {
+                CompressedTexture full;
+                loadCompressedTexture(m_path, m_compression, full);
+
+                std::lock_guard<std::mutex> lock(m_streamer->m_mutex);
+                m_streamer->m_decoded.push_back({m_index, false, QImage(), full});
+                return;
+            }
+
+            // JPEG декодируется сразу в уменьшенном размере, без полного изображения
+            QImageReader reader(m_path);
+            if(reader.size().width() > TEXTURE_PREVIEW_WIDTH)
+            {
+                QSize size = reader.size();
+                reader.setScaledSize(QSize(TEXTURE_PREVIEW_WIDTH,
+                                           std::max(1, size.height() * TEXTURE_PREVIEW_WIDTH / size.width())));
+            }
+
+            // ARGB32 в памяти little-endian - BGRA, как ждет glTexImage2D
+            QImage image = reader.read().convertToFormat(QImage::Format_ARGB32);
+
+            std::lock_guard<std::mutex> lock(m_streamer->m_mutex);
+            m_streamer->m_decoded.push_back({m_index, true, image, CompressedTexture()});
+        }
+
+    private:
+        TextureStreamer *m_streamer;
+        size_t m_index;
+        QString m_path;
+        bool m_preview;
+        TextureCompression m_compression;
+};
+
+TextureStreamer::TextureStreamer(QOpenGLFunctions_3_3_Core *gl) : m_gl(gl)
+{
+    m_cancelled = false;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    m_cancelled = true;
+    m_pool.clear();
+    m_pool.waitForDone();
+
+    // Недогруженные текстуры и PBO освобождаются, готовые принадлежат владельцу *target
+    for(auto &t : m_textures)
+        if(t.staging)
+            m_gl->glDeleteTextures(1, &t.staging);
+    if(m_pbo)
+        m_gl->glDeleteBuffers(1, &m_pbo);
+}
+
+void TextureStreamer::load(const QString &path, GLuint *id, QRgb placeholder, TextureCompression compression)
+{
+    *id = createTexture(1, 1, &placeholder);
+
+    Texture t;
+    t.path = path;
+    t.compression = compression;
+    t.target = id;
+    m_textures.push_back(t);
+    m_remaining++;
+
+    // Уменьшенные копии идут раньше полных изображений всех файлов
+    size_t index = m_textures.size() - 1;
+    m_pool.start(new DecodeTask(this, index, path, true, compression), 1);
+    m_pool.start(new DecodeTask(this, index, path, false, compression), 0);
+}
+
+GLuint TextureStreamer::createTexture(int width, int height, const void *pixels)
+{
+    GLuint id;
+    m_gl->glGenTextures(1, &id);
+    m_gl->glBindTexture(GL_TEXTURE_2D, id);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    m_gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+    if(pixels)
+        m_gl->glGenerateMipmap(GL_TEXTURE_2D);
+    m_gl->glBindTexture(GL_TEXTURE_2D, 0);
+    return id;
+}
+
+GLuint TextureStreamer::createTexture(const CompressedTexture &texture)
+{
+    GLuint id;
+    m_gl->glGenTextures(1, &id);
+    m_gl->glBindTexture(GL_TEXTURE_2D, id);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels() - 1);
+
+    // Хранилище всех уровней, данные догружаются полосами
+    for(int l = 0; l < texture.levels(); l++)
+        m_gl->glCompressedTexImage2D(GL_TEXTURE_2D, l, texture.format(), texture.levelWidth(l),
+                                     texture.levelHeight(l), 0, texture.levelSize(l), NULL);
+    m_gl->glBindTexture(GL_TEXTURE_2D, 0);
+    return id;
+}
+
+void TextureStreamer::finish(Texture &t)
+{
+    m_gl->glDeleteTextures(1, t.target);
+    *t.target = t.staging;
+    t.staging = 0;
+    t.full = CompressedTexture();
+    t.full_done = true;
+    m_remaining--;
+}
+
+void TextureStreamer::update()
+{
+    if(!m_remaining)
+        return;
+
+    // Забор декодированных изображений
+    std::vector<Decoded> decoded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        decoded.swap(m_decoded);
+    }
+
+    for(auto &d : decoded)
+    {
+        Texture &t = m_textures[d.index];
+        if(t.full_done)
+            continue;
+
+        if(d.preview ? d.image.isNull() : d.full.isNull())
+        {
+            // Нечитаемый файл остается заглушкой
+            if(!d.preview)
+            {
+                qDebug() << "Error during texture loading:" << t.path;
+                t.full_done = true;
+                m_remaining--;
+            }
+            continue;
+        }
+
+        if(d.preview)
+        {
+            // Уменьшенная копия мала и загружается сразу, если полная еще не начата
+            if(!t.staging)
+            {
+                GLuint id = createTexture(d.image.width(), d.image.height(), d.image.constBits());
+                m_gl->glDeleteTextures(1, t.target);
+                *t.target = id;
+            }
+        }
+        else
+        {
+            t.full = d.full;
+            t.level = 0;
+            t.next_row = 0;
+            t.staging = createTexture(t.full);
+        }
+    }
+
+    // Полосы блоков mip-уровней через PBO в пределах бюджета кадра
+    size_t budget = TEXTURE_UPLOAD_BUDGET;
+    for(auto &t : m_textures)
+    {
+        if(!t.staging || !budget)
+            continue;
+
+        if(!m_pbo)
+            m_gl->glGenBuffers(1, &m_pbo);
+
+        const CompressedTexture &c = t.full;
+        m_gl->glBindTexture(GL_TEXTURE_2D, t.staging);
+        while(budget && t.level < c.levels())
+        {
+            int height = c.levelHeight(t.level);
+            int block_rows = (height + 3) / 4;
+            size_t row_bytes = c.blockRowBytes(t.level);
+            int rows = std::min<int>(block_rows - t.next_row, std::max<size_t>(1, budget / row_bytes));
+            size_t bytes = row_bytes * rows;
+            const char *data = c.levelData(t.level) + row_bytes * t.next_row;
+
+            // Переопределение хранилища PBO не ждет завершения прошлой передачи
+            m_gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo);
+            m_gl->glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            void *dst = m_gl->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            const void *src = NULL;
+            if(dst)
+            {
+                std::memcpy(dst, data, bytes);
+                m_gl->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+            else
+            {
+                // Без отображения PBO полоса загружается напрямую из памяти
+                m_gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                src = data;
+            }
+
+            // Смещение по блокам кратно 4, последняя полоса доходит до края уровня
+            int y = t.next_row * 4;
+            m_gl->glCompressedTexSubImage2D(GL_TEXTURE_2D, t.level, 0, y, c.levelWidth(t.level),
+                                            std::min(rows * 4, height - y), c.format(), bytes, src);
+            m_gl->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+            t.next_row += rows;
+            if(t.next_row >= block_rows)
+            {
+                t.level++;
+                t.next_row = 0;
+            }
+            budget -= std::min(budget, bytes);
+        }
+        m_gl->glBindTexture(GL_TEXTURE_2D, 0);
+
+        if(t.level >= c.levels())
+            finish(t);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <QString>
+#include <QImage>
+#include <QThreadPool>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+#include "texturecache.h"
+
+// Ширина уменьшенной копии, которая показывается до полной текстуры
+#define TEXTURE_PREVIEW_WIDTH 512
+
+// Объем данных, загружаемых в GPU за один кадр
+#define TEXTURE_UPLOAD_BUDGET (8 * 1024 * 1024)
+
+// Асинхронная загрузка текстур.
+// Файлы декодируются в пуле потоков в два прохода: уменьшенная копия и
+// полное разрешение, которое берется из кэша сжатых текстур или сжимается
+// при первом запуске. До их готовности текстура - одноцветная заглушка.
+// Сжатые mip-уровни загружаются полосами блоков через PBO в пределах
+// бюджета кадра в отдельную текстуру, которая подменяет предыдущую целиком
+class TextureStreamer
+{
+    public:
+        explicit TextureStreamer(QOpenGLFunctions_3_3_Core *gl);
+        ~TextureStreamer();
+
+        // Создает заглушку в *id и ставит файл в очередь. По мере готовности
+        // *id заменяется текстурой лучшего качества, старая удаляется
+        void load(const QString &path, GLuint *id, QRgb placeholder = qRgb(128, 128, 128),
+                  TextureCompression compression = TextureBC1);
+
+        // Загрузка готовых изображений, вызывается каждый кадр в контексте GL
+        void update();
+
+        // Все текстуры загружены в полном разрешении или не прочитались
+        bool isComplete() const { return m_remaining == 0; }
+
+    private:
+        struct Texture
+        {
+            QString path;
+            TextureCompression compression;
+            GLuint *target;
+            GLuint staging = 0;
+            CompressedTexture full;
+            int level = 0;
+            int next_row = 0;       // в строках блоков 4x4
+            bool full_done = false;
+        };
+
+        struct Decoded
+        {
+            size_t index;
+            bool preview;
+            QImage image;
+            CompressedTexture full;
+        };
+
+        class DecodeTask;
+
+        GLuint createTexture(int width, int height, const void *pixels);
+        GLuint createTexture(const CompressedTexture &texture);
+        void finish(Texture &t);
+
+        QOpenGLFunctions_3_3_Core *m_gl;
+        QThreadPool m_pool;
+        std::vector<Texture> m_textures;
+        GLuint m_pbo = 0;
+        size_t m_remaining = 0;
+
+        // Очередь декодированных изображений из пула
+        std::mutex m_mutex;
+        std::vector<Decoded> m_decoded;
+        std::atomic<bool> m_cancelled;
+};
+
+#endif
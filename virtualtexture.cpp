@@ -0,0 +1,565 @@
+#include "virtualtexture.h"
+
+#include <QFile>
+#include <QDir>
+#include <QImageReader>
+#include <QDebug>
+
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <cstring>
+
+static QString tilePath(const QString &dir, const QString &layer, int level, int x, int y)
+{
+    return QString("%1/%2/%3/%4_%5.ktx").arg(dir).arg(layer).arg(level).arg(x).arg(y);
+}
+
+static int levelSize(int size, int level)
+{
+    return std::max(1, size >> level);
+}
+
+static int pyramidLevels(int width, int height)
+{
+    int levels = 1;
+    while(std::max(levelSize(width, levels - 1), levelSize(height, levels - 1)) > VT_TILE_SIZE)
+        levels++;
+    return levels;
+}
+
+static size_t slotBytes(TextureCompression compression)
+{
+    return size_t(VT_SLOT_SIZE / 4) * (VT_SLOT_SIZE / 4) * (compression == TextureBC1 ? 8 : 16);
+}
+
+static int nextPowerOfTwo(int value)
+{
+    int p = 1;
+    while(p < value)
+        p *= 2;
+    return p;
+}
+
+// Чтение всех слоев одного тайла
+class VirtualTexture::LoadTask : public QRunnable
+{
+    public:
+        LoadTask(VirtualTexture *texture, uint64_t key, int level, int x, int y) :
+            m_texture(texture), m_key(key), m_level(level), m_x(x), m_y(y) {}
+
+        void run()
+        {
+            if(m_texture->m_cancelled)
+                return;
+
+            Loaded loaded;
+            loaded.key = m_key;
+            for(auto &layer : m_texture->m_layers)
+            {
+                CompressedTexture tile;
+                QFile file(tilePath(m_texture->m_dir, layer.name, m_level, m_x, m_y));
+                if(!file.open(QIODevice::ReadOnly) ||
+                   !readCompressedTexture(file.readAll(), compressedFormat(layer.compression), layer.name.toUtf8(), tile) ||
+                   tile.width() != VT_SLOT_SIZE || tile.height() != VT_SLOT_SIZE)
+                {
+                    loaded.layers.clear();
+                    break;
+                }
+                loaded.layers.push_back(tile);
+            }
+
+            std::lock_guard<std::mutex> lock(m_texture->m_mutex);
+            m_texture->m_loaded.push_back(loaded);
+        }
+
+    private:
+        VirtualTexture *m_texture;
+        uint64_t m_key;
+        int m_level;
+        int m_x;
+        int m_y;
+};
+
+VirtualTexture::VirtualTexture(QOpenGLFunctions_3_3_Core *gl) : m_gl(gl)
+{
+    m_cancelled = false;
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    m_cancelled = true;
+    m_pool.clear();
+    m_pool.waitForDone();
+
+    if(!m_atlases.empty())
+        m_gl->glDeleteTextures(m_atlases.size(), m_atlases.data());
+    if(m_page_table)
+        m_gl->glDeleteTextures(1, &m_page_table);
+    if(m_feedback_fbo)
+    {
+        m_gl->glDeleteFramebuffers(1, &m_feedback_fbo);
+        m_gl->glDeleteRenderbuffers(1, &m_feedback_rbo);
+        m_gl->glDeleteBuffers(VT_FEEDBACK_BUFFERS, m_feedback_pbo);
+    }
+}
+
+int VirtualTexture::tilesX(int level) const
+{
+    return (levelSize(m_width, level) + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+}
+
+int VirtualTexture::tilesY(int level) const
+{
+    return (levelSize(m_height, level) + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+}
+
+bool VirtualTexture::open(const QString &dir, const std::vector<VirtualLayer> &layers)
+{
+    QFile info(dir + "/" VT_PYRAMID_FILE);
+    if(!info.open(QIODevice::ReadOnly))
+        return false;
+
+    // Описание: ширина, высота, уровни, размер тайла, рамка
+    QList<QByteArray> fields = info.readAll().simplified().split(' ');
+    if(fields.size() != 5 || fields[3].toInt() != VT_TILE_SIZE || fields[4].toInt() != VT_TILE_BORDER)
+    {
+        qDebug() << "Unsupported tile pyramid:" << dir;
+        return false;
+    }
+
+    m_dir = dir;
+    m_layers = layers;
+    m_width = fields[0].toInt();
+    m_height = fields[1].toInt();
+    m_levels = fields[2].toInt();
+    if(m_width <= 0 || m_height <= 0 || m_levels != pyramidLevels(m_width, m_height))
+    {
+        qDebug() << "Damaged tile pyramid:" << dir;
+        return false;
+    }
+
+    for(auto &layer : layers)
+    {
+        if(!QDir(dir + "/" + layer.name).exists())
+        {
+            qDebug() << "Tile pyramid has no layer:" << layer.name;
+            return false;
+        }
+    }
+
+    // Число слотов из бюджета видеопамяти и предела размера текстуры
+    size_t slot_bytes = 0;
+    for(auto &layer : layers)
+        slot_bytes += slotBytes(layer.compression);
+    GLint max_size;
+    m_gl->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    m_slots = std::max(2, std::min<int>(std::sqrt(double(VT_VRAM_BUDGET / slot_bytes)), max_size / VT_SLOT_SIZE));
+
+    size_t atlas_size = size_t(m_slots) * VT_SLOT_SIZE;
+    m_atlases.resize(layers.size());
+    m_gl->glGenTextures(m_atlases.size(), m_atlases.data());
+    for(size_t i = 0; i < layers.size(); i++)
+    {
+        GLenum format = compressedFormat(layers[i].compression);
+        m_gl->glBindTexture(GL_TEXTURE_2D, m_atlases[i]);
+        m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        m_gl->glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, atlas_size, atlas_size, 0,
+                                     slotBytes(layers[i].compression) * m_slots * m_slots, NULL);
+    }
+
+    // Таблица страниц: mip-уровень на уровень пирамиды, стороны - степени двойки
+    int table_width = nextPowerOfTwo(tilesX(0));
+    int table_height = nextPowerOfTwo(tilesY(0));
+    m_gl->glGenTextures(1, &m_page_table);
+    m_gl->glBindTexture(GL_TEXTURE_2D, m_page_table);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_levels - 1);
+    for(int l = 0; l < m_levels; l++)
+        m_gl->glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8UI, levelSize(table_width, l), levelSize(table_height, l), 0,
+                           GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    m_gl->glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_slot_pages.assign(m_slots * m_slots, 0);
+    m_free_slots.clear();
+    for(int s = m_slots * m_slots - 1; s >= 0; s--)
+        m_free_slots.push_back(s);
+
+    // Верхний уровень нужен всегда: он - запасной для любой точки
+    for(int y = 0; y < tilesY(m_levels - 1); y++)
+        for(int x = 0; x < tilesX(m_levels - 1); x++)
+            request(m_levels - 1, x, y);
+    m_pages_dirty = true;
+
+    return true;
+}
+
+void VirtualTexture::params(float vt[4]) const
+{
+    vt[0] = m_width;
+    vt[1] = m_height;
+    vt[2] = isOpen() ? m_levels : 0;
+    vt[3] = m_slots;
+}
+
+void VirtualTexture::bind(GLuint first_unit)
+{
+    for(size_t i = 0; i < m_atlases.size(); i++)
+    {
+        m_gl->glActiveTexture(GL_TEXTURE0 + first_unit + i);
+        m_gl->glBindTexture(GL_TEXTURE_2D, m_atlases[i]);
+    }
+    m_gl->glActiveTexture(GL_TEXTURE0 + first_unit + m_atlases.size());
+    m_gl->glBindTexture(GL_TEXTURE_2D, m_page_table);
+}
+
+void VirtualTexture::beginFeedback(int width, int height)
+{
+    int w = std::max(1, width / VT_FEEDBACK_SCALE);
+    int h = std::max(1, height / VT_FEEDBACK_SCALE);
+
+    // Кадр может рисоваться не в окно, а в FBO автономного режима
+    m_gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &m_target_fbo);
+
+    if(w != m_feedback_width || h != m_feedback_height)
+    {
+        if(!m_feedback_fbo)
+        {
+            m_gl->glGenFramebuffers(1, &m_feedback_fbo);
+            m_gl->glGenRenderbuffers(1, &m_feedback_rbo);
+            m_gl->glGenBuffers(VT_FEEDBACK_BUFFERS, m_feedback_pbo);
+        }
+
+        m_gl->glBindRenderbuffer(GL_RENDERBUFFER, m_feedback_rbo);
+        m_gl->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA16UI, w, h);
+        m_gl->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        m_gl->glBindFramebuffer(GL_FRAMEBUFFER, m_feedback_fbo);
+        m_gl->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_feedback_rbo);
+
+        for(int i = 0; i < VT_FEEDBACK_BUFFERS; i++)
+        {
+            m_gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedback_pbo[i]);
+            m_gl->glBufferData(GL_PIXEL_PACK_BUFFER, size_t(w) * h * 4 * sizeof(GLushort), NULL, GL_STREAM_READ);
+            m_feedback_size[i] = 0;
+        }
+        m_gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        m_feedback_width = w;
+        m_feedback_height = h;
+    }
+
+    m_gl->glBindFramebuffer(GL_FRAMEBUFFER, m_feedback_fbo);
+    m_gl->glViewport(0, 0, w, h);
+    const GLuint zero[4] = {0, 0, 0, 0};
+    m_gl->glClearBufferuiv(GL_COLOR, 0, zero);
+}
+
+void VirtualTexture::endFeedback(int width, int height)
+{
+    // Чтение в PBO не ждет GPU, данные разбираются через VT_FEEDBACK_BUFFERS кадров
+    m_gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedback_pbo[m_feedback_index]);
+    m_gl->glReadPixels(0, 0, m_feedback_width, m_feedback_height, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+    m_gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_feedback_size[m_feedback_index] = m_feedback_width * m_feedback_height;
+    m_feedback_index = (m_feedback_index + 1) % VT_FEEDBACK_BUFFERS;
+
+    m_gl->glBindFramebuffer(GL_FRAMEBUFFER, m_target_fbo);
+    m_gl->glViewport(0, 0, width, height);
+}
+
+void VirtualTexture::request(int level, int x, int y)
+{
+    // Тайл и все его предки нужны в этом кадре
+    for(; level < m_levels; level++, x /= 2, y /= 2)
+    {
+        Page &page = m_pages[pageKey(level, x, y)];
+        if(page.last_used == m_frame)
+            return;
+        page.last_used = m_frame;
+
+        if(page.slot < 0 && !page.loading && !page.missing)
+            m_queue.push_back(pageKey(level, x, y));
+    }
+}
+
+void VirtualTexture::readFeedback()
+{
+    int index = m_feedback_index;
+    if(!m_feedback_size[index])
+        return;
+
+    size_t count = m_feedback_size[index];
+    m_feedback_size[index] = 0;
+
+    m_gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedback_pbo[index]);
+    const GLushort *pixels = (const GLushort *)m_gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * 4 * sizeof(GLushort),
+                                                                      GL_MAP_READ_BIT);
+    if(pixels)
+    {
+        // Соседние пиксели почти всегда просят один тайл
+        std::vector<uint64_t> keys;
+        uint64_t last = ~uint64_t(0);
+        for(size_t i = 0; i < count; i++, pixels += 4)
+        {
+            if(!pixels[3])
+                continue;
+            uint64_t key = pageKey(pixels[2], pixels[0], pixels[1]);
+            if(key != last)
+                keys.push_back(key);
+            last = key;
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        for(uint64_t key : keys)
+        {
+            int level = key >> 48;
+            int y = (key >> 24) & 0xFFFFFF;
+            int x = key & 0xFFFFFF;
+            if(level < m_levels && x < tilesX(level) && y < tilesY(level))
+                request(level, x, y);
+        }
+        m_gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    m_gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+int VirtualTexture::allocateSlot()
+{
+    if(!m_free_slots.empty())
+    {
+        int slot = m_free_slots.back();
+        m_free_slots.pop_back();
+        return slot;
+    }
+
+    // Вытесняется самый давно нужный тайл, кроме верхнего уровня и нужных в этом кадре
+    int victim = -1;
+    uint64_t oldest = m_frame;
+    for(int s = 0; s < (int)m_slot_pages.size(); s++)
+    {
+        uint64_t key = m_slot_pages[s];
+        if((int)(key >> 48) == m_levels - 1)
+            continue;
+        const Page &page = m_pages[key];
+        if(page.last_used < oldest)
+        {
+            oldest = page.last_used;
+            victim = s;
+        }
+    }
+
+    if(victim >= 0)
+    {
+        m_pages.erase(m_slot_pages[victim]);
+        m_pages_dirty = true;
+    }
+    return victim;
+}
+
+void VirtualTexture::update()
+{
+    if(!isOpen())
+        return;
+
+    readFeedback();
+
+    // Загрузка прочитанных тайлов в атласы в пределах бюджета кадра
+    std::vector<Loaded> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t count = std::min<size_t>(m_loaded.size(), VT_MAX_UPLOADS);
+        loaded.assign(m_loaded.begin(), m_loaded.begin() + count);
+        m_loaded.erase(m_loaded.begin(), m_loaded.begin() + count);
+    }
+
+    for(auto &l : loaded)
+    {
+        m_loads--;
+        Page &page = m_pages[l.key];
+        page.loading = false;
+        if(l.layers.empty())
+        {
+            qDebug() << "Error during tile loading:" << m_dir << (int)(l.key >> 48)
+                     << (int)(l.key & 0xFFFFFF) << (int)((l.key >> 24) & 0xFFFFFF);
+            page.missing = true;
+            continue;
+        }
+
+        // Ненужный уже тайл не вытесняет нужные, верхний уровень нужен всегда
+        int level = l.key >> 48;
+        if(level < m_levels - 1 && page.last_used + VT_FEEDBACK_BUFFERS + 1 < m_frame)
+            continue;
+
+        int slot = allocateSlot();
+        if(slot < 0)
+            continue;
+
+        int x = slot % m_slots * VT_SLOT_SIZE;
+        int y = slot / m_slots * VT_SLOT_SIZE;
+        for(size_t i = 0; i < m_atlases.size(); i++)
+        {
+            const CompressedTexture &tile = l.layers[i];
+            m_gl->glBindTexture(GL_TEXTURE_2D, m_atlases[i]);
+            m_gl->glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VT_SLOT_SIZE, VT_SLOT_SIZE,
+                                            tile.format(), tile.levelSize(0), tile.levelData(0));
+        }
+        m_gl->glBindTexture(GL_TEXTURE_2D, 0);
+
+        m_pages[l.key].slot = slot;
+        m_slot_pages[slot] = l.key;
+        m_pages_dirty = true;
+    }
+
+    // Чтение недостающих тайлов, грубые уровни первыми
+    std::sort(m_queue.begin(), m_queue.end(), [](uint64_t a, uint64_t b) { return (a >> 48) > (b >> 48); });
+    for(uint64_t key : m_queue)
+    {
+        if(m_loads >= VT_MAX_LOADS)
+            break;
+
+        Page &page = m_pages[key];
+        if(page.slot >= 0 || page.loading)
+            continue;
+        page.loading = true;
+        m_loads++;
+        m_pool.start(new LoadTask(this, key, key >> 48, key & 0xFFFFFF, (key >> 24) & 0xFFFFFF), key >> 48);
+    }
+    m_queue.clear();
+
+    if(m_pages_dirty)
+        updatePageTable();
+    m_frame++;
+}
+
+void VirtualTexture::updatePageTable()
+{
+    // Каждый тайл ссылается на себя, если загружен, иначе на запись родителя
+    std::vector<uint8_t> parent, current;
+    m_gl->glBindTexture(GL_TEXTURE_2D, m_page_table);
+    for(int level = m_levels - 1; level >= 0; level--)
+    {
+        int w = tilesX(level), h = tilesY(level);
+        int pw = level + 1 < m_levels ? tilesX(level + 1) : 0;
+        current.assign(size_t(w) * h * 4, 0);
+
+        for(int y = 0; y < h; y++)
+        {
+            for(int x = 0; x < w; x++)
+            {
+                uint8_t *entry = &current[(size_t(y) * w + x) * 4];
+                auto it = m_pages.find(pageKey(level, x, y));
+                if(it != m_pages.end() && it->second.slot >= 0)
+                {
+                    entry[0] = it->second.slot % m_slots;
+                    entry[1] = it->second.slot / m_slots;
+                    entry[2] = level;
+                    entry[3] = 1;
+                }
+                else if(pw)
+                    std::memcpy(entry, &parent[(size_t(y / 2) * pw + x / 2) * 4], 4);
+            }
+        }
+
+        m_gl->glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, w, h, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, current.data());
+        parent.swap(current);
+    }
+    m_gl->glBindTexture(GL_TEXTURE_2D, 0);
+    m_pages_dirty = false;
+}
+
+bool buildTilePyramid(const QString &source, const QString &dir, const QString &layer,
+                      TextureCompression compression, int width, int height)
+{
+    QImageReader reader(source);
+    if(width > 0 && height > 0)
+        reader.setScaledSize(QSize(width, height));
+    QImage image = reader.read().convertToFormat(QImage::Format_ARGB32);
+    if(image.isNull())
+    {
+        qDebug() << "Error during texture loading:" << source;
+        return false;
+    }
+
+    width = image.width();
+    height = image.height();
+    int levels = pyramidLevels(width, height);
+
+    QFile info(dir + "/" VT_PYRAMID_FILE);
+    if(!QDir().mkpath(dir) || !info.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+       info.write(QString("%1 %2 %3 %4 %5\n").arg(width).arg(height).arg(levels)
+                  .arg(VT_TILE_SIZE).arg(VT_TILE_BORDER).toUtf8()) < 0)
+    {
+        qDebug() << "Error during tile pyramid writing:" << dir;
+        return false;
+    }
+    info.close();
+
+    QByteArray key = layer.toUtf8();
+    for(int level = 0; level < levels; level++)
+    {
+        if(level)
+            image = image.scaled(levelSize(width, level), levelSize(height, level),
+                                 Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+        QString level_dir = QString("%1/%2/%3").arg(dir).arg(layer).arg(level);
+        if(!QDir().mkpath(level_dir))
+        {
+            qDebug() << "Error during tile pyramid writing:" << level_dir;
+            return false;
+        }
+
+        // Строки тайлов сжимаются параллельно
+        int w = image.width(), h = image.height();
+        int tiles_x = (w + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+        int tiles_y = (h + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+        std::atomic<int> next_row(0);
+        std::atomic<bool> ok(true);
+
+        auto worker = [&]()
+        {
+            QImage tile(VT_SLOT_SIZE, VT_SLOT_SIZE, QImage::Format_ARGB32);
+            for(int ty = next_row++; ty < tiles_y && ok; ty = next_row++)
+            {
+                for(int tx = 0; tx < tiles_x; tx++)
+                {
+                    for(int y = 0; y < VT_SLOT_SIZE; y++)
+                    {
+                        int sy = std::min(std::max(ty * VT_TILE_SIZE + y - VT_TILE_BORDER, 0), h - 1);
+                        const QRgb *src = (const QRgb *)image.constScanLine(sy);
+                        QRgb *dst = (QRgb *)tile.scanLine(y);
+                        for(int x = 0; x < VT_SLOT_SIZE; x++)
+                            dst[x] = src[((tx * VT_TILE_SIZE + x - VT_TILE_BORDER) % w + w) % w];
+                    }
+
+                    CompressedTexture compressed;
+                    buildCompressedTexture(tile, compression, key, compressed, false);
+
+                    QFile file(tilePath(dir, layer, level, tx, ty));
+                    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+                       file.write(compressed.data()) != compressed.data().size())
+                    {
+                        qDebug() << "Error during tile pyramid writing:" << file.fileName();
+                        ok = false;
+                    }
+                }
+            }
+        };
+
+        std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()));
+        for(auto &t : threads)
+            t = std::thread(worker);
+        for(auto &t : threads)
+            t.join();
+
+        if(!ok)
+            return false;
+    }
+
+    return true;
+}
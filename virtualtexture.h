@@ -0,0 +1,177 @@
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#include <QString>
+#include <QThreadPool>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "texturecache.h"
+
+// Размер тайла без рамки и ширина рамки. Рамка копирует соседние пиксели
+// уровня, чтобы билинейная выборка не захватывала чужой тайл атласа
+#define VT_TILE_SIZE 256
+#define VT_TILE_BORDER 4
+#define VT_SLOT_SIZE (VT_TILE_SIZE + 2 * VT_TILE_BORDER)
+
+// Объем видеопамяти под атласы всех слоев одной виртуальной текстуры
+#define VT_VRAM_BUDGET (96 * 1024 * 1024)
+
+// Тайлов, загружаемых в атлас за кадр, и одновременно читаемых с диска
+#define VT_MAX_UPLOADS 8
+#define VT_MAX_LOADS 32
+
+// Буфер обратной связи меньше окна во столько раз по каждой оси
+#define VT_FEEDBACK_SCALE 8
+#define VT_FEEDBACK_BUFFERS 2
+
+// Описание пирамиды в ее каталоге
+#define VT_PYRAMID_FILE "pyramid.txt"
+
+// Общие функции GLSL для выборки и обратной связи.
+// vt = (ширина, высота, число уровней, слотов атласа по стороне), 0 - текстура не открыта
+#define VT_GLSL \
+    "const float VT_TILE = " QT_STRINGIFY(VT_TILE_SIZE) ".0;\n" \
+    "const float VT_BORDER = " QT_STRINGIFY(VT_TILE_BORDER) ".0;\n" \
+    "vec2 vtWrap(vec2 uv) {\n" \
+    "   return vec2(fract(uv.x), clamp(uv.y, 0.0, 0.99999));\n" \
+    "}\n" \
+    "float vtLevel(vec4 vt, vec2 uv, float bias) {\n" \
+    "   vec2 dx = dFdx(uv * vt.xy);\n" \
+    "   vec2 dy = dFdy(uv * vt.xy);\n" \
+    "   float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + bias;\n" \
+    "   return clamp(floor(lod), 0.0, max(vt.z - 1.0, 0.0));\n" \
+    "}\n" \
+    "vec2 vtPixel(vec4 vt, vec2 uv, float level) {\n" \
+    "   return vtWrap(uv) * max(floor(vt.xy / exp2(level)), vec2(1.0));\n" \
+    "}\n" \
+    "uvec4 vtPage(usampler2D pages, vec4 vt, vec2 uv, float level) {\n" \
+    "   return texelFetch(pages, ivec2(vtPixel(vt, uv, level) / VT_TILE), int(level));\n" \
+    "}\n" \
+    "vec4 vtSample(sampler2D atlas, vec4 vt, uvec4 page, vec2 uv) {\n" \
+    "   vec2 p = vtPixel(vt, uv, float(page.z));\n" \
+    "   vec2 local = p - floor(p / VT_TILE) * VT_TILE;\n" \
+    "   vec2 texel = vec2(page.xy) * (VT_TILE + 2.0 * VT_BORDER) + VT_BORDER + local;\n" \
+    "   return textureLod(atlas, texel / (vt.w * (VT_TILE + 2.0 * VT_BORDER)), 0.0);\n" \
+    "}\n"
+
+// Слой виртуальной текстуры: подкаталог пирамиды и формат сжатия тайлов
+struct VirtualLayer
+{
+    QString name;
+    TextureCompression compression;
+};
+
+// Виртуальная текстура из пирамиды тайлов на диске.
+// Все слои разбиты на одинаковые тайлы и делят одну таблицу страниц и
+// одно размещение в атласах. Нужные тайлы определяются проходом обратной
+// связи: в уменьшенный буфер рисуется поверхность, шейдер пишет в него
+// уровень и номер тайла, результат читается через PBO кадром позже.
+// Тайлы читаются в пуле потоков и занимают слоты атласа в пределах
+// VT_VRAM_BUDGET, при нехватке вытесняется давно не нужный тайл.
+// Таблица страниц для каждого тайла каждого уровня хранит слот лучшего
+// загруженного тайла (сам или ближайший грубый предок)
+class VirtualTexture
+{
+    public:
+        explicit VirtualTexture(QOpenGLFunctions_3_3_Core *gl);
+        ~VirtualTexture();
+
+        // Открытие пирамиды, построенной buildTilePyramid для всех слоев
+        bool open(const QString &dir, const std::vector<VirtualLayer> &layers);
+        bool isOpen() const { return !m_atlases.empty(); }
+
+        // Параметры vt для шейдера
+        void params(float vt[4]) const;
+
+        // Атласы слоев привязываются к блокам first_unit..., таблица страниц - за ними
+        void bind(GLuint first_unit);
+
+        // Проход обратной связи окна width x height. Между begin и end
+        // рисуется поверхность шейдером, пишущим vtFeedback
+        void beginFeedback(int width, int height);
+        void endFeedback(int width, int height);
+
+        // Разбор обратной связи, загрузка тайлов и таблицы страниц.
+        // Вызывается каждый кадр в контексте GL
+        void update();
+
+        // Есть запрошенные, но еще не загруженные в атлас тайлы
+        bool isLoading() const { return m_loads > 0; }
+
+    private:
+        struct Page
+        {
+            int slot = -1;
+            bool loading = false;
+            bool missing = false;
+            uint64_t last_used = 0;
+        };
+
+        struct Loaded
+        {
+            uint64_t key;
+            std::vector<CompressedTexture> layers;
+        };
+
+        class LoadTask;
+
+        static uint64_t pageKey(int level, int x, int y) { return uint64_t(level) << 48 | uint64_t(y) << 24 | x; }
+        int tilesX(int level) const;
+        int tilesY(int level) const;
+        void request(int level, int x, int y);
+        int allocateSlot();
+        void readFeedback();
+        void updatePageTable();
+
+        QOpenGLFunctions_3_3_Core *m_gl;
+        QString m_dir;
+        std::vector<VirtualLayer> m_layers;
+        int m_width = 0;
+        int m_height = 0;
+        int m_levels = 0;
+
+        // Атласы и таблица страниц
+        std::vector<GLuint> m_atlases;
+        GLuint m_page_table = 0;
+        int m_slots = 0;
+        std::vector<uint64_t> m_slot_pages;
+        std::vector<int> m_free_slots;
+        bool m_pages_dirty = false;
+
+        // Состояние тайлов и их очередь загрузки
+        std::unordered_map<uint64_t, Page> m_pages;
+        std::vector<uint64_t> m_queue;
+        int m_loads = 0;
+        uint64_t m_frame = 1;
+
+        // Буфер обратной связи и PBO для его асинхронного чтения
+        GLuint m_feedback_fbo = 0;
+        GLuint m_feedback_rbo = 0;
+        GLint m_target_fbo = 0;
+        int m_feedback_width = 0;
+        int m_feedback_height = 0;
+        GLuint m_feedback_pbo[VT_FEEDBACK_BUFFERS] = {};
+        int m_feedback_size[VT_FEEDBACK_BUFFERS] = {};
+        int m_feedback_index = 0;
+
+        // Прочитанные тайлы из пула
+        QThreadPool m_pool;
+        std::mutex m_mutex;
+        std::vector<Loaded> m_loaded;
+        std::atomic<bool> m_cancelled;
+};
+
+// Нарезка изображения в пирамиду тайлов слоя layer каталога dir.
+// Уровень 0 - исходное изображение (или width x height, если заданы,
+// чтобы слои совпадали), каждый следующий вдвое меньше, пока уровень
+// не поместится в один тайл. По горизонтали рамка заворачивается
+bool buildTilePyramid(const QString &source, const QString &dir, const QString &layer,
+                      TextureCompression compression, int width = 0, int height = 0);
+
+#endif
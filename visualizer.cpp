@@ -1,13 +1,18 @@
 #include "visualizer.h"
 
-Visualizer::Visualizer() : QWindow()
+Visualizer::Visualizer(const QSize &offscreen_size) : QWindow(), m_keyframes(this), m_ground_tracks(this), m_shaders(this), m_profiler(this), m_textures(this), m_earth_vt(this), m_clouds_vt(this)
 {
     m_gl_context = new QOpenGLContext;
     m_gl_format = new QSurfaceFormat;
     setSurfaceType(OpenGLSurface);
 
     // Для инициализации GL контекста необходимо, чтобы виджет имел заданый размер!
-    resize(1080, 720);
+    m_headless = offscreen_size.isValid();
+    resize(m_headless ? offscreen_size : QSize(1080, 720));
+
+    // Автономные кадры рисуются на заданные моменты, часы стоят
+    if(m_headless)
+        m_clock.setPaused(true);
 
     // Инициализация GL контекста
     m_gl_format->setRenderableType(QSurfaceFormat::OpenGL);
@@ -20,6 +25,35 @@ Visualizer::Visualizer() : QWindow()
 
     m_gl_context->setFormat(*m_gl_format);
     m_gl_context->create();
+
+    // Поверхность без окна: контекст работает и без дисплея (например, на llvmpipe)
+    if(m_headless)
+    {
+        m_offscreen = new QOffscreenSurface;
+        m_offscreen->setFormat(m_gl_context->format());
+        m_offscreen->create();
+    }
+
+    // Кадр запрашивается таймером, чтобы выдержать темп кадров и режим покоя
+    m_frame_timer.setSingleShot(true);
+    m_frame_timer.setTimerType(Qt::PreciseTimer);
+    QObject::connect(&m_frame_timer, &QTimer::timeout, [this] { requestUpdate(); });
+
+    // Готовый кадр пропагации приходит из фонового потока
+    m_propagation.setReadyCallback([this] {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::Type(RENDER_REQUEST_EVENT)));
+    });
+
+    // Как и таблица пролетов и сближения
+    m_passes.setReadyCallback([this] {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::Type(RENDER_REQUEST_EVENT)));
+    });
+    m_conjunctions.setReadyCallback([this] {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::Type(RENDER_REQUEST_EVENT)));
+    });
+    m_ephemeris.setReadyCallback([this] {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::Type(RENDER_REQUEST_EVENT)));
+    });
 }
 
 Visualizer::~Visualizer()
@@ -31,6 +65,10 @@ Visualizer::~Visualizer()
     // Освобождение VAO
     glDeleteVertexArrays(1, &m_sphere_vao_id);
     glDeleteVertexArrays(1, &m_orb_vao_id);
+    glDeleteVertexArrays(1, &m_mark_vao_id);
+    glDeleteVertexArrays(1, &m_overlay_vao_id);
+    glDeleteVertexArrays(1, &m_track_vao_id);
+    glDeleteVertexArrays(1, &m_conj_vao_id);
 
     // Освобождение текстур
     glDeleteTextures(1, &m_day_map_id);
@@ -41,14 +79,23 @@ Visualizer::~Visualizer()
     glDeleteTextures(1, &m_space_map_id);
     glDeleteTextures(1, &m_moon_map_id);
     glDeleteTextures(1, &m_sun_map_id);
+    glDeleteTextures(1, &m_sat_colors_tbo_id);
+    glDeleteTextures(1, &m_sat_orbits_tbo_id);
 
     // Освобождение шейдеров
     glDeleteProgram(m_earth_program_id);
+    glDeleteProgram(m_feedback_program_id);
     glDeleteProgram(m_space_program_id);
     glDeleteProgram(m_moon_program_id);
     glDeleteProgram(m_sun_program_id);
     glDeleteProgram(m_orb_program_id);
     glDeleteProgram(m_mark_program_id);
+    glDeleteProgram(m_overlay_program_id);
+    glDeleteProgram(m_track_program_id);
+    glDeleteProgram(m_conj_program_id);
+
+    delete m_fbo;
+    delete m_offscreen;
 }
 
 void Visualizer::setSunPosition(QVector3D position)
@@ -83,6 +130,280 @@ void Visualizer::setCameraTarget(QVector3D target)
     updateViewUniforms();
 }
 
+void Visualizer::setCatalog(const std::vector<OrbitalElements> &elements, const QVector3D &color)
+{
+    m_snapshot.close();
+
+    size_t count = elements.size();
+    m_catalog_elements = elements;
+    m_propagation.setElements(elements.data(), count, 1.0f / SCENE_UNIT_KM);
+    m_ephemeris.setElements(elements.data(), count, 1.0f / SCENE_UNIT_KM);
+    m_propagation_loaded = true;
+    replaceCatalog(count, color);
+
+    float offset[3], tilt[3], scale[3];
+    for(size_t i = 0; i < count; i++)
+    {
+        orbitEllipse(elements[i], 1.0 / SCENE_UNIT_KM, offset, tilt, scale);
+        satellites.setOrbit(m_catalog_handles[i], QVector3D(offset[0], offset[1], offset[2]),
+                            QVector3D(tilt[0], tilt[1], tilt[2]), QVector3D(scale[0], scale[1], scale[2]));
+    }
+
+    setEpoch(m_clock.now());
+}
+
+bool Visualizer::openCatalog(const QString &path, const QVector3D &color)
+{
+    std::vector<OrbitalElements> elements;
+    if(!loadCatalog(path, elements))
+        return false;
+
+    setCatalog(elements, color);
+    return true;
+}
+
+bool Visualizer::openSnapshot(const QString &path, const QVector3D &color)
+{
+    if(!m_snapshot.open(path))
+        return false;
+    m_catalog_elements.clear();
+
+    // Кадры прежнего каталога больше не нужны, а пропагатор нового
+    // инициализируется, только когда время выйдет за окно эфемерид
+    m_propagation.setElements(nullptr, 0, m_snapshot.scale());
+    m_ephemeris.setElements(nullptr, 0, m_snapshot.scale());
+    m_propagation_loaded = false;
+
+    size_t count = m_snapshot.size();
+    replaceCatalog(count, color);
+    m_snapshot_positions.assign(count * 3, 0.0f);
+
+    // Параметры орбит берутся из снимка как есть
+    const float *o = m_snapshot.orbits();
+    for(size_t i = 0; i < count; i++, o += SNAPSHOT_ORBIT_FLOATS)
+        satellites.setOrbit(m_catalog_handles[i], QVector3D(o[0], o[1], o[2]),
+                            QVector3D(o[3], o[4], o[5]), QVector3D(o[6], o[7], o[8]));
+
+    setEpoch(m_clock.now());
+    return true;
+}
+
+bool Visualizer::saveSnapshot(const QString &path, const QString &catalog_path)
+{
+    std::vector<OrbitalElements> elements;
+    if(!loadCatalog(catalog_path, elements))
+        return false;
+
+    return writeSnapshot(path, elements.data(), elements.size(), 1.0f / SCENE_UNIT_KM,
+                         m_epoch_jd, SNAPSHOT_STEP, SNAPSHOT_WINDOW_SAMPLES);
+}
+
+void Visualizer::replaceCatalog(size_t count, const QVector3D &color)
+{
+    m_ground_tracks.setElements(nullptr, 0);
+    m_keyframes.clear();
+    m_conjunction_table.clear();
+    m_conjunction_lines.clear();
+    m_conjunctions_pending = false;
+    m_catalog_color = color;
+    satellites.remove(m_catalog_handles.size(), m_catalog_handles.data());
+    m_catalog_handles.resize(count);
+
+    // Метки вставляются одним пакетом, эллипсы орбит назначаются после
+    std::vector<QVector3D> positions(count);
+    satellites.insert(count, positions.data(), color, m_catalog_handles.data());
+    invalidate(DirtyData);
+}
+
+const OrbitalElements *Visualizer::catalogElements(size_t &count) const
+{
+    count = m_snapshot.isOpen() ? m_snapshot.size() : m_catalog_elements.size();
+    return m_snapshot.isOpen() ? m_snapshot.elements() : m_catalog_elements.data();
+}
+
+void Visualizer::setGroundTracks(const std::vector<size_t> &catalog_indices)
+{
+    size_t catalog_size;
+    const OrbitalElements *catalog = catalogElements(catalog_size);
+
+    std::vector<OrbitalElements> elements;
+    std::vector<uint32_t> indices;
+    for(size_t i : catalog_indices)
+    {
+        if(i < catalog_size)
+        {
+            elements.push_back(catalog[i]);
+            indices.push_back(i);
+        }
+    }
+
+    // Точки трасс на уже подогнанных отрезках берутся из кэша эфемерид
+    m_ground_tracks.setElements(elements.data(), elements.size(), &m_ephemeris, indices.data());
+    invalidate(DirtyData);
+}
+
+void Visualizer::setGroundTrackWindow(double past, double future, double step)
+{
+    m_ground_tracks.setWindow(past, future, step);
+    invalidate(DirtyData);
+}
+
+void Visualizer::setGroundStations(const std::vector<GroundStation> &stations)
+{
+    m_passes.setStations(stations);
+    invalidate(DirtyData);
+}
+
+void Visualizer::predictPasses(double begin_jd, double end_jd,
+                               std::function<void(const std::vector<SatellitePass> &)> callback)
+{
+    size_t count;
+    const OrbitalElements *elements = catalogElements(count);
+    m_passes_callback = callback;
+    m_passes.start(elements, count, begin_jd, end_jd);
+}
+
+void Visualizer::screenConjunctions(double begin_jd, double end_jd, double threshold_km,
+                                    std::function<void(const std::vector<Conjunction> &)> callback)
+{
+    size_t count;
+    const OrbitalElements *elements = catalogElements(count);
+    m_conjunctions_callback = callback;
+    m_conjunctions_pending = true;
+    m_conjunctions.setThreshold(threshold_km);
+    m_conjunctions.start(elements, count, begin_jd, end_jd);
+}
+
+void Visualizer::setEpoch(double jd)
+{
+    // Перемотка часов: ключи нового момента запрашиваются в кадре
+    m_clock.setTime(jd);
+    m_epoch_jd = jd;
+    invalidate(DirtyData);
+
+    // Внутри окна снимка метки встают на место сразу, до первых ключей
+    if(m_snapshot.covers(jd))
+    {
+        m_snapshot.interpolate(jd, m_snapshot_positions.data());
+        satellites.setPositions(m_catalog_handles.size(), m_catalog_handles.data(), m_snapshot_positions.data());
+    }
+}
+
+double Visualizer::epoch() const
+{
+    return m_clock.now();
+}
+
+void Visualizer::scrub(double seconds)
+{
+    setEpoch(m_clock.now() + seconds / 86400.0);
+}
+
+void Visualizer::setPaused(bool paused)
+{
+    m_clock.setPaused(paused);
+    invalidate(0);
+}
+
+bool Visualizer::isPaused() const
+{
+    return m_clock.isPaused();
+}
+
+void Visualizer::setTimeWarp(double warp)
+{
+    m_clock.setWarp(warp);
+
+    // Ключи идут раз в KEYFRAME_INTERVAL настенного времени, но не реже
+    // KEYFRAME_MAX_SPAN модельного: дальше сплайн заметно срезает орбиту
+    m_keyframes.setSpan(std::min(m_clock.warp() * KEYFRAME_INTERVAL, KEYFRAME_MAX_SPAN));
+    invalidate(0);
+}
+
+double Visualizer::timeWarp() const
+{
+    return m_clock.warp();
+}
+
+void Visualizer::updateClock()
+{
+    m_epoch_jd = m_clock.now();
+    if(m_epoch_jd == m_earth_epoch_jd)
+        return;
+
+    // Сцена инерциальна (TEME), поэтому вращается Земля.
+    // Нулевой меридиан текстуры считается лежащим на оси x
+    m_earth_epoch_jd = m_epoch_jd;
+    m_earth_rotation = greenwichSiderealTime(m_epoch_jd) * 180.0 / M_PI;
+    updateEarthUniforms();
+}
+
+void Visualizer::loadPropagation()
+{
+    if(m_propagation_loaded)
+        return;
+    m_propagation.setElements(m_snapshot.elements(), m_snapshot.size(), m_snapshot.scale());
+    m_ephemeris.setElements(m_snapshot.elements(), m_snapshot.size(), m_snapshot.scale());
+    m_propagation_loaded = true;
+}
+
+QImage Visualizer::renderFrame(double jd, const QVector3D &target, const QVector3D &direction, float zoom, bool grab)
+{
+    if(!m_headless)
+        return QImage();
+    if(!m_is_init)
+        init();
+
+    m_camera_target = target;
+    m_camera_direction = direction.normalized();
+    m_zoom = zoom;
+    updateViewUniforms();
+
+    // Часы автономного режима стоят на паузе, кадр рисуется на момент jd.
+    // Метки вне окна снимка берутся из кэша эфемерид. Первый кадр отрезка
+    // считается сразу всеми потоками, пока отрезок подгоняется в фоне, а
+    // следующие кадры того же отрезка дожидаются подгонки: она дешевле
+    // пропагации каждого кадра
+    setEpoch(jd);
+    if(!m_snapshot.covers(jd))
+    {
+        loadPropagation();
+        m_headless_positions.resize(m_propagation.size() * 3);
+        m_ephemeris.wait(jd);
+        m_ephemeris.request(jd);
+        if(!m_ephemeris.evaluate(jd, m_headless_positions.data()))
+            m_propagation.propagate(jd, m_headless_positions.data());
+        satellites.setPositions(m_catalog_handles.size(), m_catalog_handles.data(), m_headless_positions.data());
+    }
+
+    // Снимок не должен содержать заглушек текстур
+    while(!m_textures.isComplete())
+    {
+        m_textures.update();
+        QThread::msleep(1);
+    }
+
+    // Тайлы виртуальных текстур запрашиваются по обратной связи кадра,
+    // поэтому кадр перерисовывается, пока они не догрузятся
+    bool vt = m_earth_vt.isOpen() || m_clouds_vt.isOpen();
+    for(int i = 0; i < HEADLESS_MAX_FRAMES; i++)
+    {
+        render();
+        bool loading = m_earth_vt.isLoading() || m_clouds_vt.isLoading();
+        if(!loading && !(vt && m_settle_frames > 0))
+            break;
+        if(loading)
+            QThread::msleep(1);
+    }
+
+    if(!grab)
+    {
+        glFinish();
+        return QImage();
+    }
+    return m_fbo->toImage();
+}
+
 void Visualizer::exposeEvent(QExposeEvent *event)
 {
     Q_UNUSED(event);
@@ -92,10 +413,70 @@ void Visualizer::exposeEvent(QExposeEvent *event)
 
 void Visualizer::render()
 {
+    if(!m_headless && !isExposed())
+        return;
     if(!m_is_init)
         init();
 
+    long int frame_start = MILLS;
+    if(m_fbo)
+        m_fbo->bind();
+    m_profiler.beginFrame();
+
+    // Догрузка текстур в пределах бюджета кадра
+    m_profiler.beginPass(PassStreaming);
+    m_textures.update();
+
+    // Момент кадра по часам модели, поворот Земли под него и недостающие ключи меток
+    updateClock();
+    updateCatalogPositions();
+
+    // Отрезок ключей под момент кадра. Выбор меток должен видеть те же положения, что и кадр
+    if(m_keyframes.update(m_epoch_jd, satellites, m_catalog_handles))
+    {
+        m_frame.key_params[0] = m_keyframes.fraction();
+        m_frame.key_params[1] = m_keyframes.segmentSeconds();
+        m_frame_dirty = true;
+        m_picker_stale = true;
+    }
+
+    // Загрузка досчитанных точек трасс и запуск расчета под новое окно
+    m_ground_tracks.update(m_epoch_jd);
+
+    // Готовая таблица пролетов отдается вызвавшему
+    if(m_passes.acquire(m_pass_table) && m_passes_callback)
+        m_passes_callback(m_pass_table);
+
+    // Как и сближения, которые сразу перекрашивают метки
+    std::vector<Conjunction> conjunctions;
+    if(m_conjunctions.acquire(conjunctions) && m_conjunctions_pending)
+    {
+        m_conjunctions_pending = false;
+        m_conjunction_table.swap(conjunctions);
+        applyConjunctionColors();
+        if(m_conjunctions_callback)
+            m_conjunctions_callback(m_conjunction_table);
+    }
+
+    // Обратная связь виртуальных текстур читается через VT_FEEDBACK_BUFFERS кадров,
+    // поэтому после движения камеры рисуется еще столько же кадров
+    if(m_dirty & DirtyCamera)
+        m_settle_frames = VT_FEEDBACK_BUFFERS;
+    else if(m_settle_frames > 0)
+        m_settle_frames--;
+    m_dirty = 0;
+
+    // Облака сдвигаются по времени модели: стоят на паузе, ускоряются
+    // вместе с ним, а автономные снимки повторяются
+    long int t_ms = (long int)std::fmod(m_epoch_jd * 86400000.0, 1000000.0);
+    float t = t_ms / 1000000.0f;
+    updateVirtualTextures(t);
+
+    // Камера, проекция и Солнце для всех программ
+    updateFrameUniforms();
+
     // Очистка FrameBuffer'а
+    m_profiler.beginPass(PassSkybox);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Отрисовка скайбокса
@@ -109,10 +490,11 @@ void Visualizer::render()
     glBindTexture(GL_TEXTURE_2D, m_space_map_id);
 
     glBindVertexArray(m_sphere_vao_id);
-    glDrawElements(GL_TRIANGLES, m_sphere_indices_count, GL_UNSIGNED_INT, (void*)NULL);
+    drawSphere(SPHERE_SKY_LOD);
     glBindVertexArray(0);
 
     // Отрисовка Солнца
+    m_profiler.beginPass(PassSun);
     glEnable(GL_DEPTH_TEST);
     glDepthMask(GL_TRUE);
     glDepthFunc(GL_LESS);
@@ -122,10 +504,11 @@ void Visualizer::render()
     glBindTexture(GL_TEXTURE_2D, m_sun_map_id);
 
     glBindVertexArray(m_sphere_vao_id);
-    glDrawElements(GL_TRIANGLES, m_sphere_indices_count, GL_UNSIGNED_INT, (void*)NULL);
+    drawSphere(sphereLod(m_sun_position, 0.5f * m_sun_scale));
     glBindVertexArray(0);
 
     // Отрисовка Луны
+    m_profiler.beginPass(PassMoon);
     glEnable(GL_DEPTH_TEST);
     glDepthMask(GL_TRUE);
     glFrontFace(GL_CCW);
@@ -140,10 +523,11 @@ void Visualizer::render()
     glBindTexture(GL_TEXTURE_2D, m_moon_specular_map_id);
 
     glBindVertexArray(m_sphere_vao_id);
-    glDrawElements(GL_TRIANGLES, m_sphere_indices_count, GL_UNSIGNED_INT, (void*)NULL);
+    drawSphere(sphereLod(m_moon_position, 0.5f * m_moon_scale));
     glBindVertexArray(0);
 
     // Отрисовка Земли
+    m_profiler.beginPass(PassEarth);
     glEnable(GL_DEPTH_TEST);
     glDepthMask(GL_TRUE);
     glFrontFace(GL_CCW);
@@ -160,86 +544,187 @@ void Visualizer::render()
     glBindTexture(GL_TEXTURE_2D, m_normal_map_id);
     glActiveTexture(GL_TEXTURE4);
     glBindTexture(GL_TEXTURE_2D, m_specular_map_id);
+    if(m_earth_vt.isOpen())
+        m_earth_vt.bind(5);
+    if(m_clouds_vt.isOpen())
+        m_clouds_vt.bind(8);
 
-    glUniform1f(m_earth_t_uni_id, (MILLS % 1000000) / 1000000.0f);
+    glUniform1f(m_earth_t_uni_id, t);
 
     glBindVertexArray(m_sphere_vao_id);
-    glDrawElements(GL_TRIANGLES, m_sphere_indices_count, GL_UNSIGNED_INT, (void*)NULL);
+    drawSphere(sphereLod(QVector3D(0.0f, 0.0f, 0.0f), 0.5f));
     glBindVertexArray(0);
 
-    // Отрисовка меток
+    // Отрисовка всех трасс одним инстанцированным вызовом поверх Земли
+    m_profiler.beginPass(PassGroundTracks);
+    if(m_ground_tracks.samples() > 1)
+    {
+        glUseProgram(m_track_program_id);
+        glUniform1i(m_track_first_slot_uni_id, m_ground_tracks.firstSlot());
+        glUniform1i(m_track_slots_uni_id, m_ground_tracks.slotCount());
+        glUniform1i(m_track_count_uni_id, m_ground_tracks.trackCount());
+        glUniform1f(m_track_now_uni_id, m_ground_tracks.samplePosition(m_epoch_jd));
+        m_ground_tracks.bind(0);
+
+        glBindVertexArray(m_track_vao_id);
+        glDrawArraysInstanced(GL_LINE_STRIP, 0, m_ground_tracks.samples(), m_ground_tracks.trackCount());
+        glBindVertexArray(0);
+    }
+
+    // Загрузка изменившихся данных спутников
+    m_profiler.beginPass(PassSatellites);
+    updateStationColors();
+    updateSatelliteBuffers();
+    updateConjunctionLines();
+
+    // Отбор видимых меток и орбит
+    m_profiler.beginPass(PassCulling);
+    cullSatellites();
+
+    // Отрисовка видимых меток одним вызовом. Ключи нужны и орбитам, и отрезкам сближений
+    m_profiler.beginPass(PassMarks);
     glUseProgram(m_mark_program_id);
     glDepthMask(GL_TRUE);
+    m_keyframes.bind(KEYFRAME_BINDING);
+
+    glBindVertexArray(m_mark_vao_id);
+    glDrawElements(GL_POINTS, m_culler.visibleMarks().size(), GL_UNSIGNED_INT, (void*)0);
+
+    // Отрисовка видимых орбит инстанцированным вызовом на уровень детализации.
+    // Орбиты уровня идут в буфере экземпляров подряд, поэтому вызов лишь сдвигает его начало
+    m_profiler.beginPass(PassOrbits);
+    glUseProgram(m_orb_program_id);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, m_sat_orbits_tbo_id);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, m_sat_colors_tbo_id);
 
-    // Зеленые
-    glUniform3f(m_mark_color_uni_id, 0.1f, 1.0f, 0.1f);
-    for(auto m : green_marks)
+    glBindVertexArray(m_orb_vao_id);
+    glBindBuffer(GL_ARRAY_BUFFER, m_orb_instances_vbo_id);
+    for(int lod = 0; lod < ORBIT_LODS; lod++)
     {
-        m_mark_model_mat.setToIdentity();
-        m_mark_model_mat.translate(m);
-        glUniformMatrix4fv(m_mark_model_uni_id, 1, false, m_mark_model_mat.data());
+        size_t begin = m_culler.orbitLodBegin(lod);
+        size_t count = m_culler.orbitLodBegin(lod + 1) - begin;
+        if(!count)
+            continue;
 
-        glBindVertexArray(m_mark_vao_id);
-        glDrawArrays(GL_POINTS, 0, 1);
+        glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, 0, (void*)(sizeof(GLuint) * begin));
+        glDrawArraysInstanced(GL_LINE_LOOP, orbitLodFirst(lod), orbitLodSegments(lod), count);
     }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(0);
 
-    // Красные
-    glUniform3f(m_mark_color_uni_id, 1.0f, 0.1f, 0.1f);
-    for(auto m : red_marks)
+    // Отрезки между сближающимися спутниками одним вызовом по буферу положений меток
+    m_profiler.beginPass(PassConjunctions);
+    if(!m_conjunction_lines.empty())
     {
-        m_mark_model_mat.setToIdentity();
-        m_mark_model_mat.translate(m);
-        glUniformMatrix4fv(m_mark_model_uni_id, 1, false, m_mark_model_mat.data());
+        glUseProgram(m_conj_program_id);
+        glBindVertexArray(m_conj_vao_id);
+        glDrawElements(GL_LINES, m_conjunction_lines.size(), GL_UNSIGNED_INT, (void*)0);
+        glBindVertexArray(0);
+    }
 
-        glBindVertexArray(m_mark_vao_id);
-        glDrawArrays(GL_POINTS, 0, 1);
+    if(m_profiler_overlay)
+    {
+        m_profiler.beginPass(PassOverlay);
+        drawProfilerOverlay();
     }
 
-    // Отрисовка орбит
-    glUseProgram(m_orb_program_id);
+    // Ожидание вертикальной синхронизации в замер не входит
+    m_profiler.endFrame();
+    if(!m_headless)
+        m_gl_context->swapBuffers(this);
 
-    // Зеленые
-    glUniform3f(m_orb_col_uni_id, 0.1f, 1.0f, 0.1f);
-    for(unsigned int i = 0; i < green_orbits_tilt.size(); i++)
+    // Отчет о времени запуска
+    if(!m_first_frame_reported)
     {
-        m_orb_model_mat.setToIdentity();
-        m_orb_model_mat.translate(green_orbits_offset[i]);
-        m_orb_model_mat.rotate(QQuaternion::fromEulerAngles(green_orbits_tilt[i]));
-        m_orb_model_mat.scale(green_orbits_scale[i]);
-        glUniformMatrix4fv(m_orb_model_uni_id, 1, false, m_orb_model_mat.data());
-        glUniform3f(m_orb_targ_uni_id, green_marks[i].x(), green_marks[i].y(), green_marks[i].z());
-
-        glUseProgram(m_orb_program_id);
-        glBindVertexArray(m_orb_vao_id);
-        glDrawArrays(GL_LINE_LOOP, 0, 400);
+        printf("Time to first frame: %ld ms\n", (long)(MILLS - m_start_time));
+        m_first_frame_reported = true;
     }
-
-    // Красные
-    glUniform3f(m_orb_col_uni_id, 1.0f, 0.1f, 0.1f);
-    for(unsigned int i = 0; i < red_orbits_tilt.size(); i++)
+    if(!m_full_quality_reported && m_textures.isComplete())
     {
-        m_orb_model_mat.setToIdentity();
-        m_orb_model_mat.translate(red_orbits_offset[i]);
-        m_orb_model_mat.rotate(QQuaternion::fromEulerAngles(red_orbits_tilt[i]));
-        m_orb_model_mat.scale(red_orbits_scale[i]);
-        glUniformMatrix4fv(m_orb_model_uni_id, 1, false, m_orb_model_mat.data());
-        glUniform3f(m_orb_targ_uni_id, red_marks[i].x(), red_marks[i].y(), red_marks[i].z());
-
-        glUseProgram(m_orb_program_id);
-        glBindVertexArray(m_orb_vao_id);
-        glDrawArrays(GL_LINE_LOOP, 0, 400);
+        printf("Time to full quality: %ld ms\n", (long)(MILLS - m_start_time));
+        m_full_quality_reported = true;
     }
 
-    glBindVertexArray(0);
+    // Следующий кадр: сразу при изменениях, анимации, ускоренном ходе часов
+    // и догрузке данных, иначе кадр покоя. Без ускорения метки за кадр покоя
+    // смещаются на доли пикселя, поэтому ход часов x1 покоя не отменяет
+    m_last_frame = frame_start;
+    bool warping = !m_clock.isPaused() && m_clock.warp() > CLOCK_MIN_WARP;
+    if(m_dirty || m_animating || warping || m_settle_frames > 0 || !m_textures.isComplete() ||
+       m_earth_vt.isLoading() || m_clouds_vt.isLoading() || m_ground_tracks.isComputing())
+        invalidate(0);
+    else
+        scheduleFrame(1000 / IDLE_FPS);
+}
+
+void Visualizer::invalidate(unsigned flags)
+{
+    m_dirty |= flags;
+
+    // Темп кадров выдерживается от начала прошлого кадра, поэтому
+    // первое изменение после покоя рисуется без задержки
+    long int delay = 0;
+    if(m_frame_rate > 0)
+        delay = std::max(0L, m_last_frame + 1000 / m_frame_rate - (long int)MILLS);
+    scheduleFrame(delay);
+}
+
+void Visualizer::setFrameRate(int fps)
+{
+    m_frame_rate = fps;
+    invalidate(0);
+}
+
+void Visualizer::setAnimating(bool animating)
+{
+    m_animating = animating;
+    invalidate(0);
+}
+
+void Visualizer::scheduleFrame(long int delay)
+{
+    // Автономные кадры рисуются только по renderFrame
+    if(m_headless)
+        return;
 
-    m_gl_context->swapBuffers(this);
+    // Уже назначенный более ранний кадр не откладывается
+    if(m_frame_timer.isActive() && m_frame_timer.remainingTime() <= delay)
+        return;
+    m_frame_timer.start(delay);
+}
+
+bool Visualizer::event(QEvent *ev)
+{
+    if(ev->type() == QEvent::UpdateRequest)
+    {
+        render();
+        return true;
+    }
+    if(ev->type() == RENDER_REQUEST_EVENT)
+    {
+        invalidate(DirtyData);
+        return true;
+    }
+    return QWindow::event(ev);
 }
 
 void Visualizer::init()
 {
-    m_gl_context->makeCurrent(this);
+    if(m_headless)
+        m_gl_context->makeCurrent(m_offscreen);
+    else
+        m_gl_context->makeCurrent(this);
     initializeOpenGLFunctions();
 
+    if(m_headless)
+    {
+        m_fbo = new QOpenGLFramebufferObject(size(), QOpenGLFramebufferObject::CombinedDepthStencil);
+        m_fbo->bind();
+    }
+
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
     glEnable(GL_BLEND);
@@ -251,32 +736,29 @@ void Visualizer::init()
     glLineWidth(5.0f);
 
     // Шейдер Земли
-    GLuint vs_id = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fs_id = glCreateShader(GL_FRAGMENT_SHADER);
-
     const char *vs_source = "#version 420 core\n" \
+                            FRAME_GLSL \
                             "layout(location = 0) in vec3 position;\n" \
                             "layout(location = 1) in vec3 normal;\n" \
-                            "layout(location = 2) in vec3 bitangent;\n" \
+                            "layout(location = 2) in vec3 tangent;\n" \
                             "layout(location = 3) in vec2 uv;\n" \
                             "uniform mat4 model_matrix;\n" \
-                            "uniform mat4 view_matrix;\n" \
-                            "uniform mat4 proj_matrix;\n" \
                             "out vec3 normal_itp;\n" \
-                            "out vec3 bitangent_itp;\n" \
+                            "out vec3 tangent_itp;\n" \
                             "out vec2 uv_itp;\n" \
                             "out vec3 frag_pos;\n" \
                             "void main() {\n" \
                             "   gl_Position = proj_matrix * view_matrix * model_matrix * vec4(position, 1.0);\n" \
                             "   uv_itp = uv;\n" \
                             "   normal_itp = normal;\n" \
-                            "   bitangent_itp = -bitangent;\n" \
+                            "   tangent_itp = tangent;\n" \
                             "   frag_pos = (model_matrix * vec4(position, 1.0)).xyz;\n" \
                             "}\n";
 
     const char *fs_source = "#version 420 core\n" \
+                            FRAME_GLSL \
                             "in vec3 normal_itp;\n" \
-                            "in vec3 bitangent_itp;\n" \
+                            "in vec3 tangent_itp;\n" \
                             "in vec2 uv_itp;\n" \
                             "in vec3 frag_pos;\n" \
                             "layout (binding = 0) uniform sampler2D day_map;\n" \
@@ -284,80 +766,65 @@ void Visualizer::init()
                             "layout (binding = 2) uniform sampler2D clouds_map;\n" \
                             "layout (binding = 3) uniform sampler2D normal_map;\n" \
                             "layout (binding = 4) uniform sampler2D specular_map;\n" \
+                            "layout (binding = 5) uniform sampler2D day_atlas;\n" \
+                            "layout (binding = 6) uniform sampler2D night_atlas;\n" \
+                            "layout (binding = 7) uniform usampler2D earth_pages;\n" \
+                            "layout (binding = 8) uniform sampler2D clouds_atlas;\n" \
+                            "layout (binding = 9) uniform usampler2D clouds_pages;\n" \
                             "uniform mat4 model_matrix;\n" \
-                            "uniform vec3 camera_pos;\n" \
-                            "uniform vec3 sun_pos;\n" \
                             "uniform float t;\n" \
+                            "uniform vec4 earth_vt;\n" \
+                            "uniform vec4 clouds_vt;\n" \
                             "out vec4 color;\n" \
+                            VT_GLSL \
+                            "vec4 earthTexture(sampler2D map, sampler2D atlas, usampler2D pages, vec4 vt, vec2 uv) {\n" \
+                            "   vec4 base = texture(map, uv);\n" \
+                            "   if(vt.z == 0.0) return base;\n" \
+                            "   uvec4 page = vtPage(pages, vt, uv, vtLevel(vt, uv, 0.0));\n" \
+                            "   return page.w != 0u ? vtSample(atlas, vt, page, uv) : base;\n" \
+                            "}\n" \
                             "void main() {\n" \
-                            "   vec3 T = normalize(vec3(model_matrix * vec4(cross(normal_itp, bitangent_itp), 0.0)));\n" \
-                            "   vec3 B = normalize(vec3(model_matrix * vec4(bitangent_itp, 0.0)));\n" \
+                            "   vec3 T = normalize(vec3(model_matrix * vec4(tangent_itp, 0.0)));\n" \
                             "   vec3 N = normalize(vec3(model_matrix * vec4(normal_itp, 0.0)));\n" \
+                            "   vec3 B = cross(N, T);\n" \
                             "   mat3 tbn = mat3(T, B, N);\n" \
-                            "   vec3 normal_comp = tbn * (texture(normal_map, uv_itp).rgb * 2.0 - 1.0);\n" \
+                            "   vec2 normal_xy = texture(normal_map, uv_itp).rg * 2.0 - 1.0;\n" \
+                            "   vec3 normal_comp = tbn * vec3(normal_xy, sqrt(max(1.0 - dot(normal_xy, normal_xy), 0.0)));\n" \
                             "   vec3 view_dir = normalize(camera_pos - frag_pos);\n" \
                             "   vec3 sun_dir = normalize(sun_pos - frag_pos);\n" \
                             "   vec3 sun_ref = reflect(-sun_dir, normal_comp);\n" \
-                            "   float spec = max(texture(specular_map, uv_itp).r - texture(clouds_map, uv_itp + vec2(t, 0)).r, 0.0) * pow(clamp(dot(normal_comp, normalize(view_dir + sun_dir)), 0.0, 1.0), 20.0);" \
+                            "   vec4 day = earthTexture(day_map, day_atlas, earth_pages, earth_vt, uv_itp);\n" \
+                            "   vec4 night = earthTexture(night_map, night_atlas, earth_pages, earth_vt, uv_itp);\n" \
+                            "   vec4 clouds = earthTexture(clouds_map, clouds_atlas, clouds_pages, clouds_vt, uv_itp + vec2(t, 0));\n" \
+                            "   float spec = max(texture(specular_map, uv_itp).r - clouds.r, 0.0) * pow(clamp(dot(normal_comp, normalize(view_dir + sun_dir)), 0.0, 1.0), 20.0);" \
                             "   float diffuse = max(dot(sun_dir, normal_comp), 0.0);\n" \
                             "   color = mix("
-                            "       mix(texture(night_map, uv_itp), texture(clouds_map, uv_itp + vec2(t, 0)) * 0.1,"
-                            "       texture(clouds_map, uv_itp + vec2(t, 0)).a),"
-                            "       diffuse * mix(texture(day_map, uv_itp), texture(clouds_map, uv_itp + vec2(t, 0)),"
-                            "       texture(clouds_map, uv_itp + vec2(t, 0)).a),"
+                            "       mix(night, clouds * 0.1, clouds.a),"
+                            "       diffuse * mix(day, clouds, clouds.a),"
                             "       diffuse) + 0.5 * vec4(spec);\n" \
                             "       color.a = 1.0;\n" \
                             "}\n";
 
-    GLint result;
-
-    glShaderSource(vs_id, 1, &vs_source, NULL);
-    glCompileShader(vs_id);
-    glGetShaderiv(vs_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(vs_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(vs_id, length, &length, info);
-        printf("Earth VS: %s",info);
-    }
-
-    glShaderSource(fs_id, 1, &fs_source, NULL);
-    glCompileShader(fs_id);
-    glGetShaderiv(fs_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(fs_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(fs_id, length, &length, info);
-        printf("Earth FS: %s",info);
-    }
-
-    m_earth_program_id = glCreateProgram();
-    glAttachShader(m_earth_program_id, vs_id);
-    glAttachShader(m_earth_program_id, fs_id);
-    glLinkProgram(m_earth_program_id);
-    glDeleteShader(vs_id);
-    glDeleteShader(fs_id);
-
-    m_earth_model_uni_id = glGetUniformLocation(m_earth_program_id, "model_matrix");
-    m_earth_view_uni_id = glGetUniformLocation(m_earth_program_id, "view_matrix");
-    m_earth_proj_uni_id = glGetUniformLocation(m_earth_program_id, "proj_matrix");
-    m_earth_cam_pos_uni_id = glGetUniformLocation(m_earth_program_id, "camera_pos");
-    m_earth_sun_pos_uni_id = glGetUniformLocation(m_earth_program_id, "sun_pos");
-    m_earth_t_uni_id = glGetUniformLocation(m_earth_program_id, "t");
+    // Шейдер обратной связи виртуальных текстур: та же геометрия Земли,
+    // в буфер пишутся номер тайла и уровень, нужные в каждой точке
+    const char *fs_feedback_source = "#version 420 core\n" \
+                                     "in vec2 uv_itp;\n" \
+                                     "uniform vec4 vt;\n" \
+                                     "uniform vec2 uv_offset;\n" \
+                                     "uniform float lod_bias;\n" \
+                                     "layout(location = 0) out uvec4 feedback;\n" \
+                                     VT_GLSL \
+                                     "void main() {\n" \
+                                     "   vec2 uv = uv_itp + uv_offset;\n" \
+                                     "   float level = vtLevel(vt, uv, lod_bias);\n" \
+                                     "   feedback = uvec4(uvec2(vtPixel(vt, uv, level) / VT_TILE), uint(level), 1u);\n" \
+                                     "}\n";
 
     // Шейдер космоса
-    GLuint vs_space_id = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fs_space_id = glCreateShader(GL_FRAGMENT_SHADER);
-
     const char *vs_space_source = "#version 420 core\n" \
+                                  FRAME_GLSL \
                                   "layout(location = 0) in vec3 position;\n" \
                                   "layout(location = 3) in vec2 uv;\n" \
-                                  "uniform mat4 view_matrix;\n" \
-                                  "uniform mat4 proj_matrix;\n" \
                                   "out vec2 uv_itp;\n" \
                                   "void main() {\n" \
                                   "   gl_Position = proj_matrix * vec4((view_matrix * vec4(position, 0.0)).xyz, 1.0);\n" \
@@ -373,82 +840,44 @@ void Visualizer::init()
                                   "   color.a = 1.0;\n" \
                                   "}\n";
 
-    glShaderSource(vs_space_id, 1, &vs_space_source, NULL);
-    glCompileShader(vs_space_id);
-    glGetShaderiv(vs_space_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(vs_space_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(vs_space_id, length, &length, info);
-        printf("Space VS: %s",info);
-    }
-
-    glShaderSource(fs_space_id, 1, &fs_space_source, NULL);
-    glCompileShader(fs_space_id);
-    glGetShaderiv(fs_space_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(fs_space_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(fs_space_id, length, &length, info);
-        printf("Space FS: %s",info);
-    }
-
-    m_space_program_id = glCreateProgram();
-    glAttachShader(m_space_program_id, vs_space_id);
-    glAttachShader(m_space_program_id, fs_space_id);
-    glLinkProgram(m_space_program_id);
-    glDeleteShader(vs_space_id);
-    glDeleteShader(fs_space_id);
-
-    m_space_view_uni_id = glGetUniformLocation(m_space_program_id, "view_matrix");
-    m_space_proj_uni_id = glGetUniformLocation(m_space_program_id, "proj_matrix");
-
     // Шейдер Луны
-    GLuint vs_moon_id = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fs_moon_id = glCreateShader(GL_FRAGMENT_SHADER);
-
     const char *vs_moon_source = "#version 420 core\n" \
+                               FRAME_GLSL \
                                "layout(location = 0) in vec3 position;\n" \
                                "layout(location = 1) in vec3 normal;\n" \
-                               "layout(location = 2) in vec3 bitangent;\n" \
+                               "layout(location = 2) in vec3 tangent;\n" \
                                "layout(location = 3) in vec2 uv;\n" \
                                "uniform mat4 model_matrix;\n" \
-                               "uniform mat4 view_matrix;\n" \
-                               "uniform mat4 proj_matrix;\n" \
                                "out vec2 uv_itp;\n" \
                                "out vec3 normal_itp;\n" \
-                               "out vec3 bitangent_itp;\n" \
+                               "out vec3 tangent_itp;\n" \
                                "out vec3 frag_pos;\n" \
                                "void main() {\n" \
                                "   gl_Position = proj_matrix * view_matrix * model_matrix * vec4(position, 1.0);\n" \
                                "   uv_itp = uv;\n" \
                                "   normal_itp = normal;\n" \
-                               "   bitangent_itp = -bitangent;\n" \
+                               "   tangent_itp = tangent;\n" \
                                "   frag_pos = (model_matrix * vec4(position, 1.0)).xyz;\n" \
                                "}\n";
 
     const char *fs_moon_source = "#version 420 core\n" \
+                               FRAME_GLSL \
                                "in vec2 uv_itp;\n" \
                                "in vec3 normal_itp;\n" \
-                               "in vec3 bitangent_itp;\n" \
+                               "in vec3 tangent_itp;\n" \
                                "in vec3 frag_pos;\n" \
-                               "uniform vec3 sun_pos;\n" \
-                               "uniform vec3 camera_pos;\n" \
                                "uniform mat4 model_matrix;\n" \
                                "layout (binding = 0) uniform sampler2D color_map;\n" \
                                "layout (binding = 1) uniform sampler2D normal_map;\n" \
                                "layout (binding = 2) uniform sampler2D specular_map;\n" \
                                  "out vec4 color;\n" \
                                "void main() {\n" \
-                               "   vec3 T = normalize(vec3(model_matrix * vec4(cross(normal_itp, bitangent_itp), 0.0)));\n" \
-                               "   vec3 B = normalize(vec3(model_matrix * vec4(bitangent_itp, 0.0)));\n" \
+                               "   vec3 T = normalize(vec3(model_matrix * vec4(tangent_itp, 0.0)));\n" \
                                "   vec3 N = normalize(vec3(model_matrix * vec4(normal_itp, 0.0)));\n" \
+                               "   vec3 B = cross(N, T);\n" \
                                "   mat3 tbn = mat3(T, B, N);\n" \
-                               "   vec3 normal_comp = tbn * (texture(normal_map, uv_itp).rgb * 2.0 - 1.0);\n" \
+                               "   vec2 normal_xy = texture(normal_map, uv_itp).rg * 2.0 - 1.0;\n" \
+                               "   vec3 normal_comp = tbn * vec3(normal_xy, sqrt(max(1.0 - dot(normal_xy, normal_xy), 0.0)));\n" \
                                "   vec3 sun_dir = normalize(sun_pos - frag_pos);\n" \
                                "   vec3 view_dir = normalize(camera_pos - frag_pos);\n" \
                                "   vec3 sun_ref = reflect(-sun_dir, normal_comp);\n" \
@@ -458,53 +887,12 @@ void Visualizer::init()
                                "   color.a = 1.0;\n" \
                                "}\n";
 
-    glShaderSource(vs_moon_id, 1, &vs_moon_source, NULL);
-    glCompileShader(vs_moon_id);
-    glGetShaderiv(vs_moon_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(vs_moon_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(vs_moon_id, length, &length, info);
-        printf("Moon VS: %s",info);
-    }
-
-    glShaderSource(fs_moon_id, 1, &fs_moon_source, NULL);
-    glCompileShader(fs_moon_id);
-    glGetShaderiv(fs_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(fs_moon_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(fs_moon_id, length, &length, info);
-        printf("Moon FS: %s",info);
-    }
-
-    m_moon_program_id = glCreateProgram();
-    glAttachShader(m_moon_program_id, vs_moon_id);
-    glAttachShader(m_moon_program_id, fs_moon_id);
-    glLinkProgram(m_moon_program_id);
-    glDeleteShader(vs_moon_id);
-    glDeleteShader(fs_moon_id);
-
-    m_moon_model_uni_id = glGetUniformLocation(m_moon_program_id, "model_matrix");
-    m_moon_view_uni_id = glGetUniformLocation(m_moon_program_id, "view_matrix");
-    m_moon_proj_uni_id = glGetUniformLocation(m_moon_program_id, "proj_matrix");
-    m_moon_sun_pos_uni_id = glGetUniformLocation(m_moon_program_id, "sun_pos");
-    m_moon_cam_pos_uni_id = glGetUniformLocation(m_moon_program_id, "camera_pos");
-
     // Шейдер Солнца
-    GLuint vs_sun_id = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fs_sun_id = glCreateShader(GL_FRAGMENT_SHADER);
-
     const char *vs_sun_source = "#version 420 core\n" \
+                               FRAME_GLSL \
                                "layout(location = 0) in vec3 position;\n" \
                                "layout(location = 3) in vec2 uv;\n" \
                                "uniform mat4 model_matrix;\n" \
-                               "uniform mat4 view_matrix;\n" \
-                               "uniform mat4 proj_matrix;\n" \
                                "out vec2 uv_itp;\n" \
                                "void main() {\n" \
                                "   gl_Position = proj_matrix * view_matrix * model_matrix * vec4(position, 1.0);\n" \
@@ -520,283 +908,255 @@ void Visualizer::init()
                                "   color.a = 1.0;\n" \
                                "}\n";
 
-    glShaderSource(vs_sun_id, 1, &vs_sun_source, NULL);
-    glCompileShader(vs_sun_id);
-    glGetShaderiv(vs_sun_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(vs_sun_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(vs_sun_id, length, &length, info);
-        printf("Sun VS: %s",info);
-    }
-
-    glShaderSource(fs_sun_id, 1, &fs_sun_source, NULL);
-    glCompileShader(fs_sun_id);
-    glGetShaderiv(fs_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(fs_sun_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(fs_sun_id, length, &length, info);
-        printf("Sun FS: %s",info);
-    }
-
-    m_sun_program_id = glCreateProgram();
-    glAttachShader(m_sun_program_id, vs_sun_id);
-    glAttachShader(m_sun_program_id, fs_sun_id);
-    glLinkProgram(m_sun_program_id);
-    glDeleteShader(vs_sun_id);
-    glDeleteShader(fs_sun_id);
-
-    m_sun_model_uni_id = glGetUniformLocation(m_earth_program_id, "model_matrix");
-    m_sun_view_uni_id = glGetUniformLocation(m_earth_program_id, "view_matrix");
-    m_sun_proj_uni_id = glGetUniformLocation(m_earth_program_id, "proj_matrix");
-
     // Шейдер орбит
-    GLuint vs_orb_id = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fs_orb_id = glCreateShader(GL_FRAGMENT_SHADER);
-
     const char *vs_orb_source = "#version 420 core\n" \
+                               FRAME_GLSL \
                                "layout(location = 0) in vec3 position;\n" \
-                               "uniform mat4 model_matrix;\n" \
-                               "uniform mat4 view_matrix;\n" \
-                               "uniform mat4 proj_matrix;\n" \
+                               KEYFRAME_GLSL \
+                               "layout(location = 1) in uint instance;\n" \
+                               "layout(binding = 0) uniform samplerBuffer orbits;\n" \
+                               "layout(binding = 2) uniform samplerBuffer sat_colors;\n" \
                                "out vec3 pos_int;\n" \
+                               "out vec3 target_itp;\n" \
+                               "out vec3 col_itp;\n" \
                                "void main() {\n" \
+                               "   int i = int(instance);\n" \
+                               "   mat4 model_matrix = mat4(texelFetch(orbits, i * 4), texelFetch(orbits, i * 4 + 1),\n" \
+                               "                            texelFetch(orbits, i * 4 + 2), texelFetch(orbits, i * 4 + 3));\n" \
                                "   pos_int = (model_matrix * vec4(position, 1.0)).xyz;\n" \
+                               "   target_itp = satellitePosition(i);\n" \
+                               "   col_itp = texelFetch(sat_colors, i).xyz;\n" \
                                "   gl_Position = proj_matrix * view_matrix * model_matrix * vec4(position, 1.0);\n" \
                                "}\n";
 
     const char *fs_orb_source = "#version 420 core\n" \
                                "in vec3 pos_int;\n" \
+                               "in vec3 target_itp;\n" \
+                               "in vec3 col_itp;\n" \
                                "out vec4 color;\n" \
-                               "uniform vec3 target_pos;\n" \
-                               "uniform vec3 col;\n" \
                                "void main() {\n" \
-                               "   float alpha = min(1.0 / pow(distance(target_pos, pos_int), 5.0), 1.0);\n" \
-                               "   color = vec4(col, alpha);\n" \
+                               "   float alpha = min(1.0 / pow(distance(target_itp, pos_int), 5.0), 1.0);\n" \
+                               "   color = vec4(col_itp, alpha);\n" \
                                "}\n";
 
-    glShaderSource(vs_orb_id, 1, &vs_orb_source, NULL);
-    glCompileShader(vs_orb_id);
-    glGetShaderiv(vs_orb_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(vs_orb_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(vs_orb_id, length, &length, info);
-        printf("Orbit VS: %s",info);
-    }
-
-    glShaderSource(fs_orb_id, 1, &fs_orb_source, NULL);
-    glCompileShader(fs_orb_id);
-    glGetShaderiv(fs_orb_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(fs_orb_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(fs_orb_id, length, &length, info);
-        printf("Orbit FS: %s",info);
-    }
-
-    m_orb_program_id = glCreateProgram();
-    glAttachShader(m_orb_program_id, vs_orb_id);
-    glAttachShader(m_orb_program_id, fs_orb_id);
-    glLinkProgram(m_orb_program_id);
-    glDeleteShader(vs_orb_id);
-    glDeleteShader(fs_orb_id);
-
-    m_orb_model_uni_id = glGetUniformLocation(m_orb_program_id, "model_matrix");
-    m_orb_view_uni_id = glGetUniformLocation(m_orb_program_id, "view_matrix");
-    m_orb_proj_uni_id = glGetUniformLocation(m_orb_program_id, "proj_matrix");
-    m_orb_targ_uni_id = glGetUniformLocation(m_orb_program_id, "target_pos");
-    m_orb_col_uni_id = glGetUniformLocation(m_orb_program_id, "col");
-
-    // Шейдер спутников
-    GLuint vs_mark_id = glCreateShader(GL_VERTEX_SHADER);
-    GLuint fs_mark_id = glCreateShader(GL_FRAGMENT_SHADER);
-
+    // Шейдер спутников: положение метки номер gl_VertexID по ключам
     const char *vs_mark_source = "#version 420 core\n" \
-                               "layout(location = 0) in vec3 position;\n" \
-                               "uniform mat4 model_matrix;\n" \
-                               "uniform mat4 view_matrix;\n" \
-                               "uniform mat4 proj_matrix;\n" \
-                               "out vec2 pos;\n" \
+                               FRAME_GLSL \
+                               KEYFRAME_GLSL \
+                               "layout(location = 1) in vec3 col;\n" \
+                               "out vec3 col_itp;\n" \
                                "void main() {\n" \
-                               "   gl_Position = proj_matrix * view_matrix * model_matrix * vec4(position, 1.0);\n" \
-                               "   pos = (proj_matrix * view_matrix * model_matrix * vec4(position, 1.0)).xy;\n" \
+                               "   gl_Position = proj_matrix * view_matrix * vec4(satellitePosition(gl_VertexID), 1.0);\n" \
+                               "   col_itp = col;\n" \
                                "}\n";
 
     const char *fs_mark_source = "#version 420 core\n" \
                                "out vec4 color;\n" \
-                               "uniform vec3 col;\n" \
-                               "in vec2 pos;\n" \
+                               "in vec3 col_itp;\n" \
                                "void main() {\n" \
                                "   vec2 cxy = 2.0 * gl_PointCoord - 1.0;\n" \
                                "   float r = dot(cxy, cxy);\n" \
                                "   if(r > 1.0)\n" \
                                "      discard;\n" \
-                               "   color = vec4(r < 0.5 ? col : col * 0.5, 1.0);\n" \
+                               "   color = vec4(r < 0.5 ? col_itp : col_itp * 0.5, 1.0);\n" \
                                "}\n";
 
-    glShaderSource(vs_mark_id, 1, &vs_mark_source, NULL);
-    glCompileShader(vs_mark_id);
-    glGetShaderiv(vs_mark_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(vs_mark_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(vs_mark_id, length, &length, info);
-        printf("mark VS: %s",info);
-    }
-
-    glShaderSource(fs_mark_id, 1, &fs_mark_source, NULL);
-    glCompileShader(fs_mark_id);
-    glGetShaderiv(fs_mark_id, GL_COMPILE_STATUS, &result);
-    if(result == GL_FALSE)
-    {
-        GLint length = 0;
-        glGetShaderiv(fs_mark_id, GL_INFO_LOG_LENGTH, &length);
-        char info[length];
-        glGetShaderInfoLog(fs_mark_id, length, &length, info);
-        printf("mark FS: %s",info);
-    }
-
-    m_mark_program_id = glCreateProgram();
-    glAttachShader(m_mark_program_id, vs_mark_id);
-    glAttachShader(m_mark_program_id, fs_mark_id);
-    glLinkProgram(m_mark_program_id);
-    glDeleteShader(vs_mark_id);
-    glDeleteShader(fs_mark_id);
-
-    m_mark_model_uni_id = glGetUniformLocation(m_mark_program_id, "model_matrix");
-    m_mark_view_uni_id = glGetUniformLocation(m_mark_program_id, "view_matrix");
-    m_mark_proj_uni_id = glGetUniformLocation(m_mark_program_id, "proj_matrix");
-    m_mark_color_uni_id = glGetUniformLocation(m_mark_program_id, "col");
+    // Шейдер трасс: точка номер gl_VertexID трассы gl_InstanceID из кольца,
+    // широта и долгота переводятся в точку на сфере в системе Земли
+    const char *vs_track_source = "#version 420 core\n" \
+                               FRAME_GLSL \
+                               "layout(binding = 0) uniform samplerBuffer track_samples;\n" \
+                               "uniform mat4 model_matrix;\n" \
+                               "uniform int first_slot;\n" \
+                               "uniform int slots;\n" \
+                               "uniform int tracks;\n" \
+                               "out float sample_itp;\n" \
+                               "void main() {\n" \
+                               "   int slot = (first_slot + gl_VertexID) % slots;\n" \
+                               "   vec2 ll = texelFetch(track_samples, slot * tracks + gl_InstanceID).xy;\n" \
+                               "   vec3 p = vec3(cos(ll.x) * cos(ll.y), sin(ll.x), -cos(ll.x) * sin(ll.y));\n" \
+                               "   gl_Position = proj_matrix * view_matrix * model_matrix * vec4(p * " QT_STRINGIFY(GROUND_TRACK_RADIUS) ", 1.0);\n" \
+                               "   if(isnan(ll.x))\n" \
+                               "      gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n" \
+                               "   sample_itp = float(gl_VertexID);\n" \
+                               "}\n";
 
-    // Загрузка модели сферы
-    Assimp::Importer imp;
-    const aiScene *scene = imp.ReadFile("sphere.obj", aiProcess_CalcTangentSpace | aiProcess_FlipUVs);
+    const char *fs_track_source = "#version 420 core\n" \
+                               "uniform float now_sample;\n" \
+                               "uniform vec3 track_color;\n" \
+                               "in float sample_itp;\n" \
+                               "out vec4 color;\n" \
+                               "void main() {\n" \
+                               "   color = vec4(track_color, sample_itp < now_sample ? " QT_STRINGIFY(GROUND_TRACK_PAST_ALPHA) " : 1.0);\n" \
+                               "}\n";
 
-    if(!scene)
-        qDebug() << "Error during mesh loading";
+    // Шейдер отрезков сближений: концы - метки номер gl_VertexID
+    const char *vs_conj_source = "#version 420 core\n" \
+                               FRAME_GLSL \
+                               KEYFRAME_GLSL \
+                               "void main() {\n" \
+                               "   gl_Position = proj_matrix * view_matrix * vec4(satellitePosition(gl_VertexID), 1.0);\n" \
+                               "}\n";
 
-    // Загружает только первую сетку, так как загрузка целых сцен не предпологается
-    aiMesh *mesh = *(scene->mMeshes);
+    const char *fs_conj_source = "#version 420 core\n" \
+                               "uniform vec3 line_color;\n" \
+                               "out vec4 color;\n" \
+                               "void main() {\n" \
+                               "   color = vec4(line_color, 1.0);\n" \
+                               "}\n";
 
-    std::vector<GLfloat> vertices;
-    std::vector<GLfloat> normals;
-    std::vector<GLfloat> bitangents;
-    std::vector<GLfloat> UVs;
-    std::vector<GLuint> indices;
+    // Шейдер графиков профилировщика: прямоугольники из массива юниформ по номеру вершины
+    const char *vs_overlay_source = "#version 420 core\n" \
+                                  "uniform vec4 bars[" QT_STRINGIFY(PROFILER_OVERLAY_BARS) "];\n" \
+                                  "uniform vec3 bar_colors[" QT_STRINGIFY(PROFILER_OVERLAY_BARS) "];\n" \
+                                  "out vec3 col_itp;\n" \
+                                  "void main() {\n" \
+                                  "   int c = gl_VertexID % 6;\n" \
+                                  "   vec2 corner = vec2(c == 1 || c == 4 || c == 5 ? 1.0 : 0.0, c == 2 || c == 3 || c == 5 ? 1.0 : 0.0);\n" \
+                                  "   vec4 bar = bars[gl_VertexID / 6];\n" \
+                                  "   gl_Position = vec4(mix(bar.xy, bar.zw, corner), 0.0, 1.0);\n" \
+                                  "   col_itp = bar_colors[gl_VertexID / 6];\n" \
+                                  "}\n";
 
-    for(int i = 0; i < mesh->mNumVertices; i++)
-    {
-        vertices.push_back(mesh->mVertices[i].x);
-        vertices.push_back(mesh->mVertices[i].y);
-        vertices.push_back(mesh->mVertices[i].z);
+    const char *fs_overlay_source = "#version 420 core\n" \
+                                  "in vec3 col_itp;\n" \
+                                  "out vec4 color;\n" \
+                                  "void main() {\n" \
+                                  "   color = vec4(col_itp, 0.8);\n" \
+                                  "}\n";
 
-        if(mesh->HasNormals())
-        {
-            normals.push_back(mesh->mNormals[i].x);
-            normals.push_back(mesh->mNormals[i].y);
-            normals.push_back(mesh->mNormals[i].z);
-        }
+    // Сборка программ, слинкованные при прошлом запуске берутся из кэша
+    std::vector<ShaderProgram> programs = {
+        {"Earth", vs_source, fs_source, &m_earth_program_id},
+        {"Feedback", vs_source, fs_feedback_source, &m_feedback_program_id},
+        {"Space", vs_space_source, fs_space_source, &m_space_program_id},
+        {"Moon", vs_moon_source, fs_moon_source, &m_moon_program_id},
+        {"Sun", vs_sun_source, fs_sun_source, &m_sun_program_id},
+        {"Orbit", vs_orb_source, fs_orb_source, &m_orb_program_id},
+        {"Mark", vs_mark_source, fs_mark_source, &m_mark_program_id},
+        {"GroundTrack", vs_track_source, fs_track_source, &m_track_program_id},
+        {"Conjunction", vs_conj_source, fs_conj_source, &m_conj_program_id},
+        {"Overlay", vs_overlay_source, fs_overlay_source, &m_overlay_program_id}
+    };
+    long int shaders_start = MILLS;
+    m_shaders.build(programs);
+    printf("Shaders: %ld ms, %d of %d from cache\n", (long)(MILLS - shaders_start), m_shaders.cachedCount(), (int)programs.size());
 
-        if(mesh->HasTangentsAndBitangents())
-        {
-            bitangents.push_back(mesh->mBitangents[i].x);
-            bitangents.push_back(mesh->mBitangents[i].y);
-            bitangents.push_back(mesh->mBitangents[i].z);
-        }
+    m_earth_model_uni_id = glGetUniformLocation(m_earth_program_id, "model_matrix");
+    m_earth_t_uni_id = glGetUniformLocation(m_earth_program_id, "t");
+    m_earth_vt_uni_id = glGetUniformLocation(m_earth_program_id, "earth_vt");
+    m_earth_clouds_vt_uni_id = glGetUniformLocation(m_earth_program_id, "clouds_vt");
 
-        if(mesh->HasTextureCoords(0))
-        {
-            UVs.push_back(mesh->mTextureCoords[0][i].x);
-            UVs.push_back(mesh->mTextureCoords[0][i].y);
-        }
-    }
+    m_feedback_model_uni_id = glGetUniformLocation(m_feedback_program_id, "model_matrix");
+    m_feedback_vt_uni_id = glGetUniformLocation(m_feedback_program_id, "vt");
+    m_feedback_offset_uni_id = glGetUniformLocation(m_feedback_program_id, "uv_offset");
+    // В уменьшенном буфере производные uv больше в VT_FEEDBACK_SCALE раз, и
+    // без поправки обратная связь просила бы уровни грубее основного прохода
+    glUseProgram(m_feedback_program_id);
+    glUniform1f(glGetUniformLocation(m_feedback_program_id, "lod_bias"), -std::log2((float)VT_FEEDBACK_SCALE));
 
-    for(int i = 0; i < mesh->mNumFaces; i++)
-    {
-        indices.push_back(mesh->mFaces[i].mIndices[0]);
-        indices.push_back(mesh->mFaces[i].mIndices[1]);
-        indices.push_back(mesh->mFaces[i].mIndices[2]);
-    }
-    m_sphere_indices_count = indices.size();
+    m_moon_model_uni_id = glGetUniformLocation(m_moon_program_id, "model_matrix");
 
-    // Загрузка сферы в графическую память
+    m_sun_model_uni_id = glGetUniformLocation(m_sun_program_id, "model_matrix");
+
+    m_track_model_uni_id = glGetUniformLocation(m_track_program_id, "model_matrix");
+    m_track_first_slot_uni_id = glGetUniformLocation(m_track_program_id, "first_slot");
+    m_track_slots_uni_id = glGetUniformLocation(m_track_program_id, "slots");
+    m_track_count_uni_id = glGetUniformLocation(m_track_program_id, "tracks");
+    m_track_now_uni_id = glGetUniformLocation(m_track_program_id, "now_sample");
+    glUseProgram(m_track_program_id);
+    glUniform3f(glGetUniformLocation(m_track_program_id, "track_color"),
+                GROUND_TRACK_COLOR.x(), GROUND_TRACK_COLOR.y(), GROUND_TRACK_COLOR.z());
+
+    glUseProgram(m_conj_program_id);
+    glUniform3f(glGetUniformLocation(m_conj_program_id, "line_color"),
+                CONJUNCTION_LINE_COLOR.x(), CONJUNCTION_LINE_COLOR.y(), CONJUNCTION_LINE_COLOR.z());
+
+    m_overlay_bars_uni_id = glGetUniformLocation(m_overlay_program_id, "bars");
+    m_overlay_colors_uni_id = glGetUniformLocation(m_overlay_program_id, "bar_colors");
+
+    // Замер проходов кадра, порядок имен совпадает с RenderPass
+    m_profiler.init({"Streaming", "Skybox", "Sun", "Moon", "Earth", "GroundTracks", "Satellites", "Culling", "Marks", "Orbits", "Conjunctions", "Overlay"});
+    glGenVertexArrays(1, &m_overlay_vao_id);
+
+    // Трассы читают все из буферной текстуры, VAO без атрибутов
+    m_ground_tracks.init();
+    glGenVertexArrays(1, &m_track_vao_id);
+
+    // Общий блок юниформ кадра, привязан к точке FRAME_UBO_BINDING для всех программ
+    glGenBuffers(1, &m_frame_ubo_id);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frame_ubo_id);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, m_frame_ubo_id);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_buffers.push_back(m_frame_ubo_id);
+
+    // Сферы всех уровней детализации в общих буферах, атрибуты чередуются
     glGenVertexArrays(1, &m_sphere_vao_id);
     glBindVertexArray(m_sphere_vao_id);
 
-    GLuint vertices_vbo;
-    glGenBuffers(1, &vertices_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vertices_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    GLuint sphere_vbo;
+    glGenBuffers(1, &sphere_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, sphere_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(SphereVertex) * m_sphere.vertices().size(), m_sphere.vertices().data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    m_buffers.push_back(vertices_vbo);
-
-    GLuint normals_vbo;
-    if(mesh->HasNormals())
-    {
-        glGenBuffers(1, &normals_vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, normals_vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * normals.size(), normals.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        m_buffers.push_back(normals_vbo);
-    }
-
-    GLuint bitangents_vbo;
-    if(mesh->HasTangentsAndBitangents())
-    {
-        glGenBuffers(1, &bitangents_vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, bitangents_vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * bitangents.size(), bitangents.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        m_buffers.push_back(bitangents_vbo);
-    }
-
-    GLuint uvs_vbo;
-    if(mesh->HasTextureCoords(0))
-    {
-        glGenBuffers(1, &uvs_vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, uvs_vbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * UVs.size(), UVs.data(), GL_STATIC_DRAW);
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        m_buffers.push_back(uvs_vbo);
-    }
-
-    GLuint indices_vbo;
-    glGenBuffers(1, &indices_vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_vbo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
-    m_buffers.push_back(indices_vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SphereVertex), (void*)offsetof(SphereVertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SphereVertex), (void*)offsetof(SphereVertex, normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(SphereVertex), (void*)offsetof(SphereVertex, tangent));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(SphereVertex), (void*)offsetof(SphereVertex, uv));
+    m_buffers.push_back(sphere_vbo);
+
+    GLuint sphere_indices_vbo;
+    glGenBuffers(1, &sphere_indices_vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphere_indices_vbo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * m_sphere.indices().size(), m_sphere.indices().data(), GL_STATIC_DRAW);
+    m_buffers.push_back(sphere_indices_vbo);
 
     glBindVertexArray(0);
 
-    // Генерация орбиты
+    // Буферы спутников: раскладка совпадает с плотными массивами SatelliteStore.
+    // Положения меток шейдеры берут из ключевых кадров
+    glGenBuffers(1, &m_sat_colors_vbo_id);
+    glGenBuffers(1, &m_sat_orbits_vbo_id);
+    m_buffers.push_back(m_sat_colors_vbo_id);
+    m_buffers.push_back(m_sat_orbits_vbo_id);
+    m_keyframes.init();
+
+    // Буферные текстуры ссылаются на объекты буферов, поэтому переживают их перевыделение
+    glGenTextures(1, &m_sat_colors_tbo_id);
+    glBindTexture(GL_TEXTURE_BUFFER, m_sat_colors_tbo_id);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGB32F, m_sat_colors_vbo_id);
+    glGenTextures(1, &m_sat_orbits_tbo_id);
+    glBindTexture(GL_TEXTURE_BUFFER, m_sat_orbits_tbo_id);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_sat_orbits_vbo_id);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    // Индексы видимых меток и орбит, перезаписываются каждый кадр
+    glGenBuffers(1, &m_mark_indices_vbo_id);
+    glGenBuffers(1, &m_orb_instances_vbo_id);
+    m_buffers.push_back(m_mark_indices_vbo_id);
+    m_buffers.push_back(m_orb_instances_vbo_id);
+
+    // Генерация орбит: единичные окружности всех уровней детализации подряд
     glGenVertexArrays(1, &m_orb_vao_id);
     glBindVertexArray(m_orb_vao_id);
 
     std::vector<float> orb_vertices;
 
-    for(int i = 0; i < 400; i++)
+    for(int lod = 0; lod < ORBIT_LODS; lod++)
     {
-        float t = 2 * M_PI * i / 200;
+        int segments = orbitLodSegments(lod);
+        for(int i = 0; i < segments; i++)
+        {
+            float t = 2 * M_PI * i / segments;
 
-        orb_vertices.push_back(std::cos(t)); // x
-        orb_vertices.push_back(0.0f);        // y
-        orb_vertices.push_back(std::sin(t)); // z
+            orb_vertices.push_back(std::cos(t)); // x
+            orb_vertices.push_back(0.0f);        // y
+            orb_vertices.push_back(std::sin(t)); // z
+        }
     }
 
     GLuint orb_vertices_vbo;
@@ -807,157 +1167,70 @@ void Visualizer::init()
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
     m_buffers.push_back(orb_vertices_vbo);
 
+    // Номер спутника видимой орбиты (location 1) читается один раз на экземпляр,
+    // матрица орбиты, позиция и цвет спутника берутся по нему из буферных текстур
+    glBindBuffer(GL_ARRAY_BUFFER, m_orb_instances_vbo_id);
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, 0, (void*)0);
+    glVertexAttribDivisor(1, 1);
+
     glBindVertexArray(0);
 
-    // Метка спутника
+    // Метки спутников: одна вершина на метку, положение из ключевых кадров
     glGenVertexArrays(1, &m_mark_vao_id);
     glBindVertexArray(m_mark_vao_id);
 
-    GLfloat mark_data[3] = {0.0f, 0.0f, 0.0f};
+    glBindBuffer(GL_ARRAY_BUFFER, m_sat_colors_vbo_id);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_mark_indices_vbo_id);
 
-    GLuint mark_vertices_vbo;
-    glGenBuffers(1, &mark_vertices_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mark_vertices_vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 3, mark_data, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    m_buffers.push_back(mark_vertices_vbo);
+    glBindVertexArray(0);
 
-    imp.FreeScene();
+    // Отрезки сближений: те же положения меток, пары индексов задают концы
+    glGenBuffers(1, &m_conj_indices_vbo_id);
+    m_buffers.push_back(m_conj_indices_vbo_id);
+    glGenVertexArrays(1, &m_conj_vao_id);
+    glBindVertexArray(m_conj_vao_id);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_conj_indices_vbo_id);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     // Загрузка текстур
-    QImage day_texture("earth_day.jpg");
-    glGenTextures(1, &m_day_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_day_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, day_texture.width(), day_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, day_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage night_texture("earth_night.jpg");
-    glGenTextures(1, &m_night_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_night_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, night_texture.width(), night_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, night_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage clouds_texture("earth_clouds.png");
-    glGenTextures(1, &m_clouds_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_clouds_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, clouds_texture.width(), clouds_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, clouds_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage normal_texture("earth_normal.tif");
-    glGenTextures(1, &m_normal_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_normal_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, normal_texture.width(), normal_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, normal_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage specular_texture("earth_specular.jpg");
-    glGenTextures(1, &m_specular_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_specular_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, specular_texture.width(), specular_texture.height(), 0,
-                    GL_RGBA, GL_UNSIGNED_BYTE, specular_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage space_texture("space.jpg");
-    glGenTextures(1, &m_space_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_space_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, space_texture.width(), space_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, space_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage moon_texture("moon.jpg");
-    glGenTextures(1, &m_moon_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_moon_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, moon_texture.width(), moon_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, moon_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage moon_normal_texture("moon_normal.jpg");
-    glGenTextures(1, &m_moon_normal_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_moon_normal_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, moon_normal_texture.width(), moon_normal_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, moon_normal_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage moon_specular_texture("moon_specular.jpg");
-    glGenTextures(1, &m_moon_specular_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_moon_specular_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, moon_specular_texture.width(), moon_specular_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, moon_specular_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    QImage sun_texture("sun.jpg");
-    glGenTextures(1, &m_sun_map_id);
-    glBindTexture(GL_TEXTURE_2D, m_sun_map_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, sun_texture.width(), sun_texture.height(), 0,
-                    GL_BGRA, GL_UNSIGNED_BYTE, sun_texture.bits());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Текстуры декодируются в пуле потоков и догружаются по кадрам:
+    // сначала заглушки, затем уменьшенные копии, затем сжатые mip-уровни.
+    // Карты нормалей хранят только X и Y (BC5), облака - с альфа-каналом (BC3)
+    m_textures.load("earth_day.jpg", &m_day_map_id);
+    m_textures.load("earth_night.jpg", &m_night_map_id, qRgb(0, 0, 0));
+    m_textures.load("earth_clouds.png", &m_clouds_map_id, qRgba(0, 0, 0, 0), TextureBC3);
+    m_textures.load("earth_normal.tif", &m_normal_map_id, qRgb(128, 128, 255), TextureBC5);
+    m_textures.load("earth_specular.jpg", &m_specular_map_id, qRgb(0, 0, 0));
+    m_textures.load("space.jpg", &m_space_map_id, qRgb(0, 0, 0));
+    m_textures.load("moon.jpg", &m_moon_map_id);
+    m_textures.load("moon_normal.jpg", &m_moon_normal_map_id, qRgb(128, 128, 255), TextureBC5);
+    m_textures.load("moon_specular.jpg", &m_moon_specular_map_id, qRgb(0, 0, 0));
+    m_textures.load("sun.jpg", &m_sun_map_id, qRgb(255, 220, 150));
+
+    // Дневная, ночная карты и облака высокого разрешения, если рядом есть пирамида тайлов.
+    // Облака сдвигаются по долготе, поэтому их тайлы запрашиваются отдельно
+    m_earth_vt.open(EARTH_TILES_DIR, {{"day", TextureBC1}, {"night", TextureBC1}});
+    m_clouds_vt.open(EARTH_TILES_DIR, {{"clouds", TextureBC3}});
+
+    float vt[4];
+    glUseProgram(m_earth_program_id);
+    m_earth_vt.params(vt);
+    glUniform4fv(m_earth_vt_uni_id, 1, vt);
+    m_clouds_vt.params(vt);
+    glUniform4fv(m_earth_clouds_vt_uni_id, 1, vt);
 
     updateViewUniforms();
     updateProjUniforms();
 
-    // Завод таймера отрисовки
-    QTimer *timer = new QTimer(this);
-    QObject::connect(timer, &QTimer::timeout, this, &Visualizer::draw);
-    timer->start(1000 / FPS);
-
     // Начальные значения и просчет матрицы Земли
-    m_earth_model_mat.setToIdentity();
-    glUseProgram(m_earth_program_id);
-    glUniformMatrix4fv(m_earth_model_uni_id, 1, false, m_earth_model_mat.data());
+    setEpoch(m_clock.now());
+    updateClock();
 
     // Начальные значения и просчет матриц других тел
     setMoonPosition(QVector3D(-30.168f, 0.0f, 0.0f));
@@ -968,6 +1241,129 @@ void Visualizer::init()
     m_is_init = true;
 }
 
+int Visualizer::sphereLod(const QVector3D &center, float radius)
+{
+    // Видимый радиус в пикселях по расстоянию от камеры и углу обзора
+    QVector3D camera = m_camera_target + m_camera_direction * m_zoom;
+    float distance = (center - camera).length();
+    if(distance <= radius)
+        return m_sphere.lodCount() - 1;
+
+    float radius_px = radius / (std::sqrt(distance * distance - radius * radius) * std::tan(qDegreesToRadians(CAMERA_FOV / 2.0f)))
+                      * height() / 2.0f;
+    return m_sphere.selectLod(radius_px);
+}
+
+void Visualizer::drawSphere(int lod)
+{
+    const SphereLod &l = m_sphere.lod(lod);
+    glDrawElements(GL_TRIANGLES, l.count, GL_UNSIGNED_INT, (void*)(sizeof(GLuint) * l.first));
+}
+
+void Visualizer::setProfilerOverlay(bool visible)
+{
+    m_profiler_overlay = visible;
+    invalidate(DirtyScene);
+}
+
+void Visualizer::drawProfilerOverlay()
+{
+    // По две полосы на проход: p95 CPU и, темнее, p95 GPU. Полная длина -
+    // PROFILER_OVERLAY_MS, вертикальная черта отмечает эту границу
+    GLfloat bars[PROFILER_OVERLAY_BARS * 4];
+    GLfloat colors[PROFILER_OVERLAY_BARS * 3];
+    float px = 2.0f / width();
+    float py = 2.0f / height();
+    float x0 = -1.0f + PROFILER_OVERLAY_MARGIN * px;
+    float length = PROFILER_OVERLAY_WIDTH * px;
+    float top = 1.0f - PROFILER_OVERLAY_MARGIN * py;
+    float bar = PROFILER_OVERLAY_BAR * py;
+
+    int count = 0;
+    int passes = std::min(m_profiler.passCount(), (PROFILER_OVERLAY_BARS - 1) / 2);
+    for(int i = 0; i < passes; i++)
+    {
+        PassStats s = m_profiler.stats(i);
+        QColor c = QColor::fromHsv(i * 300 / passes, 200, 255);
+        float values[2] = {s.cpu_p95, s.gpu_p95};
+        for(int k = 0; k < 2; k++, count++)
+        {
+            float y = top - (2 * i + k) * bar * 1.5f;
+            float w = std::min(values[k] / PROFILER_OVERLAY_MS, 1.0f) * length;
+            GLfloat rect[4] = {x0, y - bar, x0 + std::max(w, px), y};
+            std::copy(rect, rect + 4, bars + count * 4);
+            float shade = k ? 0.5f : 1.0f;
+            colors[count * 3 + 0] = c.redF() * shade;
+            colors[count * 3 + 1] = c.greenF() * shade;
+            colors[count * 3 + 2] = c.blueF() * shade;
+        }
+    }
+
+    GLfloat marker[4] = {x0 + length, top - passes * 3.0f * bar, x0 + length + px, top};
+    std::copy(marker, marker + 4, bars + count * 4);
+    std::fill(colors + count * 3, colors + count * 3 + 3, 1.0f);
+    count++;
+
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(m_overlay_program_id);
+    glUniform4fv(m_overlay_bars_uni_id, count, bars);
+    glUniform3fv(m_overlay_colors_uni_id, count, colors);
+    glBindVertexArray(m_overlay_vao_id);
+    glDrawArrays(GL_TRIANGLES, 0, count * 6);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void Visualizer::updateVirtualTextures(float t)
+{
+    if(!m_earth_vt.isOpen() && !m_clouds_vt.isOpen())
+        return;
+
+    // Тайлы, запрошенные обратной связью прошлых кадров
+    m_earth_vt.update();
+    m_clouds_vt.update();
+
+    // Проход обратной связи в уменьшенный буфер
+    glUseProgram(m_feedback_program_id);
+    glEnable(GL_CULL_FACE);
+    glFrontFace(GL_CCW);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(m_sphere_vao_id);
+
+    VirtualTexture *textures[2] = {&m_earth_vt, &m_clouds_vt};
+    for(int i = 0; i < 2; i++)
+    {
+        if(!textures[i]->isOpen())
+            continue;
+
+        float vt[4];
+        textures[i]->params(vt);
+        glUniform4fv(m_feedback_vt_uni_id, 1, vt);
+        glUniform2f(m_feedback_offset_uni_id, i ? t : 0.0f, 0.0f);
+
+        textures[i]->beginFeedback(width(), height());
+        drawSphere(sphereLod(QVector3D(0.0f, 0.0f, 0.0f), 0.5f));
+        textures[i]->endFeedback(width(), height());
+    }
+
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void Visualizer::updateEarthUniforms()
+{
+    m_earth_model_mat.setToIdentity();
+    m_earth_model_mat.rotate(m_earth_rotation, 0.0f, 1.0f, 0.0f);
+
+    glUseProgram(m_earth_program_id);
+    glUniformMatrix4fv(m_earth_model_uni_id, 1, false, m_earth_model_mat.data());
+    glUseProgram(m_feedback_program_id);
+    glUniformMatrix4fv(m_feedback_model_uni_id, 1, false, m_earth_model_mat.data());
+    glUseProgram(m_track_program_id);
+    glUniformMatrix4fv(m_track_model_uni_id, 1, false, m_earth_model_mat.data());
+    invalidate(DirtyScene);
+}
+
 void Visualizer::updateSunUniforms()
 {
     m_sun_model_mat.setToIdentity();
@@ -976,10 +1372,12 @@ void Visualizer::updateSunUniforms()
 
     glUseProgram(m_sun_program_id);
     glUniformMatrix4fv(m_sun_model_uni_id, 1, false, m_sun_model_mat.data());
-    glUseProgram(m_earth_program_id);
-    glUniform3f(m_earth_sun_pos_uni_id, m_sun_position.x(), m_sun_position.y(), m_sun_position.z());
-    glUseProgram(m_moon_program_id);
-    glUniform3f(m_moon_sun_pos_uni_id, m_sun_position.x(), m_sun_position.y(), m_sun_position.z());
+
+    m_frame.sun_pos[0] = m_sun_position.x();
+    m_frame.sun_pos[1] = m_sun_position.y();
+    m_frame.sun_pos[2] = m_sun_position.z();
+    m_frame_dirty = true;
+    invalidate(DirtyScene);
 }
 
 void Visualizer::updateMoonUniforms()
@@ -991,31 +1389,240 @@ void Visualizer::updateMoonUniforms()
 
     glUseProgram(m_moon_program_id);
     glUniformMatrix4fv(m_moon_model_uni_id, 1, false, m_moon_model_mat.data());
+    invalidate(DirtyScene);
+}
+
+void Visualizer::updateCatalogPositions()
+{
+    // Положения автономного кадра уже посчитаны синхронно, метки стоят
+    if(m_headless)
+        return;
+
+    // Забор готового ключа пропагации и отрезка эфемерид без ожидания
+    const float *positions, *velocities;
+    double jd;
+    if(m_propagation.acquire(positions, velocities, jd))
+        m_keyframes.insert(jd, positions, velocities, m_propagation.size());
+    m_ephemeris.update();
+
+    // Недостающие ключи внутри окна снимка и на подогнанных отрезках кэша
+    // эфемерид вычисляются сразу. Остальные по одному считаются в фоне, а
+    // их отрезок подгоняется, чтобы при возврате к этому моменту пропагация
+    // уже не понадобилась
+    double key_jd;
+    while(m_keyframes.nextRequest(m_epoch_jd, key_jd))
+    {
+        if(snapshotKeyframe(key_jd) || ephemerisKeyframe(key_jd))
+            continue;
+
+        loadPropagation();
+        m_ephemeris.request(key_jd);
+        m_propagation.request(key_jd);
+        break;
+    }
+}
+
+bool Visualizer::ephemerisKeyframe(double jd)
+{
+    size_t count = m_ephemeris.size();
+    m_key_positions.resize(count * 3);
+    m_key_velocities.resize(count * 3);
+    if(!count || !m_ephemeris.evaluate(jd, m_key_positions.data(), m_key_velocities.data()))
+        return false;
+
+    m_keyframes.insert(jd, m_key_positions.data(), m_key_velocities.data(), count);
+    return true;
+}
+
+bool Visualizer::snapshotKeyframe(double jd)
+{
+    // Скорости - центральная разность на SNAPSHOT_VELOCITY_STEP секунд
+    double h = SNAPSHOT_VELOCITY_STEP / 86400.0;
+    if(!m_snapshot.covers(jd - h) || !m_snapshot.covers(jd + h))
+        return false;
+
+    size_t count = m_snapshot.size();
+    m_key_positions.resize(count * 3);
+    m_key_velocities.resize(count * 3);
+    m_snapshot.interpolate(jd - h, m_key_velocities.data());
+    m_snapshot.interpolate(jd + h, m_snapshot_positions.data());
+    for(size_t i = 0; i < count * 3; i++)
+        m_key_velocities[i] = float((m_snapshot_positions[i] - m_key_velocities[i]) / (2.0 * SNAPSHOT_VELOCITY_STEP));
+    m_snapshot.interpolate(jd, m_key_positions.data());
+
+    m_keyframes.insert(jd, m_key_positions.data(), m_key_velocities.data(), count);
+    return true;
+}
+
+void Visualizer::updateStationColors()
+{
+    if(m_passes.stations().empty() && m_in_view_colors.empty())
+        return;
+
+    size_t count = satellites.size();
+    m_station_masks.resize(count);
+    m_passes.visibility(m_keyframes.positions(), count, SCENE_UNIT_KM, m_epoch_jd, m_station_masks.data());
+
+    // Перекрашиваются только метки, сменившие видимость
+    for(size_t i = 0; i < count; i++)
+    {
+        SatelliteHandle handle = satellites.handleAt(i);
+        auto it = m_in_view_colors.find(handle);
+        bool was = it != m_in_view_colors.end();
+        if(m_station_masks[i] && !was)
+        {
+            m_in_view_colors[handle] = satellites.color(handle);
+            satellites.setColor(handle, PASS_IN_VIEW_COLOR);
+        }
+        else if(!m_station_masks[i] && was)
+        {
+            satellites.setColor(handle, it->second);
+            m_in_view_colors.erase(it);
+        }
+    }
+
+    // Удаленные метки
+    for(auto it = m_in_view_colors.begin(); it != m_in_view_colors.end();)
+    {
+        if(satellites.contains(it->first))
+            ++it;
+        else
+            it = m_in_view_colors.erase(it);
+    }
+}
+
+void Visualizer::applyConjunctionColors()
+{
+    size_t count = m_catalog_handles.size();
+    std::vector<uint8_t> involved(count, 0);
+    for(const Conjunction &c : m_conjunction_table)
+        if(c.second < count)
+            involved[c.first] = involved[c.second] = 1;
+
+    // Метка, видимая сейчас со станции, получит цвет, когда уйдет из вида
+    for(size_t i = 0; i < count; i++)
+    {
+        SatelliteHandle handle = m_catalog_handles[i];
+        QVector3D color = involved[i] ? MARK_COLOR_RED : m_catalog_color;
+        auto it = m_in_view_colors.find(handle);
+        if(it != m_in_view_colors.end())
+            it->second = color;
+        else if(satellites.color(handle) != color)
+            satellites.setColor(handle, color);
+    }
+    invalidate(DirtyData);
+}
+
+void Visualizer::updateConjunctionLines()
+{
+    if(m_conjunction_table.empty() && m_conjunction_lines.empty())
+        return;
+
+    // Таблица упорядочена по TCA, поэтому окно - непрерывный диапазон.
+    // Плотные индексы меток сдвигаются при удалении, поэтому ищутся каждый кадр
+    double window = CONJUNCTION_LINE_WINDOW / 1440.0;
+    auto it = std::lower_bound(m_conjunction_table.begin(), m_conjunction_table.end(), m_epoch_jd - window,
+                               [](const Conjunction &c, double jd) { return c.tca_jd < jd; });
+    std::vector<GLuint> lines;
+    for(; it != m_conjunction_table.end() && it->tca_jd <= m_epoch_jd + window; ++it)
+    {
+        if(it->second >= m_catalog_handles.size())
+            continue;
+        size_t a = satellites.indexOf(m_catalog_handles[it->first]);
+        size_t b = satellites.indexOf(m_catalog_handles[it->second]);
+        if(a == SIZE_MAX || b == SIZE_MAX)
+            continue;
+        lines.push_back(a);
+        lines.push_back(b);
+    }
+
+    if(lines == m_conjunction_lines)
+        return;
+    m_conjunction_lines.swap(lines);
+    glBindBuffer(GL_ARRAY_BUFFER, m_conj_indices_vbo_id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * m_conjunction_lines.size(), m_conjunction_lines.data(), GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Visualizer::updateSatelliteBuffers()
+{
+    size_t count = satellites.size();
+
+    // При нехватке места буферы перевыделяются с запасом и загружаются целиком
+    if(count > m_sat_capacity)
+    {
+        m_sat_capacity = std::max(count, m_sat_capacity * 2);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_sat_colors_vbo_id);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 3 * m_sat_capacity, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * 3 * count, satellites.colorData());
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_sat_orbits_vbo_id);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 16 * m_sat_capacity, NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * 16 * count, satellites.orbitTransformData());
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        satellites.clearDirty();
+        return;
+    }
+
+    uploadDirtyRanges(m_sat_colors_vbo_id, SatelliteStore::Colors, satellites.colorData(), 3);
+    uploadDirtyRanges(m_sat_orbits_vbo_id, SatelliteStore::Orbits, satellites.orbitTransformData(), 16);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    satellites.clearDirty();
+}
+
+void Visualizer::cullSatellites()
+{
+    QVector3D camera = m_camera_target + m_camera_direction * m_zoom;
+    float pixels_per_unit = height() / (2.0f * std::tan(qDegreesToRadians(CAMERA_FOV / 2.0f)));
+    m_culler.update(m_proj_mat * m_view_mat, camera, pixels_per_unit, m_keyframes.positions(),
+                    satellites.orbitTransformData(), satellites.size());
+
+    // Переопределение хранилища целиком не ждет кадр, который еще читает прежние индексы
+    const std::vector<uint32_t> &marks = m_culler.visibleMarks();
+    glBindBuffer(GL_ARRAY_BUFFER, m_mark_indices_vbo_id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * marks.size(), marks.data(), GL_STREAM_DRAW);
+
+    const std::vector<uint32_t> &orbits = m_culler.visibleOrbits();
+    glBindBuffer(GL_ARRAY_BUFFER, m_orb_instances_vbo_id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * orbits.size(), orbits.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Visualizer::uploadDirtyRanges(GLuint vbo_id, SatelliteStore::Channel channel, const GLfloat *data, size_t components)
+{
+    size_t count = satellites.size();
+    const auto &ranges = satellites.dirtyRanges(channel, MAX_UPLOAD_RANGES);
+    if(ranges.empty())
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_id);
+    for(const auto &r : ranges)
+    {
+        // Диапазоны удаленных спутников за концом массива не загружаются
+        size_t end = std::min(r.end, count);
+        if(r.begin >= end)
+            continue;
+
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * components * r.begin,
+                        sizeof(GLfloat) * components * (end - r.begin), data + components * r.begin);
+    }
 }
 
 void Visualizer::updateViewUniforms()
 {
+    QVector3D camera_pos = m_camera_target + m_camera_direction * m_zoom;
     m_view_mat.setToIdentity();
-    m_view_mat.lookAt(m_camera_target + (m_camera_direction * m_zoom), m_camera_target, QVector3D(0.0f, 1.0f, 0.0f));
-
-    glUseProgram(m_earth_program_id);
-    glUniformMatrix4fv(m_earth_view_uni_id, 1, false, m_view_mat.data());
-    glUniform3f(m_earth_cam_pos_uni_id, m_camera_target.x() + m_camera_direction.x() * m_zoom,
-                                        m_camera_target.y() + m_camera_direction.y() * m_zoom,
-                                        m_camera_target.z() + m_camera_direction.z() * m_zoom);
-    glUseProgram(m_space_program_id);
-    glUniformMatrix4fv(m_space_view_uni_id, 1, false, m_view_mat.data());
-    glUseProgram(m_moon_program_id);
-    glUniformMatrix4fv(m_moon_view_uni_id, 1, false, m_view_mat.data());
-    glUniform3f(m_moon_cam_pos_uni_id, m_camera_target.x() + m_camera_direction.x() * m_zoom,
-                                       m_camera_target.y() + m_camera_direction.y() * m_zoom,
-                                       m_camera_target.z() + m_camera_direction.z() * m_zoom);
-    glUseProgram(m_sun_program_id);
-    glUniformMatrix4fv(m_sun_view_uni_id, 1, false, m_view_mat.data());
-    glUseProgram(m_orb_program_id);
-    glUniformMatrix4fv(m_orb_view_uni_id, 1, false, m_view_mat.data());
-    glUseProgram(m_mark_program_id);
-    glUniformMatrix4fv(m_mark_view_uni_id, 1, false, m_view_mat.data());
+    m_view_mat.lookAt(camera_pos, m_camera_target, QVector3D(0.0f, 1.0f, 0.0f));
+
+    std::copy(m_view_mat.constData(), m_view_mat.constData() + 16, m_frame.view_matrix);
+    m_frame.camera_pos[0] = camera_pos.x();
+    m_frame.camera_pos[1] = camera_pos.y();
+    m_frame.camera_pos[2] = camera_pos.z();
+    m_frame_dirty = true;
+    invalidate(DirtyCamera);
 }
 
 void Visualizer::updateProjUniforms()
@@ -1023,30 +1630,52 @@ void Visualizer::updateProjUniforms()
     glViewport(0, 0, width(), height());
 
     m_proj_mat.setToIdentity();
-    m_proj_mat.perspective(45.0f, (float)width() / (float)height(), 0.01f, 15000.0f);
+    m_proj_mat.perspective(CAMERA_FOV, (float)width() / (float)height(), 0.01f, 15000.0f);
 
-    glUseProgram(m_earth_program_id);
-    glUniformMatrix4fv(m_earth_proj_uni_id, 1, false, m_proj_mat.data());
-    glUseProgram(m_space_program_id);
-    glUniformMatrix4fv(m_space_proj_uni_id, 1, false, m_proj_mat.data());
-    glUseProgram(m_moon_program_id);
-    glUniformMatrix4fv(m_moon_proj_uni_id, 1, false, m_proj_mat.data());
-    glUseProgram(m_sun_program_id);
-    glUniformMatrix4fv(m_sun_proj_uni_id, 1, false, m_proj_mat.data());
-    glUseProgram(m_orb_program_id);
-    glUniformMatrix4fv(m_orb_proj_uni_id, 1, false, m_proj_mat.data());
-    glUseProgram(m_mark_program_id);
-    glUniformMatrix4fv(m_mark_proj_uni_id, 1, false, m_proj_mat.data());
+    std::copy(m_proj_mat.constData(), m_proj_mat.constData() + 16, m_frame.proj_matrix);
+    m_frame_dirty = true;
+    invalidate(DirtyCamera);
+}
+
+void Visualizer::updateFrameUniforms()
+{
+    if(!m_frame_dirty)
+        return;
+
+    // Одна запись на кадр, сколько бы раз ни менялись камера и Солнце
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frame_ubo_id);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &m_frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_frame_dirty = false;
 }
 
 void Visualizer::draw()
 {
-    // Замер delta
-    long int current_time = MILLS;
-    m_delta_time = (current_time - m_last_time) / 1000.0;
-    m_last_time = current_time;
+    invalidate(DirtyScene);
+}
+
+SatelliteHandle Visualizer::pick(int x, int y)
+{
+    if(!m_is_init)
+        return INVALID_SATELLITE;
+
+    if(m_picker_stale)
+    {
+        m_picker.update(m_keyframes.positions(), m_keyframes.count());
+        m_picker_stale = false;
+    }
+
+    // Луч из камеры через точку на дальней плоскости отсечения
+    QVector3D camera = m_camera_target + m_camera_direction * m_zoom;
+    QVector3D far_point = (m_proj_mat * m_view_mat).inverted().map(
+        QVector3D(2.0f * x / width() - 1.0f, 1.0f - 2.0f * y / height(), 1.0f));
+    QVector3D direction = (far_point - camera).normalized();
+
+    // Допуск - угол, под которым виден радиус выбора в центре экрана
+    float tolerance = PICK_RADIUS_PX * 2.0f * std::tan(qDegreesToRadians(CAMERA_FOV / 2.0f)) / height();
 
-    render();
+    size_t index = m_picker.pick(m_keyframes.positions(), camera, direction, tolerance, CULL_EARTH_RADIUS);
+    return index == SIZE_MAX ? INVALID_SATELLITE : satellites.handleAt(index);
 }
 
 void Visualizer::mousePressEvent(QMouseEvent *ev)
@@ -1055,19 +1684,36 @@ void Visualizer::mousePressEvent(QMouseEvent *ev)
     {
         m_button_down = true;
         m_drag_begin = QVector2D(ev->x(), ev->y());
+        m_press_pos = m_drag_begin;
     }
 }
 
 void Visualizer::mouseReleaseEvent(QMouseEvent *ev)
 {
-    if(ev->button() == 1)
-        m_button_down = false;
+    if(ev->button() != 1)
+        return;
+    m_button_down = false;
+
+    // Щелчок без заметного сдвига выбирает метку
+    if(m_select_callback && (QVector2D(ev->x(), ev->y()) - m_press_pos).length() <= PICK_CLICK_DISTANCE)
+        m_select_callback(pick(ev->x(), ev->y()));
 }
 
 void Visualizer::mouseMoveEvent(QMouseEvent *ev)
 {
     if(!m_button_down)
+    {
+        if(!m_hover_callback)
+            return;
+
+        SatelliteHandle hovered = pick(ev->x(), ev->y());
+        if(hovered != m_hovered)
+        {
+            m_hovered = hovered;
+            m_hover_callback(hovered);
+        }
         return;
+    }
 
     float x_diff = (ev->x() - m_drag_begin.x()) * MOUSE_SENS_X;
     float y_diff = (ev->y() - m_drag_begin.y()) * MOUSE_SENS_Y;
@@ -1088,6 +1734,34 @@ void Visualizer::mouseMoveEvent(QMouseEvent *ev)
     m_drag_begin = QVector2D(ev->x(), ev->y());
 }
 
+void Visualizer::keyPressEvent(QKeyEvent *ev)
+{
+    // Пауза, ускорение и перемотка часов модели. Перемотка пропорциональна
+    // ускорению, чтобы за одно нажатие проходило заметное время
+    switch(ev->key())
+    {
+        case Qt::Key_Space:
+            setPaused(!isPaused());
+            break;
+        case Qt::Key_Plus:
+        case Qt::Key_Equal:
+            setTimeWarp(timeWarp() * CLOCK_WARP_STEP);
+            break;
+        case Qt::Key_Minus:
+            setTimeWarp(timeWarp() / CLOCK_WARP_STEP);
+            break;
+        case Qt::Key_Right:
+            scrub(CLOCK_SCRUB_STEP * timeWarp());
+            break;
+        case Qt::Key_Left:
+            scrub(-CLOCK_SCRUB_STEP * timeWarp());
+            break;
+        default:
+            QWindow::keyPressEvent(ev);
+            return;
+    }
+}
+
 void Visualizer::wheelEvent(QWheelEvent *ev)
 {
     // Приблежение камеры
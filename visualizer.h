@@ -4,68 +4,330 @@
 #include <QWindow>
 #include <chrono>
 #include <QTimer>
+#include <QCoreApplication>
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QVector3D>
 #include <QMatrix4x4>
 #include <QImage>
+#include <QColor>
+#include <QThread>
+#include <QOffscreenSurface>
+#include <QOpenGLFramebufferObject>
 #include <QOpenGLFunctions_3_3_Core>
 
-#include <assimp/Importer.hpp>
-#include <assimp/postprocess.h>
-#include <assimp/scene.h>
-#include <assimp/mesh.h>
-
 #include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include "satellitestore.h"
+#include "sgp4.h"
+#include "propagation.h"
+#include "ephemeris.h"
+#include "catalog.h"
+#include "snapshot.h"
+#include "texturestreamer.h"
+#include "virtualtexture.h"
+#include "spheremesh.h"
+#include "shadermanager.h"
+#include "frameprofiler.h"
+#include "culling.h"
+#include "picking.h"
+#include "groundtrack.h"
+#include "passes.h"
+#include "conjunctions.h"
+#include "simclock.h"
+#include "keyframes.h"
 
 // Чувствительность мыши
 #define MOUSE_SENS_X -0.5f
 #define MOUSE_SENS_Y 0.5f
 
-// Частота обновления
-#define FPS 30
+// Вертикальный угол обзора камеры, градусы
+#define CAMERA_FOV 45.0f
+
+// Уровень детализации сферы фона: она всегда во весь экран
+#define SPHERE_SKY_LOD 2
+
+// Точка привязки общего блока юниформ кадра
+#define FRAME_UBO_BINDING 0
+
+// Блок юниформ кадра (std140), общий для всех программ: видовая и
+// проекционная матрицы, положения камеры и Солнца в координатах сцены,
+// доля отрезка ключей меток и его длина в секундах
+#define FRAME_GLSL \
+    "layout(std140, binding = " QT_STRINGIFY(FRAME_UBO_BINDING) ") uniform Frame {\n" \
+    "   mat4 view_matrix;\n" \
+    "   mat4 proj_matrix;\n" \
+    "   vec3 camera_pos;\n" \
+    "   vec3 sun_pos;\n" \
+    "   vec4 key_params;\n" \
+    "};\n"
+
+// Частота кадров при изменениях сцены, 0 - по вертикальной синхронизации
+#define FPS 0
+
+// Частота кадров в покое, когда движутся только облака
+#define IDLE_FPS 2
+
+// Графики профилировщика: не больше полос, отступ, длина и толщина
+// полосы в пикселях, время, соответствующее полной длине, мс
+#define PROFILER_OVERLAY_BARS 32
+#define PROFILER_OVERLAY_MARGIN 10
+#define PROFILER_OVERLAY_WIDTH 300
+#define PROFILER_OVERLAY_BAR 6
+#define PROFILER_OVERLAY_MS 16.7f
+
+// Предел кадров на один снимок автономного режима, пока дочитываются
+// тайлы виртуальных текстур
+#define HEADLESS_MAX_FRAMES 64
+
+// Трассы: цвет, радиус сферы, на которую они ложатся, чуть выше поверхности,
+// и яркость пройденной части
+#define GROUND_TRACK_COLOR QVector3D(1.0f, 0.8f, 0.2f)
+#define GROUND_TRACK_RADIUS 0.502f
+#define GROUND_TRACK_PAST_ALPHA 0.4f
+
+// Цвет меток, видимых хотя бы с одной наземной станции
+#define PASS_IN_VIEW_COLOR QVector3D(0.2f, 0.6f, 1.0f)
+
+// Отрезки между участниками сближений: цвет и окно вокруг текущего
+// момента, минуты, в которое попадает момент наибольшего сближения
+#define CONJUNCTION_LINE_COLOR QVector3D(1.0f, 0.3f, 0.2f)
+#define CONJUNCTION_LINE_WINDOW 10.0
+
+// Радиус выбора метки курсором и сдвиг мыши, после которого нажатие
+// считается поворотом камеры, а не выбором, в пикселях
+#define PICK_RADIUS_PX 10.0f
+#define PICK_CLICK_DISTANCE 3.0f
+
+// Событие, которым фоновые потоки просят перерисовку
+#define RENDER_REQUEST_EVENT (QEvent::User + 1)
+
+// Предел числа вызовов glBufferSubData на буфер за кадр
+#define MAX_UPLOAD_RANGES 64
+
+// Окно эфемерид, записываемое в снимок по умолчанию: 2 часа с шагом в минуту
+#define SNAPSHOT_WINDOW_SAMPLES 121
+#define SNAPSHOT_STEP (1.0 / 1440.0)
+
+// Шаг разности, по которой считаются скорости ключей из снимка, секунды
+#define SNAPSHOT_VELOCITY_STEP 1.0
+
+// Клавиши часов: множитель ускорения за нажатие и перемотка стрелками,
+// секунды модели на единицу ускорения
+#define CLOCK_WARP_STEP 10.0
+#define CLOCK_SCRUB_STEP 60.0
+
+// Каталог пирамиды тайлов Земли высокого разрешения (--tiles)
+#define EARTH_TILES_DIR "earth_tiles"
+
+// Единица длины сцены - диаметр Земли (ей кратны положения Луны и Солнца)
+#define SCENE_UNIT_KM 12742.0
 
 // Макрос для UNIX времени
 #define MILLS std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()
 
+// Раскладка блока Frame в памяти: vec3 по правилам std140 выравнивается как vec4
+struct FrameUniforms
+{
+    GLfloat view_matrix[16];
+    GLfloat proj_matrix[16];
+    GLfloat camera_pos[4];
+    GLfloat sun_pos[4];
+    GLfloat key_params[4];
+};
+
 class Visualizer : public QWindow, protected QOpenGLFunctions_3_3_Core
 {
     public:
-        Visualizer();
+        // С пустым размером - окно. С заданным - автономный режим: окно не
+        // показывается, кадры рисуются в FBO этого размера через
+        // QOffscreenSurface и получаются только вызовом renderFrame
+        explicit Visualizer(const QSize &offscreen_size = QSize());
         ~Visualizer();
         virtual void render();
         void exposeEvent(QExposeEvent *event);
 
+        // Причины перерисовки
+        enum DirtyFlag
+        {
+            DirtyCamera = 1,
+            DirtyScene = 2,
+            DirtyData = 4
+        };
+
+        // Кадр рисуется только после изменений. Код, меняющий satellites
+        // напрямую, вызывает invalidate(DirtyData), иначе изменения
+        // появятся лишь с кадром покоя
+        void invalidate(unsigned flags = DirtyScene);
+
+        // Частота кадров при изменениях, 0 - по вертикальной синхронизации
+        void setFrameRate(int fps);
+
+        // Пока идет анимация, кадры рисуются непрерывно
+        void setAnimating(bool animating);
+
+        // Проходы кадра, замеряемые профилировщиком
+        enum RenderPass
+        {
+            PassStreaming,
+            PassSkybox,
+            PassSun,
+            PassMoon,
+            PassEarth,
+            PassGroundTracks,
+            PassSatellites,
+            PassCulling,
+            PassMarks,
+            PassOrbits,
+            PassConjunctions,
+            PassOverlay,
+            PassCount
+        };
+
+        // Процентили времени CPU/GPU и счетчики вызовов по проходам.
+        // stats() можно читать из любого потока
+        FrameProfiler &profiler() { return m_profiler; }
+
+        // Графики p95 проходов поверх сцены
+        void setProfilerOverlay(bool visible);
+
+        // Синхронная отрисовка кадра автономного режима на юлианскую дату jd
+        // с камерой, смотрящей на target с направления direction с расстояния
+        // zoom. Метки считаются сразу, текстуры дожидаются загрузки.
+        // Без grab кадр не читается из FBO, а только дожидается GPU (для замеров)
+        QImage renderFrame(double jd, const QVector3D &target, const QVector3D &direction, float zoom, bool grab = true);
+
         // API
         void setSunPosition(QVector3D position);
         void setMoonPosition(QVector3D position);
         void setMoonRotation(QVector3D rotation);
         void setCameraTarget(QVector3D target);
 
-        std::vector<QVector3D> green_marks;
-        std::vector<QVector3D> red_marks;
-
-        std::vector<QVector3D> green_orbits_tilt;
-        std::vector<QVector3D> green_orbits_scale;
-        std::vector<QVector3D> green_orbits_offset;
-
-        std::vector<QVector3D> red_orbits_tilt;
-        std::vector<QVector3D> red_orbits_scale;
-        std::vector<QVector3D> red_orbits_offset;
+        // Спутники: метки и орбиты
+        SatelliteStore satellites;
+
+        // Метка под точкой окна (x, y) в пикселях, INVALID_SATELLITE - нет.
+        // Учитываются положения последнего нарисованного кадра
+        SatelliteHandle pick(int x, int y);
+
+        // Метка под курсором сменилась (INVALID_SATELLITE - курсор ушел с меток)
+        // и метка выбрана щелчком. Вызываются в потоке окна
+        void setHoverCallback(std::function<void(SatelliteHandle)> callback) { m_hover_callback = callback; }
+        void setSelectCallback(std::function<void(SatelliteHandle)> callback) { m_select_callback = callback; }
+
+        // Каталог, положения которого считает SGP4/SDP4. Спутники каталога
+        // добавляются в satellites вместе с орбитами и движутся по часам модели
+        void setCatalog(const std::vector<OrbitalElements> &elements, const QVector3D &color = MARK_COLOR_GREEN);
+
+        // Часы модели: перемотка на юлианскую дату jd или на seconds от
+        // текущего момента, пауза и ускорение [CLOCK_MIN_WARP, CLOCK_MAX_WARP].
+        // Ключи меток нового момента считаются в фоне и появляются в одном
+        // из следующих кадров. Пробел, +/- и стрелки делают то же с клавиатуры
+        void setEpoch(double jd);
+        double epoch() const;
+        void scrub(double seconds);
+        void setPaused(bool paused);
+        bool isPaused() const;
+        void setTimeWarp(double warp);
+        double timeWarp() const;
+
+        // Загрузка каталога TLE/3LE или OMM XML/CSV из файла и замена им текущего
+        bool openCatalog(const QString &path, const QVector3D &color = MARK_COLOR_GREEN);
+
+        // Снимок каталога с готовыми параметрами орбит и окном эфемерид.
+        // Внутри окна метки берутся из снимка без пропагации, поэтому
+        // данные видны уже в первом кадре
+        bool openSnapshot(const QString &path, const QVector3D &color = MARK_COLOR_GREEN);
+        bool saveSnapshot(const QString &path, const QString &catalog_path);
+
+        // Трассы подспутниковых точек для спутников с заданными номерами в
+        // каталоге или снимке. Пустой список убирает трассы; замена каталога тоже
+        void setGroundTracks(const std::vector<size_t> &catalog_indices);
+
+        // Окно трасс: минуты до и после текущего момента и шаг в минутах
+        void setGroundTrackWindow(double past, double future, double step);
+
+        // Наземные станции. Пока они заданы, метки, видимые хотя бы с одной
+        // из них, окрашиваются в PASS_IN_VIEW_COLOR; пустой список возвращает цвета
+        void setGroundStations(const std::vector<GroundStation> &stations);
+
+        // Фоновый прогноз пролетов спутников каталога или снимка над станциями
+        // на интервал [begin_jd, end_jd]. callback вызывается в потоке окна
+        void predictPasses(double begin_jd, double end_jd,
+                           std::function<void(const std::vector<SatellitePass> &)> callback);
+
+        // Фоновый поиск сближений спутников каталога или снимка ближе threshold_km
+        // на интервале [begin_jd, end_jd]. Участники окрашиваются в MARK_COLOR_RED,
+        // остальные метки каталога - в его цвет; сближения не дальше
+        // CONJUNCTION_LINE_WINDOW от текущего момента соединяются отрезками.
+        // callback вызывается в потоке окна
+        void screenConjunctions(double begin_jd, double end_jd, double threshold_km,
+                                std::function<void(const std::vector<Conjunction> &)> callback = nullptr);
 
     protected:
         void mousePressEvent(QMouseEvent *ev);
         void mouseReleaseEvent(QMouseEvent *ev);
         void mouseMoveEvent(QMouseEvent *ev);
+        void keyPressEvent(QKeyEvent *ev);
         void wheelEvent(QWheelEvent* ev);
         void resizeEvent(QResizeEvent* ev);
+        bool event(QEvent *ev);
 
     private:
+        // Вызовы отрисовки и смены состояния считаются профилировщиком:
+        // одноименные функции скрывают функции базового класса
+        void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+            { m_profiler.countDraw(); QOpenGLFunctions_3_3_Core::glDrawElements(mode, count, type, indices); }
+        void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+            { m_profiler.countDraw(); QOpenGLFunctions_3_3_Core::glDrawArrays(mode, first, count); }
+        void glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+            { m_profiler.countDraw(); QOpenGLFunctions_3_3_Core::glDrawArraysInstanced(mode, first, count, instances); }
+        void glUseProgram(GLuint program)
+            { m_profiler.countStateChange(); QOpenGLFunctions_3_3_Core::glUseProgram(program); }
+        void glBindTexture(GLenum target, GLuint texture)
+            { m_profiler.countStateChange(); QOpenGLFunctions_3_3_Core::glBindTexture(target, texture); }
+        void glBindVertexArray(GLuint array)
+            { m_profiler.countStateChange(); QOpenGLFunctions_3_3_Core::glBindVertexArray(array); }
+        void glEnable(GLenum cap)
+            { m_profiler.countStateChange(); QOpenGLFunctions_3_3_Core::glEnable(cap); }
+        void glDisable(GLenum cap)
+            { m_profiler.countStateChange(); QOpenGLFunctions_3_3_Core::glDisable(cap); }
+        void glDepthMask(GLboolean flag)
+            { m_profiler.countStateChange(); QOpenGLFunctions_3_3_Core::glDepthMask(flag); }
+        void glDepthFunc(GLenum func)
+            { m_profiler.countStateChange(); QOpenGLFunctions_3_3_Core::glDepthFunc(func); }
+        void glFrontFace(GLenum mode)
+            { m_profiler.countStateChange(); QOpenGLFunctions_3_3_Core::glFrontFace(mode); }
+
         void init();
+        void updateEarthUniforms();
+        void updateVirtualTextures(float t);
+        int sphereLod(const QVector3D &center, float radius);
+        void drawSphere(int lod);
+        void drawProfilerOverlay();
         void updateSunUniforms();
         void updateMoonUniforms();
         void updateViewUniforms();
         void updateProjUniforms();
+        void updateFrameUniforms();
+        void scheduleFrame(long int delay);
+        void replaceCatalog(size_t count, const QVector3D &color);
+        const OrbitalElements *catalogElements(size_t &count) const;
+        void loadPropagation();
+        void updateClock();
+        void updateCatalogPositions();
+        bool snapshotKeyframe(double jd);
+        bool ephemerisKeyframe(double jd);
+        void updateSatelliteBuffers();
+        void cullSatellites();
+        void updateStationColors();
+        void applyConjunctionColors();
+        void updateConjunctionLines();
+        void uploadDirtyRanges(GLuint vbo_id, SatelliteStore::Channel channel, const GLfloat *data, size_t components);
 
         // Общие параметры GL и виджета
         QOpenGLContext *m_gl_context;
@@ -73,59 +335,153 @@ class Visualizer : public QWindow, protected QOpenGLFunctions_3_3_Core
         bool m_is_init = false;
         std::vector<GLuint> m_buffers;
 
+        // Автономный режим
+        bool m_headless = false;
+        QOffscreenSurface *m_offscreen = nullptr;
+        QOpenGLFramebufferObject *m_fbo = nullptr;
+        std::vector<float> m_headless_positions;
+
         // Данные сферы
+        SphereMesh m_sphere;
         GLuint m_sphere_vao_id;
-        GLint m_sphere_indices_count;
 
         // Данные эллипса орбиты
         GLuint m_orb_vao_id;
         GLint m_orb_indices_count;
 
-        // Данные метки
+        // Данные меток
         GLuint m_mark_vao_id;
 
+        // Буферы спутников
+        GLuint m_sat_colors_vbo_id;
+        GLuint m_sat_orbits_vbo_id;
+        size_t m_sat_capacity = 0;
+
+        // Ключевые кадры положений меток
+        MarkKeyframes m_keyframes;
+
+        // Те же буферы как буферные текстуры: орбиты читают их по индексу экземпляра
+        GLuint m_sat_colors_tbo_id;
+        GLuint m_sat_orbits_tbo_id;
+
+        // Отсечение и индексы видимых меток и орбит
+        ViewCuller m_culler;
+        GLuint m_mark_indices_vbo_id;
+        GLuint m_orb_instances_vbo_id;
+
+        // Выбор меток: иерархия подгоняется при первом запросе после смены положений
+        SatellitePicker m_picker;
+        bool m_picker_stale = true;
+        SatelliteHandle m_hovered = INVALID_SATELLITE;
+        std::function<void(SatelliteHandle)> m_hover_callback;
+        std::function<void(SatelliteHandle)> m_select_callback;
+
+        // Каталог SGP4/SDP4, считается в фоновых потоках, и его эфемериды
+        // рядами Чебышева для возврата к уже пройденным моментам
+        PropagationScheduler m_propagation;
+        EphemerisCache m_ephemeris;
+        std::vector<SatelliteHandle> m_catalog_handles;
+        bool m_propagation_loaded = true;
+
+        // Параметры орбит каталога, заданного через setCatalog
+        std::vector<OrbitalElements> m_catalog_elements;
+
+        // Трассы
+        GroundTracks m_ground_tracks;
+        GLuint m_track_vao_id;
+
+        // Пролеты над наземными станциями и исходные цвета меток,
+        // перекрашенных как видимые
+        PassPredictor m_passes;
+        std::vector<SatellitePass> m_pass_table;
+        std::function<void(const std::vector<SatellitePass> &)> m_passes_callback;
+        std::vector<uint32_t> m_station_masks;
+        std::unordered_map<SatelliteHandle, QVector3D> m_in_view_colors;
+
+        // Сближения спутников каталога. Результат расчета, начатого до
+        // замены каталога, отбрасывается
+        ConjunctionScreener m_conjunctions;
+        std::vector<Conjunction> m_conjunction_table;
+        std::function<void(const std::vector<Conjunction> &)> m_conjunctions_callback;
+        bool m_conjunctions_pending = false;
+        QVector3D m_catalog_color = MARK_COLOR_GREEN;
+
+        // Отрезки сближений: пары плотных индексов в буфере положений меток
+        std::vector<GLuint> m_conjunction_lines;
+        GLuint m_conj_vao_id;
+        GLuint m_conj_indices_vbo_id;
+
+        // Снимок каталога
+        Snapshot m_snapshot;
+        std::vector<float> m_snapshot_positions;
+
+        // Часы модели и момент текущего кадра по ним. Земля повернута на момент m_earth_epoch_jd
+        SimulationClock m_clock;
+        double m_epoch_jd = 2440587.5 + MILLS / 86400000.0;
+        double m_earth_epoch_jd = 0.0;
+
+        // Ключ, интерполированный из снимка или вычисленный из кэша эфемерид
+        std::vector<float> m_key_positions;
+        std::vector<float> m_key_velocities;
+
+        // Сборка программ GLSL
+        ShaderManager m_shaders;
+
+        // Замер проходов кадра
+        FrameProfiler m_profiler;
+        bool m_profiler_overlay = false;
+
+        // Данные шейдера графиков профилировщика
+        GLuint m_overlay_program_id;
+        GLuint m_overlay_vao_id;
+        GLint m_overlay_bars_uni_id;
+        GLint m_overlay_colors_uni_id;
+
+        // Общий блок юниформ кадра и его копия, записываемая при изменении
+        GLuint m_frame_ubo_id;
+        FrameUniforms m_frame = {};
+        bool m_frame_dirty = true;
+
         // Данные шейдера Земли
         GLuint m_earth_program_id;
         GLint m_earth_model_uni_id;
-        GLint m_earth_view_uni_id;
-        GLint m_earth_proj_uni_id;
-        GLint m_earth_cam_pos_uni_id;
-        GLint m_earth_sun_pos_uni_id;
         GLint m_earth_t_uni_id;
+        GLint m_earth_vt_uni_id;
+        GLint m_earth_clouds_vt_uni_id;
+
+        // Данные шейдера обратной связи виртуальных текстур
+        GLuint m_feedback_program_id;
+        GLint m_feedback_model_uni_id;
+        GLint m_feedback_vt_uni_id;
+        GLint m_feedback_offset_uni_id;
 
         // Данные шейдера фона
         GLuint m_space_program_id;
-        GLint m_space_view_uni_id;
-        GLint m_space_proj_uni_id;
 
         // Данные шейдера Луны
         GLuint m_moon_program_id;
         GLint m_moon_model_uni_id;
-        GLint m_moon_view_uni_id;
-        GLint m_moon_proj_uni_id;
-        GLint m_moon_cam_pos_uni_id;
-        GLint m_moon_sun_pos_uni_id;
 
         // Данные шейдера Солнца
         GLuint m_sun_program_id;
         GLint m_sun_model_uni_id;
-        GLint m_sun_view_uni_id;
-        GLint m_sun_proj_uni_id;
 
         // Данные шейдера орбит
         GLuint m_orb_program_id;
-        GLint m_orb_model_uni_id;
-        GLint m_orb_view_uni_id;
-        GLint m_orb_proj_uni_id;
-        GLint m_orb_targ_uni_id;
-        GLint m_orb_col_uni_id;
+
+        // Данные шейдера трасс
+        GLuint m_track_program_id;
+        GLint m_track_model_uni_id;
+        GLint m_track_first_slot_uni_id;
+        GLint m_track_slots_uni_id;
+        GLint m_track_count_uni_id;
+        GLint m_track_now_uni_id;
 
         // Данные шейдера меток
         GLuint m_mark_program_id;
-        GLint m_mark_model_uni_id;
-        GLint m_mark_view_uni_id;
-        GLint m_mark_proj_uni_id;
-        GLint m_mark_color_uni_id;
+
+        // Данные шейдера отрезков сближений
+        GLuint m_conj_program_id;
 
         // Текстуры
         GLuint m_day_map_id;
@@ -138,17 +494,27 @@ class Visualizer : public QWindow, protected QOpenGLFunctions_3_3_Core
         GLuint m_moon_normal_map_id;
         GLuint m_moon_specular_map_id;
         GLuint m_sun_map_id;
-
-        // Цикл обновления
-        long int m_last_time = clock();
-        double m_delta_time;
+        TextureStreamer m_textures;
+        VirtualTexture m_earth_vt;
+        VirtualTexture m_clouds_vt;
+
+        // Планирование кадров
+        QTimer m_frame_timer;
+        unsigned m_dirty = DirtyScene;
+        int m_frame_rate = FPS;
+        bool m_animating = false;
+        long int m_last_frame = 0;
+        int m_settle_frames = 0;
+
+        // Замер времени запуска
+        long int m_start_time = MILLS;
+        bool m_first_frame_reported = false;
+        bool m_full_quality_reported = false;
 
         // Матрицы отрисовки
         QMatrix4x4 m_earth_model_mat;
         QMatrix4x4 m_sun_model_mat;
         QMatrix4x4 m_moon_model_mat;
-        QMatrix4x4 m_orb_model_mat;
-        QMatrix4x4 m_mark_model_mat;
         QMatrix4x4 m_view_mat;
         QMatrix4x4 m_proj_mat;
 
@@ -159,6 +525,7 @@ class Visualizer : public QWindow, protected QOpenGLFunctions_3_3_Core
         // Управление камерой
         bool m_button_down = false;
         QVector2D m_drag_begin;
+        QVector2D m_press_pos;
         float m_zoom = 3.0f;
         float m_last_angle_y = 0.0f;
 
@@ -168,6 +535,7 @@ class Visualizer : public QWindow, protected QOpenGLFunctions_3_3_Core
         QVector3D m_sun_position;
         float m_moon_scale = 0.272f;
         float m_sun_scale = 109.168f;
+        float m_earth_rotation = 0.0f;
 
     public slots:
         virtual void draw();